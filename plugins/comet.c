@@ -0,0 +1,57 @@
+#include "omen_effect.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* A comet sweeping across the zones, leaving a fading tail. Args: RRGGBB color. */
+
+typedef struct
+{
+    uint32_t color;
+    double speed;
+} comet;
+
+static void *comet_init(const char *args, uint32_t zone_count)
+{
+    (void)zone_count;
+    comet *state = malloc(sizeof(comet));
+    if (!state)
+        return NULL;
+    state->color = (args && *args) ? (uint32_t)strtoul(args, NULL, 16) & 0xFFFFFF : 0x00A0FF;
+    state->speed = 1.5;
+    return state;
+}
+
+static int comet_render(void *state, uint32_t *frame, uint32_t zone_count, double t)
+{
+    const comet *c = state;
+    double head = fmod(t * c->speed, 1.0) * zone_count;
+
+    for (uint32_t zone = 0; zone < zone_count; ++zone)
+    {
+        double distance = fmod(head - zone + zone_count, (double)zone_count);
+        double level = exp(-distance * 1.2);
+        uint32_t r = (uint32_t)(((c->color >> 16) & 0xFF) * level);
+        uint32_t g = (uint32_t)(((c->color >> 8) & 0xFF) * level);
+        uint32_t b = (uint32_t)((c->color & 0xFF) * level);
+        frame[zone] = 0xFF000000u | r << 16 | g << 8 | b;
+    }
+    return 0;
+}
+
+static void comet_destroy(void *state)
+{
+    free(state);
+}
+
+static const omen_effect_v1 COMET = {
+    OMEN_EFFECT_ABI_VERSION,
+    "comet",
+    comet_init,
+    comet_render,
+    comet_destroy,
+};
+
+__attribute__((visibility("default"))) const omen_effect_v1 *omen_effect_entry(void)
+{
+    return &COMET;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "power.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+// Picks the highest frame rate the driver can sustain from the rolling latency of
+// zone writes, capped lower on battery.
+namespace omen::rgb::adaptive
+{
+    struct Limits
+    {
+        double minFps = 5.0;
+        double maxFps = 60.0;
+        double batteryFps = 15.0;
+        // Fraction of each frame interval that writes may take.
+        double budget = 0.5;
+    };
+
+    class LatencyWindow
+    {
+    public:
+        static constexpr size_t SIZE = 64;
+
+        void push(double seconds)
+        {
+            samples_[next_] = seconds;
+            next_ = (next_ + 1) % SIZE;
+            count_ = std::min(count_ + 1, SIZE);
+        }
+
+        size_t size() const { return count_; }
+
+        double percentile(double p) const
+        {
+            if (count_ == 0)
+                return 0.0;
+            std::array<double, SIZE> sorted = samples_;
+            auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(std::min(count_ - 1, static_cast<size_t>(p * count_)));
+            std::nth_element(sorted.begin(), nth, sorted.begin() + static_cast<std::ptrdiff_t>(count_));
+            return *nth;
+        }
+
+    private:
+        std::array<double, SIZE> samples_{};
+        size_t next_ = 0;
+        size_t count_ = 0;
+    };
+
+    class Governor
+    {
+    public:
+        // Frames between re-evaluations; the rate only moves when the target differs by more than
+        // HYSTERESIS, and climbs by at most RAISE_STEP per evaluation while it drops at once.
+        static constexpr size_t ADJUST_FRAMES = 16;
+        static constexpr double HYSTERESIS = 0.1;
+        static constexpr double RAISE_STEP = 1.25;
+
+        explicit Governor(Limits limits) : limits_(limits), fps_(limits.maxFps) {}
+
+        double fps() const { return fps_; }
+        const LatencyWindow &latency() const { return latency_; }
+
+        // Highest rate at which the 90th percentile frame write fits in the budget.
+        double sustainable() const
+        {
+            double p90 = latency_.percentile(0.9);
+            return p90 > 0.0 ? limits_.budget / p90 : limits_.maxFps;
+        }
+
+        void record(double writeSeconds)
+        {
+            latency_.push(writeSeconds);
+            ++sinceAdjust_;
+        }
+
+        // Returns true if fps() changed.
+        bool adjust(power::Source source)
+        {
+            double cap = source == power::Source::Battery ? std::min(limits_.batteryFps, limits_.maxFps) : limits_.maxFps;
+            bool capChanged = cap != cap_;
+            cap_ = cap;
+            if (!capChanged && sinceAdjust_ < ADJUST_FRAMES)
+                return false;
+            sinceAdjust_ = 0;
+
+            double target = std::floor(std::clamp(std::min(sustainable(), cap), limits_.minFps, std::max(cap, limits_.minFps)));
+            if (!capChanged && std::abs(target - fps_) <= fps_ * HYSTERESIS)
+                return false;
+            if (!capChanged && target > fps_)
+                target = std::min(target, std::ceil(fps_ * RAISE_STEP));
+            bool changed = target != fps_;
+            fps_ = target;
+            return changed;
+        }
+
+    private:
+        Limits limits_;
+        double fps_;
+        double cap_ = 0.0;
+        size_t sinceAdjust_ = 0;
+        LatencyWindow latency_;
+    };
+}
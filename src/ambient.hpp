@@ -0,0 +1,302 @@
+#pragma once
+#include "color.hpp"
+#include "cpu.hpp"
+#include "definitions.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Ambient lighting from a binary PPM (P6) stream: each frame is averaged into one
+// vertical band per zone. The per-channel sums are the hot loop and use the same
+// runtime-dispatched backends as the color kernels.
+namespace omen::rgb::ambient
+{
+    using color::Backend;
+
+    // Adds the R, G and B bytes of pixels packed RGB triplets into sums[0..2].
+    using SumFn = void (*)(const uint8_t *rgb, size_t pixels, uint64_t *sums);
+
+    namespace scalar
+    {
+        inline void sum(const uint8_t *rgb, size_t pixels, uint64_t *sums)
+        {
+            uint64_t r = 0, g = 0, b = 0;
+            for (size_t i = 0; i < pixels; ++i, rgb += 3)
+            {
+                r += rgb[0];
+                g += rgb[1];
+                b += rgb[2];
+            }
+            sums[0] += r;
+            sums[1] += g;
+            sums[2] += b;
+        }
+    }
+
+#ifdef OMEN_X86
+    // bytes[k][c] selects the bytes of channel c in the k-th vector of a 3-vector block.
+    template <int Width>
+    struct ChannelMasks
+    {
+        alignas(Width) uint8_t bytes[3][3][Width];
+
+        ChannelMasks()
+        {
+            for (int k = 0; k < 3; ++k)
+                for (int c = 0; c < 3; ++c)
+                    for (int j = 0; j < Width; ++j)
+                        bytes[k][c][j] = (Width * k + j) % 3 == c ? 0xFF : 0;
+        }
+    };
+
+    // Both SIMD paths take blocks of 3 vectors (a whole number of pixels), mask each vector
+    // down to one channel's bytes and reduce with sad against zero into 64-bit lanes.
+    namespace sse2
+    {
+        OMEN_TARGET("sse2")
+        inline void sum(const uint8_t *rgb, size_t pixels, uint64_t *sums)
+        {
+            static const ChannelMasks<16> masks;
+
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc[3] = {zero, zero, zero};
+            size_t i = 0;
+            for (; i + 16 <= pixels; i += 16, rgb += 48)
+                for (int k = 0; k < 3; ++k)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + 16 * k));
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        __m128i m = _mm_load_si128(reinterpret_cast<const __m128i *>(masks.bytes[k][c]));
+                        acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(_mm_and_si128(v, m), zero));
+                    }
+                }
+
+            for (int c = 0; c < 3; ++c)
+            {
+                alignas(16) uint64_t lanes[2];
+                _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc[c]);
+                sums[c] += lanes[0] + lanes[1];
+            }
+            scalar::sum(rgb, pixels - i, sums);
+        }
+    }
+
+    namespace avx2
+    {
+        OMEN_TARGET("avx2")
+        inline void sum(const uint8_t *rgb, size_t pixels, uint64_t *sums)
+        {
+            static const ChannelMasks<32> masks;
+
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i acc[3] = {zero, zero, zero};
+            size_t i = 0;
+            for (; i + 32 <= pixels; i += 32, rgb += 96)
+                for (int k = 0; k < 3; ++k)
+                {
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rgb + 32 * k));
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        __m256i m = _mm256_load_si256(reinterpret_cast<const __m256i *>(masks.bytes[k][c]));
+                        acc[c] = _mm256_add_epi64(acc[c], _mm256_sad_epu8(_mm256_and_si256(v, m), zero));
+                    }
+                }
+
+            for (int c = 0; c < 3; ++c)
+            {
+                alignas(32) uint64_t lanes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc[c]);
+                sums[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            }
+            sse2::sum(rgb, pixels - i, sums);
+        }
+    }
+#endif
+
+    inline SumFn sumFor(Backend backend)
+    {
+#ifdef OMEN_X86
+        if (backend == Backend::Avx2 && color::isSupported(backend))
+            return avx2::sum;
+        if (backend == Backend::Sse2 && color::isSupported(backend))
+            return sse2::sum;
+#endif
+        return scalar::sum;
+    }
+
+    inline Backend bestBackend()
+    {
+        for (auto backend : {Backend::Avx2, Backend::Sse2})
+            if (color::isSupported(backend))
+                return backend;
+        return Backend::Scalar;
+    }
+
+    struct Frame
+    {
+        size_t width = 0;
+        size_t height = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+    // Average color of each of bands equal-width vertical bands, left to right, over every
+    // rowStep-th row.
+    inline void reduce(const Frame &frame, size_t bands, RGB_HEX *out, size_t rowStep = 1, Backend backend = bestBackend())
+    {
+        SumFn sum = sumFor(backend);
+        std::vector<uint64_t> sums(bands * 3, 0);
+        size_t rows = 0;
+        for (size_t y = 0; y < frame.height; y += rowStep, ++rows)
+        {
+            const uint8_t *row = frame.pixels.data() + y * frame.width * 3;
+            for (size_t b = 0; b < bands; ++b)
+            {
+                size_t x0 = frame.width * b / bands, x1 = frame.width * (b + 1) / bands;
+                sum(row + x0 * 3, x1 - x0, &sums[b * 3]);
+            }
+        }
+
+        for (size_t b = 0; b < bands; ++b)
+        {
+            uint64_t count = std::max<uint64_t>(1, rows * (frame.width * (b + 1) / bands - frame.width * b / bands));
+            RGB_HEX c = 0;
+            for (int ch = 0; ch < 3; ++ch)
+                c = c << 8 | static_cast<RGB_HEX>((sums[b * 3 + ch] + count / 2) / count);
+            out[b] = c;
+        }
+    }
+
+    // Reads consecutive P6 images (maxval <= 255) from a file descriptor through one buffer.
+    class PpmReader
+    {
+    public:
+        explicit PpmReader(int fd) : fd_(fd), buffer_(1 << 16) {}
+
+        // Returns false at a clean end of stream between frames.
+        bool next(Frame &frame)
+        {
+            int c = skipSpace();
+            if (c < 0)
+                return false;
+            if (c != 'P' || get() != '6')
+                throw std::runtime_error("Not a binary PPM (P6) stream");
+
+            size_t width = number(), height = number(), maxval = number();
+            if (width == 0 || height == 0 || maxval == 0 || maxval > 255)
+                throw std::runtime_error("Unsupported PPM header (" + std::to_string(width) + "x" + std::to_string(height) +
+                                         ", maxval " + std::to_string(maxval) + ")");
+            get();
+
+            frame.width = width;
+            frame.height = height;
+            frame.pixels.resize(width * height * 3);
+            uint8_t *dst = frame.pixels.data();
+            size_t need = frame.pixels.size();
+
+            size_t buffered = std::min(need, end_ - pos_);
+            std::memcpy(dst, buffer_.data() + pos_, buffered);
+            pos_ += buffered;
+            for (size_t done = buffered; done < need;)
+            {
+                ssize_t n = ::read(fd_, dst + done, need - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw std::runtime_error("PPM stream ended inside a frame");
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+    private:
+        int get()
+        {
+            if (pos_ == end_)
+            {
+                ssize_t n;
+                do
+                    n = ::read(fd_, buffer_.data(), buffer_.size());
+                while (n < 0 && errno == EINTR);
+                if (n <= 0)
+                    return -1;
+                pos_ = 0;
+                end_ = static_cast<size_t>(n);
+            }
+            return buffer_[pos_++];
+        }
+
+        // Skips whitespace and # comments; returns the next character or -1.
+        int skipSpace()
+        {
+            for (int c = get();; c = get())
+            {
+                if (c == '#')
+                    while (c >= 0 && c != '\n')
+                        c = get();
+                if (c < 0 || !std::isspace(c))
+                    return c;
+            }
+        }
+
+        size_t number()
+        {
+            int c = skipSpace();
+            if (c < '0' || c > '9')
+                throw std::runtime_error("Malformed PPM header");
+            size_t value = 0;
+            for (; c >= '0' && c <= '9'; c = get())
+                value = value * 10 + static_cast<size_t>(c - '0');
+            if (c >= 0)
+                --pos_;
+            return value;
+        }
+
+        int fd_;
+        std::vector<uint8_t> buffer_;
+        size_t pos_ = 0;
+        size_t end_ = 0;
+    };
+
+    // Exponential smoothing per zone, and a write only when some channel of the smoothed
+    // color moved more than threshold from what was last written.
+    class Smoother
+    {
+    public:
+        Smoother(size_t zones, double alpha, int threshold) : alpha_(alpha), threshold_(threshold), state_(zones * 3, -1.0), written_(zones, ~RGB_HEX(0)) {}
+
+        // Updates zone and returns true with the color to write if it moved enough.
+        bool update(size_t zone, RGB_HEX target, RGB_HEX &color)
+        {
+            int moved = 0;
+            color = 0;
+            for (int ch = 0; ch < 3; ++ch)
+            {
+                double value = static_cast<double>((target >> (16 - 8 * ch)) & 0xFF);
+                double &s = state_[zone * 3 + ch];
+                s = s < 0.0 ? value : s + alpha_ * (value - s);
+                auto level = static_cast<RGB_HEX>(std::lround(s));
+                color = color << 8 | level;
+                int last = written_[zone] == ~RGB_HEX(0) ? -1000 : static_cast<int>((written_[zone] >> (16 - 8 * ch)) & 0xFF);
+                moved = std::max(moved, std::abs(static_cast<int>(level) - last));
+            }
+            if (moved <= threshold_)
+                return false;
+            written_[zone] = color;
+            return true;
+        }
+
+    private:
+        double alpha_;
+        int threshold_;
+        std::vector<double> state_;
+        std::vector<RGB_HEX> written_;
+    };
+}
@@ -0,0 +1,499 @@
+#pragma once
+#include "color.hpp"
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "output.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#define SOCKET_PATH_ENV "OMEN_RGB_SOCKET"
+
+// Many local clients sharing the keyboard. Each client holds a layer of zone colors with a
+// priority, an opacity and an optional lease; per zone the highest-priority live layer owns
+// the zone, translucent layers are composited over the ones below and layers under an opaque
+// one are suspended.
+namespace omen::rgb::arbiter
+{
+    using Clock = std::chrono::steady_clock;
+
+    // $OMEN_RGB_SOCKET, else $XDG_RUNTIME_DIR/omen-rgb-cli.sock, else /tmp/omen-rgb-cli.sock.
+    inline std::string defaultSocketPath()
+    {
+        if (const char *path = std::getenv(SOCKET_PATH_ENV); path && *path)
+            return path;
+        const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+        return std::string(runtime && *runtime ? runtime : "/tmp") + "/omen-rgb-cli.sock";
+    }
+
+    struct Layer
+    {
+        std::string name;
+        int priority = 0;
+        uint8_t opacity = 255;
+        // Zero means the layer never expires.
+        std::chrono::nanoseconds lease{0};
+        Clock::time_point renewed{};
+        // Arrival order breaks priority ties, newest on top.
+        uint64_t order = 0;
+        std::vector<std::optional<RGB_HEX>> colors;
+
+        bool live(Clock::time_point now) const { return lease.count() == 0 || now - renewed < lease; }
+    };
+
+    // Pure arbitration state, keyed by client id.
+    class Arbiter
+    {
+    public:
+        explicit Arbiter(size_t zones) : zones_(zones), frame_(zones, 0), owners_(zones, -1) {}
+
+        size_t zones() const { return zones_; }
+        const RGB_HEX *frame() const { return frame_.data(); }
+
+        Layer &layer(int id)
+        {
+            auto [it, added] = layers_.try_emplace(id);
+            if (added)
+            {
+                it->second.name = "client" + std::to_string(id);
+                it->second.colors.assign(zones_, std::nullopt);
+                it->second.renewed = Clock::now();
+                it->second.order = ++order_;
+            }
+            return it->second;
+        }
+
+        void remove(int id) { layers_.erase(id); }
+
+        // Owning client per zone after the last resolve(), -1 for none.
+        int owner(size_t zone) const { return owners_[zone]; }
+
+        const Layer *find(int id) const
+        {
+            auto it = layers_.find(id);
+            return it == layers_.end() ? nullptr : &it->second;
+        }
+
+        // Earliest lease expiry among live layers, if any.
+        std::optional<Clock::time_point> nextExpiry(Clock::time_point now) const
+        {
+            std::optional<Clock::time_point> next;
+            for (const auto &[id, layer] : layers_)
+                if (layer.lease.count() && layer.live(now))
+                {
+                    auto at = layer.renewed + layer.lease;
+                    next = next ? std::min(*next, at) : at;
+                }
+            return next;
+        }
+
+        // Recomputes the frame; returns true if any zone color changed.
+        bool resolve(Clock::time_point now)
+        {
+            std::vector<const Layer *> stack;
+            std::vector<int> ids;
+            for (const auto &[id, layer] : layers_)
+                if (layer.live(now))
+                {
+                    stack.push_back(&layer);
+                    ids.push_back(id);
+                }
+            std::vector<size_t> byRank(stack.size());
+            for (size_t i = 0; i < byRank.size(); ++i)
+                byRank[i] = i;
+            std::sort(byRank.begin(), byRank.end(), [&](size_t a, size_t b)
+                      { return stack[a]->priority != stack[b]->priority ? stack[a]->priority > stack[b]->priority
+                                                                        : stack[a]->order > stack[b]->order; });
+
+            bool changed = false;
+            for (size_t zone = 0; zone < zones_; ++zone)
+            {
+                // Walk down from the top until an opaque layer hides everything under it.
+                size_t bottom = byRank.size();
+                owners_[zone] = -1;
+                for (size_t rank = 0; rank < byRank.size(); ++rank)
+                {
+                    const Layer *layer = stack[byRank[rank]];
+                    if (!layer->colors[zone])
+                        continue;
+                    if (owners_[zone] < 0)
+                        owners_[zone] = ids[byRank[rank]];
+                    if (layer->opacity == 255)
+                    {
+                        bottom = rank + 1;
+                        break;
+                    }
+                }
+
+                RGB_HEX color = 0;
+                for (size_t rank = bottom; rank-- > 0;)
+                {
+                    const Layer *layer = stack[byRank[rank]];
+                    if (layer->colors[zone])
+                        color = color::lerp(color, *layer->colors[zone], layer->opacity / 255.0);
+                }
+                changed = changed || color != frame_[zone];
+                frame_[zone] = color;
+            }
+            return changed;
+        }
+
+    private:
+        size_t zones_;
+        std::vector<RGB_HEX> frame_;
+        std::vector<int> owners_;
+        std::map<int, Layer> layers_;
+        uint64_t order_ = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t clients = 0;
+        uint64_t requests = 0;
+        uint64_t wakeups = 0;
+        uint64_t frames = 0;
+    };
+
+    // Line protocol over a Unix stream socket; every request gets one reply line, sent after
+    // the frame it produced has been written:
+    //   hello <name> [priority] [lease-seconds] [opacity 0-100]   -> ok <owned zones>
+    //   set <zone> <hex> | frame <hex|-> ... | clear [zone] | renew -> ok <owned zones>
+    //   status -> status <zone>:<owner>...           quit -> closes the connection
+    class Server
+    {
+    public:
+        // With write false the frame is resolved but not sent to the driver (load tests).
+        Server(const std::string &path, size_t zones, bool write = true)
+            : path_(path), arbiter_(zones), writer_(zones), write_(write)
+        {
+            listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                throw std::invalid_argument("Socket path too long: " + path);
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            removeStale(addr);
+            if (listener_ < 0 || bind(listener_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener_, 512) != 0)
+                throw std::runtime_error("Failed to listen on " + path + ": " + std::strerror(errno));
+
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            stop_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epoll_ < 0 || timer_ < 0 || stop_ < 0)
+                throw std::runtime_error(std::string("Failed to set up event loop: ") + std::strerror(errno));
+            for (int fd : {listener_, timer_, stop_})
+                watch(fd, EPOLLIN);
+        }
+
+        ~Server()
+        {
+            for (auto &[fd, client] : clients_)
+                close(fd);
+            for (int fd : {listener_, timer_, stop_, signals_, epoll_})
+                if (fd >= 0)
+                    close(fd);
+            unlink(path_.c_str());
+        }
+
+        Server(const Server &) = delete;
+        Server &operator=(const Server &) = delete;
+
+        const Stats &stats() const { return stats_; }
+        size_t writes() const { return writer_.writes(); }
+
+        // SIGINT and SIGTERM end run() cleanly.
+        void handleSignals()
+        {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGINT);
+            sigaddset(&mask, SIGTERM);
+            sigprocmask(SIG_BLOCK, &mask, nullptr);
+            signals_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (signals_ < 0)
+                throw std::runtime_error(std::string("Failed to create signalfd: ") + std::strerror(errno));
+            watch(signals_, EPOLLIN);
+        }
+
+        // Thread-safe; makes run() return.
+        void stop()
+        {
+            uint64_t one = 1;
+            (void)::write(stop_, &one, sizeof(one));
+        }
+
+        void run()
+        {
+            epoll_event events[64];
+            for (;;)
+            {
+                int n = epoll_wait(epoll_, events, 64, -1);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ++stats_.wakeups;
+                for (int i = 0; i < n; ++i)
+                {
+                    int fd = events[i].data.fd;
+                    if (fd == stop_ || fd == signals_)
+                        return;
+                    if (fd == listener_)
+                        accept();
+                    else if (fd == timer_)
+                    {
+                        uint64_t expirations;
+                        (void)read(timer_, &expirations, sizeof(expirations));
+                    }
+                    else if (clients_.count(fd) && !service(fd))
+                        drop(fd);
+                }
+
+                // Requests from this wakeup share one resolve and one frame, then get their replies.
+                auto now = Clock::now();
+                if (arbiter_.resolve(now))
+                {
+                    ++stats_.frames;
+                    if (write_)
+                        writer_.write(arbiter_.frame(), arbiter_.zones());
+                }
+                expireLeases(now);
+                for (int fd : waiting_)
+                    if (clients_.count(fd))
+                        answer(fd);
+                waiting_.clear();
+            }
+        }
+
+    private:
+        // A socket left behind by a server that died refuses connections and is removed; one
+        // that answers belongs to a running server, which is left alone.
+        static void removeStale(const sockaddr_un &addr)
+        {
+            struct stat st = {};
+            if (lstat(addr.sun_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+                return;
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe < 0)
+                throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+            bool live = connect(probe, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+            int error = errno;
+            close(probe);
+            if (live)
+                throw std::runtime_error(std::string("Another server is already listening on ") + addr.sun_path);
+            if (error == ECONNREFUSED)
+                unlink(addr.sun_path);
+        }
+
+        struct Client
+        {
+            std::string in;
+            std::vector<std::string> replies;
+            // Sent EOF: dropped once the requests it sent before are answered.
+            bool closing = false;
+        };
+
+        void watch(int fd, uint32_t events)
+        {
+            epoll_event event{};
+            event.events = events;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0)
+                throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+        }
+
+        void accept()
+        {
+            int fd;
+            while ((fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                clients_[fd];
+                arbiter_.layer(fd);
+                watch(fd, EPOLLIN);
+                ++stats_.clients;
+            }
+        }
+
+        void drop(int fd)
+        {
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            clients_.erase(fd);
+            arbiter_.remove(fd);
+        }
+
+        // Re-arms the one-shot lease timer for the earliest expiry.
+        void expireLeases(Clock::time_point now)
+        {
+            auto next = arbiter_.nextExpiry(now);
+            itimerspec spec{};
+            if (next)
+            {
+                auto ns = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(*next - now).count());
+                spec.it_value = {static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+            }
+            timerfd_settime(timer_, 0, &spec, nullptr);
+        }
+
+        bool service(int fd)
+        {
+            Client &client = clients_[fd];
+            char buffer[4096];
+            for (;;)
+            {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n > 0)
+                {
+                    client.in.append(buffer, static_cast<size_t>(n));
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (n < 0)
+                    return false;
+                client.closing = true;
+                epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+                break;
+            }
+            if (client.in.size() > 65536)
+                return false;
+
+            for (size_t eol; (eol = client.in.find('\n')) != std::string::npos;)
+            {
+                std::string line = client.in.substr(0, eol);
+                client.in.erase(0, eol + 1);
+                ++stats_.requests;
+                std::string reply;
+                try
+                {
+                    if (!request(fd, utils::split(line), reply))
+                        return false;
+                }
+                catch (const std::exception &e)
+                {
+                    reply = std::string("err ") + e.what();
+                }
+                client.replies.push_back(reply);
+            }
+            if (client.replies.empty())
+                return !client.closing;
+            waiting_.push_back(fd);
+            return true;
+        }
+
+        // Handles one request; an empty reply is completed with the owned zones once the frame is out.
+        bool request(int fd, const std::vector<std::string> &words, std::string &reply)
+        {
+            if (words.empty())
+                throw std::invalid_argument("empty request");
+            std::string verb = utils::toLower(words[0]);
+            if (verb == "quit")
+                return false;
+
+            Layer &layer = arbiter_.layer(fd);
+            layer.renewed = Clock::now();
+            if (verb == "hello" && words.size() >= 2)
+            {
+                layer.name = words[1];
+                layer.priority = words.size() > 2 ? static_cast<int>(compositor::parseNumber(words[2], "priority")) : 0;
+                double lease = words.size() > 3 ? compositor::parseNumber(words[3], "lease") : 0.0;
+                layer.lease = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(std::max(0.0, lease)));
+                double opacity = words.size() > 4 ? compositor::parseNumber(words[4], "opacity") : 100.0;
+                layer.opacity = static_cast<uint8_t>(std::lround(std::clamp(opacity, 0.0, 100.0) * 2.55));
+            }
+            else if (verb == "set" && words.size() == 3)
+            {
+                size_t zone = zoneIndex(words[1]);
+                layer.colors[zone] = parseColor(words[2]);
+            }
+            else if (verb == "frame" && words.size() >= 2)
+            {
+                for (size_t zone = 0; zone < arbiter_.zones(); ++zone)
+                {
+                    const std::string &word = words[1 + std::min(zone, words.size() - 2)];
+                    layer.colors[zone] = word == "-" ? std::nullopt : std::optional<RGB_HEX>(parseColor(word));
+                }
+            }
+            else if (verb == "clear")
+            {
+                if (words.size() > 1)
+                    layer.colors[zoneIndex(words[1])] = std::nullopt;
+                else
+                    layer.colors.assign(arbiter_.zones(), std::nullopt);
+            }
+            else if (verb == "status")
+            {
+                reply = "status";
+                for (size_t zone = 0; zone < arbiter_.zones(); ++zone)
+                {
+                    const Layer *owner = arbiter_.find(arbiter_.owner(zone));
+                    reply += " " + std::to_string(zone) + ":" + (owner ? owner->name : "-");
+                }
+            }
+            else if (verb != "renew")
+            {
+                throw std::invalid_argument("unknown request: " + words[0]);
+            }
+            return true;
+        }
+
+        static RGB_HEX parseColor(const std::string &word) { return utils::hexStringToRGB(utils::sanitizeHexString(word)); }
+
+        size_t zoneIndex(const std::string &word) const
+        {
+            size_t zone = static_cast<size_t>(compositor::parseNumber(word, "zone"));
+            if (zone >= arbiter_.zones())
+                throw std::invalid_argument("zone out of range: " + word);
+            return zone;
+        }
+
+        void answer(int fd)
+        {
+            Client &client = clients_[fd];
+            std::string owned;
+            for (size_t zone = 0; zone < arbiter_.zones(); ++zone)
+                if (arbiter_.owner(zone) == fd)
+                    owned += (owned.empty() ? "" : ",") + std::to_string(zone);
+
+            std::string out;
+            for (const auto &reply : client.replies)
+                out += (reply.empty() ? "ok " + (owned.empty() ? std::string("-") : owned) : reply) + "\n";
+            client.replies.clear();
+            // Replies are short; a client that stops reading is dropped rather than buffered for.
+            if (send(fd, out.data(), out.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != static_cast<ssize_t>(out.size()) || client.closing)
+                drop(fd);
+        }
+
+        std::string path_;
+        Arbiter arbiter_;
+        output::ZoneWriter writer_;
+        bool write_;
+        std::map<int, Client> clients_;
+        std::vector<int> waiting_;
+        int listener_ = -1;
+        int epoll_ = -1;
+        int timer_ = -1;
+        int stop_ = -1;
+        int signals_ = -1;
+        Stats stats_;
+    };
+}
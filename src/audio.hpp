@@ -0,0 +1,255 @@
+#pragma once
+#include "color.hpp"
+#include "definitions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Audio analysis for the visualizer: WAV / raw PCM decoding, a windowed radix-2 FFT
+// per hop, and bass / mid / treble band levels with automatic gain.
+namespace omen::rgb::audio
+{
+    struct Format
+    {
+        uint32_t rate = 44100;
+        uint16_t channels = 2;
+        uint16_t bits = 16;
+        bool isFloat = false;
+
+        size_t frameBytes() const { return static_cast<size_t>(channels) * bits / 8; }
+    };
+
+    namespace detail
+    {
+        inline uint32_t le(const unsigned char *p, int bytes)
+        {
+            uint32_t v = 0;
+            for (int i = bytes - 1; i >= 0; --i)
+                v = v << 8 | p[i];
+            return v;
+        }
+    }
+
+    // Reads RIFF chunks up to the start of "data" and returns the format; the stream is
+    // left positioned at the first sample. Accepts PCM 8/16/24/32 and float32, plain or extensible.
+    inline Format readWavHeader(std::istream &in)
+    {
+        unsigned char riff[12];
+        if (!in.read(reinterpret_cast<char *>(riff), 12) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0)
+            throw std::runtime_error("Not a RIFF/WAVE file");
+
+        Format format;
+        bool haveFormat = false;
+        unsigned char header[8];
+        while (in.read(reinterpret_cast<char *>(header), 8))
+        {
+            uint32_t size = detail::le(header + 4, 4);
+            if (std::memcmp(header, "data", 4) == 0)
+            {
+                if (!haveFormat)
+                    throw std::runtime_error("WAV data chunk before fmt chunk");
+                return format;
+            }
+            std::vector<unsigned char> body(size + (size & 1));
+            if (!in.read(reinterpret_cast<char *>(body.data()), static_cast<std::streamsize>(body.size())))
+                break;
+            if (std::memcmp(header, "fmt ", 4) == 0 && size >= 16)
+            {
+                uint32_t tag = detail::le(body.data(), 2);
+                if (tag == 0xFFFE && size >= 26)
+                    tag = detail::le(body.data() + 24, 2);
+                format.channels = static_cast<uint16_t>(detail::le(body.data() + 2, 2));
+                format.rate = detail::le(body.data() + 4, 4);
+                format.bits = static_cast<uint16_t>(detail::le(body.data() + 14, 2));
+                format.isFloat = tag == 3;
+                if ((tag != 1 && tag != 3) || (format.isFloat && format.bits != 32) ||
+                    (format.bits != 8 && format.bits != 16 && format.bits != 24 && format.bits != 32) ||
+                    format.channels == 0 || format.rate == 0)
+                    throw std::runtime_error("Unsupported WAV format (tag " + std::to_string(tag) + ", " + std::to_string(format.bits) + " bits)");
+                haveFormat = true;
+            }
+        }
+        throw std::runtime_error("WAV file has no data chunk");
+    }
+
+    // Interleaved bytes in format to mono floats in [-1, 1]; returns the frames decoded.
+    inline size_t decode(const unsigned char *bytes, size_t frames, const Format &format, float *out)
+    {
+        const size_t width = format.bits / 8;
+        for (size_t f = 0; f < frames; ++f)
+        {
+            float sum = 0.0f;
+            for (size_t c = 0; c < format.channels; ++c)
+            {
+                const unsigned char *p = bytes + (f * format.channels + c) * width;
+                uint32_t raw = detail::le(p, static_cast<int>(width));
+                if (format.isFloat)
+                {
+                    float value;
+                    std::memcpy(&value, &raw, sizeof(value));
+                    sum += value;
+                }
+                else if (width == 1)
+                {
+                    sum += (static_cast<float>(raw) - 128.0f) / 128.0f;
+                }
+                else
+                {
+                    int shift = 32 - format.bits;
+                    sum += static_cast<float>(static_cast<int32_t>(raw << shift) >> shift) / static_cast<float>(1u << (format.bits - 1));
+                }
+            }
+            out[f] = sum / format.channels;
+        }
+        return frames;
+    }
+
+    // In-place iterative radix-2 FFT with precomputed twiddles and bit reversal.
+    class Fft
+    {
+    public:
+        explicit Fft(size_t n) : n_(n), twiddles_(n / 2), reversed_(n)
+        {
+            if (n < 2 || (n & (n - 1)) != 0)
+                throw std::invalid_argument("FFT size must be a power of two");
+            for (size_t k = 0; k < n / 2; ++k)
+                twiddles_[k] = std::polar(1.0f, static_cast<float>(-2.0 * M_PI * k / n));
+            size_t bits = 0;
+            while ((size_t(1) << bits) < n)
+                ++bits;
+            for (size_t i = 0; i < n; ++i)
+            {
+                size_t r = 0;
+                for (size_t b = 0; b < bits; ++b)
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                reversed_[i] = r;
+            }
+        }
+
+        size_t size() const { return n_; }
+
+        void transform(std::complex<float> *a) const
+        {
+            for (size_t i = 0; i < n_; ++i)
+                if (i < reversed_[i])
+                    std::swap(a[i], a[reversed_[i]]);
+            for (size_t len = 2; len <= n_; len <<= 1)
+            {
+                size_t stride = n_ / len;
+                for (size_t i = 0; i < n_; i += len)
+                    for (size_t j = 0; j < len / 2; ++j)
+                    {
+                        std::complex<float> u = a[i + j], v = a[i + j + len / 2] * twiddles_[j * stride];
+                        a[i + j] = u + v;
+                        a[i + j + len / 2] = u - v;
+                    }
+            }
+        }
+
+    private:
+        size_t n_;
+        std::vector<std::complex<float>> twiddles_;
+        std::vector<size_t> reversed_;
+    };
+
+    enum Band
+    {
+        Bass,
+        Mid,
+        Treble,
+        BAND_COUNT
+    };
+
+    // Band edges in Hz: bass 20-250, mid 250-4000, treble 4000-16000.
+    constexpr double BAND_EDGES[BAND_COUNT + 1] = {20.0, 250.0, 4000.0, 16000.0};
+
+    struct Levels
+    {
+        float band[BAND_COUNT] = {};
+        float overall = 0.0f;
+    };
+
+    // Hann-windowed FFT over the last size() samples. Band RMS magnitudes are divided by a
+    // per-band peak that decays with a time constant of AGC_SECONDS, giving levels in 0-1.
+    class Analyzer
+    {
+    public:
+        static constexpr double AGC_SECONDS = 10.0;
+        static constexpr float NOISE_FLOOR = 1e-4f;
+
+        Analyzer(size_t size, uint32_t rate, size_t hop)
+            : fft_(size), window_(size), buffer_(size)
+        {
+            for (size_t i = 0; i < size; ++i)
+                window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / (size - 1)));
+            decay_ = static_cast<float>(std::exp(-static_cast<double>(hop) / rate / AGC_SECONDS));
+            for (int b = 0; b <= BAND_COUNT; ++b)
+                edges_[b] = std::clamp<size_t>(static_cast<size_t>(BAND_EDGES[b] * size / rate + 0.5), 1, size / 2);
+        }
+
+        size_t size() const { return fft_.size(); }
+
+        Levels analyze(const float *samples)
+        {
+            for (size_t i = 0; i < buffer_.size(); ++i)
+                buffer_[i] = {samples[i] * window_[i], 0.0f};
+            fft_.transform(buffer_.data());
+
+            Levels levels;
+            float total = 0.0f;
+            for (int b = 0; b < BAND_COUNT; ++b)
+            {
+                float energy = 0.0f;
+                for (size_t k = edges_[b]; k < edges_[b + 1]; ++k)
+                    energy += std::norm(buffer_[k]);
+                size_t bins = std::max<size_t>(1, edges_[b + 1] - edges_[b]);
+                float rms = std::sqrt(energy / bins);
+                peaks_[b] = std::max({rms, peaks_[b] * decay_, NOISE_FLOOR});
+                levels.band[b] = rms / peaks_[b];
+                total += levels.band[b];
+            }
+            levels.overall = total / BAND_COUNT;
+            return levels;
+        }
+
+    private:
+        Fft fft_;
+        std::vector<float> window_;
+        std::vector<std::complex<float>> buffer_;
+        float decay_ = 1.0f;
+        size_t edges_[BAND_COUNT + 1] = {};
+        float peaks_[BAND_COUNT] = {};
+    };
+
+    // Zone i shows band i (bass, mid, treble) and the last zone the overall level, each as
+    // its palette color scaled by the level. Levels rise at once and fall by release per frame.
+    class Visualizer
+    {
+    public:
+        Visualizer(std::vector<RGB_HEX> palette, float release) : palette_(std::move(palette)), release_(release) {}
+
+        void render(const Levels &levels, RGB_HEX *frame, size_t zones)
+        {
+            if (smoothed_.size() != zones)
+                smoothed_.assign(zones, 0.0f);
+            for (size_t i = 0; i < zones; ++i)
+            {
+                float level = i < BAND_COUNT && i + 1 < zones ? levels.band[i] : levels.overall;
+                smoothed_[i] = std::max(std::min(level, 1.0f), smoothed_[i] * release_);
+                RGB_HEX base = palette_[i % palette_.size()];
+                frame[i] = color::lerp(0, base, smoothed_[i]);
+            }
+        }
+
+    private:
+        std::vector<RGB_HEX> palette_;
+        float release_;
+        std::vector<float> smoothed_;
+    };
+}
@@ -0,0 +1,931 @@
+#pragma once
+#include "ambient.hpp"
+#include "arbiter.hpp"
+#include "calibration.hpp"
+#include "color.hpp"
+#include "definitions.hpp"
+#include "dither.hpp"
+#include "expr.hpp"
+#include "frametable.hpp"
+#include "fs.hpp"
+#include "hexframe.hpp"
+#include "output.hpp"
+#include "timeline.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace omen::rgb::bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Calls fn in doubling batches until minSeconds have passed and returns seconds per call.
+    template <typename Fn>
+    inline double timePerCall(Fn &&fn, double minSeconds = 0.25)
+    {
+        size_t calls = 0;
+        size_t batch = 1;
+        double elapsed = 0.0;
+        auto start = Clock::now();
+        do
+        {
+            for (size_t i = 0; i < batch; ++i)
+                fn();
+            calls += batch;
+            batch *= 2;
+            elapsed = secondsSince(start);
+        } while (elapsed < minSeconds);
+        return elapsed / static_cast<double>(calls);
+    }
+
+    inline size_t argOr(const std::vector<std::string> &args, size_t index, size_t fallback)
+    {
+        return index < args.size() ? static_cast<size_t>(std::stoul(args[index])) : fallback;
+    }
+
+    inline std::vector<RGB_HEX> randomColors(size_t count, uint32_t seed = 0x0E3E4)
+    {
+        std::mt19937 rng(seed);
+        std::vector<RGB_HEX> colors(count);
+        for (auto &color : colors)
+            color = rng() & 0xFFFFFF;
+        return colors;
+    }
+
+    inline void printRow(const std::string &label, double mbPerSecond, double framesPerSecond)
+    {
+        std::cout << "  " << std::left << std::setw(10) << label << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << mbPerSecond << " MB/s"
+                  << std::setprecision(0) << std::setw(14) << framesPerSecond << " frames/s\n";
+    }
+
+    // bench hex [colors-per-line] [lines]
+    inline void hex(const std::vector<std::string> &args)
+    {
+        size_t colorsPerLine = argOr(args, 2, ZONE_COUNT);
+        size_t lineCount = argOr(args, 3, 4096);
+        if (colorsPerLine == 0 || colorsPerLine > MAX_FRAME_COLORS || lineCount == 0)
+            throw std::invalid_argument("colors-per-line must be 1-" + std::to_string(MAX_FRAME_COLORS) + " and lines > 0");
+
+        std::vector<RGB_HEX> expected = randomColors(colorsPerLine * lineCount);
+        std::vector<std::string> lines(lineCount);
+        size_t bytes = 0;
+        for (size_t l = 0; l < lineCount; ++l)
+        {
+            for (size_t i = 0; i < colorsPerLine; ++i)
+                lines[l] += (i ? " " : "") + utils::hex6(expected[l * colorsPerLine + i]);
+            bytes += lines[l].size() + 1;
+        }
+
+        std::cout << "Hex frame parsing: " << lineCount << " lines x " << colorsPerLine << " colors ("
+                  << bytes << " bytes)\n";
+
+        std::vector<RGB_HEX> frame(colorsPerLine);
+        volatile RGB_HEX sink = 0;
+
+        double legacy = timePerCall([&]()
+                                    {
+            for (const auto &line : lines)
+            {
+                size_t n = 0;
+                for (const auto &token : utils::split(line))
+                    frame[n++] = utils::hexStringToRGB(utils::sanitizeHexString(token));
+                sink = sink + frame[0];
+            } });
+        printRow("legacy", bytes / legacy / 1e6, lineCount / legacy);
+
+        for (auto backend : {hexframe::Backend::Scalar, hexframe::Backend::Ssse3, hexframe::Backend::Avx2})
+        {
+            if (!hexframe::isSupported(backend))
+                continue;
+
+            for (size_t l = 0; l < lineCount; ++l)
+            {
+                size_t n = hexframe::parseFrame(lines[l], frame.data(), frame.size(), backend);
+                if (n != colorsPerLine || !std::equal(frame.begin(), frame.end(), expected.begin() + l * colorsPerLine))
+                    throw std::runtime_error(std::string("Backend ") + hexframe::backendName(backend) + " decoded line " + std::to_string(l) + " incorrectly");
+            }
+
+            double seconds = timePerCall([&]()
+                                         {
+                for (const auto &line : lines)
+                {
+                    hexframe::parseFrame(line, frame.data(), frame.size(), backend);
+                    sink = sink + frame[0];
+                } });
+            printRow(hexframe::backendName(backend), bytes / seconds / 1e6, lineCount / seconds);
+        }
+    }
+
+    // bench color --check: every supported backend against the scalar kernels, exhaustively.
+    // Two-operand kernels see every (dst, src) channel pair with every alpha; saturate sees
+    // every RGB color at amounts around its fixed-point edges. Buffers end in an odd tail
+    // so the scalar fallback after the vector loop is covered too.
+    inline void colorCheck()
+    {
+        constexpr size_t PAIRS = 256 * 256, TAIL = 7;
+        // Channel pairs go into R and G with the roles swapped and a third mapping into B,
+        // so a kernel that mixes up channels fails as well.
+        std::vector<RGB_HEX> pairDst(PAIRS + TAIL), pairSrc(PAIRS + TAIL);
+        for (size_t k = 0; k < pairDst.size(); ++k)
+        {
+            RGB_HEX hi = (k >> 8) & 0xFF, lo = k & 0xFF;
+            pairDst[k] = static_cast<RGB_HEX>(k * 0x9E) << 24 | hi << 16 | lo << 8 | (hi ^ lo);
+            pairSrc[k] = lo << 16 | hi << 8 | ((hi + lo) & 0xFF);
+        }
+        color::GammaLut lut = color::GammaLut::make(2.2);
+        lut.g = color::GammaLut::make(1.8).g;
+        lut.b = color::GammaLut::make(0.45).b;
+
+        using Kernel = std::function<void(const color::Kernels &, RGB_HEX *, const RGB_HEX *, size_t)>;
+        // A kernel with its parameter, run over one buffer.
+        struct Case
+        {
+            std::string name;
+            Kernel run;
+        };
+        std::vector<Case> pairCases;
+        for (unsigned v = 0; v < 256; ++v)
+        {
+            auto p = static_cast<uint8_t>(v);
+            pairCases.push_back({"scale " + std::to_string(v), [p](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *, size_t n)
+                                 { k.scale(d, n, p); }});
+            pairCases.push_back({"blend " + std::to_string(v), [p](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+                                 { k.blend(d, s, n, p); }});
+            pairCases.push_back({"blendAlpha " + std::to_string(v), [p](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+                                 {
+                                     std::vector<RGB_HEX> src(s, s + n);
+                                     for (auto &c : src)
+                                         c = c | static_cast<RGB_HEX>(p) << 24;
+                                     k.blendAlpha(d, src.data(), n); }});
+        }
+        pairCases.push_back({"gamma", [&lut](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *, size_t n)
+                             { k.gamma(d, n, lut); }});
+        pairCases.push_back({"add", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+                             { k.add(d, s, n); }});
+        pairCases.push_back({"multiply", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+                             { k.multiply(d, s, n); }});
+
+        const uint16_t amounts[] = {0, 1, 127, 128, 255, color::SATURATION_IDENTITY, 257, 384, 510, color::SATURATION_MAX};
+        std::vector<RGB_HEX> colors(PAIRS + TAIL);
+
+        std::vector<std::string> failures;
+        size_t backends = 0;
+        for (auto backend : {color::Backend::Sse2, color::Backend::Avx2})
+        {
+            if (!color::isSupported(backend))
+                continue;
+            ++backends;
+            const color::Kernels &scalar = color::kernels(color::Backend::Scalar), &k = color::kernels(backend);
+            uint64_t inputs = 0;
+            auto compare = [&](const std::string &name, const std::vector<RGB_HEX> &base, const RGB_HEX *src, const Kernel &run)
+            {
+                std::vector<RGB_HEX> want = base, got = base;
+                run(scalar, want.data(), src, want.size());
+                run(k, got.data(), src, got.size());
+                inputs += base.size();
+                auto diff = std::mismatch(want.begin(), want.end(), got.begin());
+                if (diff.first != want.end())
+                {
+                    size_t at = static_cast<size_t>(diff.first - want.begin());
+                    failures.push_back(name + " on " + color::backendName(backend) + " differs at input " + utils::hex6(base[at]) +
+                                       ": " + utils::hex6(*diff.second) + " instead of " + utils::hex6(*diff.first));
+                }
+            };
+            for (const auto &c : pairCases)
+                compare(c.name, pairDst, pairSrc.data(), c.run);
+            for (uint16_t amount : amounts)
+                for (RGB_HEX high = 0; high < 256; ++high)
+                {
+                    for (size_t i = 0; i < colors.size(); ++i)
+                        colors[i] = static_cast<RGB_HEX>(i * 0x3B) << 24 | high << 16 | static_cast<RGB_HEX>(i & 0xFFFF);
+                    compare("saturate " + std::to_string(amount), colors, nullptr, [amount](const color::Kernels &kk, RGB_HEX *d, const RGB_HEX *, size_t n)
+                            { kk.saturate(d, n, amount); });
+                }
+            std::cout << color::backendName(backend) << ": " << inputs << " inputs compared with scalar\n";
+        }
+
+        if (!failures.empty())
+        {
+            for (const auto &failure : failures)
+                std::cerr << MSG_ERR(failure) << "\n";
+            throw std::runtime_error("color kernel check failed");
+        }
+        if (backends == 0)
+            std::cout << "[OK] No vector backend on this CPU; scalar only" << std::endl;
+        else
+            std::cout << "[OK] Vector color kernels match scalar" << std::endl;
+    }
+
+    // bench color [leds...] | --check
+    inline void colorKernels(const std::vector<std::string> &args)
+    {
+        if (args.size() > 2 && args[2] == "--check")
+            return colorCheck();
+
+        std::vector<size_t> sizes;
+        for (size_t i = 2; i < args.size(); ++i)
+            sizes.push_back(argOr(args, i, 0));
+        if (sizes.empty())
+            sizes = {4, 128, 4096};
+
+        using Kernel = std::function<void(const color::Kernels &, RGB_HEX *, const RGB_HEX *, size_t)>;
+        static const color::GammaLut lut = color::GammaLut::make(2.2);
+        const std::vector<std::pair<std::string, Kernel>> kernels = {
+            {"scale", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *, size_t n)
+             { k.scale(d, n, 179); }},
+            {"gamma", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *, size_t n)
+             { k.gamma(d, n, lut); }},
+            {"blend", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+             { k.blend(d, s, n, 96); }},
+            {"blendAlpha", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+             { k.blendAlpha(d, s, n); }},
+            {"add", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+             { k.add(d, s, n); }},
+            {"multiply", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *s, size_t n)
+             { k.multiply(d, s, n); }},
+            {"saturate", [](const color::Kernels &k, RGB_HEX *d, const RGB_HEX *, size_t n)
+             { k.saturate(d, n, 384); }}};
+        const color::Backend backends[] = {color::Backend::Scalar, color::Backend::Sse2, color::Backend::Avx2};
+
+        for (size_t leds : sizes)
+        {
+            if (leds == 0)
+                throw std::invalid_argument("LED count must be greater than 0");
+
+            std::vector<RGB_HEX> base = randomColors(leds, 1);
+            std::vector<RGB_HEX> src = randomColors(leds, 2);
+            for (auto &c : base)
+                c |= 0xFF000000 & (c << 8);
+            for (auto &c : src)
+                c |= (c * 2654435761u) & 0xFF000000;
+
+            std::cout << "Color kernels at " << leds << " LEDs (ns/frame):\n  " << std::left << std::setw(12) << "kernel";
+            for (auto backend : backends)
+                if (color::isSupported(backend))
+                    std::cout << std::right << std::setw(12) << color::backendName(backend);
+            std::cout << "\n";
+
+            for (const auto &[name, kernel] : kernels)
+            {
+                std::vector<RGB_HEX> reference = base;
+                kernel(color::kernels(color::Backend::Scalar), reference.data(), src.data(), leds);
+
+                std::cout << "  " << std::left << std::setw(12) << name << std::right;
+                for (auto backend : backends)
+                {
+                    if (!color::isSupported(backend))
+                        continue;
+
+                    const color::Kernels &k = color::kernels(backend);
+                    std::vector<RGB_HEX> frame = base;
+                    kernel(k, frame.data(), src.data(), leds);
+                    if (frame != reference)
+                        throw std::runtime_error(name + " on " + color::backendName(backend) + " differs from the scalar reference");
+
+                    double seconds = timePerCall([&]()
+                                                 { kernel(k, frame.data(), src.data(), leds); },
+                                                 0.05);
+                    std::cout << std::fixed << std::setprecision(1) << std::setw(12) << seconds * 1e9;
+                }
+                std::cout << "\n";
+            }
+        }
+    }
+
+    // bench expr [expression] [zones]
+    inline void expression(const std::vector<std::string> &args)
+    {
+        std::string source = args.size() > 2 ? args[2] : "hsv(t*0.2 + zone/4, 1, 0.5+0.5*sin(t))";
+        size_t zones = argOr(args, 3, ZONE_COUNT);
+        if (zones == 0 || zones > MAX_FRAME_COLORS)
+            throw std::invalid_argument("zones must be 1-" + std::to_string(MAX_FRAME_COLORS));
+
+        expr::Program program;
+        double compile = timePerCall([&]()
+                                     { program = expr::compile(source); },
+                                     0.05);
+
+        std::vector<RGB_HEX> frame(zones);
+        volatile RGB_HEX sink = 0;
+        double t = 0.0;
+        double render = timePerCall([&]()
+                                    {
+            program.render(t, frame.data(), zones);
+            t += 1.0 / 60.0;
+            sink = sink + frame[0]; });
+
+        std::cout << "Expression: " << source << "\n"
+                  << "  bytecode     " << program.size() << " instructions\n"
+                  << std::fixed << std::setprecision(2)
+                  << "  compile      " << compile * 1e6 << " us\n"
+                  << "  frame        " << render * 1e9 << " ns (" << zones << " zones)\n"
+                  << std::setprecision(0)
+                  << "  throughput   " << 1.0 / render << " frames/s on one core\n";
+    }
+
+    // bench loop [layer...]
+    inline void loop(const std::vector<std::string> &args)
+    {
+        frametable::Key key;
+        key.sources.assign(args.begin() + std::min<size_t>(2, args.size()), args.end());
+        if (key.sources.empty())
+            key.sources = {"cycle:ocean", "breathe:4"};
+
+        compositor::Compositor live(key.zones), table(key.zones);
+        for (const auto &source : key.sources)
+            live.add(compositor::parseLayer(source));
+
+        auto start = Clock::now();
+        auto frames = frametable::Table::build(key);
+        double build = secondsSince(start);
+        table.add(frametable::layer(frames));
+
+        volatile RGB_HEX sink = 0;
+        auto perFrame = [&](compositor::Compositor &comp)
+        {
+            double t = 0.0;
+            return timePerCall([&]()
+                               {
+                comp.compose(t);
+                t += 1.0 / key.fps;
+                sink = sink + comp.frame()[0]; },
+                               0.1);
+        };
+        double liveNs = perFrame(live) * 1e9;
+        double tableNs = perFrame(table) * 1e9;
+
+        std::string label;
+        for (const auto &source : key.sources)
+            label += (label.empty() ? "" : " ") + source;
+        std::cout << "Loop: " << label << " (" << key.period << " s at " << key.fps << " fps)\n"
+                  << "  table        " << frames->frames() << " frames, " << frames->bytes() << " bytes, built in "
+                  << std::fixed << std::setprecision(2) << build * 1e3 << " ms\n"
+                  << std::setprecision(1)
+                  << "  live         " << liveNs << " ns/frame\n"
+                  << "  playback     " << tableNs << " ns/frame (" << liveNs / tableNs << "x)\n";
+    }
+
+    // bench ambient [width] [height] [frames]
+    inline void ambientReduce(const std::vector<std::string> &args)
+    {
+        size_t width = argOr(args, 2, 1920), height = argOr(args, 3, 1080), frameCount = argOr(args, 4, 30);
+        if (width == 0 || height == 0 || frameCount == 0)
+            throw std::invalid_argument("width, height and frames must be greater than 0");
+
+        // A gradient that differs per frame, streamed through a temporary file like a real pipe.
+        std::FILE *file = std::tmpfile();
+        if (!file)
+            throw std::runtime_error("Failed to create a temporary file");
+        std::string header = "P6\n# bench\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        std::vector<uint8_t> pixels(width * height * 3);
+        for (size_t f = 0; f < frameCount; ++f)
+        {
+            for (size_t i = 0; i < pixels.size(); ++i)
+                pixels[i] = static_cast<uint8_t>((i * 7 + f * 13 + (i / (width * 3)) * 3) & 0xFF);
+            std::fwrite(header.data(), 1, header.size(), file);
+            std::fwrite(pixels.data(), 1, pixels.size(), file);
+        }
+        std::fflush(file);
+
+        std::cout << "Ambient decode + reduce: " << frameCount << " frames of " << width << "x" << height << " into " << ZONE_COUNT << " bands\n";
+        std::vector<RGB_HEX> reference;
+        for (auto backend : {color::Backend::Scalar, color::Backend::Sse2, color::Backend::Avx2})
+        {
+            if (!color::isSupported(backend))
+                continue;
+
+            std::rewind(file);
+            lseek(fileno(file), 0, SEEK_SET);
+            ambient::PpmReader reader(fileno(file));
+            ambient::Frame frame;
+            std::vector<RGB_HEX> zones(ZONE_COUNT), all;
+            double decode = 0.0, reduce = 0.0;
+            for (size_t f = 0; f < frameCount; ++f)
+            {
+                auto start = Clock::now();
+                reader.next(frame);
+                decode += secondsSince(start);
+                start = Clock::now();
+                ambient::reduce(frame, zones.size(), zones.data(), 1, backend);
+                reduce += secondsSince(start);
+                all.insert(all.end(), zones.begin(), zones.end());
+            }
+            if (reference.empty())
+                reference = all;
+            else if (all != reference)
+                throw std::runtime_error(std::string("ambient reduce on ") + color::backendName(backend) + " differs from the scalar reference");
+
+            std::cout << "  " << std::left << std::setw(10) << color::backendName(backend) << std::right << std::fixed << std::setprecision(3)
+                      << " decode " << decode / frameCount * 1e3 << " ms  reduce " << reduce / frameCount * 1e3 << " ms  total "
+                      << (decode + reduce) / frameCount * 1e3 << " ms/frame\n";
+        }
+        std::fclose(file);
+    }
+
+    // bench serve [clients] [requests-per-client]
+    inline void serve(const std::vector<std::string> &args)
+    {
+        size_t clientCount = argOr(args, 2, 200), requests = argOr(args, 3, 50);
+        if (clientCount == 0 || requests == 0)
+            throw std::invalid_argument("clients and requests must be greater than 0");
+
+        // Zones are written only when a driver (or a fake tree) is present.
+        bool hardware = omen::fs::sysfsExists(utils::zonePath(0));
+        std::string path = "/tmp/omen-rgb-bench-" + std::to_string(getpid()) + ".sock";
+        arbiter::Server server(path, ZONE_COUNT, hardware);
+        std::thread thread([&]()
+                           { server.run(); });
+
+        struct Client
+        {
+            int fd = -1;
+            size_t sent = 0;
+            Clock::time_point at;
+            std::string in;
+        };
+        std::vector<Client> clients(clientCount);
+        int epoll = epoll_create1(EPOLL_CLOEXEC);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        std::mt19937 rng(7);
+        auto send = [&](Client &client, const std::string &line)
+        {
+            client.at = Clock::now();
+            if (write(client.fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+                throw std::runtime_error("bench client write failed");
+        };
+        for (size_t i = 0; i < clientCount; ++i)
+        {
+            Client &client = clients[i];
+            client.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (client.fd < 0 || connect(client.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+                throw std::runtime_error(std::string("bench client connect failed: ") + std::strerror(errno));
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, client.fd, &event);
+            // A mix of priorities, some translucent, so arbitration and compositing both run.
+            send(client, "hello bench" + std::to_string(i) + " " + std::to_string(i % 8) + " 0 " + (i % 3 ? "100" : "50") + "\n");
+        }
+
+        std::vector<double> latencies;
+        latencies.reserve(clientCount * requests);
+        size_t open = clientCount;
+        auto start = Clock::now();
+        while (open > 0)
+        {
+            epoll_event events[64];
+            int n = epoll_wait(epoll, events, 64, 5000);
+            if (n <= 0)
+                throw std::runtime_error("bench timed out waiting for replies");
+            for (int e = 0; e < n; ++e)
+            {
+                Client &client = clients[events[e].data.u64];
+                char buffer[256];
+                ssize_t got = read(client.fd, buffer, sizeof(buffer));
+                if (got <= 0)
+                    throw std::runtime_error("bench client lost its connection");
+                client.in.append(buffer, static_cast<size_t>(got));
+                for (size_t eol; (eol = client.in.find('\n')) != std::string::npos;)
+                {
+                    if (client.in.compare(0, 3, "err") == 0)
+                        throw std::runtime_error("server replied " + client.in.substr(0, eol));
+                    client.in.erase(0, eol + 1);
+                    if (client.sent++ > 0)
+                        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - client.at).count());
+                    if (client.sent <= requests)
+                    {
+                        send(client, "set " + std::to_string(rng() % ZONE_COUNT) + " " + utils::hex6(rng() & 0xFFFFFF) + "\n");
+                    }
+                    else
+                    {
+                        close(client.fd);
+                        client.fd = -1;
+                        --open;
+                    }
+                }
+            }
+        }
+        double elapsed = secondsSince(start);
+        server.stop();
+        thread.join();
+        close(epoll);
+
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&](double p)
+        { return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))]; };
+        const auto &stats = server.stats();
+        std::cout << "Serve: " << clientCount << " clients x " << requests << " requests, " << (hardware ? "writing zones" : "no driver, zones not written") << "\n"
+                  << std::fixed << std::setprecision(1)
+                  << "  throughput   " << latencies.size() / elapsed << " requests/s\n"
+                  << "  latency      p50 " << at(0.5) << " us  p90 " << at(0.9) << " us  p99 " << at(0.99) << " us  max " << latencies.back() << " us\n"
+                  << "  server       " << stats.wakeups << " wakeups, " << stats.frames << " frames, " << server.writes() << " zone writes\n";
+    }
+
+    // bench timeline [hours]
+    inline void timeline(const std::vector<std::string> &args)
+    {
+        size_t hours = argOr(args, 2, 3);
+        if (hours == 0)
+            throw std::invalid_argument("hours must be greater than 0");
+
+        // A synthetic show: zone keyframes every half second with mixed easings,
+        // brightness every 10 s and a firmware mode change every 5 minutes.
+        static const char *easings[] = {"linear", "step", "in", "out", "inout"};
+        std::mt19937 rng(11);
+        std::ostringstream text;
+        const uint32_t end = static_cast<uint32_t>(hours * 3600000);
+        for (uint32_t ms = 0; ms <= end; ms += 500)
+        {
+            text << ms / 1000 << "." << (ms % 1000) / 100 << " zone " << rng() % ZONE_COUNT << " " << utils::hex6(rng() & 0xFFFFFF) << " " << easings[rng() % 5] << "\n";
+            if (ms % 10000 == 0)
+                text << ms / 1000 << " brightness " << rng() % 101 << "\n";
+            if (ms % 300000 == 0)
+                text << ms / 1000 << " mode " << timeline::firmwareModes()[1 + rng() % (timeline::firmwareModes().size() - 1)] << " " << 1 + rng() % 10 << "\n";
+        }
+        std::string source = text.str();
+        std::string path = "/tmp/omen-rgb-bench-" + std::to_string(getpid()) + ".omtl";
+
+        auto start = Clock::now();
+        std::istringstream in(source);
+        timeline::Source parsed = timeline::parse(in, "bench");
+        double parseTime = secondsSince(start);
+        start = Clock::now();
+        timeline::compile(parsed, path);
+        double compileTime = secondsSince(start);
+        start = Clock::now();
+        auto show = timeline::Timeline::map(path);
+        double mapTime = secondsSince(start);
+        unlink(path.c_str());
+
+        timeline::Player player(*show);
+        const size_t seeks = 100000;
+        std::vector<double> points(seeks);
+        for (auto &point : points)
+            point = static_cast<double>(rng() % (end + 1));
+        volatile uint32_t sink = 0;
+        start = Clock::now();
+        for (double point : points)
+            sink = sink + (player.seek(point) != nullptr);
+        double seekTime = secondsSince(start);
+        start = Clock::now();
+        for (double point : points)
+        {
+            player.seek(point);
+            for (size_t k = 0; k < show->tracks(); ++k)
+                sink = sink + player.sample(k, point);
+        }
+        double sampleTime = secondsSince(start) - seekTime;
+
+        // Real-time playback from around the two hour mark (or the middle of shorter shows).
+        double from = std::min(7200000.0, end / 2.0), window = 2000.0, period = 1000.0 / 60.0;
+        player.seek(from);
+        std::vector<double> lateness;
+        auto origin = Clock::now();
+        for (double t = from; t < from + window;)
+        {
+            player.advance(t, [&](const timeline::Event &event)
+                           { sink = sink + event.mode; });
+            for (size_t zone = 0; zone <= ZONE_COUNT; ++zone)
+                sink = sink + player.sample(zone, t);
+            bool animating = false;
+            double wake = std::min<double>(player.nextChange(animating), from + window);
+            if (animating)
+                wake = std::min(wake, t + period);
+            auto due = origin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(wake - from));
+            std::this_thread::sleep_until(due);
+            lateness.push_back(std::chrono::duration<double, std::micro>(Clock::now() - due).count());
+            t = wake;
+        }
+        std::sort(lateness.begin(), lateness.end());
+
+        std::cout << "Timeline: " << hours << " h, " << show->keyframeCount() << " keyframes, " << show->eventCount() << " mode changes\n"
+                  << std::fixed << std::setprecision(1)
+                  << "  source       " << source.size() / 1048576.0 << " MiB text -> " << show->bytes() / 1048576.0 << " MiB compiled\n"
+                  << "  parse        " << parseTime * 1e3 << " ms\n"
+                  << "  compile      " << compileTime * 1e3 << " ms\n"
+                  << "  map          " << mapTime * 1e6 << " us\n"
+                  << "  seek         " << seekTime / seeks * 1e9 << " ns (random, index + scan)\n"
+                  << "  sample       " << sampleTime / seeks * 1e9 << " ns (all " << show->tracks() << " tracks)\n"
+                  << "  playback     " << lateness.size() << " wakes over " << window / 1000.0 << " s from " << timeline::formatTime(static_cast<uint32_t>(from))
+                  << ": lateness p50 " << lateness[lateness.size() / 2] << " us  p99 " << lateness[std::min(lateness.size() - 1, lateness.size() * 99 / 100)]
+                  << " us  max " << lateness.back() << " us\n";
+    }
+
+    // Cost of the shared I/O counters: writeSysfs to a scratch file with counting off and on,
+    // in alternating rounds so drift hits both sides, and record() on its own.
+    inline void io(const std::vector<std::string> &args)
+    {
+        size_t writes = argOr(args, 2, 20000);
+        if (writes == 0)
+            throw std::invalid_argument("writes must be greater than 0");
+
+        // A private segment, so the numbers stay out of the real counters.
+        std::string base = "/tmp/omen-rgb-bench-" + std::to_string(getpid());
+        setenv(STATS_PATH_ENV, (base + ".stats").c_str(), 1);
+        auto *recorder = omen::fs::stats::Recorder::instance();
+        if (!recorder)
+            throw std::runtime_error("Failed to map counters at " + base + ".stats");
+        std::string path = base + ".attr";
+
+        const size_t rounds = 10, perRound = std::max<size_t>(writes / rounds, 1);
+        std::vector<double> off, on;
+        for (size_t round = 0; round < rounds; ++round)
+            for (bool enabled : {false, true})
+            {
+                recorder->setEnabled(enabled);
+                auto start = Clock::now();
+                for (size_t i = 0; i < perRound; ++i)
+                    omen::fs::writeSysfs(path, utils::hex6(static_cast<uint32_t>(i * 2654435761u) & 0xFFFFFF));
+                (enabled ? on : off).push_back(secondsSince(start) / perRound);
+            }
+        recorder->setEnabled(true);
+
+        const size_t records = 1000000;
+        auto start = Clock::now();
+        for (size_t i = 0; i < records; ++i)
+            recorder->record(omen::fs::stats::Write, path, 6, 1000 + (i & 0xFFFF), 0);
+        double recordTime = secondsSince(start) / records;
+
+        unlink(path.c_str());
+        unlink((base + ".stats").c_str());
+        std::sort(off.begin(), off.end());
+        std::sort(on.begin(), on.end());
+        double plain = off[off.size() / 2], counted = on[on.size() / 2];
+        std::cout << "I/O counters: " << perRound * rounds << " writes each way to a scratch file\n"
+                  << std::fixed << std::setprecision(0)
+                  << "  write          " << plain * 1e9 << " ns uncounted, " << counted * 1e9 << " ns counted (median of " << rounds << " rounds)\n"
+                  << "  record()       " << recordTime * 1e9 << " ns (clock reads excluded)\n"
+                  << std::setprecision(2)
+                  << "  overhead       " << (counted - plain) * 1e9 << " ns per write, " << (counted - plain) / plain * 100.0 << "%\n";
+    }
+
+    // Frames to several stand-in devices (directories in /tmp): one device, all of them one
+    // after another, and all of them in parallel on the device pool.
+    inline void devices(const std::vector<std::string> &args)
+    {
+        size_t count = argOr(args, 2, 4), frames = argOr(args, 3, 2000);
+        if (count < 2 || frames == 0)
+            throw std::invalid_argument("need at least 2 devices and 1 frame");
+
+        std::string base = "/tmp/omen-rgb-bench-" + std::to_string(getpid());
+        std::string spec;
+        mkdir(base.c_str(), 0755);
+        for (size_t d = 0; d < count; ++d)
+        {
+            std::string dir = base + "/dev" + std::to_string(d);
+            mkdir(dir.c_str(), 0755);
+            mkdir((dir + "/rgb_zones").c_str(), 0755);
+            for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                std::ofstream(dir + "/rgb_zones/zone0" + std::to_string(zone)) << "000000";
+            spec += (d ? "," : "") + dir;
+        }
+
+        // Every zone changes every frame, so each frame is a full batch on every device.
+        auto run = [&](const std::string &selection, size_t threads)
+        {
+            omen::fs::selectDevices(selection, threads);
+            output::ZoneWriter writer(ZONE_COUNT);
+            std::vector<RGB_HEX> frame(ZONE_COUNT);
+            auto start = Clock::now();
+            for (size_t f = 0; f < frames; ++f)
+            {
+                for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                    frame[zone] = static_cast<RGB_HEX>((f * 0x010203 + zone * 0x40) & 0xFFFFFF);
+                writer.write(frame.data(), frame.size());
+            }
+            return secondsSince(start) / frames;
+        };
+        double one = run(base + "/dev0", 0);
+        double sequential = run(spec, 0);
+        double parallel = run(spec, count - 1);
+        omen::fs::selectDevices(base + "/dev0", 0);
+
+        for (size_t d = 0; d < count; ++d)
+        {
+            std::string dir = base + "/dev" + std::to_string(d);
+            for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                unlink((dir + "/rgb_zones/zone0" + std::to_string(zone)).c_str());
+            rmdir((dir + "/rgb_zones").c_str());
+            rmdir(dir.c_str());
+        }
+        rmdir(base.c_str());
+
+        std::cout << "Devices: " << frames << " frames of " << ZONE_COUNT << " zone writes\n"
+                  << std::fixed << std::setprecision(1)
+                  << "  1 device       " << one * 1e6 << " us/frame\n"
+                  << "  " << count << " sequential   " << sequential * 1e6 << " us/frame (" << sequential / one << "x one device)\n"
+                  << "  " << count << " parallel     " << parallel * 1e6 << " us/frame (" << parallel / one << "x one device, "
+                  << count - 1 << " pool threads + caller)\n";
+    }
+
+    // Calibration cost per frame through the fused tables, against the exact double-precision
+    // transform, plus how far the tables stray from it.
+    inline void calibration(const std::vector<std::string> &args)
+    {
+        size_t frames = argOr(args, 2, 1000000);
+        if (frames == 0)
+            throw std::invalid_argument("frames must be greater than 0");
+
+        std::istringstream text("* curve rgb = 0 0.22 0.47 0.73 1\n"
+                                "0 matrix = 0.95 0.03 0.02  0.01 0.97 0.02  0 0.02 0.86\n"
+                                "1 matrix = 1 0 0  0.02 0.92 0  0 0 0.90\n"
+                                "2 curve b = 0 0.18 0.41 0.68 0.93\n"
+                                "3 matrix = 0.90 0.05 0  0 1 0  0.02 0 0.95\n");
+        auto start = Clock::now();
+        auto profile = omen::rgb::calibration::parse(text, "bench");
+        double buildTime = secondsSince(start);
+
+        std::mt19937 rng(5);
+        std::vector<RGB_HEX> colors(4096);
+        for (auto &color : colors)
+            color = rng() & 0xFFFFFF;
+        volatile RGB_HEX sink = 0;
+        start = Clock::now();
+        for (size_t f = 0; f < frames; ++f)
+            for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                sink = sink + profile->apply(zone, colors[(f * ZONE_COUNT + zone) & 4095]);
+        double fusedTime = secondsSince(start) / frames;
+
+        size_t exactFrames = std::max<size_t>(frames / 100, 1);
+        start = Clock::now();
+        for (size_t f = 0; f < exactFrames; ++f)
+            for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                sink = sink + profile->zone(zone).reference(colors[(f * ZONE_COUNT + zone) & 4095]);
+        double exactTime = secondsSince(start) / exactFrames;
+
+        // What the sysfs layer adds per zone write: parse the hex value, calibrate, format.
+        omen::fs::devices::Device device{"bench", "/tmp", {}, 0, profile};
+        std::string path = utils::zonePath(2);
+        std::vector<std::string> values;
+        for (RGB_HEX color : colors)
+            values.push_back(utils::hex6(color));
+        start = Clock::now();
+        for (size_t f = 0; f < frames; ++f)
+            for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+                sink = sink + omen::fs::calibrated(device, path, values[(f * ZONE_COUNT + zone) & 4095]).size();
+        double stringTime = secondsSince(start) / frames;
+
+        int worst = 0;
+        size_t exact = 0, samples = 200000;
+        for (size_t i = 0; i < samples; ++i)
+        {
+            RGB_HEX color = rng() & 0xFFFFFF;
+            size_t zone = i % ZONE_COUNT;
+            RGB_HEX a = profile->apply(zone, color), b = profile->zone(zone).reference(color);
+            int error = 0;
+            for (int shift = 0; shift < 24; shift += 8)
+                error = std::max(error, std::abs(static_cast<int>((a >> shift) & 0xFF) - static_cast<int>((b >> shift) & 0xFF)));
+            worst = std::max(worst, error);
+            exact += error == 0;
+        }
+        std::istringstream none("");
+        auto identity = omen::rgb::calibration::parse(none, "identity");
+        size_t changed = 0;
+        for (RGB_HEX color = 0; color <= 0xFFFFFF; ++color)
+            changed += identity->apply(0, color) != color;
+
+        std::cout << "Calibration: " << ZONE_COUNT << " zones per frame, " << frames << " frames\n"
+                  << std::fixed << std::setprecision(1)
+                  << "  build        " << buildTime * 1e3 << " ms (" << ZONE_COUNT + 1 << " fused tables)\n"
+                  << "  fused        " << fusedTime * 1e9 << " ns/frame\n"
+                  << "  exact        " << exactTime * 1e9 << " ns/frame (doubles, pow)\n"
+                  << "  sysfs path   " << stringTime * 1e9 << " ns/frame (hex parse, calibrate, format)\n"
+                  << std::setprecision(3)
+                  << "  budget       " << fusedTime / (1.0 / 1000.0) * 100.0 << "% of a frame at 1000 fps\n"
+                  << std::setprecision(2)
+                  << "  accuracy     " << 100.0 * exact / samples << "% of channels exact, worst " << worst << " level(s) off\n"
+                  << "  identity     " << (changed ? std::to_string(changed) + " colors changed" : std::string("all 16777216 colors unchanged")) << "\n";
+    }
+
+    // Quantization error of a slow, dark fade rendered offline, rounded against dithered, as
+    // seen through a 50 ms moving average, plus the per-frame cost of the 16-bit path.
+    inline void dither(const std::vector<std::string> &args)
+    {
+        double fps = 60.0;
+        size_t first = 2;
+        if (args.size() > 2 && std::isdigit(static_cast<unsigned char>(args[2][0])))
+            fps = compositor::parseNumber(args[first++], "fps");
+        std::vector<std::string> sources(args.begin() + std::min(first, args.size()), args.end());
+        if (sources.empty())
+            sources = {"seq:000000,181818:10"};
+        if (fps <= 0.0)
+            throw std::invalid_argument("fps must be greater than 0");
+
+        compositor::Compositor comp;
+        for (const auto &source : sources)
+            comp.add(compositor::parseLayer(source));
+        comp.setDeep(true);
+        omen::rgb::dither::Temporal temporal(comp.zones());
+
+        const size_t frames = static_cast<size_t>(20.0 * fps), window = std::max<size_t>(1, static_cast<size_t>(std::lround(fps * 0.05)));
+        const size_t channels = comp.zones() * 3;
+        std::vector<double> ideal, rounded, dithered;
+        std::vector<RGB_HEX> out(comp.zones());
+        auto level = [](RGB_HEX c, size_t k)
+        { return static_cast<double>((c >> (16 - 8 * k)) & 0xFF); };
+        for (size_t f = 0; f < frames; ++f)
+        {
+            comp.compose(static_cast<double>(f) / fps);
+            temporal.quantize(comp.deepFrame(), out.data(), comp.zones());
+            for (size_t i = 0; i < comp.zones(); ++i)
+            {
+                const auto &deep = comp.deepFrame()[i];
+                const uint16_t exact[3] = {deep.r, deep.g, deep.b};
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    ideal.push_back(exact[k] / 257.0);
+                    rounded.push_back(level(comp.frame()[i], k));
+                    dithered.push_back(level(out[i], k));
+                }
+            }
+        }
+
+        struct Error
+        {
+            double rms = 0.0, worst = 0.0;
+        };
+        // Error of the moving average of the shown levels against that of the ideal ones.
+        auto measure = [&](const std::vector<double> &shown)
+        {
+            Error error;
+            double sum = 0.0;
+            size_t count = 0;
+            for (size_t c = 0; c < channels; ++c)
+            {
+                for (size_t f = window; f <= frames; ++f)
+                {
+                    double a = 0.0, b = 0.0;
+                    for (size_t w = f - window; w < f; ++w)
+                    {
+                        a += shown[w * channels + c];
+                        b += ideal[w * channels + c];
+                    }
+                    double diff = std::abs(a - b) / window;
+                    sum += diff * diff;
+                    ++count;
+                    error.worst = std::max(error.worst, diff);
+                }
+            }
+            error.rms = std::sqrt(sum / std::max<size_t>(count, 1));
+            return error;
+        };
+        Error plain = measure(rounded), smooth = measure(dithered);
+
+        volatile RGB_HEX sink = 0;
+        auto perFrame = [&](bool deep)
+        {
+            compositor::Compositor timed;
+            for (const auto &source : sources)
+                timed.add(compositor::parseLayer(source));
+            timed.setDeep(deep);
+            double t = 0.0;
+            return timePerCall([&]()
+                               {
+                timed.compose(t);
+                t += 1.0 / fps;
+                sink = sink + timed.frame()[0]; },
+                               0.1);
+        };
+        double composeNs = perFrame(false) * 1e9, deepNs = perFrame(true) * 1e9;
+        double quantizeNs = timePerCall([&]()
+                                        {
+            temporal.quantize(comp.deepFrame(), out.data(), comp.zones());
+            sink = sink + out[0]; },
+                                        0.1) *
+                            1e9;
+
+        std::string label;
+        for (const auto &source : sources)
+            label += (label.empty() ? "" : " ") + source;
+        std::cout << "Dither: " << label << ", " << frames << " frames at " << fps << " fps, " << window << "-frame (50 ms) average\n"
+                  << std::fixed << std::setprecision(3)
+                  << "  rounded      error rms " << plain.rms << ", worst " << plain.worst << " levels\n"
+                  << "  dithered     error rms " << smooth.rms << ", worst " << smooth.worst << " levels\n"
+                  << std::setprecision(1)
+                  << "  compose      " << composeNs << " ns/frame 8-bit, " << deepNs << " ns/frame with 16-bit\n"
+                  << "  quantize     " << quantizeNs << " ns/frame (" << comp.zones() << " zones)\n";
+    }
+}
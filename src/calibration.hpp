@@ -0,0 +1,266 @@
+#pragma once
+#include "definitions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CALIBRATION_DIR_ENV "OMEN_RGB_CALIBRATION"
+
+// Per-zone color calibration. A zone's color is decoded to linear light, mixed by a 3x3
+// matrix, re-encoded and passed through a per-channel curve. Profiles are compiled into
+// fused tables, so calibrating a zone costs twelve table lookups and no floating point.
+namespace omen::rgb::calibration
+{
+    // Linear light is quantized to this many steps between the matrix and the curve.
+    constexpr int32_t LINEAR_STEPS = 1 << 14;
+    // Each listed zone compiles a 58 KiB table.
+    constexpr size_t MAX_ZONES = 100;
+
+    inline double decode(double v) { return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4); }
+    inline double encode(double v) { return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055; }
+
+    struct Zone
+    {
+        double matrix[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+        // Output levels (0-1) at evenly spaced inputs; empty is the identity.
+        std::vector<double> curve[3];
+
+        double shape(int channel, double v) const
+        {
+            const auto &points = curve[channel];
+            if (points.size() < 2)
+                return v;
+            double x = std::clamp(v, 0.0, 1.0) * (points.size() - 1);
+            size_t i = std::min(static_cast<size_t>(x), points.size() - 2);
+            return points[i] + (points[i + 1] - points[i]) * (x - i);
+        }
+
+        // The exact transform, in doubles; the fused tables must stay within one level of it.
+        RGB_HEX reference(RGB_HEX color) const
+        {
+            double in[3];
+            for (int k = 0; k < 3; ++k)
+                in[k] = decode(((color >> (16 - 8 * k)) & 0xFF) / 255.0);
+            RGB_HEX result = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                double out = matrix[c][0] * in[0] + matrix[c][1] * in[1] + matrix[c][2] * in[2];
+                double level = shape(c, encode(std::clamp(out, 0.0, 1.0)));
+                result |= static_cast<RGB_HEX>(std::lround(std::clamp(level, 0.0, 1.0) * 255.0)) << (16 - 8 * c);
+            }
+            return result;
+        }
+    };
+
+    struct Table
+    {
+        // mix[c][k][v]: input channel k at level v, weighted for output channel c, in linear steps.
+        int32_t mix[3][3][256];
+        uint8_t out[3][LINEAR_STEPS + 1];
+
+        explicit Table(const Zone &zone)
+        {
+            for (int c = 0; c < 3; ++c)
+                for (int k = 0; k < 3; ++k)
+                    for (int v = 0; v < 256; ++v)
+                        mix[c][k][v] = static_cast<int32_t>(std::lround(zone.matrix[c][k] * decode(v / 255.0) * LINEAR_STEPS));
+            for (int c = 0; c < 3; ++c)
+                for (int32_t q = 0; q <= LINEAR_STEPS; ++q)
+                {
+                    double level = zone.shape(c, encode(static_cast<double>(q) / LINEAR_STEPS));
+                    out[c][q] = static_cast<uint8_t>(std::lround(std::clamp(level, 0.0, 1.0) * 255.0));
+                }
+        }
+
+        RGB_HEX apply(RGB_HEX color) const
+        {
+            uint32_t r = (color >> 16) & 0xFF, g = (color >> 8) & 0xFF, b = color & 0xFF;
+            RGB_HEX result = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                int32_t sum = std::clamp(mix[c][0][r] + mix[c][1][g] + mix[c][2][b], 0, LINEAR_STEPS);
+                result |= static_cast<RGB_HEX>(out[c][sum]) << (16 - 8 * c);
+            }
+            return result;
+        }
+    };
+
+    class Profile
+    {
+    public:
+        // Zones past the listed ones use the "*" entry.
+        Profile(std::string path, std::vector<Zone> zones, Zone fallback)
+            : path_(std::move(path)), zones_(std::move(zones)), fallback_(std::move(fallback))
+        {
+            for (const auto &zone : zones_)
+                tables_.push_back(std::make_unique<Table>(zone));
+            tables_.push_back(std::make_unique<Table>(fallback_));
+        }
+
+        const std::string &path() const { return path_; }
+        size_t zones() const { return zones_.size(); }
+        const Zone &zone(size_t index) const { return index < zones_.size() ? zones_[index] : fallback_; }
+
+        RGB_HEX apply(size_t zone, RGB_HEX color) const
+        {
+            return tables_[std::min(zone, zones_.size())]->apply(color) | (color & 0xFF000000);
+        }
+
+    private:
+        std::string path_;
+        std::vector<Zone> zones_;
+        Zone fallback_;
+        std::vector<std::unique_ptr<Table>> tables_;
+    };
+
+    // "<zones> <key> = <values>" lines, where zones is "*" or a comma list; '#' starts a comment.
+    // Later lines override earlier ones, so "*" lines go first:
+    //   <zones> matrix = <9 numbers>             row-major, on linear light
+    //   <zones> curve <r|g|b|rgb> = <levels>     2+ output levels (0-1) at evenly spaced inputs
+    inline std::shared_ptr<const Profile> parse(std::istream &in, const std::string &path)
+    {
+        struct Setting
+        {
+            std::vector<size_t> zones;
+            bool all = false;
+            std::string key, channels;
+            std::vector<double> values;
+        };
+        std::vector<Setting> settings;
+        size_t listed = 0;
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); ++number)
+        {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            try
+            {
+                size_t equals = line.find('=');
+                if (equals == std::string::npos)
+                    throw std::invalid_argument("expected <zones> <key> = <values>");
+                std::istringstream left(line.substr(0, equals)), right(line.substr(equals + 1));
+                Setting setting;
+                std::string zones, extra;
+                left >> zones >> setting.key >> setting.channels >> extra;
+                if (zones.empty() || setting.key.empty() || !extra.empty())
+                    throw std::invalid_argument("expected <zones> <key> = <values>");
+                if (zones == "*")
+                    setting.all = true;
+                else
+                {
+                    std::istringstream list(zones);
+                    for (std::string item; std::getline(list, item, ',');)
+                    {
+                        char *end = nullptr;
+                        unsigned long zone = std::strtoul(item.c_str(), &end, 10);
+                        if (item.empty() || *end || zone >= MAX_ZONES)
+                            throw std::invalid_argument("bad zone " + item);
+                        setting.zones.push_back(zone);
+                        listed = std::max<size_t>(listed, zone + 1);
+                    }
+                }
+                for (std::string token; right >> token;)
+                {
+                    char *end = nullptr;
+                    double value = std::strtod(token.c_str(), &end);
+                    if (*end || !std::isfinite(value))
+                        throw std::invalid_argument("bad number " + token);
+                    setting.values.push_back(value);
+                }
+
+                if (setting.key == "matrix")
+                {
+                    if (!setting.channels.empty() || setting.values.size() != 9)
+                        throw std::invalid_argument("matrix takes 9 numbers");
+                }
+                else if (setting.key == "curve")
+                {
+                    if (setting.channels != "r" && setting.channels != "g" && setting.channels != "b" && setting.channels != "rgb")
+                        throw std::invalid_argument("curve channel must be r, g, b or rgb");
+                    if (setting.values.size() < 2)
+                        throw std::invalid_argument("curve takes at least 2 levels");
+                    for (double value : setting.values)
+                        if (value < 0.0 || value > 1.0)
+                            throw std::invalid_argument("curve levels must be 0-1");
+                }
+                else
+                    throw std::invalid_argument("unknown key " + setting.key);
+                settings.push_back(std::move(setting));
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(path + ":" + std::to_string(number) + ": " + e.what());
+            }
+        }
+
+        std::vector<Zone> zones(listed);
+        Zone fallback;
+        auto set = [](Zone &zone, const Setting &setting)
+        {
+            if (setting.key == "matrix")
+                for (int i = 0; i < 9; ++i)
+                    zone.matrix[i / 3][i % 3] = setting.values[i];
+            else
+                for (int c = 0; c < 3; ++c)
+                    if (setting.channels == "rgb" || setting.channels[0] == "rgb"[c])
+                        zone.curve[c] = setting.values;
+        };
+        for (const auto &setting : settings)
+        {
+            if (setting.all)
+            {
+                set(fallback, setting);
+                for (auto &zone : zones)
+                    set(zone, setting);
+            }
+            for (size_t index : setting.zones)
+                set(zones[index], setting);
+        }
+        return std::make_shared<Profile>(path, std::move(zones), std::move(fallback));
+    }
+
+    // $OMEN_RGB_CALIBRATION, else $XDG_CONFIG_HOME/omen-rgb-cli/calibration, else ~/.config/omen-rgb-cli/calibration.
+    inline std::string directory()
+    {
+        if (const char *dir = std::getenv(CALIBRATION_DIR_ENV); dir && *dir)
+            return dir;
+        if (const char *xdg = std::getenv("XDG_CONFIG_HOME"); xdg && *xdg)
+            return std::string(xdg) + "/omen-rgb-cli/calibration";
+        const char *home = std::getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.config/omen-rgb-cli/calibration";
+    }
+
+    // <directory>/<device>.cal, by the last component of the device name.
+    inline std::string profilePath(const std::string &device)
+    {
+        return directory() + "/" + device.substr(device.find_last_of('/') + 1) + ".cal";
+    }
+
+    // The device's profile, or nullptr if it has none. A broken profile is reported and
+    // ignored, so a typo never stops the lights.
+    inline std::shared_ptr<const Profile> load(const std::string &device)
+    {
+        std::string path = profilePath(device);
+        std::ifstream file(path);
+        if (!file)
+            return nullptr;
+        try
+        {
+            return parse(file, path);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << MSG_ERR("Ignoring calibration: ") << e.what() << "\n";
+            return nullptr;
+        }
+    }
+}
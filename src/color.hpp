@@ -0,0 +1,481 @@
+#pragma once
+#include "cpu.hpp"
+#include "definitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Color kernels over packed RGB_HEX frame buffers (0xAARRGGBB).
+// Bits 24-31 of the destination are carried through untouched by every
+// kernel; blendAlpha reads the source's top byte as per-pixel alpha.
+// The scalar backend is the reference the SIMD backends must match bit for bit.
+namespace omen::rgb::color
+{
+    enum class Backend
+    {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    inline const char *backendName(Backend backend)
+    {
+        switch (backend)
+        {
+        case Backend::Sse2:
+            return "sse2";
+        case Backend::Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+        }
+    }
+
+    inline bool isSupported(Backend backend)
+    {
+#ifdef OMEN_X86
+        if (backend == Backend::Avx2)
+            return __builtin_cpu_supports("avx2");
+        if (backend == Backend::Sse2)
+            return __builtin_cpu_supports("sse2");
+#endif
+        return backend == Backend::Scalar;
+    }
+
+    struct GammaLut
+    {
+        std::array<uint8_t, 256> r, g, b;
+
+        static GammaLut make(double gamma)
+        {
+            if (!(gamma > 0.0))
+                throw std::invalid_argument("Gamma must be greater than 0");
+
+            GammaLut lut;
+            for (int i = 0; i < 256; ++i)
+            {
+                double v = std::pow(i / 255.0, gamma) * 255.0 + 0.5;
+                lut.r[i] = lut.g[i] = lut.b[i] = static_cast<uint8_t>(std::min(255.0, v));
+            }
+            return lut;
+        }
+    };
+
+    // 256 leaves saturation unchanged, 0 is grayscale, 511 is the maximum boost.
+    constexpr uint16_t SATURATION_IDENTITY = 256;
+    constexpr uint16_t SATURATION_MAX = 511;
+
+    struct Kernels
+    {
+        void (*scale)(RGB_HEX *frame, size_t count, uint8_t factor);
+        void (*gamma)(RGB_HEX *frame, size_t count, const GammaLut &lut);
+        void (*blend)(RGB_HEX *dst, const RGB_HEX *src, size_t count, uint8_t alpha);
+        void (*blendAlpha)(RGB_HEX *dst, const RGB_HEX *src, size_t count);
+        void (*add)(RGB_HEX *dst, const RGB_HEX *src, size_t count);
+        void (*multiply)(RGB_HEX *dst, const RGB_HEX *src, size_t count);
+        void (*saturate)(RGB_HEX *frame, size_t count, uint16_t amount);
+    };
+
+    namespace scalar
+    {
+        constexpr RGB_HEX ALPHA_MASK = 0xFF000000;
+
+        inline uint32_t div255(uint32_t x)
+        {
+            x += 128;
+            return (x + (x >> 8)) >> 8;
+        }
+
+        inline uint32_t channel(RGB_HEX c, int shift) { return (c >> shift) & 0xFF; }
+
+        template <typename Op>
+        inline RGB_HEX perChannel(RGB_HEX keep, Op op)
+        {
+            return (keep & ALPHA_MASK) | (op(16) << 16) | (op(8) << 8) | op(0);
+        }
+
+        inline void scale(RGB_HEX *frame, size_t count, uint8_t factor)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                RGB_HEX c = frame[i];
+                frame[i] = perChannel(c, [&](int s)
+                                      { return div255(channel(c, s) * factor); });
+            }
+        }
+
+        inline void gamma(RGB_HEX *frame, size_t count, const GammaLut &lut)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                RGB_HEX c = frame[i];
+                frame[i] = (c & ALPHA_MASK) | (RGB_HEX(lut.r[channel(c, 16)]) << 16) |
+                           (RGB_HEX(lut.g[channel(c, 8)]) << 8) | lut.b[channel(c, 0)];
+            }
+        }
+
+        inline RGB_HEX mix(RGB_HEX d, RGB_HEX s, uint32_t a)
+        {
+            return perChannel(d, [&](int sh)
+                              { return div255(channel(s, sh) * a + channel(d, sh) * (255 - a)); });
+        }
+
+        inline void blend(RGB_HEX *dst, const RGB_HEX *src, size_t count, uint8_t alpha)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = mix(dst[i], src[i], alpha);
+        }
+
+        inline void blendAlpha(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = mix(dst[i], src[i], src[i] >> 24);
+        }
+
+        inline void add(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                RGB_HEX d = dst[i], s = src[i];
+                dst[i] = perChannel(d, [&](int sh)
+                                    { return std::min<uint32_t>(255, channel(d, sh) + channel(s, sh)); });
+            }
+        }
+
+        inline void multiply(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                RGB_HEX d = dst[i], s = src[i];
+                dst[i] = perChannel(d, [&](int sh)
+                                    { return div255(channel(d, sh) * channel(s, sh)); });
+            }
+        }
+
+        inline void saturate(RGB_HEX *frame, size_t count, uint16_t amount)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                RGB_HEX c = frame[i];
+                int y = static_cast<int>((29 * channel(c, 0) + 150 * channel(c, 8) + 77 * channel(c, 16) + 128) >> 8);
+                frame[i] = perChannel(c, [&](int sh)
+                                      {
+                    int d = static_cast<int>(channel(c, sh)) - y;
+                    return static_cast<uint32_t>(std::clamp(y + ((d * amount) >> 8), 0, 255)); });
+            }
+        }
+    }
+
+#ifdef OMEN_X86
+    namespace sse2
+    {
+        OMEN_TARGET("sse2")
+        inline __m128i div255(__m128i x)
+        {
+            x = _mm_add_epi16(x, _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+        }
+
+        OMEN_TARGET("sse2")
+        inline __m128i keepAlpha(__m128i result, __m128i original)
+        {
+            __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+            return _mm_or_si128(_mm_and_si128(result, rgb), _mm_andnot_si128(rgb, original));
+        }
+
+        // Widens four pixels to 16-bit channels, applies op to each half and narrows back.
+        template <typename Op>
+        OMEN_TARGET("sse2")
+        inline void map(RGB_HEX *dst, const RGB_HEX *src, size_t &i, size_t count, Op op)
+        {
+            __m128i zero = _mm_setzero_si128();
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                __m128i s = src ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)) : zero;
+                __m128i lo = op(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+                __m128i hi = op(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), keepAlpha(_mm_packus_epi16(lo, hi), d));
+            }
+        }
+
+        OMEN_TARGET("sse2")
+        inline void scale(RGB_HEX *frame, size_t count, uint8_t factor)
+        {
+            size_t i = 0;
+            __m128i f = _mm_set1_epi16(factor);
+            map(frame, nullptr, i, count, [f](__m128i d, __m128i) OMEN_TARGET("sse2")
+                { return div255(_mm_mullo_epi16(d, f)); });
+            scalar::scale(frame + i, count - i, factor);
+        }
+
+        OMEN_TARGET("sse2")
+        inline void blend(RGB_HEX *dst, const RGB_HEX *src, size_t count, uint8_t alpha)
+        {
+            size_t i = 0;
+            __m128i a = _mm_set1_epi16(alpha);
+            __m128i inv = _mm_set1_epi16(255 - alpha);
+            map(dst, src, i, count, [a, inv](__m128i d, __m128i s) OMEN_TARGET("sse2")
+                { return div255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv))); });
+            scalar::blend(dst + i, src + i, count - i, alpha);
+        }
+
+        OMEN_TARGET("sse2")
+        inline void blendAlpha(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            __m128i full = _mm_set1_epi16(255);
+            map(dst, src, i, count, [full](__m128i d, __m128i s) OMEN_TARGET("sse2")
+                {
+                __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+                __m128i inv = _mm_sub_epi16(full, a);
+                return div255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv))); });
+            scalar::blendAlpha(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("sse2")
+        inline void add(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), keepAlpha(_mm_adds_epu8(d, s), d));
+            }
+            scalar::add(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("sse2")
+        inline void multiply(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            map(dst, src, i, count, [](__m128i d, __m128i s) OMEN_TARGET("sse2")
+                { return div255(_mm_mullo_epi16(d, s)); });
+            scalar::multiply(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("sse2")
+        inline void saturate(RGB_HEX *frame, size_t count, uint16_t amount)
+        {
+            size_t i = 0;
+            __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+            __m128i s = _mm_set1_epi16(static_cast<int16_t>(amount * 4));
+            map(frame, nullptr, i, count, [weights, s](__m128i d, __m128i) OMEN_TARGET("sse2")
+                {
+                __m128i sum = _mm_madd_epi16(d, weights);
+                sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+                __m128i y = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+                y = _mm_packs_epi32(y, y);
+                y = _mm_unpacklo_epi16(y, y);
+                __m128i delta = _mm_slli_epi16(_mm_sub_epi16(d, y), 6);
+                return _mm_add_epi16(y, _mm_mulhi_epi16(delta, s)); });
+            scalar::saturate(frame + i, count - i, amount);
+        }
+    }
+
+    namespace avx2
+    {
+        OMEN_TARGET("avx2")
+        inline __m256i div255(__m256i x)
+        {
+            x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+            return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+        }
+
+        OMEN_TARGET("avx2")
+        inline __m256i keepAlpha(__m256i result, __m256i original)
+        {
+            return _mm256_blendv_epi8(original, result, _mm256_set1_epi32(0x00FFFFFF));
+        }
+
+        // Lane-wise unpack/pack keeps pixel order, so this mirrors sse2::map at eight pixels.
+        template <typename Op>
+        OMEN_TARGET("avx2")
+        inline void map(RGB_HEX *dst, const RGB_HEX *src, size_t &i, size_t count, Op op)
+        {
+            __m256i zero = _mm256_setzero_si256();
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+                __m256i s = src ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)) : zero;
+                __m256i lo = op(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+                __m256i hi = op(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), keepAlpha(_mm256_packus_epi16(lo, hi), d));
+            }
+        }
+
+        OMEN_TARGET("avx2")
+        inline void scale(RGB_HEX *frame, size_t count, uint8_t factor)
+        {
+            size_t i = 0;
+            __m256i f = _mm256_set1_epi16(factor);
+            map(frame, nullptr, i, count, [f](__m256i d, __m256i) OMEN_TARGET("avx2")
+                { return div255(_mm256_mullo_epi16(d, f)); });
+            sse2::scale(frame + i, count - i, factor);
+        }
+
+        OMEN_TARGET("avx2")
+        inline void blend(RGB_HEX *dst, const RGB_HEX *src, size_t count, uint8_t alpha)
+        {
+            size_t i = 0;
+            __m256i a = _mm256_set1_epi16(alpha);
+            __m256i inv = _mm256_set1_epi16(255 - alpha);
+            map(dst, src, i, count, [a, inv](__m256i d, __m256i s) OMEN_TARGET("avx2")
+                { return div255(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, inv))); });
+            sse2::blend(dst + i, src + i, count - i, alpha);
+        }
+
+        OMEN_TARGET("avx2")
+        inline void blendAlpha(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            __m256i full = _mm256_set1_epi16(255);
+            map(dst, src, i, count, [full](__m256i d, __m256i s) OMEN_TARGET("avx2")
+                {
+                __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+                __m256i inv = _mm256_sub_epi16(full, a);
+                return div255(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, inv))); });
+            sse2::blendAlpha(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("avx2")
+        inline void add(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+                __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), keepAlpha(_mm256_adds_epu8(d, s), d));
+            }
+            sse2::add(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("avx2")
+        inline void multiply(RGB_HEX *dst, const RGB_HEX *src, size_t count)
+        {
+            size_t i = 0;
+            // A capture-default suppresses the untargeted function-pointer conversion.
+            map(dst, src, i, count, [=](__m256i d, __m256i s) OMEN_TARGET("avx2")
+                { return div255(_mm256_mullo_epi16(d, s)); });
+            sse2::multiply(dst + i, src + i, count - i);
+        }
+
+        OMEN_TARGET("avx2")
+        inline void saturate(RGB_HEX *frame, size_t count, uint16_t amount)
+        {
+            size_t i = 0;
+            __m256i weights = _mm256_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77, 0);
+            __m256i s = _mm256_set1_epi16(static_cast<int16_t>(amount * 4));
+            map(frame, nullptr, i, count, [weights, s](__m256i d, __m256i) OMEN_TARGET("avx2")
+                {
+                __m256i sum = _mm256_madd_epi16(d, weights);
+                sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+                __m256i y = _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+                y = _mm256_packs_epi32(y, y);
+                y = _mm256_unpacklo_epi16(y, y);
+                __m256i delta = _mm256_slli_epi16(_mm256_sub_epi16(d, y), 6);
+                return _mm256_add_epi16(y, _mm256_mulhi_epi16(delta, s)); });
+            sse2::saturate(frame + i, count - i, amount);
+        }
+    }
+#endif
+
+    // Gamma stays a byte-table lookup on every backend: x86 has no byte gather,
+    // and the table is hot in L1 for any frame size we drive.
+    inline const Kernels &kernels(Backend backend)
+    {
+        static const Kernels scalarKernels = {scalar::scale, scalar::gamma, scalar::blend, scalar::blendAlpha,
+                                              scalar::add, scalar::multiply, scalar::saturate};
+#ifdef OMEN_X86
+        static const Kernels sse2Kernels = {sse2::scale, scalar::gamma, sse2::blend, sse2::blendAlpha,
+                                            sse2::add, sse2::multiply, sse2::saturate};
+        static const Kernels avx2Kernels = {avx2::scale, scalar::gamma, avx2::blend, avx2::blendAlpha,
+                                            avx2::add, avx2::multiply, avx2::saturate};
+        if (backend == Backend::Avx2)
+            return avx2Kernels;
+        if (backend == Backend::Sse2)
+            return sse2Kernels;
+#endif
+        return scalarKernels;
+    }
+
+    inline Backend bestBackend()
+    {
+        static const Backend best = isSupported(Backend::Avx2)   ? Backend::Avx2
+                                    : isSupported(Backend::Sse2) ? Backend::Sse2
+                                                                 : Backend::Scalar;
+        return best;
+    }
+
+    inline const Kernels &active()
+    {
+        static const Kernels &k = kernels(bestBackend());
+        return k;
+    }
+
+    inline void scale(RGB_HEX *frame, size_t count, uint8_t factor) { active().scale(frame, count, factor); }
+    inline void gamma(RGB_HEX *frame, size_t count, const GammaLut &lut) { active().gamma(frame, count, lut); }
+    inline void blend(RGB_HEX *dst, const RGB_HEX *src, size_t count, uint8_t alpha) { active().blend(dst, src, count, alpha); }
+    inline void blendAlpha(RGB_HEX *dst, const RGB_HEX *src, size_t count) { active().blendAlpha(dst, src, count); }
+    inline void add(RGB_HEX *dst, const RGB_HEX *src, size_t count) { active().add(dst, src, count); }
+    inline void multiply(RGB_HEX *dst, const RGB_HEX *src, size_t count) { active().multiply(dst, src, count); }
+
+    inline void saturate(RGB_HEX *frame, size_t count, uint16_t amount)
+    {
+        if (amount > SATURATION_MAX)
+            throw std::invalid_argument("Saturation must be between 0 and " + std::to_string(SATURATION_MAX));
+        active().saturate(frame, count, amount);
+    }
+
+    // Linear per-channel interpolation from a (f = 0) to b (f = 1), alpha taken from a.
+    inline RGB_HEX lerp(RGB_HEX a, RGB_HEX b, double f)
+    {
+        f = std::clamp(f, 0.0, 1.0);
+        return scalar::perChannel(a, [&](int sh)
+                                  {
+            double ca = scalar::channel(a, sh), cb = scalar::channel(b, sh);
+            return static_cast<uint32_t>(ca + (cb - ca) * f + 0.5); });
+    }
+
+    // 16 bits per channel, for rendering that is dithered down to RGB_HEX at the output.
+    struct Color16
+    {
+        uint16_t r = 0, g = 0, b = 0, a = 0;
+
+        bool operator==(const Color16 &o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+        bool operator!=(const Color16 &o) const { return !(*this == o); }
+    };
+
+    // x * 257 maps 0-255 exactly onto 0-65535.
+    inline Color16 widen(RGB_HEX c)
+    {
+        auto ch = [c](int sh)
+        { return static_cast<uint16_t>(scalar::channel(c, sh) * 257); };
+        return {ch(16), ch(8), ch(0), ch(24)};
+    }
+
+    inline RGB_HEX narrow(const Color16 &c)
+    {
+        auto ch = [](uint16_t v)
+        { return static_cast<RGB_HEX>((v + 128) / 257); };
+        return ch(c.a) << 24 | ch(c.r) << 16 | ch(c.g) << 8 | ch(c.b);
+    }
+
+    // lerp without rounding to 8 bits.
+    inline Color16 lerp16(RGB_HEX a, RGB_HEX b, double f)
+    {
+        f = std::clamp(f, 0.0, 1.0);
+        auto ch = [&](int sh)
+        {
+            double ca = scalar::channel(a, sh) * 257.0, cb = scalar::channel(b, sh) * 257.0;
+            return static_cast<uint16_t>(ca + (cb - ca) * f + 0.5);
+        };
+        return {ch(16), ch(8), ch(0), static_cast<uint16_t>(scalar::channel(a, 24) * 257)};
+    }
+}
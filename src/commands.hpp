@@ -1,8 +1,46 @@
 #pragma once
+#include "adaptive.hpp"
+#include "arbiter.hpp"
+#include "ambient.hpp"
+#include "audio.hpp"
+#include "bench.hpp"
+#include "calibration.hpp"
+#include "compositor.hpp"
+#include "config.hpp"
 #include "definitions.hpp"
+#include "dither.hpp"
 #include "enums.hpp"
+#include "frametable.hpp"
 #include "fs.hpp"
+#include "hexframe.hpp"
+#include "illuminance.hpp"
+#include "metrics.hpp"
+#include "offload.hpp"
+#include "openrgb.hpp"
+#include "output.hpp"
+#include "plugins.hpp"
+#include "power.hpp"
+#include "presets.hpp"
+#include "render.hpp"
+#include "resident.hpp"
+#include "schedule.hpp"
+#include "timeline.hpp"
+#include "typing.hpp"
 #include "utils.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -56,16 +94,12 @@ namespace omen::rgb::commands
         RGB_HEX color = utils::hexStringToRGB(utils::sanitizeHexString(args[1]));
         std::string colorStr = utils::rgbHexToUpper(color, false);
 
-        bool allSuccess = true;
-        for (int zone = 0; zone < 4; ++zone)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (zone < 10 ? "0" : "") + std::to_string(zone);
-            if (!omen::fs::writeSysfs(path, colorStr))
-            {
-                allSuccess = false;
-                break;
-            }
-        }
+        std::vector<omen::fs::Write> writes;
+        for (size_t zone = 0, zones = output::discoverZones(); zone < zones; ++zone)
+            writes.push_back({utils::zonePath(zone), colorStr});
+        std::vector<char> results = omen::fs::writeBatch(writes);
+        bool allSuccess = std::all_of(results.begin(), results.end(), [](char ok)
+                                      { return ok != 0; });
 
         if (!allSuccess)
         {
@@ -212,341 +246,2098 @@ namespace omen::rgb::commands
         }
     }
 
-    inline void cmdExamples() { std::cout << "Example commands:\n"
-                                          << EXAMPLE_COMMANDS_TEXT; }
-
-    inline void cmdVersion() { std::cout << PROGRAM_VERSION << std::endl; }
-
-    struct FlagData
-    {
-        std::string name;
-        std::string emoji;
-        std::vector<RGB_HEX> colors;
-        std::string category;
-    };
-
-    static const std::unordered_map<std::string, FlagData> FLAG_DATABASE = {
-        {"pride", {"Pride", "🌈", {0xFF0000, 0xFF8000, 0xFFFF00, 0x00FF00, 0x0000FF, 0x8000FF}, "pride"}},
-        {"trans", {"Transgender", "⚧", {0x5BCEFA, 0xF5A9B8, 0xFFFFFF, 0xF5A9B8, 0x5BCEFA}, "pride"}},
-        {"bi", {"Bisexual", "💖", {0xD60270, 0x9B4F96, 0x0038A8}, "pride"}},
-        {"pan", {"Pansexual", "💗", {0xFF1B8D, 0xFFD700, 0x1BB3FF}, "pride"}},
-        {"ace", {"Asexual", "🖤", {0x000000, 0xA3A3A3, 0xFFFFFF, 0x800080}, "pride"}},
-        {"lesbian", {"Lesbian", "🧡", {0xD52D00, 0xFF9A56, 0xFFFFFF, 0xD362A4, 0xA30262}, "pride"}},
-        {"gay", {"Gay", "💙", {0x078D70, 0x26CEAA, 0x98E8C1, 0xFFFFFF, 0x7BADE2, 0x5049CC, 0x3D1A78}, "pride"}},
-        {"nonbinary", {"Non-binary", "💛", {0xFFF430, 0xFFFFFF, 0x9C59D1, 0x000000}, "pride"}},
-        {"genderfluid", {"Genderfluid", "💜", {0xFF75A2, 0xFFFFFF, 0xBE18D6, 0x000000, 0x333EBD}, "pride"}},
-        {"agender", {"Agender", "🤍", {0x000000, 0xBCC4C6, 0xFFFFFF, 0xB8F483, 0xFFFFFF, 0xBCC4C6, 0x000000}, "pride"}},
-        {"demigirl", {"Demigirl", "💗", {0x7F7F7F, 0xC4C4C4, 0xFFB6C1, 0xFFFFFF, 0xFFB6C1, 0xC4C4C4, 0x7F7F7F}, "pride"}},
-        {"demiboy", {"Demiboy", "💙", {0x7F7F7F, 0xC4C4C4, 0x9ACEEB, 0xFFFFFF, 0x9ACEEB, 0xC4C4C4, 0x7F7F7F}, "pride"}},
-        {"aro", {"Aromantic", "🤍", {0x3DA542, 0xA7D379, 0xFFFFFF, 0xA9A9A9, 0x000000}, "pride"}},
-        {"demi", {"Demisexual", "💜", {0x000000, 0x7F7F7F, 0xFFFFFF, 0x800080}, "pride"}},
-        {"intersex", {"Intersex", "🟡", {0xFFD700, 0x7B68EE, 0xFFD700}, "pride"}},
-        {"twospirit", {"Two-Spirit", "🟣", {0x800080, 0xFFFFFF, 0x000000}, "pride"}},
-
-        {"usa", {"United States", "[US]", {0xB22234, 0xFFFFFF, 0x3C3B6E}, "country"}},
-        {"uk", {"United Kingdom", "[UK]", {0x012169, 0xFFFFFF, 0xC8102E}, "country"}},
-        {"france", {"France", "[FR]", {0x002395, 0xFFFFFF, 0xED2939}, "country"}},
-        {"germany", {"Germany", "[DE]", {0x000000, 0xDD0000, 0xFFCE00}, "country"}},
-        {"italy", {"Italy", "[IT]", {0x009246, 0xFFFFFF, 0xCE2B37}, "country"}},
-        {"canada", {"Canada", "[CA]", {0xFF0000, 0xFFFFFF, 0xFF0000}, "country"}},
-        {"japan", {"Japan", "[JP]", {0xFFFFFF, 0xBC002D, 0xFFFFFF}, "country"}},
-        {"brazil", {"Brazil", "[BR]", {0x009639, 0xFFDF00, 0x002776}, "country"}},
-        {"australia", {"Australia", "[AU]", {0x00008B, 0xFF0000, 0xFFFFFF}, "country"}},
-        {"spain", {"Spain", "[ES]", {0xAA151B, 0xF1BF00, 0xAA151B}, "country"}},
-
-        {"sunset", {"Sunset", "🌅", {0xFF6B6B, 0xFF8E53, 0xFF6B9D, 0xC44569, 0xF8B500}, "theme"}},
-        {"ocean", {"Ocean", "🌊", {0x006994, 0x0099CC, 0x00CCFF, 0x66E0FF}, "theme"}},
-        {"fire", {"Fire", "🔥", {0xFF4500, 0xFF6347, 0xFF7F50, 0xFFA500}, "theme"}},
-        {"rainbow", {"Rainbow", "🌈", {0xFF0000, 0xFF7F00, 0xFFFF00, 0x00FF00, 0x0000FF, 0x4B0082, 0x9400D3}, "theme"}},
-        {"aurora", {"Aurora", "🌌", {0x00FF9F, 0x00D4FF, 0x9D4EDD, 0x7209B7}, "theme"}},
-        {"matrix", {"Matrix", "🟢", {0x00FF00, 0x00CC00, 0x009900, 0x006600}, "theme"}},
-        {"cyberpunk", {"Cyberpunk", "🤖", {0xFF0080, 0x00FFFF, 0x8000FF, 0xFFFF00}, "theme"}},
-        {"neon", {"Neon", "💡", {0xFF00FF, 0x00FFFF, 0xFFFF00, 0xFF0080}, "theme"}},
-        {"galaxy", {"Galaxy", "🌌", {0x4B0082, 0x8A2BE2, 0x9370DB, 0xDA70D6}, "theme"}}};
-
-    inline void cmdFlag(const std::string &flagName)
+    inline void cmdStream(const std::vector<std::string> &args)
     {
-        auto it = FLAG_DATABASE.find(utils::toLower(flagName));
-        if (it == FLAG_DATABASE.end())
-        {
-            std::cout << "[ERROR] Unknown flag/theme: " << flagName << std::endl;
+        if (!checkArgs(args, 1, std::string(CMD_STREAM) + " < frames.txt"))
             return;
-        }
 
-        const FlagData &flag = it->second;
-        std::cout << "Applying " << flag.emoji << " " << flag.name << " theme..." << std::endl;
+        std::ios::sync_with_stdio(false);
+
+        std::vector<RGB_HEX> frame(MAX_FRAME_COLORS);
+        output::ZoneWriter writer;
 
-        for (size_t i = 0; i < flag.colors.size() && i < 4; ++i)
+        std::string line;
+        size_t lineNumber = 0;
+        size_t frames = 0;
+        while (std::getline(std::cin, line))
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (flag.colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            ++lineNumber;
+            size_t count = 0;
+            try
             {
-                std::cout << MSG_OK_ZONE(i, flag.colors[i]) << std::endl;
+                count = hexframe::parseFrame(line, frame.data(), frame.size());
             }
-            else
+            catch (const std::invalid_argument &ex)
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                std::cerr << MSG_ERR("Line " + std::to_string(lineNumber) + ": " + ex.what()) << "\n";
+                continue;
             }
-        }
 
-        if (flag.category == "theme")
-        {
-            std::cout << "💡 Tip: Use 'animation <mode> <speed>' for dynamic effects!" << std::endl;
+            writer.write(frame.data(), count);
+            if (count > 0)
+                ++frames;
         }
+
+        std::cout << "[OK] Streamed " << frames << " frames." << std::endl;
     }
 
-    inline void cmdAce()
+    // Applies one stdin control line to a running composition; returns false on "quit".
+    inline bool composeControl(compositor::Compositor &comp, const std::string &line)
     {
-        std::vector<RGB_HEX> colors = {0x000000, 0x808080, 0xFFFFFF, 0x800080};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        std::vector<std::string> words = utils::split(line);
+        if (words.empty())
+            return true;
+
+        std::string action = utils::toLower(words[0]);
+        // The rest of the line, so expr: layers and their names may contain spaces.
+        size_t from = line.find_first_not_of(" \t", line.find(words[0]) + words[0].size());
+        size_t to = line.find_last_not_of(" \t\r");
+        std::string argument = from == std::string::npos ? "" : line.substr(from, to + 1 - from);
+        try
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            if (action == "quit" || action == CMD_EXIT)
+                return false;
+            if (action == "add" && words.size() >= 2)
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                compositor::Layer layer = compositor::parseLayer(argument);
+                std::string name = layer.name;
+                comp.add(std::move(layer));
+                std::cout << "[OK] Layer " << name << " added." << std::endl;
             }
-            else
+            else if (action == "remove" && words.size() >= 2)
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                if (comp.remove(argument))
+                    std::cout << "[OK] Layer " << argument << " removed." << std::endl;
+                else
+                    std::cerr << MSG_ERR("No layer named " + argument) << "\n";
             }
-        }
-    }
-
-    inline void cmdLesbian()
-    {
-        std::vector<RGB_HEX> colors = {0xD52D00, 0xEF7627, 0xFF9A56, 0xFFFFFF, 0xD162A4, 0xB55690, 0xA30262};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            else if (action == "list")
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                for (const auto &name : comp.names())
+                    std::cout << "  " << name << "\n";
+                std::cout << std::flush;
             }
             else
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                std::cerr << MSG_ERR("Commands: add <layer>, remove <name>, list, quit") << "\n";
             }
         }
+        catch (const std::exception &ex)
+        {
+            std::cerr << MSG_ERR(ex.what()) << "\n";
+        }
+        return true;
     }
 
-    inline void cmdGay()
+    inline void runComposition(compositor::Compositor &comp, double fps, dither::Mode mode = dither::Mode::Auto);
+
+    inline void cmdCompose(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0x078D70, 0x26CEAA, 0x98E8C1, 0xFFFFFF, 0x7BADE2, 0x5049CC, 0x3D1A78};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
+        double fps = 30.0;
+        dither::Mode mode = dither::Mode::Auto;
+        std::vector<std::string> specs;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--fps" && i + 1 < args.size())
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--dither" && i + 1 < args.size())
+                mode = dither::parseMode(args[++i]);
+            else if (args[i] == "--budget-us" && i + 1 < args.size())
+                plugins::host().budget = std::chrono::microseconds(static_cast<int64_t>(compositor::parseNumber(args[++i], "budget")));
             else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+                specs.push_back(args[i]);
         }
+        if (specs.empty() || fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_COMPOSE << " [--fps N] [--dither auto|on|off] [--budget-us N] <layer>...\n";
+            return;
+        }
+
+        compositor::Compositor comp;
+        for (const auto &spec : specs)
+            comp.add(compositor::parseLayer(spec));
+
+        std::cout << "[OK] Composing " << specs.size() << " layers" << (dither::enabled(mode, fps) ? ", dithered" : "")
+                  << ". Stdin commands: add <layer>, remove <name>, list, quit" << std::endl;
+        runComposition(comp, fps, mode);
     }
 
-    inline void cmdNonbinary()
+    // Renders comp at fps until stdin says quit, or stdin closes with nothing left to animate.
+    inline void runComposition(compositor::Compositor &comp, double fps, dither::Mode mode)
     {
-        std::vector<RGB_HEX> colors = {0xFFF430, 0xFFFFFF, 0x9C59D1, 0x000000};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        output::ZoneWriter writer(comp.zones());
+        dither::Stage stage(comp);
+        stage.setEnabled(dither::enabled(mode, fps));
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        const auto interval = std::chrono::duration<double>(1.0 / fps);
+        auto nextFrame = start;
+        bool stdinOpen = true;
+        std::string pending;
+
+        for (;;)
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            auto now = Clock::now();
+            if (now >= nextFrame)
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                stage.frame(std::chrono::duration<double>(now - start).count(), writer);
+                while (nextFrame <= now)
+                    nextFrame += std::chrono::duration_cast<Clock::duration>(interval);
             }
-            else
+
+            // Nothing animates: sleep until stdin has something for us.
+            int timeout = -1;
+            if (comp.animated())
+                timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(nextFrame - Clock::now()).count()));
+            else if (!stdinOpen)
+                break;
+
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, stdinOpen ? 1 : 0, timeout) <= 0)
+                continue;
+
+            char buffer[4096];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0)
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                stdinOpen = false;
+                continue;
             }
+            pending.append(buffer, static_cast<size_t>(n));
+
+            bool quit = false;
+            for (size_t eol; !quit && (eol = pending.find('\n')) != std::string::npos;)
+            {
+                quit = !composeControl(comp, pending.substr(0, eol));
+                pending.erase(0, eol + 1);
+            }
+            if (quit)
+                break;
+            nextFrame = std::min(nextFrame, Clock::now());
         }
+
+        std::cout << "[OK] Composition stopped after " << comp.composites() << " composites, " << writer.writes() << " zone writes." << std::endl;
+        plugins::host().report(std::cout);
     }
 
-    inline void cmdGenderfluid()
+    inline void cmdEffect(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0xFF75A2, 0xFFFFFF, 0xBE18D6, 0x000000, 0x333EBD};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        double fps = 60.0;
+        std::string source;
+        for (size_t i = 1; i < args.size(); ++i)
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
+            if (args[i] == "--fps" && i + 1 < args.size())
+                fps = compositor::parseNumber(args[++i], "fps");
             else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+                source += (source.empty() ? "" : " ") + args[i];
+        }
+        if (source.empty() || fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_EFFECT << " [--fps N] <expression>\n";
+            return;
         }
+
+        compositor::Compositor comp;
+        comp.add(compositor::exprLayer(source));
+        std::cout << "[OK] Running effect: " << source << std::endl;
+        runComposition(comp, fps);
     }
 
-    inline void cmdAgender()
+    inline double processCpuSeconds()
     {
-        std::vector<RGB_HEX> colors = {0x000000, 0xBCC4C6, 0xFFFFFF, 0xB8F483, 0xFFFFFF, 0xBCC4C6, 0x000000};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+    }
+
+    inline void cmdLoop(const std::vector<std::string> &args)
+    {
+        frametable::Key key;
+        bool useCache = true, live = false, periodGiven = false;
+        for (size_t i = 1; i < args.size(); ++i)
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            if (args[i] == "--period" && i + 1 < args.size())
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                key.period = compositor::parseNumber(args[++i], "period");
+                periodGiven = true;
             }
+            else if (args[i] == "--fps" && i + 1 < args.size())
+                key.fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--no-cache")
+                useCache = false;
+            else if (args[i] == "--live")
+                live = true;
             else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+                key.sources.push_back(args[i]);
+        }
+        if (key.sources.empty() || key.period <= 0.0 || key.fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_LOOP << " [--period S] [--fps N] [--no-cache] [--live] <layer>...\n";
+            return;
+        }
+
+        if (!periodGiven)
+        {
+            std::optional<double> period = frametable::loopPeriod(key.sources);
+            if (period && *period > 0.0)
+                key.period = *period;
+            else if (!period)
+                std::cout << "[OK] No common period for these layers; looping every " << key.period << " s (set --period)" << std::endl;
         }
+
+        compositor::Compositor comp(key.zones);
+        if (live)
+        {
+            for (const auto &source : key.sources)
+                comp.add(compositor::parseLayer(source));
+            std::cout << "[OK] Computing " << key.sources.size() << " layers live" << std::endl;
+        }
+        else
+        {
+            auto start = std::chrono::steady_clock::now();
+            frametable::Lookup lookup = frametable::load(key, useCache);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            comp.add(frametable::layer(lookup.table));
+
+            std::cout << "[OK] Looping " << lookup.table->frames() << " frames (" << key.period << " s at " << key.fps << " fps), "
+                      << (lookup.hit ? "mapped from cache" : "rendered") << " in " << std::fixed << std::setprecision(2) << ms << " ms";
+            if (useCache)
+                std::cout << "\n     cache " << lookup.path << ", hit rate " << std::setprecision(1) << lookup.stats.hitRate()
+                          << "% (" << lookup.stats.hits << "/" << lookup.stats.hits + lookup.stats.misses << ")";
+            std::cout << std::defaultfloat << std::endl;
+        }
+
+        double cpuStart = processCpuSeconds();
+        runComposition(comp, key.fps);
+        if (comp.composites())
+            std::cout << "     steady-state CPU " << std::fixed << std::setprecision(2)
+                      << (processCpuSeconds() - cpuStart) / comp.composites() * 1e6 << " us/frame ("
+                      << (live ? "live" : "frame table") << ")" << std::endl;
     }
 
-    inline void cmdDemigirl()
+    inline void cmdAnimate(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0x7F7F7F, 0xC4C4C4, 0xFFB7D5, 0xFFFFFF, 0xFFB7D5, 0xC4C4C4, 0x7F7F7F};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
+        offload::Request request;
+        offload::Policy policy = offload::Policy::Exact;
+        double fps = 30.0;
+        bool dryRun = false;
+        std::vector<std::string> positional;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--period" && i + 1 < args.size())
+                request.period = compositor::parseNumber(args[++i], "period");
+            else if (args[i] == "--fps" && i + 1 < args.size())
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--prefer-hardware")
+                policy = offload::Policy::Approximate;
+            else if (args[i] == "--software")
+                policy = offload::Policy::Never;
+            else if (args[i] == "--dry-run")
+                dryRun = true;
             else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+                positional.push_back(args[i]);
+        }
+        if (positional.empty() || positional.size() > 2 || fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_ANIMATE << " <static|breathe|pulse|cycle|rainbow> [preset] [--period S] [--fps N] [--prefer-hardware|--software] [--dry-run]\n";
+            return;
+        }
+        request.effect = positional[0];
+        request.preset = positional.size() > 1 ? positional[1] : "";
+        if (request.preset.empty() && utils::toLower(request.effect) != "rainbow")
+            throw std::invalid_argument("animate " + request.effect + " needs a preset");
+
+        offload::Plan plan = offload::plan(request);
+        bool hardware = plan.offloaded(policy);
+        double hostWrites = offload::hostWritesPerSecond(plan, fps);
+
+        std::cout << "[OK] animate " << request.effect << (request.preset.empty() ? "" : " " + request.preset)
+                  << " (" << request.period << " s): firmware " << plan.mode;
+        if (plan.fidelity != offload::Fidelity::None && plan.mode != "static")
+            std::cout << " speed " << static_cast<int>(plan.speed) << " (" << plan.firmwarePeriod << " s)";
+        std::cout << " is " << offload::fidelityName(plan.fidelity) << (plan.note.empty() ? "" : ", " + plan.note) << "\n"
+                  << "     decision: " << (hardware ? "offload to firmware" : "render in userspace") << ", "
+                  << plan.hardwareWrites() << " writes once versus ~" << std::fixed << std::setprecision(1) << hostWrites
+                  << " zone writes/s at " << std::setprecision(0) << fps << " fps" << std::defaultfloat << std::endl;
+        if (dryRun)
+            return;
+
+        if (hardware)
+        {
+            output::ZoneWriter writer(plan.colors.size());
+            bool ok = writer.write(plan.colors.data(), plan.colors.size());
+            ok = omen::fs::writeSysfs(ANIMATION_MODE_PATH, plan.mode) && ok;
+            ok = omen::fs::writeSysfs(ANIMATION_SPEED_PATH, std::to_string(plan.speed)) && ok;
+            if (!ok)
+                throw std::runtime_error("Could not offload animation to firmware");
+            std::cout << MSG_OK_ANIMATION(plan.mode, static_cast<int>(plan.speed)) << std::endl;
+            return;
         }
+
+        // Userspace rendering needs the firmware to hold the zone colors still.
+        omen::fs::writeSysfs(ANIMATION_MODE_PATH, "static");
+        compositor::Compositor comp;
+        for (auto &layer : plan.layers)
+            comp.add(std::move(layer));
+        runComposition(comp, fps);
     }
 
-    inline void cmdDemiboy()
+    // Applies a static preset, idles, then checks that no frame timer fired; also checks
+    // that the timer runs while a layer animates and is disarmed again once it is removed
+    // or, for a fade, once it has finished. Runs against a scratch keyboard.
+    inline void runSelfCheck(double idleSeconds)
     {
-        std::vector<RGB_HEX> colors = {0x7F7F7F, 0xC4C4C4, 0x9AD9EA, 0xFFFFFF, 0x9AD9EA, 0xC4C4C4, 0x7F7F7F};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
+        omen::fs::Scratch scratch(ZONE_COUNT);
+        const auto start = std::chrono::steady_clock::now();
+        compositor::Compositor comp;
+        comp.add(compositor::presetLayer("ocean"));
+        resident::Runner runner(comp, 30.0, [&comp](const std::string &line)
+                                { return composeControl(comp, line); });
+        auto idle = std::chrono::milliseconds(static_cast<int64_t>(idleSeconds * 1000.0));
+
+        std::vector<std::string> failures;
+        runner.run(idle);
+        resident::Stats stats = runner.stats();
+        std::cout << "static preset, " << idleSeconds << " s idle: ";
+        resident::printStats(std::cout, stats);
+        if (stats.timerWakeups != 0 || stats.wakeups != 0)
+            failures.push_back("static preset woke up " + std::to_string(stats.wakeups) + " times");
+
+        runner.control("add cycle:ocean:2");
+        runner.run(std::chrono::milliseconds(300));
+        uint64_t animatedWakeups = runner.stats().timerWakeups;
+        std::cout << "cycle layer, 0.3 s: " << animatedWakeups << " timer wakeups\n";
+        if (animatedWakeups == 0)
+            failures.push_back("frame timer never fired while animating");
+
+        runner.control("remove cycle:ocean");
+        runner.run(idle);
+        uint64_t after = runner.stats().timerWakeups - animatedWakeups;
+        std::cout << "cycle removed, " << idleSeconds << " s idle: " << after << " timer wakeups\n";
+        if (after != 0)
+            failures.push_back("frame timer still fired " + std::to_string(after) + " times after animation stopped");
+
+        // Fades run on the runner's clock, so this one ends 0.3 s from now.
+        double fadeEnd = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() + 0.3;
+        runner.control("add fade:ocean:fire:" + std::to_string(fadeEnd));
+        uint64_t before = runner.stats().timerWakeups;
+        runner.run(std::chrono::milliseconds(600));
+        uint64_t fading = runner.stats().timerWakeups - before;
+        runner.run(idle);
+        uint64_t settled = runner.stats().timerWakeups - before - fading;
+        std::cout << "fade, 0.6 s: " << fading << " timer wakeups; fade finished, " << idleSeconds << " s idle: " << settled << " timer wakeups\n";
+        if (fading == 0)
+            failures.push_back("frame timer never fired while fading");
+        if (settled != 0)
+            failures.push_back("frame timer still fired " + std::to_string(settled) + " times after the fade finished");
+
+        if (!failures.empty())
+        {
+            for (const auto &failure : failures)
+                std::cerr << MSG_ERR(failure) << "\n";
+            throw std::runtime_error("run self-check failed");
+        }
+        std::cout << "[OK] Idle loop is tickless" << std::endl;
+    }
+
+    // Swaps a reloaded config in on the main loop: user presets, brightness, the config's own
+    // layers at the bottom of the stack and the frame rate. The layers are built first, so a
+    // spec that fails to build rejects the config before anything changes. base holds the
+    // names of the layers the running config put in.
+    inline void applyConfig(compositor::Compositor &comp, resident::Runner *runner, const config::Config &next, const config::Config *previous,
+                            std::vector<std::string> &base)
+    {
+        std::vector<compositor::Layer> layers = config::buildLayers(next);
+        std::vector<std::string> names;
+        for (const auto &layer : layers)
+            names.push_back(layer.name);
+        presets::userPresets() = next.userPresets;
+        if (next.brightness && (!previous || previous->brightness != next.brightness))
+            omen::fs::writeSysfs(BRIGHTNESS_PATH, std::to_string(*next.brightness));
+        comp.replaceBase(base, std::move(layers));
+        base = std::move(names);
+        if (runner && (!previous || previous->fps != next.fps))
+            runner->setFps(next.fps);
+    }
+
+    inline void cmdRun(const std::vector<std::string> &args)
+    {
+        double fps = 0.0;
+        dither::Mode mode = dither::Mode::Auto;
+        std::string fifo = resident::defaultFifoPath(), configPath;
+        std::vector<std::string> specs;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--fps" && i + 1 < args.size())
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--dither" && i + 1 < args.size())
+                mode = dither::parseMode(args[++i]);
+            else if (args[i] == "--fifo" && i + 1 < args.size())
+                fifo = args[++i];
+            else if (args[i] == "--config" && i + 1 < args.size())
+                configPath = args[++i] == "default" ? config::defaultPath() : args[i];
+            else if (args[i] == "--self-check")
+                return runSelfCheck(i + 1 < args.size() ? compositor::parseNumber(args[i + 1], "idle seconds") : 2.0);
             else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+                specs.push_back(args[i]);
+        }
+        if (specs.empty() && configPath.empty())
+        {
+            std::cerr << "Usage: " << CMD_RUN << " [--fps N] [--dither auto|on|off] [--fifo path] [--config <path|default>] [layer...]\n"
+                      << "       " << CMD_RUN << " --self-check [idle-seconds]\n";
+            return;
         }
+
+        compositor::Compositor comp;
+        std::shared_ptr<const config::Config> current;
+        std::vector<std::string> base;
+        if (!configPath.empty())
+        {
+            current = config::parse(configPath, comp.zones());
+            applyConfig(comp, nullptr, *current, nullptr, base);
+        }
+        for (const auto &spec : specs)
+            comp.add(compositor::parseLayer(spec));
+
+        resident::Runner runner(comp, fps > 0.0 ? fps : current ? current->fps : 30.0, [&comp](const std::string &line)
+                                { return composeControl(comp, line); });
+        runner.setDither(mode);
+        runner.openFifo(fifo);
+        runner.handleSignals();
+
+        std::unique_ptr<config::Reloader> reloader;
+        size_t reloads = 0, rejected = 0;
+        if (current)
+        {
+            reloader = std::make_unique<config::Reloader>(current, comp.zones());
+            runner.watch(reloader->fd(), [&]()
+                         {
+                             std::optional<config::Reload> reload = reloader->take();
+                             if (!reload)
+                                 return;
+                             if (!reload->config)
+                             {
+                                 ++rejected;
+                                 std::cerr << MSG_ERR("Config rejected, keeping the running one: " + reload->error) << std::endl;
+                                 return;
+                             }
+                             // An explicit --fps stays in force over the config's.
+                             auto next = std::make_shared<config::Config>(*reload->config);
+                             if (fps > 0.0)
+                                 next->fps = fps;
+                             try
+                             {
+                                 applyConfig(comp, &runner, *next, current.get(), base);
+                             }
+                             catch (const std::exception &e)
+                             {
+                                 ++rejected;
+                                 std::cerr << MSG_ERR(std::string("Config rejected, keeping the running one: ") + e.what()) << std::endl;
+                                 return;
+                             }
+                             current = std::move(next);
+                             ++reloads;
+                             std::cout << "[OK] Config reloaded: parsed in " << std::fixed << std::setprecision(2) << reload->parseMs << " ms, applied "
+                                       << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reload->noticed).count()
+                                       << " ms after the change" << std::defaultfloat << std::endl;
+                         });
+            std::cout << "[OK] Watching " << configPath << " for changes" << std::endl;
+        }
+        std::cout << "[OK] Running " << comp.names().size() << " layers. Write add <layer>, remove <name>, list, stats or quit to " << fifo << std::endl;
+        runner.run();
+
+        std::cout << "[OK] Stopped after " << runner.writes() << " zone writes";
+        if (current)
+            std::cout << ", " << reloads << " config reloads, " << rejected << " rejected";
+        std::cout << "." << std::endl;
+        resident::printStats(std::cout, runner.stats());
     }
 
-    inline void cmdAro()
+    // Cycles a preset at the highest frame rate the driver sustains; on battery the rate is
+    // capped, or the cycle is held still or handed to the firmware wave mode.
+    inline void cmdCycle(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0x3AA63F, 0xA8D47A, 0xFFFFFF, 0xABABAB, 0x000000};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        adaptive::Limits limits;
+        double period = 8.0;
+        std::string preset, onBattery = "lower";
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--period" && hasValue)
+                period = compositor::parseNumber(args[++i], "period");
+            else if (args[i] == "--max-fps" && hasValue)
+                limits.maxFps = compositor::parseNumber(args[++i], "max fps");
+            else if (args[i] == "--min-fps" && hasValue)
+                limits.minFps = compositor::parseNumber(args[++i], "min fps");
+            else if (args[i] == "--battery-fps" && hasValue)
+                limits.batteryFps = compositor::parseNumber(args[++i], "battery fps");
+            else if (args[i] == "--on-battery" && hasValue)
+                onBattery = utils::toLower(args[++i]);
+            else
+                preset = args[i];
+        }
+        if (preset.empty() || limits.minFps <= 0.0 || limits.maxFps < limits.minFps ||
+            (onBattery != "lower" && onBattery != "static" && onBattery != "firmware"))
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            std::cerr << "Usage: " << CMD_CYCLE << " <preset> [--period S] [--min-fps N] [--max-fps N] [--battery-fps N] [--on-battery lower|static|firmware]\n";
+            return;
+        }
+
+        compositor::Compositor comp;
+        comp.add(compositor::cycleLayer(preset, period));
+        output::ZoneWriter writer(comp.zones());
+        adaptive::Governor governor(limits);
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        const auto powerInterval = std::chrono::seconds(2);
+        auto nextPowerCheck = start;
+        auto nextFrame = start;
+        power::Source source = power::Source::Unknown;
+        bool held = false, stdinOpen = true, first = true;
+        size_t frames = 0;
+
+        std::cout << "[OK] Cycling " << preset << " every " << period << " s, " << limits.minFps << "-" << limits.maxFps
+                  << " fps, on battery: " << onBattery << ". Type quit to stop." << std::endl;
+        for (;;)
+        {
+            auto now = Clock::now();
+            if (now >= nextPowerCheck)
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                nextPowerCheck = now + powerInterval;
+                power::Source current = power::read();
+                if (current != source || first)
+                {
+                    source = current;
+                    first = false;
+                    bool battery = source == power::Source::Battery;
+                    if (held && !battery && onBattery == "firmware")
+                        omen::fs::writeSysfs(ANIMATION_MODE_PATH, "static");
+                    held = battery && onBattery != "lower";
+                    if (held && onBattery == "firmware")
+                    {
+                        uint8_t speed;
+                        double achieved;
+                        offload::speedFor(period, speed, achieved);
+                        auto colors = presets::get(utils::toLower(preset)).colors;
+                        writer.write(colors.data(), colors.size());
+                        omen::fs::writeSysfs(ANIMATION_MODE_PATH, "wave");
+                        omen::fs::writeSysfs(ANIMATION_SPEED_PATH, std::to_string(speed));
+                    }
+                    governor.adjust(source);
+                    std::cout << "[OK] Power source " << power::sourceName(source) << ": "
+                              << (held ? (onBattery == "firmware" ? "handed to firmware wave" : "holding the current frame")
+                                       : "rendering at " + std::to_string(static_cast<int>(governor.fps())) + " fps")
+                              << std::endl;
+                }
             }
-            else
+
+            if (!held && now >= nextFrame)
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                comp.compose(std::chrono::duration<double>(now - start).count());
+                size_t before = writer.writes();
+                auto writeStart = Clock::now();
+                writer.write(comp.frame(), comp.zones());
+                if (writer.writes() != before)
+                    governor.record(std::chrono::duration<double>(Clock::now() - writeStart).count());
+                ++frames;
+
+                double previous = governor.fps();
+                if (governor.adjust(source))
+                    std::cout << "[OK] fps " << previous << " -> " << governor.fps() << " (p90 frame write "
+                              << std::fixed << std::setprecision(3) << governor.latency().percentile(0.9) * 1e3
+                              << " ms)" << std::defaultfloat << std::endl;
+                nextFrame += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / governor.fps()));
+                if (nextFrame < now)
+                    nextFrame = now;
+            }
+
+            auto wake = held ? nextPowerCheck : std::min(nextFrame, nextPowerCheck);
+            int timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(wake - Clock::now()).count()));
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, stdinOpen ? 1 : 0, timeout) <= 0)
+                continue;
+
+            char buffer[256];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                stdinOpen = false;
+                continue;
             }
+            std::vector<std::string> words = utils::split(std::string(buffer, static_cast<size_t>(n)));
+            if (!words.empty() && (utils::toLower(words[0]) == "quit" || words[0] == CMD_EXIT))
+                break;
         }
+
+        std::cout << "[OK] Cycle stopped after " << frames << " frames, " << writer.writes() << " zone writes, final "
+                  << governor.fps() << " fps." << std::endl;
     }
 
-    inline void cmdDemi()
+    inline void cmdReact(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0x7F7F7F, 0xFFFFFF, 0x7F7F7F};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        double interval = 1.0;
+        int steps = 20;
+        std::vector<std::string> specs;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--interval" && i + 1 < args.size())
+                interval = compositor::parseNumber(args[++i], "interval");
+            else if (args[i] == "--steps" && i + 1 < args.size())
+                steps = static_cast<int>(compositor::parseNumber(args[++i], "steps"));
+            else
+                specs.push_back(args[i]);
+        }
+        if (specs.empty() || interval <= 0.0 || steps < 1)
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            std::cerr << "Usage: " << CMD_REACT << " [--interval S] [--steps N] <zone>=<cpu|temp|battery>[:<low>-<high>][:<hex>,<hex>...]...\n";
+            return;
+        }
+
+        std::vector<metrics::Binding> bindings;
+        std::unordered_map<std::string, std::unique_ptr<metrics::Source>> sources;
+        for (const auto &spec : specs)
+        {
+            bindings.push_back(metrics::parseBinding(spec));
+            bindings.back().gradient.steps = steps;
+            auto &source = sources[bindings.back().metric];
+            if (!source)
+                source = metrics::makeSource(bindings.back().metric);
+        }
+
+        using Clock = std::chrono::steady_clock;
+        output::ZoneWriter writer;
+        std::unordered_map<std::string, double> values;
+        size_t ticks = 0;
+        bool stdinOpen = true;
+        std::chrono::nanoseconds sampling{0}, slowest{0};
+        const double cpuStart = resident::cpuSeconds();
+
+        auto report = [&]()
+        {
+            double avg = ticks ? std::chrono::duration<double, std::micro>(sampling).count() / ticks : 0.0;
+            std::cout << "[OK] " << ticks << " samples, " << writer.writes() << " zone writes, sampling avg "
+                      << std::fixed << std::setprecision(1) << avg << " us max "
+                      << std::chrono::duration<double, std::micro>(slowest).count() << " us, process CPU "
+                      << (resident::cpuSeconds() - cpuStart) * 1e3 << " ms" << std::defaultfloat << std::endl;
+        };
+
+        std::cout << "[OK] Reacting to " << sources.size() << " metrics every " << interval << " s. Stdin: stats, quit" << std::endl;
+        auto nextTick = Clock::now();
+        for (;;)
+        {
+            if (Clock::now() >= nextTick)
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                auto start = Clock::now();
+                for (auto &[name, source] : sources)
+                    values[name] = source->sample();
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+                sampling += elapsed;
+                slowest = std::max(slowest, elapsed);
+                ++ticks;
+
+                for (const auto &binding : bindings)
+                    writer.writeZone(binding.zone, binding.gradient.at(values[binding.metric]));
+                nextTick += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
             }
-            else
+
+            int timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(nextTick - Clock::now()).count()));
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, stdinOpen ? 1 : 0, timeout) <= 0)
+                continue;
+
+            char buffer[256];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0)
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                stdinOpen = false;
+                continue;
             }
+            std::vector<std::string> words = utils::split(std::string(buffer, static_cast<size_t>(n)));
+            if (!words.empty() && utils::toLower(words[0]) == "stats")
+                report();
+            else if (!words.empty() && (utils::toLower(words[0]) == "quit" || words[0] == CMD_EXIT))
+                break;
         }
+        report();
     }
 
-    inline void cmdUsa()
+    // Plays WAV (paced to its own clock) or raw s16le PCM from stdin through the analyzer, one
+    // frame per hop. --offline analyses as fast as possible and prints frames instead of writing zones.
+    inline void cmdAudio(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0xB22234, 0xFFFFFF, 0x3C3B6E};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
+        audio::Format format;
+        std::string path, palette = "fire", unknown;
+        double fps = 60.0;
+        size_t fftSize = 1024, hopSize = 0;
+        bool raw = false, offline = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--raw")
+                raw = true;
+            else if (args[i] == "--offline")
+                offline = true;
+            else if (args[i] == "--rate" && hasValue)
+                format.rate = static_cast<uint32_t>(compositor::parseNumber(args[++i], "rate"));
+            else if (args[i] == "--channels" && hasValue)
+                format.channels = static_cast<uint16_t>(compositor::parseNumber(args[++i], "channels"));
+            else if (args[i] == "--fps" && hasValue)
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--fft" && hasValue)
+                fftSize = static_cast<size_t>(compositor::parseNumber(args[++i], "fft size"));
+            else if (args[i] == "--hop" && hasValue)
+                hopSize = static_cast<size_t>(compositor::parseNumber(args[++i], "hop"));
+            else if (args[i] == "--preset" && hasValue)
+                palette = args[++i];
+            else if (path.empty() && (args[i] == "-" || args[i].rfind("--", 0) != 0))
+                path = args[i];
+            else if (unknown.empty())
+                unknown = args[i];
+        }
+        if (!unknown.empty())
+            std::cerr << "Unknown argument: " << unknown << "\n";
+        if (!unknown.empty() || (path.empty() && !raw) || fps <= 0.0 || format.rate == 0 || format.channels == 0)
+        {
+            std::cerr << "Usage: " << CMD_AUDIO << " <file.wav|-> [--fps N | --hop N] [--fft N] [--preset name] [--offline]\n"
+                      << "       " << CMD_AUDIO << " --raw [--rate N] [--channels N] ...   (s16le PCM on stdin)\n";
+            return;
         }
+
+        std::ifstream file;
+        std::istream *in = &std::cin;
+        if (!path.empty() && path != "-")
+        {
+            file.open(path, std::ios::binary);
+            if (!file)
+                throw std::runtime_error("Failed to open " + path);
+            in = &file;
+        }
+        if (!raw)
+            format = audio::readWavHeader(*in);
+        const bool paced = !offline && in == &file;
+
+        const size_t hop = hopSize ? hopSize : std::max<size_t>(1, static_cast<size_t>(std::lround(format.rate / fps)));
+        if (hop > fftSize)
+            throw std::invalid_argument("Hop of " + std::to_string(hop) + " samples is longer than the " + std::to_string(fftSize) +
+                                        "-point FFT, so samples would be skipped; raise --fft" + (hopSize ? "" : " or --fps"));
+        audio::Analyzer analyzer(fftSize, format.rate, hop);
+        audio::Visualizer visualizer(presets::get(utils::toLower(palette)).colors, 0.85f);
+        output::ZoneWriter writer;
+        std::vector<float> window(analyzer.size(), 0.0f);
+        std::vector<unsigned char> bytes(hop * format.frameBytes());
+        std::vector<RGB_HEX> frame(writer.zones());
+        std::string text;
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        std::chrono::nanoseconds analysis{0}, slowest{0}, latency{0}, worstLatency{0};
+        size_t hops = 0, samples = 0;
+
+        std::cerr << "[OK] " << format.rate << " Hz, " << format.channels << " ch, " << format.bits << " bit; FFT " << analyzer.size()
+                  << ", hop " << hop << " samples (" << std::setprecision(4) << format.rate / static_cast<double>(hop) << " frames/s)" << std::endl;
+        for (;;)
+        {
+            in->read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            size_t got = static_cast<size_t>(in->gcount()) / format.frameBytes();
+            if (got == 0)
+                break;
+            samples += got;
+
+            // The hop is "heard" once its last sample is due on the file's clock, or once it arrived on stdin.
+            auto ready = Clock::now();
+            if (paced)
+            {
+                ready = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(samples) / format.rate));
+                std::this_thread::sleep_until(ready);
+            }
+
+            auto t0 = Clock::now();
+            std::memmove(window.data(), window.data() + got, (window.size() - std::min(got, window.size())) * sizeof(float));
+            size_t keep = std::min(got, window.size());
+            audio::decode(bytes.data() + (got - keep) * format.frameBytes(), keep, format, window.data() + window.size() - keep);
+            audio::Levels levels = analyzer.analyze(window.data());
+            visualizer.render(levels, frame.data(), frame.size());
+            auto spent = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0);
+            analysis += spent;
+            slowest = std::max(slowest, spent);
+            ++hops;
+
+            if (offline)
+            {
+                for (size_t i = 0; i < frame.size(); ++i)
+                    (text += utils::hex6(frame[i])) += i + 1 < frame.size() ? ' ' : '\n';
+                continue;
+            }
+            writer.write(frame.data(), frame.size());
+            auto endToEnd = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - ready);
+            latency += endToEnd;
+            worstLatency = std::max(worstLatency, endToEnd);
+        }
+        std::cout << text << std::flush;
+
+        if (!hops)
+            throw std::runtime_error("No audio samples read");
+        double audioSeconds = static_cast<double>(samples) / format.rate;
+        double analysisSeconds = std::chrono::duration<double>(analysis).count();
+        std::cerr << std::fixed << std::setprecision(1) << "[OK] " << hops << " hops, " << audioSeconds << " s of audio; analysis avg "
+                  << analysisSeconds / hops * 1e6 << " us, max " << std::chrono::duration<double, std::micro>(slowest).count()
+                  << " us per hop (" << std::setprecision(0) << audioSeconds / analysisSeconds << "x real time)" << std::setprecision(1);
+        if (!offline)
+            std::cerr << "; end-to-end avg " << std::chrono::duration<double, std::milli>(latency).count() / hops << " ms, max "
+                      << std::chrono::duration<double, std::milli>(worstLatency).count() << " ms";
+        std::cerr << "; window delay " << 500.0 * analyzer.size() / format.rate << " ms" << std::defaultfloat << std::endl;
     }
 
-    inline void cmdUk()
+    // Averages each PPM frame on stdin into one vertical band per zone, left to right.
+    inline void cmdAmbient(const std::vector<std::string> &args)
     {
-        std::vector<RGB_HEX> colors = {0x012169, 0xFFFFFF, 0xC8102E};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+        double smoothing = 0.3;
+        int threshold = 3;
+        size_t rowStep = 1, zones = 0;
+        std::string unknown;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--smooth" && hasValue)
+                smoothing = compositor::parseNumber(args[++i], "smoothing");
+            else if (args[i] == "--threshold" && hasValue)
+                threshold = static_cast<int>(compositor::parseNumber(args[++i], "threshold"));
+            else if (args[i] == "--row-step" && hasValue)
+                rowStep = static_cast<size_t>(compositor::parseNumber(args[++i], "row step"));
+            else if (args[i] == "--zones" && hasValue)
+                zones = static_cast<size_t>(compositor::parseNumber(args[++i], "zones"));
+            else if (unknown.empty())
+                unknown = args[i];
+        }
+        if (!unknown.empty())
+            std::cerr << "Unknown argument: " << unknown << "\n";
+        if (!unknown.empty() || smoothing <= 0.0 || smoothing > 1.0 || threshold < 0 || rowStep == 0)
+        {
+            std::cerr << "Usage: " << CMD_AMBIENT << " [--smooth 0-1] [--threshold N] [--row-step N] [--zones N] < frames.ppm\n";
+            return;
+        }
+        if (zones == 0)
+            zones = output::discoverZones();
+
+        output::ZoneWriter writer(zones);
+        ambient::PpmReader reader(STDIN_FILENO);
+        ambient::Smoother smoother(zones, smoothing, threshold);
+        ambient::Frame frame;
+        std::vector<RGB_HEX> bands(zones);
+
+        using Clock = std::chrono::steady_clock;
+        std::chrono::nanoseconds total{0}, slowest{0};
+        size_t frames = 0;
+        std::cerr << "[OK] Ambient over " << zones << " zones (" << color::backendName(ambient::bestBackend()) << " reduction)" << std::endl;
+        for (;;)
+        {
+            auto start = Clock::now();
+            if (!reader.next(frame))
+                break;
+            ambient::reduce(frame, zones, bands.data(), rowStep);
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+            total += elapsed;
+            slowest = std::max(slowest, elapsed);
+            ++frames;
+
+            RGB_HEX color;
+            for (size_t zone = 0; zone < zones; ++zone)
+                if (smoother.update(zone, bands[zone], color))
+                    writer.writeZone(zone, color);
+        }
+
+        if (frames)
+            std::cerr << "[OK] " << frames << " frames of " << frame.width << "x" << frame.height << ", decode+reduce avg "
+                      << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>(total).count() / frames
+                      << " ms, max " << std::chrono::duration<double, std::milli>(slowest).count() << " ms; "
+                      << writer.writes() << " zone writes" << std::defaultfloat << std::endl;
+    }
+
+    // Keypress effects from an evdev node, a FIFO or a recorded capture of struct input_event.
+    // Captures are replayed on their own timestamps; --offline prints one frame per key press.
+    inline void cmdTyping(const std::vector<std::string> &args)
+    {
+        std::string path, effectName = "ripple", palette = "ocean", recordPath;
+        double fps = 60.0;
+        size_t zones = 0;
+        bool offline = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--offline")
+                offline = true;
+            else if (args[i] == "--effect" && hasValue)
+                effectName = utils::toLower(args[++i]);
+            else if (args[i] == "--preset" && hasValue)
+                palette = utils::toLower(args[++i]);
+            else if (args[i] == "--fps" && hasValue)
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--zones" && hasValue)
+                zones = static_cast<size_t>(compositor::parseNumber(args[++i], "zones"));
+            else if (args[i] == "--record" && hasValue)
+                recordPath = args[++i];
+            else
+                path = args[i];
+        }
+        if (path.empty() || fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_TYPING << " <device|capture|fifo> [--effect ripple|heatmap] [--preset name] [--fps N]\n"
+                      << "       " << std::string(std::strlen(CMD_TYPING), ' ') << " [--zones N] [--record file] [--offline]\n";
+            return;
+        }
+        if (zones == 0)
+            zones = offline ? ZONE_COUNT : output::discoverZones();
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        struct stat info = {};
+        fstat(fd, &info);
+        const bool device = S_ISCHR(info.st_mode), replay = S_ISREG(info.st_mode);
+
+        // Device events are stamped on the monotonic clock when the driver allows it, so
+        // latency can be measured from the kernel's stamp rather than from our read.
+        int clockId = CLOCK_MONOTONIC;
+        const bool kernelStamps = device && ioctl(fd, EVIOCSCLOCKID, &clockId) == 0;
+
+        int record = -1;
+        if (!recordPath.empty() && (record = open(recordPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+            throw std::runtime_error("Failed to open " + recordPath + ": " + std::strerror(errno));
+
+        auto effect = typing::makeEffect(effectName, presets::get(palette).colors);
+        output::ZoneWriter writer(zones);
+        typing::EventReader reader(fd);
+        std::vector<input_event> events;
+        std::vector<RGB_HEX> frame(zones);
+        std::vector<double> latencies;
+        size_t presses = 0, frames = 0, recorded = 0;
+
+        auto monotonic = []()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+        };
+        auto show = [&](double t)
+        {
+            effect->render(t, frame.data(), zones);
+            writer.write(frame.data(), zones);
+            ++frames;
+        };
+        auto keep = [&](const input_event &event)
+        {
+            if (record >= 0 && write(record, &event, sizeof(event)) == static_cast<ssize_t>(sizeof(event)))
+                ++recorded;
+        };
+
+        const double period = 1.0 / fps;
+        if (offline)
+        {
+            double first = -1.0;
+            while (reader.read(events))
+                ;
+            for (const auto &event : events)
+            {
+                keep(event);
+                if (!typing::isKeyPress(event))
+                    continue;
+                first = first < 0.0 ? typing::eventSeconds(event) : first;
+                double t = typing::eventSeconds(event) - first;
+                effect->press(typing::keyZone(event.code, zones), t);
+                effect->render(t, frame.data(), zones);
+                ++presses;
+                std::cout << std::fixed << std::setprecision(3) << t << std::defaultfloat;
+                for (RGB_HEX c : frame)
+                    std::cout << ' ' << utils::hex6(c);
+                std::cout << '\n';
+            }
+            std::cout << std::flush;
+            std::cerr << "[OK] " << presses << " key presses from " << events.size() << " events" << std::endl;
+        }
+        else
+        {
+            std::cerr << "[OK] " << effectName << " on " << zones << " zones from " << (device ? "device" : replay ? "capture" : "stream")
+                      << " " << path << (kernelStamps ? " (latency from kernel timestamps)" : "") << std::endl;
+            const double start = monotonic();
+            double nextFrame = 0.0, first = -1.0;
+            bool reading = true;
+            size_t next = 0;
+            std::vector<double> stamps;
+            for (;;)
+            {
+                double now = monotonic() - start;
+                if (effect->active(now) && now >= nextFrame)
+                {
+                    show(now);
+                    nextFrame = now + period;
+                }
+                if (!reading && !effect->active(now))
+                    break;
+
+                // A capture's next event is due at its offset from the first one; live sources
+                // are polled until the next frame, or indefinitely while the effect is idle.
+                double due = nextFrame;
+                if (replay && reading && next == events.size())
+                {
+                    events.clear();
+                    next = 0;
+                    reading = reader.read(events);
+                    continue;
+                }
+                if (replay && reading)
+                {
+                    first = first < 0.0 ? typing::eventSeconds(events[next]) : first;
+                    double eventDue = typing::eventSeconds(events[next]) - first;
+                    if (!effect->active(now) || eventDue < due)
+                        due = eventDue;
+                }
+                timespec wait{}, *timeout = nullptr;
+                if (replay || effect->active(now))
+                {
+                    double seconds = std::max(0.0, due - now);
+                    wait.tv_sec = static_cast<time_t>(seconds);
+                    wait.tv_nsec = static_cast<long>((seconds - static_cast<double>(wait.tv_sec)) * 1e9);
+                    timeout = &wait;
+                }
+
+                pollfd pfd{fd, POLLIN, 0};
+                int ready = ppoll(&pfd, replay || !reading ? 0 : 1, timeout, nullptr);
+                now = monotonic() - start;
+
+                bool pressed = false;
+                stamps.clear();
+                if (replay && reading)
+                {
+                    for (; next < events.size() && typing::eventSeconds(events[next]) - first <= now; ++next)
+                    {
+                        keep(events[next]);
+                        if (!typing::isKeyPress(events[next]))
+                            continue;
+                        effect->press(typing::keyZone(events[next].code, zones), now);
+                        stamps.push_back(start + typing::eventSeconds(events[next]) - first);
+                        pressed = true;
+                    }
+                }
+                else if (ready > 0)
+                {
+                    events.clear();
+                    reading = reader.read(events);
+                    double arrived = monotonic();
+                    for (const auto &event : events)
+                    {
+                        keep(event);
+                        if (!typing::isKeyPress(event))
+                            continue;
+                        effect->press(typing::keyZone(event.code, zones), now);
+                        stamps.push_back(kernelStamps ? typing::eventSeconds(event) : arrived);
+                        pressed = true;
+                    }
+                }
+
+                if (pressed)
+                {
+                    show(now);
+                    nextFrame = now + period;
+                    double written = monotonic();
+                    for (double stamp : stamps)
+                        latencies.push_back((written - stamp) * 1e6);
+                    presses += stamps.size();
+                }
+            }
+
+            std::sort(latencies.begin(), latencies.end());
+            double sum = 0.0;
+            for (double l : latencies)
+                sum += l;
+            std::cerr << "[OK] " << presses << " key presses, " << frames << " frames, " << writer.writes() << " zone writes";
+            if (!latencies.empty())
+                std::cerr << std::fixed << std::setprecision(1) << "; input-to-light avg " << sum / latencies.size() << " us, p99 "
+                          << latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)] << " us, max "
+                          << latencies.back() << " us" << std::defaultfloat;
+            std::cerr << std::endl;
+        }
+
+        if (record >= 0)
+        {
+            close(record);
+            std::cerr << "[OK] Recorded " << recorded << " events to " << recordPath << std::endl;
+        }
+        close(fd);
+    }
+
+    // Follows an IIO light sensor, writing the brightness attribute only when the ramped level changes.
+    inline void cmdAutoBrightness(const std::vector<std::string> &args)
+    {
+        double interval = 0.5;
+        std::string curveSpec = illuminance::Curve::DEFAULT, device;
+        illuminance::Settings settings;
+        bool once = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--once")
+                once = true;
+            else if (args[i] == "--interval" && hasValue)
+                interval = compositor::parseNumber(args[++i], "interval");
+            else if (args[i] == "--curve" && hasValue)
+                curveSpec = args[++i];
+            else if (args[i] == "--threshold" && hasValue)
+                settings.threshold = compositor::parseNumber(args[++i], "threshold");
+            else if (args[i] == "--rate" && hasValue)
+                settings.rate = compositor::parseNumber(args[++i], "rate");
+            else if (args[i] == "--smooth" && hasValue)
+                settings.smoothing = compositor::parseNumber(args[++i], "smoothing");
+            else if (args[i] == "--sensor" && hasValue)
+                device = args[++i];
+            else
+                interval = -1.0;
+        }
+        if (interval <= 0.0 || settings.threshold < 0.0 || settings.rate <= 0.0 || settings.smoothing <= 0.0 || settings.smoothing > 1.0)
+        {
+            std::cerr << "Usage: " << CMD_AUTO_BRIGHTNESS << " [--interval S] [--curve <lux>:<percent>,...] [--threshold N] [--rate N/s]\n"
+                      << "       " << std::string(std::strlen(CMD_AUTO_BRIGHTNESS), ' ') << " [--smooth 0-1] [--sensor <iio device dir>] [--once]\n";
+            return;
+        }
+
+        illuminance::Sensor sensor(device);
+        int initial = -1;
+        try
+        {
+            initial = std::stoi(omen::fs::readSysfs(BRIGHTNESS_PATH));
+        }
+        catch (const std::exception &)
+        {
+        }
+        illuminance::Controller controller(illuminance::Curve(curveSpec), settings, initial);
+
+        size_t samples = 0, writes = 0;
+        auto sample = [&](double elapsed)
+        {
+            ++samples;
+            if (!controller.update(sensor.lux(), elapsed))
+                return;
+            ++writes;
+            if (!omen::fs::writeSysfs(BRIGHTNESS_PATH, std::to_string(controller.level())))
+                std::cerr << MSG_ERR("Could not set brightness.") << "\n";
+            else
+                std::cout << "[OK] " << std::fixed << std::setprecision(1) << controller.lux() << " lux -> brightness "
+                          << controller.level() << " (target " << controller.target() << ")" << std::defaultfloat << std::endl;
+        };
+
+        std::cout << "[OK] Following " << sensor.path() << (initial >= 0 ? ", from brightness " + std::to_string(initial) : "") << std::endl;
+        if (once)
+        {
+            // Jump straight to the target instead of ramping.
+            sample(1e9);
+            return;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        auto last = Clock::now(), nextTick = last;
+        bool stdinOpen = true;
+        for (;;)
+        {
+            if (Clock::now() >= nextTick)
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                auto now = Clock::now();
+                sample(std::chrono::duration<double>(now - last).count());
+                last = now;
+                nextTick += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
             }
+
+            int timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(nextTick - Clock::now()).count()));
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, stdinOpen ? 1 : 0, timeout) <= 0)
+                continue;
+
+            char buffer[256];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                stdinOpen = false;
+                continue;
+            }
+            std::vector<std::string> words = utils::split(std::string(buffer, static_cast<size_t>(n)));
+            if (!words.empty() && (utils::toLower(words[0]) == "quit" || words[0] == CMD_EXIT))
+                break;
+        }
+        std::cout << "[OK] " << samples << " samples, " << writes << " brightness writes" << std::endl;
+    }
+
+    // Runs the server on an ephemeral port over a scratch keyboard and drives it with a
+    // scripted client: handshake, controller data, then per-LED and single-LED updates
+    // checked against the zones.
+    inline void openRgbSelfCheck()
+    {
+        omen::fs::Scratch scratch(ZONE_COUNT);
+        const size_t zones = output::discoverZones();
+        std::vector<std::string> original(zones), failures;
+        for (size_t zone = 0; zone < zones; ++zone)
+        {
+            original[zone] = utils::hex6(static_cast<RGB_HEX>(0x0A141E * (zone + 1)) & 0xFFFFFF);
+            omen::fs::writeRecorded(utils::zonePath(zone), original[zone]);
+        }
+
+        openrgb::Server server(zones, 0, 1000.0);
+        std::thread thread([&server]()
+                           { server.run(); });
+        try
+        {
+            openrgb::ScriptClient client(server.port());
+            openrgb::Writer version, name, none;
+            version.u32(openrgb::PROTOCOL_VERSION);
+            std::vector<unsigned char> reply = client.request(openrgb::REQUEST_PROTOCOL_VERSION, version);
+            uint32_t negotiated = openrgb::Reader(reply.data(), reply.size()).u32();
+            name.raw("self-check", 11);
+            client.send(openrgb::SET_CLIENT_NAME, name);
+            reply = client.request(openrgb::REQUEST_CONTROLLER_COUNT, none);
+            uint32_t count = openrgb::Reader(reply.data(), reply.size()).u32();
+            auto controller = [&]()
+            {
+                std::vector<unsigned char> data = client.request(openrgb::REQUEST_CONTROLLER_DATA, version);
+                openrgb::Reader r(data.data(), data.size());
+                return openrgb::parseController(r, openrgb::PROTOCOL_VERSION);
+            };
+            openrgb::Controller before = controller();
+            std::cout << "protocol " << negotiated << ", " << count << " controller: " << before.name << " at " << before.location << ", "
+                      << before.zones.size() << " zones, " << before.modes << " modes\n";
+            if (negotiated != openrgb::PROTOCOL_VERSION || count != 1)
+                failures.push_back("handshake returned protocol " + std::to_string(negotiated) + " and " + std::to_string(count) + " controllers");
+            if (before.zones.size() != zones || before.colors.size() != zones)
+                failures.push_back("controller reports " + std::to_string(before.colors.size()) + " zones instead of " + std::to_string(zones));
+            if (before.location != omen::fs::resolve(omen::fs::selection().devices.front().path) && omen::fs::selection().devices.size() == 1)
+                failures.push_back("controller location is " + before.location);
+            for (size_t zone = 0; zone < std::min(zones, before.colors.size()); ++zone)
+                if (utils::hex6(before.colors[zone]) != original[zone])
+                    failures.push_back("zone " + std::to_string(zone) + " reported as " + utils::hex6(before.colors[zone]) + ", holds " + original[zone]);
+
+            // Waits out the frame-rate limit, then checks what the zones and the controller show.
+            auto expect = [&](const std::vector<RGB_HEX> &colors, const std::string &step)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                openrgb::Controller after = controller();
+                for (size_t zone = 0; zone < zones; ++zone)
+                {
+                    const auto &device = omen::fs::readDevice(utils::zonePath(zone));
+                    std::string want = omen::fs::calibrated(device, utils::zonePath(zone), utils::hex6(colors[zone]));
+                    std::string got = omen::fs::readSysfs(utils::zonePath(zone));
+                    if (got != want)
+                        failures.push_back(step + ": zone " + std::to_string(zone) + " holds " + got + " instead of " + want);
+                    if (zone >= after.colors.size() || after.colors[zone] != colors[zone])
+                        failures.push_back(step + ": controller reports the wrong color for zone " + std::to_string(zone));
+                }
+                std::cout << step << ": " << zones << " zones checked\n";
+            };
+            std::vector<RGB_HEX> colors(zones);
+            openrgb::Writer leds, led;
+            leds.u32(static_cast<uint32_t>(4 + 2 + 4 * zones));
+            leds.u16(static_cast<uint16_t>(zones));
+            for (size_t zone = 0; zone < zones; ++zone)
+            {
+                colors[zone] = static_cast<RGB_HEX>(0x102030 + 0x302010 * zone) & 0xFFFFFF;
+                leds.u32(openrgb::toWire(colors[zone]));
+            }
+            client.send(openrgb::UPDATE_LEDS, leds);
+            expect(colors, "UpdateLEDs");
+            colors[0] = 0xFF8000;
+            led.i32(0);
+            led.u32(openrgb::toWire(colors[0]));
+            client.send(openrgb::UPDATE_SINGLE_LED, led);
+            expect(colors, "UpdateSingleLED");
+        }
+        catch (const std::exception &e)
+        {
+            failures.push_back(e.what());
+        }
+        server.stop();
+        thread.join();
+
+        if (!failures.empty())
+        {
+            for (const auto &failure : failures)
+                std::cerr << MSG_ERR(failure) << "\n";
+            throw std::runtime_error("openrgb self-check failed");
+        }
+        std::cout << "[OK] OpenRGB server answers a scripted client" << std::endl;
+    }
+
+    // Serves the keyboard to OpenRGB clients on loopback until SIGINT or SIGTERM.
+    inline void cmdOpenRgb(const std::vector<std::string> &args)
+    {
+        if (std::find(args.begin(), args.end(), "--self-check") != args.end())
+            return openRgbSelfCheck();
+        double port = openrgb::DEFAULT_PORT, maxFps = 60.0;
+        size_t zones = 0;
+        for (size_t i = 1; i + 1 < args.size(); ++i)
+        {
+            if (args[i] == "--port")
+                port = compositor::parseNumber(args[++i], "port");
+            else if (args[i] == "--max-fps")
+                maxFps = compositor::parseNumber(args[++i], "fps");
+            else if (args[i] == "--zones")
+                zones = static_cast<size_t>(compositor::parseNumber(args[++i], "zones"));
+        }
+        if (port < 1 || port > 65535 || maxFps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_OPENRGB << " [--port N] [--max-fps N] [--zones N]\n"
+                      << "       " << CMD_OPENRGB << " --self-check\n";
+            return;
+        }
+        if (zones == 0)
+            zones = output::discoverZones();
+
+        openrgb::Server server(zones, static_cast<uint16_t>(port), maxFps);
+        std::cout << "[OK] OpenRGB SDK server on 127.0.0.1:" << static_cast<int>(port) << ", " << zones << " zones, protocol "
+                  << openrgb::PROTOCOL_VERSION << ", at most " << maxFps << " frames/s" << std::endl;
+        server.run();
+
+        const auto &stats = server.stats();
+        std::cout << "[OK] " << stats.clients << " clients, " << stats.packets << " packets; " << stats.frames << " LED updates applied as "
+                  << stats.applied << " frames (" << stats.zoneWrites << " zone writes), " << stats.modeChanges << " mode changes" << std::endl;
+    }
+
+    // Shares the keyboard between clients on a Unix socket until SIGINT or SIGTERM.
+    inline void cmdServe(const std::vector<std::string> &args)
+    {
+        std::string path = arbiter::defaultSocketPath();
+        size_t zones = 0;
+        for (size_t i = 1; i + 1 < args.size(); ++i)
+        {
+            if (args[i] == "--socket")
+                path = args[++i];
+            else if (args[i] == "--zones")
+                zones = static_cast<size_t>(compositor::parseNumber(args[++i], "zones"));
+        }
+        if (zones == 0)
+            zones = output::discoverZones();
+
+        arbiter::Server server(path, zones);
+        server.handleSignals();
+        std::cout << "[OK] Serving " << zones << " zones on " << path << std::endl;
+        server.run();
+
+        const auto &stats = server.stats();
+        std::cout << "[OK] " << stats.clients << " clients, " << stats.requests << " requests in " << stats.wakeups << " wakeups, "
+                  << stats.frames << " frames, " << server.writes() << " zone writes" << std::endl;
+    }
+
+    // Compiles a text timeline, timing the parse and the write.
+    inline std::string compileTimeline(const std::string &in, const std::string &out)
+    {
+        std::ifstream file(in);
+        if (!file)
+            throw std::runtime_error("Failed to open " + in);
+        auto start = std::chrono::steady_clock::now();
+        timeline::Source source = timeline::parse(file, in);
+        timeline::compile(source, out);
+        size_t keyframes = 0;
+        for (const auto &track : source.tracks)
+            keyframes += track.size();
+        std::ostringstream oss;
+        oss << keyframes << " keyframes, " << source.events.size() << " mode changes, " << timeline::formatTime(source.duration)
+            << " compiled in " << std::fixed << std::setprecision(1)
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+        return oss.str();
+    }
+
+    inline void cmdTimeline(const std::vector<std::string> &args)
+    {
+        if (args.size() == 4 && args[1] == "compile")
+        {
+            std::string report = compileTimeline(args[2], args[3]);
+            std::cout << "[OK] " << args[3] << ": " << report << std::endl;
+        }
+        else if (args.size() == 3 && args[1] == "info")
+        {
+            auto show = timeline::Timeline::map(args[2]);
+            std::cout << args[2] << ": " << show->zones() << " zones, " << show->keyframeCount() << " keyframes, " << show->eventCount()
+                      << " mode changes, " << timeline::formatTime(show->duration()) << ", " << show->bytes() << " bytes\n";
+        }
+        else
+        {
+            std::cerr << "Usage: " << CMD_TIMELINE << " compile <show.txt> <show.omtl>\n"
+                      << "       " << CMD_TIMELINE << " info <show.omtl>\n";
+        }
+    }
+
+    // Plays a compiled timeline (text is compiled into the cache first). Frames are rendered
+    // only during transitions; keyframes and mode changes are waited for exactly.
+    inline void cmdPlay(const std::vector<std::string> &args)
+    {
+        std::string path, unknown;
+        double seek = 0.0, fps = 60.0;
+        bool loop = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--loop")
+                loop = true;
+            else if (args[i] == "--seek" && i + 1 < args.size())
+                seek = timeline::parseTime(args[++i]);
+            else if (args[i] == "--fps" && i + 1 < args.size())
+                fps = compositor::parseNumber(args[++i], "fps");
+            else if (path.empty() && args[i].rfind("--", 0) != 0)
+                path = args[i];
+            else if (unknown.empty())
+                unknown = args[i];
+        }
+        if (!unknown.empty())
+            std::cerr << "Unknown argument: " << unknown << "\n";
+        if (!unknown.empty() || path.empty() || fps <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_PLAY << " <show.omtl|show.txt> [--seek [[h:]m:]s] [--loop] [--fps N]\n";
+            return;
+        }
+
+        if (!timeline::isCompiled(path))
+        {
+            struct stat info = {};
+            stat(path.c_str(), &info);
+            uint64_t h = 0xCBF29CE484222325ull;
+            for (char c : path + ":" + std::to_string(info.st_size) + ":" + std::to_string(info.st_mtime))
+                h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+            std::string dir = frametable::cacheDir(), compiled = dir + "/" + render::hashHex(h) + ".omtl";
+            if (access(compiled.c_str(), R_OK) != 0)
+            {
+                size_t slash = dir.rfind('/');
+                if (slash != std::string::npos && slash > 0)
+                    mkdir(dir.substr(0, slash).c_str(), 0755);
+                mkdir(dir.c_str(), 0755);
+                std::string report = compileTimeline(path, compiled);
+                std::cout << "[OK] " << report << std::endl;
+            }
+            path = compiled;
+        }
+
+        auto show = timeline::Timeline::map(path);
+        timeline::Player player(*show);
+        output::ZoneWriter writer(show->zones());
+        int brightness = -1;
+        size_t modeChanges = 0;
+        auto fire = [&](const timeline::Event &event)
+        {
+            omen::fs::writeSysfs(ANIMATION_MODE_PATH, timeline::firmwareModes()[event.mode]);
+            omen::fs::writeSysfs(ANIMATION_SPEED_PATH, std::to_string(event.speed));
+            ++modeChanges;
+        };
+        if (const timeline::Event *event = player.seek(seek))
+            fire(*event);
+
+        using Clock = std::chrono::steady_clock;
+        const double duration = show->duration(), period = 1000.0 / fps;
+        auto origin = Clock::now() - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(seek));
+        std::vector<double> lateness;
+        size_t wakes = 0, frames = 0;
+        bool stdinOpen = true;
+        std::cout << "[OK] Playing " << timeline::formatTime(duration) << " on " << show->zones() << " zones from " << timeline::formatTime(seek)
+                  << (loop ? ", looping" : "") << ". Stdin: quit" << std::endl;
+
+        for (double t = seek;;)
+        {
+            player.advance(t, fire);
+            for (size_t zone = 0; zone < show->zones(); ++zone)
+                if (uint32_t color = player.sample(zone, t); color != timeline::NONE)
+                    writer.writeZone(zone, color);
+            if (uint32_t level = player.sample(show->zones(), t); level != timeline::NONE && static_cast<int>(level) != brightness)
+            {
+                brightness = static_cast<int>(level);
+                omen::fs::writeSysfs(BRIGHTNESS_PATH, std::to_string(brightness));
+            }
+            ++frames;
+
+            if (t >= duration)
+            {
+                if (!loop)
+                    break;
+                origin += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(duration));
+                if (const timeline::Event *event = player.seek(0.0))
+                    fire(*event);
+            }
+
+            // Sleep to the next keyframe or event, or one frame ahead while a transition runs.
+            bool animating = false;
+            double next = std::min<double>(player.nextChange(animating), duration);
+            double now = std::chrono::duration<double, std::milli>(Clock::now() - origin).count();
+            double wake = animating ? std::min(next, std::max(now, t) + period) : next;
+            if (duration == 0.0 && t >= duration && loop)
+                wake = now + period;
+
+            auto due = origin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(wake));
+            auto left = std::max(Clock::duration::zero(), due - Clock::now());
+            timespec timeout{static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(left).count()),
+                             static_cast<long>((left % std::chrono::seconds(1)) / std::chrono::nanoseconds(1))};
+            pollfd pfd{STDIN_FILENO, POLLIN, 0};
+            if (ppoll(&pfd, stdinOpen ? 1 : 0, &timeout, nullptr) > 0)
+            {
+                char buffer[256];
+                ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+                if (n <= 0)
+                    stdinOpen = false;
+                else if (std::string(buffer, static_cast<size_t>(n)).find("quit") != std::string::npos)
+                    break;
+                t = std::chrono::duration<double, std::milli>(Clock::now() - origin).count();
+                continue;
+            }
+            ++wakes;
+            lateness.push_back(std::chrono::duration<double, std::micro>(Clock::now() - due).count());
+            t = std::max(wake, std::chrono::duration<double, std::milli>(Clock::now() - origin).count());
+        }
+
+        std::sort(lateness.begin(), lateness.end());
+        double sum = 0.0;
+        for (double l : lateness)
+            sum += l;
+        std::cout << "[OK] " << frames << " frames, " << writer.writes() << " zone writes, " << modeChanges << " mode changes";
+        if (!lateness.empty())
+            std::cout << std::fixed << std::setprecision(1) << "; wake-up lateness avg " << sum / lateness.size() << " us, p99 "
+                      << lateness[std::min(lateness.size() - 1, lateness.size() * 99 / 100)] << " us, max " << lateness.back() << " us"
+                      << std::defaultfloat;
+        std::cout << std::endl;
+    }
+
+    // Runs a time-of-day schedule in-process, or lists its next entries with --next.
+    inline void cmdSchedule(const std::vector<std::string> &args)
+    {
+        std::string path, at, configPath;
+        size_t next = 0, zones = output::discoverZones();
+        bool usage = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            bool hasValue = i + 1 < args.size();
+            if (args[i] == "--next")
+                next = hasValue && std::isdigit(static_cast<unsigned char>(args[i + 1][0])) ? std::stoul(args[++i]) : 5;
+            else if (args[i] == "--at" && hasValue)
+                at = args[++i];
+            else if (args[i] == "--zones" && hasValue)
+                zones = static_cast<size_t>(compositor::parseNumber(args[++i], "zones"));
+            else if (args[i] == "--config" && hasValue)
+                configPath = args[++i] == "default" ? config::defaultPath() : args[i];
+            else if (path.empty())
+                path = args[i];
             else
+                usage = true;
+        }
+        if (usage || (!path.empty() && !configPath.empty()) || zones == 0)
+        {
+            std::cerr << "Usage: " << CMD_SCHEDULE << " <file> [--zones N]\n"
+                      << "       " << CMD_SCHEDULE << " [--config <path|default>] [--zones N]\n"
+                      << "       " << CMD_SCHEDULE << " <file> --next [N] [--at \"YYYY-MM-DD HH:MM[:SS]\"]\n";
+            return;
+        }
+
+        // Without a file the schedule named in the config is run, and followed as the config changes.
+        std::shared_ptr<const config::Config> current;
+        std::vector<schedule::Entry> entries;
+        if (path.empty())
+        {
+            current = config::parse(configPath.empty() ? config::defaultPath() : configPath, zones);
+            if (current->schedulePath.empty())
+                throw std::runtime_error(current->path + " has no schedule = <file> entry");
+            entries = current->schedule;
+        }
+        else
+        {
+            std::ifstream file(path);
+            if (!file)
+                throw std::runtime_error("Failed to open " + path);
+            entries = schedule::parse(file, path, zones);
+        }
+
+        if (next > 0)
+        {
+            time_t now = time(nullptr);
+            if (!at.empty())
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                tm local{};
+                std::istringstream in(at);
+                in >> std::get_time(&local, at.size() > 16 ? "%Y-%m-%d %H:%M:%S" : "%Y-%m-%d %H:%M");
+                if (in.fail())
+                    throw std::invalid_argument("--at must be \"YYYY-MM-DD HH:MM[:SS]\": " + at);
+                local.tm_isdst = -1;
+                now = mktime(&local);
             }
+            std::cout << "[OK] " << entries.size() << " entries, from " << schedule::formatLocal(now) << ":\n";
+            for (const auto &due : schedule::upcoming(entries, now, next))
+                std::cout << "  " << schedule::formatLocal(due.when) << "  (" << due.when << ")  " << entries[due.entry].text << "\n";
+            return;
         }
+
+        schedule::Scheduler scheduler(std::move(entries), zones, [](const std::string &line)
+                                      { std::cout << "[OK] " << line << std::endl; });
+        std::unique_ptr<config::Reloader> reloader;
+        if (current)
+        {
+            reloader = std::make_unique<config::Reloader>(current, zones);
+            scheduler.watch(reloader->fd(), [&]()
+                            {
+                                std::optional<config::Reload> reload = reloader->take();
+                                if (!reload)
+                                    return;
+                                if (!reload->config || reload->config->schedule.empty())
+                                {
+                                    std::cerr << MSG_ERR("Config rejected, keeping the running schedule: " +
+                                                         (reload->config ? reload->config->path + " has no schedule" : reload->error))
+                                              << std::endl;
+                                    return;
+                                }
+                                current = reload->config;
+                                scheduler.replace(current->schedule);
+                                std::cout << "[OK] Schedule reloaded: " << current->schedule.size() << " entries, parsed in " << std::fixed
+                                          << std::setprecision(2) << reload->parseMs << " ms" << std::defaultfloat << std::endl;
+                            });
+        }
+        scheduler.run();
+        const auto &stats = scheduler.stats();
+        std::cout << "[OK] " << stats.wakeups << " wakeups, " << stats.entries << " entries run, " << stats.fadeSteps << " fade steps, "
+                  << stats.clockChanges << " clock changes, " << scheduler.writes() << " zone writes" << std::endl;
     }
 
-    inline void cmdFrance()
+    // Traces a zone write to a scratch keyboard through a calibration profile, replays the
+    // trace and checks that the zone ends up with the recorded value rather than one
+    // calibrated twice.
+    inline void replaySelfCheck()
     {
-        std::vector<RGB_HEX> colors = {0x002395, 0xFFFFFF, 0xED2939};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
+        if (const char *tracing = std::getenv(TRACE_PATH_ENV); tracing && *tracing)
+            throw std::runtime_error("Unset " TRACE_PATH_ENV " for the replay self-check");
+        omen::fs::Scratch scratch(ZONE_COUNT);
+        const std::string trace = scratch.root() + "/writes.trace", zone = ZONE_BASE_PATH "00";
+        setenv(TRACE_PATH_ENV, trace.c_str(), 1);
+
+        std::istringstream profile("* matrix = 0.5 0 0  0 1 0  0 0 1\n");
+        omen::fs::devices::Device device{DEFAULT_DEVICE, PLATFORM_PATH "/" DEFAULT_DEVICE, {}, 0, calibration::parse(profile, "self-check")};
+        omen::fs::devices::probe(device, omen::fs::resolve(device.path));
+        omen::fs::selection().devices = {device};
+
+        std::vector<std::string> failures;
+        try
         {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
+            if (!omen::fs::trace::Recorder::instance())
+                failures.push_back("could not record a trace to " + trace);
+            omen::fs::writeSysfs(zone, "FFFFFF");
+            std::string written = omen::fs::readSysfs(zone);
+            omen::fs::trace::Log log = omen::fs::trace::load(trace);
+            omen::fs::writeRecorded(zone, "000000");
+            for (const auto &r : log.records)
+                omen::fs::writeRecorded(r.path, r.value);
+            std::string replayed = omen::fs::readSysfs(zone);
+            std::cout << "FFFFFF through a calibration profile: wrote " << written << ", replayed " << replayed << "\n";
+            if (written == "FFFFFF")
+                failures.push_back("the profile was not applied to the write");
+            if (log.records.size() != 1 || log.records[0].value != written)
+                failures.push_back("the trace does not hold the written value");
+            if (replayed != written)
+                failures.push_back("replay wrote " + replayed + " instead of " + written);
+        }
+        catch (const std::exception &e)
+        {
+            failures.push_back(e.what());
+        }
+
+        if (!failures.empty())
+        {
+            for (const auto &failure : failures)
+                std::cerr << MSG_ERR(failure) << "\n";
+            throw std::runtime_error("replay self-check failed");
+        }
+        std::cout << "[OK] Replay writes recorded values as they were" << std::endl;
+    }
+
+    // Re-issues a recorded write trace through the sysfs layer, at its original pace (scaled
+    // by --speed) or back to back with --fast, and compares latencies and results.
+    inline void cmdReplay(const std::vector<std::string> &args)
+    {
+        std::string path;
+        double speed = 1.0;
+        bool fast = false, print = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--self-check")
+                return replaySelfCheck();
+            else if (args[i] == "--fast")
+                fast = true;
+            else if (args[i] == "--print")
+                print = true;
+            else if (args[i] == "--speed" && i + 1 < args.size())
+                speed = compositor::parseNumber(args[++i], "speed");
+            else if (path.empty())
+                path = args[i];
+            else
+                speed = -1.0;
+        }
+        if (path.empty() || speed <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_REPLAY << " <trace> [--fast | --speed X] [--print]\n"
+                      << "       " << CMD_REPLAY << " --self-check\n";
+            return;
+        }
+
+        omen::fs::trace::Log log = omen::fs::trace::load(path);
+        const auto &records = log.records;
+        std::cout << "[OK] " << path << ": " << records.size() << " writes from " << log.sessions << " sessions, " << log.bytes << " bytes";
+        if (!records.empty())
+            std::cout << " (" << std::fixed << std::setprecision(1) << static_cast<double>(log.bytes) / records.size() << " per write), "
+                      << std::setprecision(3) << (records.back().time - records.front().time) * 1e-9 << " s" << std::defaultfloat;
+        std::cout << std::endl;
+        if (records.empty())
+            return;
+
+        if (print)
+        {
+            for (const auto &r : records)
+                std::cout << std::fixed << std::setprecision(6) << "  +" << (r.time - records.front().time) * 1e-9 << " s  pid " << r.pid << "  "
+                          << r.path << " = " << r.value << "  " << std::setprecision(1) << r.latency * 1e-3 << " us  "
+                          << (r.error ? std::strerror(r.error) : "ok") << std::defaultfloat << "\n";
+            return;
+        }
+
+        // Replaying into the trace being read would grow it forever.
+        struct stat in = {}, out = {};
+        const char *tracing = std::getenv(TRACE_PATH_ENV);
+        if (tracing && stat(path.c_str(), &in) == 0 && stat(tracing, &out) == 0 && in.st_dev == out.st_dev && in.st_ino == out.st_ino)
+            throw std::runtime_error("Refusing to replay " + path + " while recording into it; unset " TRACE_PATH_ENV);
+
+        std::vector<double> latency, recorded, lateness;
+        size_t failures = 0, mismatches = 0;
+        const uint64_t first = records.front().time, start = omen::fs::trace::monotonicNs();
+        for (const auto &r : records)
+        {
+            if (!fast)
+            {
+                uint64_t due = start + static_cast<uint64_t>((r.time - first) / speed);
+                timespec ts{static_cast<time_t>(due / 1000000000), static_cast<long>(due % 1000000000)};
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+                {
+                }
+                lateness.push_back((omen::fs::trace::monotonicNs() - due) * 1e-3);
+            }
+            uint64_t before = omen::fs::trace::monotonicNs();
+            bool ok = omen::fs::writeRecorded(r.path, r.value);
+            latency.push_back((omen::fs::trace::monotonicNs() - before) * 1e-3);
+            recorded.push_back(r.latency * 1e-3);
+            failures += !ok;
+            mismatches += ok != (r.error == 0);
+        }
+        double elapsed = (omen::fs::trace::monotonicNs() - start) * 1e-9;
+
+        auto summary = [](std::vector<double> values)
+        {
+            std::sort(values.begin(), values.end());
             std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
+            oss << std::fixed << std::setprecision(1) << "p50 " << values[values.size() / 2] << " us  p99 "
+                << values[std::min(values.size() - 1, values.size() * 99 / 100)] << " us  max " << values.back() << " us";
+            return oss.str();
+        };
+        std::cout << "[OK] Replayed " << records.size() << " writes in " << std::fixed << std::setprecision(3) << elapsed << " s ("
+                  << std::setprecision(0) << records.size() / std::max(elapsed, 1e-9) << " writes/s"
+                  << (fast ? ", as fast as possible" : ", " + std::to_string(speed).substr(0, 4) + "x speed") << ")" << std::defaultfloat << "\n"
+                  << "  latency    " << summary(latency) << "\n"
+                  << "  recorded   " << summary(recorded) << "\n";
+        if (!fast)
+            std::cout << "  lateness   " << summary(lateness) << "\n";
+        std::cout << "  results    " << failures << " failed, " << mismatches << " differ from the recording" << std::endl;
+    }
+
+    // Prints the shared sysfs I/O counters, or keeps a node_exporter textfile up to date
+    // until SIGINT or SIGTERM.
+    inline void cmdMetrics(const std::vector<std::string> &args)
+    {
+        std::string textfile;
+        double interval = 15.0;
+        bool reset = false;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i] == "--textfile" && i + 1 < args.size())
+                textfile = args[++i];
+            else if (args[i] == "--interval" && i + 1 < args.size())
+                interval = compositor::parseNumber(args[++i], "interval");
+            else if (args[i] == "--reset")
+                reset = true;
+            else
+                interval = 0.0;
+        }
+        if (interval <= 0.0)
+        {
+            std::cerr << "Usage: " << CMD_METRICS << " [--textfile path [--interval S]] [--reset]\n";
+            return;
+        }
+
+        std::string segment = omen::fs::stats::segmentPath();
+        if (reset)
+        {
+            // Running processes keep counting into their old mapping; new ones start from zero.
+            if (unlink(segment.c_str()) != 0 && errno != ENOENT)
+                throw std::runtime_error("Failed to remove " + segment + ": " + std::strerror(errno));
+            std::cout << "[OK] Cleared " << segment << std::endl;
+            return;
+        }
+        if (textfile.empty())
+        {
+            if (!omen::fs::stats::exposition(std::cout, segment))
+                throw std::runtime_error("No I/O counters at " + segment + " (nothing has touched sysfs yet, or " STATS_PATH_ENV "=off)");
+            return;
+        }
+
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigprocmask(SIG_BLOCK, &mask, nullptr);
+        int signals = signalfd(-1, &mask, SFD_CLOEXEC);
+        if (signals < 0)
+            throw std::runtime_error(std::string("Failed to create signalfd: ") + std::strerror(errno));
+        std::cout << "[OK] Writing " << textfile << " every " << interval << " s" << std::endl;
+        size_t updates = 0;
+        for (;;)
+        {
+            // Written aside and renamed so the collector never reads half a file.
+            std::string temporary = textfile + ".tmp";
             {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
+                std::ofstream out(temporary);
+                if (!out)
+                {
+                    close(signals);
+                    throw std::runtime_error("Failed to open " + temporary);
+                }
+                if (!omen::fs::stats::exposition(out, segment))
+                    out << "# No I/O counters at " << segment << " yet\n";
+            }
+            if (rename(temporary.c_str(), textfile.c_str()) != 0)
+            {
+                close(signals);
+                throw std::runtime_error("Failed to replace " + textfile + ": " + std::strerror(errno));
+            }
+            ++updates;
+            pollfd fd = {signals, POLLIN, 0};
+            if (poll(&fd, 1, static_cast<int>(interval * 1000.0)) > 0)
+                break;
+        }
+        close(signals);
+        std::cout << "[OK] " << updates << " updates written" << std::endl;
+    }
+
+    // Lists the rgb_zones devices, marking the ones --device selected.
+    inline void cmdDevices(const std::vector<std::string> &)
+    {
+        const auto &selected = omen::fs::selection().devices;
+        std::vector<omen::fs::devices::Device> found = omen::fs::listDevices();
+        for (const auto &device : selected)
+            if (std::none_of(found.begin(), found.end(), [&](const auto &other)
+                             { return other.path == device.path; }))
+                found.push_back(device);
+        if (found.empty())
+        {
+            std::cout << "No devices with rgb_zones under " << omen::fs::resolve(PLATFORM_PATH) << std::endl;
+            return;
+        }
+        for (auto &device : found)
+        {
+            if (device.attributes.empty())
+                omen::fs::devices::probe(device, omen::fs::resolve(device.path));
+            bool active = std::any_of(selected.begin(), selected.end(), [&](const auto &other)
+                                      { return other.path == device.path; });
+            std::cout << (active ? "* " : "  ") << std::left << std::setw(24) << device.name << std::right << device.zones << " zones";
+            if (device.has("brightness"))
+            {
+                std::ifstream file(omen::fs::resolve(device.path + "/rgb_zones/brightness"));
+                std::string level;
+                if (std::getline(file, level))
+                    std::cout << ", brightness " << level;
             }
+            std::cout << "  " << omen::fs::resolve(device.path) << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    // Prints what a profile does to a few colors in each zone.
+    inline void printCalibration(const calibration::Profile &profile, size_t zones, const std::vector<RGB_HEX> &colors)
+    {
+        std::cout << "        ";
+        for (RGB_HEX color : colors)
+            std::cout << "  " << utils::hex6(color);
+        std::cout << "\n";
+        for (size_t zone = 0; zone <= zones; ++zone)
+        {
+            std::cout << "  " << std::left << std::setw(6) << (zone < zones ? "zone " + std::to_string(zone) : std::string("*")) << std::right;
+            for (RGB_HEX color : colors)
+                std::cout << "  " << utils::hex6(profile.apply(zone < zones ? zone : calibration::MAX_ZONES, color));
+            std::cout << "\n";
+        }
+    }
+
+    // Shows the calibration of each selected device, or checks a profile file.
+    inline void cmdCalibration(const std::vector<std::string> &args)
+    {
+        std::vector<RGB_HEX> colors = {0xFFFFFF, 0x808080, 0x202020, 0xFF0000, 0x00FF00, 0x0000FF};
+        if (args.size() >= 3 && args[1] == "check")
+        {
+            std::ifstream file(args[2]);
+            if (!file)
+                throw std::runtime_error("Failed to open " + args[2]);
+            auto profile = calibration::parse(file, args[2]);
+            if (args.size() > 3)
+                colors.clear();
+            for (size_t i = 3; i < args.size(); ++i)
+                colors.push_back(utils::hexStringToRGB(utils::sanitizeHexString(args[i])));
+            std::cout << "[OK] " << args[2] << ": " << profile->zones() << " zones listed\n";
+            printCalibration(*profile, profile->zones(), colors);
+            std::cout << std::flush;
+            return;
+        }
+        if (args.size() > 1)
+        {
+            std::cerr << "Usage: " << CMD_CALIBRATION << " [check <profile> [hex...]]\n";
+            return;
+        }
+
+        for (const auto &device : omen::fs::selection().devices)
+        {
+            if (!device.calibration)
+            {
+                std::cout << device.name << ": uncalibrated (no " << calibration::profilePath(device.name) << ")\n";
+                continue;
+            }
+            std::cout << device.name << ": " << device.calibration->path() << "\n";
+            printCalibration(*device.calibration, std::max(device.calibration->zones(), device.zones ? device.zones : output::discoverZones()), colors);
+        }
+        std::cout << std::flush;
+    }
+
+    inline void cmdRender(const std::vector<std::string> &args)
+    {
+        render::Options options;
+        std::vector<std::string> sources;
+        std::string out, format, golden, check;
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            const std::string &arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--frames" && hasValue)
+                options.frames = std::stoul(args[++i]);
+            else if (arg == "--fps" && hasValue)
+                options.fps = compositor::parseNumber(args[++i], "fps");
+            else if (arg == "--zones" && hasValue)
+                options.zones = std::stoul(args[++i]);
+            else if (arg == "--out" && hasValue)
+                out = args[++i];
+            else if (arg == "--format" && hasValue)
+                format = args[++i];
+            else if (arg == "--golden" && hasValue)
+                golden = args[++i];
+            else if (arg == "--check" && hasValue)
+                check = args[++i];
             else
+                sources.push_back(arg);
+        }
+
+        if (!check.empty())
+        {
+            std::ifstream in(check);
+            if (!in)
+                throw std::runtime_error("Failed to open golden file: " + check);
+            auto mismatches = render::checkGolden(in);
+            for (const auto &mismatch : mismatches)
+                std::cerr << MSG_ERR(mismatch) << "\n";
+            if (!mismatches.empty())
+                throw std::runtime_error(std::to_string(mismatches.size()) + " golden mismatches in " + check);
+            std::cout << "[OK] Rendered output matches " << check << std::endl;
+            return;
+        }
+        if (!golden.empty())
+        {
+            std::ofstream file(golden);
+            if (!file)
+                throw std::runtime_error("Failed to open golden file for writing: " + golden);
+            render::writeGolden(file, options);
+            std::cout << "[OK] Wrote " << render::goldenSources().size() << " golden hashes to " << golden << std::endl;
+            return;
+        }
+        if (sources.empty() || out.empty())
+        {
+            std::cerr << "Usage: " << CMD_RENDER << " <source>... --out <file|-> [--frames N] [--fps F] [--zones Z] [--format bin|ppm|text]\n"
+                      << "       " << CMD_RENDER << " --golden <file> | --check <file>\n";
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<RGB_HEX> frames = render::renderFrames(sources, options);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        render::Format fmt = format.empty() ? render::formatForPath(out) : render::parseFormat(format);
+        if (out == "-")
+        {
+            render::write(std::cout, fmt, frames, options);
+        }
+        else
+        {
+            std::ofstream file(out, std::ios::binary);
+            if (!file)
+                throw std::runtime_error("Failed to open output file: " + out);
+            render::write(file, fmt, frames, options);
+        }
+
+        (out == "-" ? std::cerr : std::cout)
+            << "[OK] Rendered " << options.frames << " frames x " << options.zones << " zones in "
+            << std::fixed << std::setprecision(2) << seconds * 1e3 << " ms ("
+            << std::setprecision(0) << options.frames / seconds << " frames/s), hash "
+            << render::hashHex(render::hash(frames)) << std::endl;
+    }
+
+    inline void cmdPlugins()
+    {
+        std::cout << "Plugin search path:\n";
+        for (const auto &dir : plugins::searchPath())
+            std::cout << "  " << dir << "\n";
+
+        std::cout << "Plugins:\n";
+        for (const auto &path : plugins::discover())
+        {
+            try
             {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
+                auto plugin = plugins::Plugin::load(path);
+                std::cout << "  " << std::left << std::setw(16) << plugin->name() << std::right << path << "\n";
+            }
+            catch (const std::exception &ex)
+            {
+                std::cout << "  " << MSG_ERR(ex.what()) << "\n";
             }
         }
     }
 
-    inline void cmdGermany()
+    inline void cmdBench(const std::vector<std::string> &args)
+    {
+        static const std::unordered_map<std::string, std::function<void(const std::vector<std::string> &)>> benches = {
+            {"hex", bench::hex},
+            {"color", bench::colorKernels},
+            {"expr", bench::expression},
+            {"loop", bench::loop},
+            {"ambient", bench::ambientReduce},
+            {"serve", bench::serve},
+            {"timeline", bench::timeline},
+            {"io", bench::io},
+            {"devices", bench::devices},
+            {"calibration", bench::calibration},
+            {"dither", bench::dither}};
+
+        auto it = args.size() >= 2 ? benches.find(utils::toLower(args[1])) : benches.end();
+        if (it == benches.end())
+        {
+            std::cerr << "Usage: " << CMD_BENCH << " <hex|color|expr|loop|ambient|serve|timeline|io|devices|calibration|dither> [args...]\n";
+            return;
+        }
+        it->second(args);
+    }
+
+    inline void cmdExamples() { std::cout << "Example commands:\n"
+                                          << EXAMPLE_COMMANDS_TEXT; }
+
+    inline void cmdVersion() { std::cout << PROGRAM_VERSION << std::endl; }
+
+    using presets::FlagData;
+    using presets::FLAG_DATABASE;
+
+    inline void applyZoneColors(const std::vector<RGB_HEX> &colors)
     {
-        std::vector<RGB_HEX> colors = {0x000000, 0xDD0000, 0xFFCE00};
         for (size_t i = 0; i < colors.size() && i < 4; ++i)
         {
             std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
@@ -563,331 +2354,183 @@ namespace omen::rgb::commands
         }
     }
 
+    inline void cmdFlag(const std::string &flagName)
+    {
+        auto it = FLAG_DATABASE.find(utils::toLower(flagName));
+        if (it == FLAG_DATABASE.end())
+        {
+            std::cout << "[ERROR] Unknown flag/theme: " << flagName << std::endl;
+            return;
+        }
+
+        const FlagData &flag = it->second;
+        std::cout << "Applying " << flag.emoji << " " << flag.name << " theme..." << std::endl;
+
+        applyZoneColors(flag.colors);
+
+        if (flag.category == "theme")
+        {
+            std::cout << "💡 Tip: Use 'animation <mode> <speed>' for dynamic effects!" << std::endl;
+        }
+    }
+
+    inline void cmdAce()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("ace"));
+    }
+
+    inline void cmdLesbian()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("lesbian"));
+    }
+
+    inline void cmdGay()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("gay"));
+    }
+
+    inline void cmdNonbinary()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("nonbinary"));
+    }
+
+    inline void cmdGenderfluid()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("genderfluid"));
+    }
+
+    inline void cmdAgender()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("agender"));
+    }
+
+    inline void cmdDemigirl()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("demigirl"));
+    }
+
+    inline void cmdDemiboy()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("demiboy"));
+    }
+
+    inline void cmdAro()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("aro"));
+    }
+
+    inline void cmdDemi()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("demi"));
+    }
+
+    inline void cmdUsa()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("usa"));
+    }
+
+    inline void cmdUk()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("uk"));
+    }
+
+    inline void cmdFrance()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("france"));
+    }
+
+    inline void cmdGermany()
+    {
+        applyZoneColors(presets::COMMAND_PRESETS.at("germany"));
+    }
+
     inline void cmdItaly()
     {
-        std::vector<RGB_HEX> colors = {0x009246, 0xFFFFFF, 0xCE2B37};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("italy"));
     }
 
     inline void cmdCanada()
     {
-        std::vector<RGB_HEX> colors = {0xFF0000, 0xFFFFFF, 0xFF0000};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("canada"));
     }
 
     inline void cmdJapan()
     {
-        std::vector<RGB_HEX> colors = {0xFFFFFF, 0xBC002D, 0xFFFFFF};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("japan"));
     }
 
     inline void cmdBrazil()
     {
-        std::vector<RGB_HEX> colors = {0x009639, 0xFFDF00, 0x002776};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("brazil"));
     }
 
     inline void cmdAustralia()
     {
-        std::vector<RGB_HEX> colors = {0x00008B, 0xFF0000, 0xFFFFFF};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("australia"));
     }
 
     inline void cmdSpain()
     {
-        std::vector<RGB_HEX> colors = {0xAA151B, 0xF1BF00, 0xAA151B};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("spain"));
     }
 
     inline void cmdIntersex()
     {
-        std::vector<RGB_HEX> colors = {0xFFD700, 0x7B68EE, 0xFFD700};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("intersex"));
     }
 
     inline void cmdTwospirit()
     {
-        std::vector<RGB_HEX> colors = {0x800080, 0xFFFFFF, 0x000000};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("twospirit"));
     }
 
     inline void cmdSunset()
     {
-        std::vector<RGB_HEX> colors = {0xFF6B6B, 0xFF8E53, 0xFF6B9D, 0xC44569, 0xF8B500};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("sunset"));
     }
 
     inline void cmdOcean()
     {
-        std::vector<RGB_HEX> colors = {0x001F3F, 0x0074D9, 0x7FDBFF, 0x39CCCC, 0x3D9970};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("ocean"));
     }
 
     inline void cmdFire()
     {
-        std::vector<RGB_HEX> colors = {0xFF0000, 0xFF4500, 0xFF8C00, 0xFFD700, 0xFFFF00};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("fire"));
     }
 
     inline void cmdRainbow()
     {
-        std::vector<RGB_HEX> colors = {0xFF0000, 0xFF7F00, 0xFFFF00, 0x00FF00, 0x0000FF, 0x4B0082, 0x9400D3};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("rainbow"));
     }
 
     inline void cmdAurora()
     {
-        std::vector<RGB_HEX> colors = {0x00FF9F, 0x00D4FF, 0x9D4EDD, 0x7209B7};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("aurora"));
         std::cout << "🌌 Aurora theme applied! Use 'animation aurora 5' for full effect." << std::endl;
     }
 
     inline void cmdMatrix()
     {
-        std::vector<RGB_HEX> colors = {0x00FF00, 0x00CC00, 0x009900, 0x006600};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("matrix"));
         std::cout << "🟢 Matrix theme applied! Use 'animation wave 3' for full effect." << std::endl;
     }
 
     inline void cmdCyberpunk()
     {
-        std::vector<RGB_HEX> colors = {0xFF0080, 0x00FFFF, 0x8000FF, 0xFFFF00};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("cyberpunk"));
         std::cout << "🤖 Cyberpunk theme applied! Use 'animation disco 4' for full effect." << std::endl;
     }
 
     inline void cmdNeon()
     {
-        std::vector<RGB_HEX> colors = {0xFF00FF, 0x00FFFF, 0xFFFF00, 0xFF0080};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("neon"));
         std::cout << "💡 Neon theme applied! Use 'animation chase 6' for full effect." << std::endl;
     }
 
     inline void cmdGalaxy()
     {
-        std::vector<RGB_HEX> colors = {0x4B0082, 0x8A2BE2, 0x9370DB, 0xDA70D6};
-        for (size_t i = 0; i < colors.size() && i < 4; ++i)
-        {
-            std::string path = std::string(ZONE_BASE_PATH) + (i < 10 ? "0" : "") + std::to_string(i);
-            std::ostringstream oss;
-            oss << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << (colors[i] & 0xFFFFFF);
-            if (omen::fs::writeSysfs(path, oss.str()))
-            {
-                std::cout << MSG_OK_ZONE(i, colors[i]) << std::endl;
-            }
-            else
-            {
-                std::cout << "[ERROR] Failed to set zone " << i << " color" << std::endl;
-            }
-        }
+        applyZoneColors(presets::COMMAND_PRESETS.at("galaxy"));
         std::cout << "🌌 Galaxy theme applied! Use 'animation aurora 2' for full effect." << std::endl;
     }
 
@@ -1063,7 +2706,31 @@ namespace omen::rgb::commands
             {CMD_COUNTRY_PRESETS, Command::CountryPresets},
             {CMD_THEME_PRESETS, Command::ThemePresets},
             {CMD_EXAMPLES, Command::Examples},
-            {CMD_VERSION, Command::Version}};
+            {CMD_VERSION, Command::Version},
+            {CMD_STREAM, Command::Stream},
+            {CMD_BENCH, Command::Bench},
+            {CMD_COMPOSE, Command::Compose},
+            {CMD_EFFECT, Command::Effect},
+            {CMD_PLUGINS, Command::Plugins},
+            {CMD_RENDER, Command::Render},
+            {CMD_LOOP, Command::Loop},
+            {CMD_ANIMATE, Command::Animate},
+            {CMD_RUN, Command::Run},
+            {CMD_CYCLE, Command::Cycle},
+            {CMD_REACT, Command::React},
+            {CMD_AUDIO, Command::Audio},
+            {CMD_AMBIENT, Command::Ambient},
+            {CMD_TYPING, Command::Typing},
+            {CMD_AUTO_BRIGHTNESS, Command::AutoBrightness},
+            {CMD_OPENRGB, Command::OpenRgb},
+            {CMD_SERVE, Command::Serve},
+            {CMD_TIMELINE, Command::Timeline},
+            {CMD_PLAY, Command::Play},
+            {CMD_SCHEDULE, Command::Schedule},
+            {CMD_REPLAY, Command::Replay},
+            {CMD_METRICS, Command::Metrics},
+            {CMD_DEVICES, Command::Devices},
+            {CMD_CALIBRATION, Command::Calibration}};
 
         auto it = cmdMap.find(cmd);
         return it != cmdMap.end() ? it->second : Command::Unknown;
@@ -1077,8 +2744,24 @@ namespace omen::rgb::commands
             return;
         }
 
-        std::string cmdStr = utils::toLower(argv[1]);
-        std::vector<std::string> args(argv + 1, argv + argc);
+        // --device <name,...|dir|all> anywhere on the line, else $OMEN_RGB_DEVICE.
+        std::vector<std::string> args;
+        std::string device = std::getenv(DEVICE_ENV) ? std::getenv(DEVICE_ENV) : "";
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::string(argv[i]) == "--device" && i + 1 < argc)
+                device = argv[++i];
+            else
+                args.push_back(argv[i]);
+        }
+        if (args.empty())
+        {
+            printUsage();
+            return;
+        }
+        if (!device.empty())
+            omen::fs::selectDevices(device);
+        std::string cmdStr = utils::toLower(args[0]);
 
         static const std::unordered_map<std::string, std::function<void()>> commandMap = {
             {"help", printUsage},
@@ -1097,7 +2780,54 @@ namespace omen::rgb::commands
             {"country-presets", cmdCountryPresets},
             {"theme-presets", cmdThemePresets},
             {"examples", cmdExamples},
-            {"version", cmdVersion}};
+            {"version", cmdVersion},
+            {"stream", [&args]()
+             { cmdStream(args); }},
+            {"bench", [&args]()
+             { cmdBench(args); }},
+            {"compose", [&args]()
+             { cmdCompose(args); }},
+            {"effect", [&args]()
+             { cmdEffect(args); }},
+            {"plugins", cmdPlugins},
+            {"render", [&args]()
+             { cmdRender(args); }},
+            {"loop", [&args]()
+             { cmdLoop(args); }},
+            {"animate", [&args]()
+             { cmdAnimate(args); }},
+            {"run", [&args]()
+             { cmdRun(args); }},
+            {"cycle", [&args]()
+             { cmdCycle(args); }},
+            {"react", [&args]()
+             { cmdReact(args); }},
+            {"audio", [&args]()
+             { cmdAudio(args); }},
+            {"ambient", [&args]()
+             { cmdAmbient(args); }},
+            {"typing", [&args]()
+             { cmdTyping(args); }},
+            {"auto-brightness", [&args]()
+             { cmdAutoBrightness(args); }},
+            {"openrgb", [&args]()
+             { cmdOpenRgb(args); }},
+            {"serve", [&args]()
+             { cmdServe(args); }},
+            {"timeline", [&args]()
+             { cmdTimeline(args); }},
+            {"play", [&args]()
+             { cmdPlay(args); }},
+            {"schedule", [&args]()
+             { cmdSchedule(args); }},
+            {"replay", [&args]()
+             { cmdReplay(args); }},
+            {"metrics", [&args]()
+             { cmdMetrics(args); }},
+            {"devices", [&args]()
+             { cmdDevices(args); }},
+            {"calibration", [&args]()
+             { cmdCalibration(args); }}};
 
         auto flagIt = FLAG_DATABASE.find(cmdStr);
         if (flagIt != FLAG_DATABASE.end())
@@ -1113,7 +2843,7 @@ namespace omen::rgb::commands
         }
         else
         {
-            std::cerr << "Unknown command: " << argv[1] << "\n\n";
+            std::cerr << "Unknown command: " << args[0] << "\n\n";
             printUsage();
         }
     }
@@ -0,0 +1,620 @@
+#pragma once
+#include "color.hpp"
+#include "definitions.hpp"
+#include "expr.hpp"
+#include "hexframe.hpp"
+#include "plugins.hpp"
+#include "presets.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace omen::rgb::compositor
+{
+    enum class BlendMode
+    {
+        Normal,
+        Add,
+        Multiply,
+        Screen
+    };
+
+    inline BlendMode parseBlendMode(const std::string &name)
+    {
+        std::string mode = utils::toLower(name);
+        if (mode == "normal")
+            return BlendMode::Normal;
+        if (mode == "add")
+            return BlendMode::Add;
+        if (mode == "multiply")
+            return BlendMode::Multiply;
+        if (mode == "screen")
+            return BlendMode::Screen;
+        throw std::invalid_argument("Invalid blend mode: " + name + ". Valid modes: normal, add, multiply, screen");
+    }
+
+    constexpr RGB_HEX OPAQUE = 0xFF000000;
+
+    // A layer renders one frame per zone with alpha in bits 24-31.
+    // Static layers are rendered once when added; animated ones on every compose().
+    // Smooth layers can also render at 16 bits per channel for dithered output; the
+    // others are widened from their 8-bit frame.
+    struct Layer
+    {
+        std::string name;
+        BlendMode mode = BlendMode::Normal;
+        uint8_t opacity = 255;
+        bool animated = false;
+        std::function<void(double t, RGB_HEX *frame, size_t zones)> render;
+        std::function<void(double t, color::Color16 *frame, size_t zones)> renderDeep;
+        // For animations that end: true once the frame at t is final, after which the layer
+        // is no longer rendered and counts as static.
+        std::function<bool(double t)> settled;
+        // Seconds after which an animated layer repeats exactly; 0 if it never does or the
+        // period is not known (expressions, plugins).
+        double period = 0.0;
+    };
+
+    class Compositor
+    {
+    public:
+        explicit Compositor(size_t zones = ZONE_COUNT)
+            : zones_(zones), output_(zones, OPAQUE), previous_(zones), scratch_(zones), source_(zones), deepOutput_(zones),
+              previousDeep_(zones), deepScratch_(zones) {}
+
+        size_t zones() const { return zones_; }
+        // Valid until the next compose(), which swaps buffers.
+        const RGB_HEX *frame() const { return output_.data(); }
+        size_t composites() const { return composites_; }
+
+        // Also composes at 16 bits per channel into deepFrame(). frame() is unaffected.
+        void setDeep(bool deep)
+        {
+            deep_ = deep;
+            for (auto &slot : slots_)
+                if (!slot.layer.animated || slot.settled)
+                    prepare(slot);
+            dirty_ = true;
+        }
+
+        const color::Color16 *deepFrame() const { return deepOutput_.data(); }
+
+        // Pushes the layer on top of the stack, replacing any layer with the same name in place.
+        void add(Layer layer)
+        {
+            Slot slot{std::move(layer), std::vector<RGB_HEX>(zones_, 0), {}};
+            if (!slot.layer.animated)
+                prepare(slot);
+
+            auto it = find(slot.layer.name);
+            if (it != slots_.end())
+                *it = std::move(slot);
+            else
+                slots_.push_back(std::move(slot));
+            dirty_ = true;
+        }
+
+        bool remove(const std::string &name)
+        {
+            auto it = find(name);
+            if (it == slots_.end())
+                return false;
+            slots_.erase(it);
+            dirty_ = true;
+            return true;
+        }
+
+        // Swaps the layers named in previous for a new set at the bottom of the stack, leaving
+        // the layers above in place. A reloaded config replaces its own layers this way.
+        void replaceBase(const std::vector<std::string> &previous, std::vector<Layer> layers)
+        {
+            std::vector<Slot> base;
+            for (auto &layer : layers)
+            {
+                Slot slot{std::move(layer), std::vector<RGB_HEX>(zones_, 0), {}};
+                if (!slot.layer.animated)
+                    prepare(slot);
+                base.push_back(std::move(slot));
+            }
+            slots_.erase(std::remove_if(slots_.begin(), slots_.end(), [&](const Slot &slot)
+                                        { return std::find(previous.begin(), previous.end(), slot.layer.name) != previous.end() ||
+                                                 std::any_of(base.begin(), base.end(), [&](const Slot &b)
+                                                             { return b.layer.name == slot.layer.name; }); }),
+                         slots_.end());
+            slots_.insert(slots_.begin(), std::make_move_iterator(base.begin()), std::make_move_iterator(base.end()));
+            dirty_ = true;
+        }
+
+        std::vector<std::string> names() const
+        {
+            std::vector<std::string> out;
+            for (const auto &slot : slots_)
+                out.push_back(slot.layer.name);
+            return out;
+        }
+
+        bool animated() const
+        {
+            return std::any_of(slots_.begin(), slots_.end(), [](const Slot &slot)
+                               { return slot.layer.animated && !slot.settled; });
+        }
+
+        // Re-renders animated layers at time t and blends the stack bottom-up if any
+        // layer output or the stack itself changed. Returns true if frame() changed.
+        bool compose(double t)
+        {
+            for (auto &slot : slots_)
+            {
+                if (!slot.layer.animated || slot.settled)
+                    continue;
+                slot.layer.render(t, scratch_.data(), zones_);
+                if (!std::equal(scratch_.begin(), scratch_.end(), slot.frame.begin()))
+                {
+                    slot.frame.swap(scratch_);
+                    dirty_ = true;
+                }
+                if (deep_)
+                {
+                    renderDeep(slot, t, deepScratch_);
+                    if (deepScratch_ != slot.deep)
+                    {
+                        slot.deep.swap(deepScratch_);
+                        dirty_ = true;
+                    }
+                }
+                if (slot.layer.settled && slot.layer.settled(t))
+                {
+                    slot.settled = true;
+                    slot.settledAt = t;
+                }
+            }
+            if (!dirty_)
+                return false;
+            dirty_ = false;
+
+            // The last frame moves aside for comparison rather than being copied.
+            output_.swap(previous_);
+            std::fill(output_.begin(), output_.end(), OPAQUE);
+            for (const auto &slot : slots_)
+                blend(slot);
+            bool changed = output_ != previous_;
+            if (deep_)
+            {
+                deepOutput_.swap(previousDeep_);
+                std::fill(deepOutput_.begin(), deepOutput_.end(), color::Color16{0, 0, 0, 65535});
+                for (const auto &slot : slots_)
+                    blendDeep(slot);
+                changed = changed || deepOutput_ != previousDeep_;
+            }
+            ++composites_;
+            return changed;
+        }
+
+    private:
+        struct Slot
+        {
+            Layer layer;
+            std::vector<RGB_HEX> frame;
+            std::vector<color::Color16> deep;
+            bool settled = false;
+            double settledAt = 0.0;
+        };
+
+        void renderDeep(const Slot &slot, double t, std::vector<color::Color16> &out) const
+        {
+            out.resize(zones_);
+            if (slot.layer.renderDeep)
+                slot.layer.renderDeep(t, out.data(), zones_);
+            else
+                std::transform(slot.frame.begin(), slot.frame.end(), out.begin(), color::widen);
+        }
+
+        // Renders a static or settled layer once.
+        void prepare(Slot &slot)
+        {
+            slot.layer.render(slot.settledAt, slot.frame.data(), zones_);
+            if (deep_)
+                renderDeep(slot, slot.settledAt, slot.deep);
+        }
+
+        std::vector<Slot>::iterator find(const std::string &name)
+        {
+            return std::find_if(slots_.begin(), slots_.end(), [&](const Slot &slot)
+                                { return slot.layer.name == name; });
+        }
+
+        // Blend modes compute dst op src into scratch, then lerp dst towards it by the layer's alpha.
+        void blend(const Slot &slot)
+        {
+            const RGB_HEX *src = slot.frame.data();
+            RGB_HEX *out = output_.data();
+            switch (slot.layer.mode)
+            {
+            case BlendMode::Normal:
+                std::copy(src, src + zones_, scratch_.begin());
+                break;
+            case BlendMode::Add:
+                std::copy(out, out + zones_, scratch_.begin());
+                color::add(scratch_.data(), src, zones_);
+                break;
+            case BlendMode::Multiply:
+                std::copy(out, out + zones_, scratch_.begin());
+                color::multiply(scratch_.data(), src, zones_);
+                break;
+            case BlendMode::Screen:
+                for (size_t i = 0; i < zones_; ++i)
+                {
+                    scratch_[i] = ~out[i];
+                    source_[i] = ~src[i];
+                }
+                color::multiply(scratch_.data(), source_.data(), zones_);
+                for (auto &c : scratch_)
+                    c = ~c;
+                break;
+            }
+
+            for (size_t i = 0; i < zones_; ++i)
+            {
+                uint32_t alpha = color::scalar::div255((src[i] >> 24) * slot.layer.opacity);
+                scratch_[i] = (scratch_[i] & 0xFFFFFF) | (alpha << 24);
+            }
+            color::blendAlpha(out, scratch_.data(), zones_);
+        }
+
+        // The same blend at 16 bits per channel; a handful of zones, so scalar.
+        void blendDeep(const Slot &slot)
+        {
+            const int64_t full = 65535;
+            for (size_t i = 0; i < zones_; ++i)
+            {
+                const color::Color16 &s = slot.deep[i];
+                color::Color16 &d = deepOutput_[i];
+                int64_t alpha = s.a * static_cast<int64_t>(slot.layer.opacity);
+                auto mix = [&](uint16_t &dst, int64_t src)
+                {
+                    int64_t top = 0;
+                    switch (slot.layer.mode)
+                    {
+                    case BlendMode::Normal:
+                        top = src;
+                        break;
+                    case BlendMode::Add:
+                        top = std::min(full, dst + src);
+                        break;
+                    case BlendMode::Multiply:
+                        top = (dst * src + full / 2) / full;
+                        break;
+                    case BlendMode::Screen:
+                        top = full - ((full - dst) * (full - src) + full / 2) / full;
+                        break;
+                    }
+                    int64_t scale = full * 255;
+                    int64_t delta = (top - dst) * alpha;
+                    dst = static_cast<uint16_t>(dst + (delta >= 0 ? delta + scale / 2 : delta - scale / 2) / scale);
+                };
+                mix(d.r, s.r);
+                mix(d.g, s.g);
+                mix(d.b, s.b);
+            }
+        }
+
+        size_t zones_;
+        std::vector<Slot> slots_;
+        std::vector<RGB_HEX> output_;
+        std::vector<RGB_HEX> previous_;
+        std::vector<RGB_HEX> scratch_;
+        std::vector<RGB_HEX> source_;
+        std::vector<color::Color16> deepOutput_;
+        std::vector<color::Color16> previousDeep_;
+        std::vector<color::Color16> deepScratch_;
+        bool deep_ = false;
+        bool dirty_ = true;
+        size_t composites_ = 0;
+    };
+
+    inline double parseNumber(const std::string &value, const std::string &what)
+    {
+        try
+        {
+            size_t used = 0;
+            double number = std::stod(value, &used);
+            if (used == value.size() && std::isfinite(number))
+                return number;
+        }
+        catch (const std::exception &)
+        {
+        }
+        throw std::invalid_argument("Invalid " + what + ": " + value);
+    }
+
+    // A number as it would be written in a spec, for layer names.
+    inline std::string formatNumber(double value)
+    {
+        std::ostringstream oss;
+        oss << value;
+        return oss.str();
+    }
+
+    inline Layer paletteLayer(const std::string &name, const std::vector<RGB_HEX> &palette)
+    {
+        Layer layer{name};
+        layer.render = [palette](double, RGB_HEX *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = OPAQUE | presets::zoneColor(palette, i);
+        };
+        return layer;
+    }
+
+    inline Layer presetLayer(const std::string &preset)
+    {
+        return paletteLayer("preset:" + preset, presets::get(utils::toLower(preset)).colors);
+    }
+
+    // The palette of a dedicated preset command such as cmdAce.
+    inline Layer commandLayer(const std::string &name)
+    {
+        return paletteLayer("command:" + name, presets::commandPalette(utils::toLower(name)));
+    }
+
+    // Rotates the preset's palette across the zones, one full turn per period.
+    inline Layer cycleLayer(const std::string &preset, double period)
+    {
+        if (period <= 0.0)
+            throw std::invalid_argument("cycle period must be greater than 0");
+
+        Layer layer{"cycle:" + preset, BlendMode::Normal, 255, true};
+        layer.period = period;
+        auto shade = [palette = presets::get(utils::toLower(preset)).colors, period](double t, size_t i, auto lerp)
+        {
+            const double n = static_cast<double>(palette.size());
+            double x = std::fmod(static_cast<double>(i) + std::fmod(t / period, 1.0) * n, n);
+            size_t k = static_cast<size_t>(x);
+            return lerp(OPAQUE | palette[k], palette[(k + 1) % palette.size()], x - static_cast<double>(k));
+        };
+        layer.render = [shade](double t, RGB_HEX *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = shade(t, i, color::lerp);
+        };
+        layer.renderDeep = [shade](double t, color::Color16 *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = shade(t, i, color::lerp16);
+        };
+        return layer;
+    }
+
+    // Smoothstep transition from one preset to another, then holds the target.
+    inline Layer fadeLayer(const std::string &from, const std::string &to, double duration)
+    {
+        if (duration <= 0.0)
+            throw std::invalid_argument("fade duration must be greater than 0");
+
+        Layer layer{"fade:" + from + ":" + to, BlendMode::Normal, 255, true};
+        auto shade = [a = presets::get(utils::toLower(from)).colors, b = presets::get(utils::toLower(to)).colors,
+                      duration](double t, size_t i, auto lerp)
+        {
+            double f = std::clamp(t / duration, 0.0, 1.0);
+            return lerp(OPAQUE | presets::zoneColor(a, i), presets::zoneColor(b, i), f * f * (3.0 - 2.0 * f));
+        };
+        layer.settled = [duration](double t)
+        { return t >= duration; };
+        layer.render = [shade](double t, RGB_HEX *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = shade(t, i, color::lerp);
+        };
+        layer.renderDeep = [shade](double t, color::Color16 *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = shade(t, i, color::lerp16);
+        };
+        return layer;
+    }
+
+    // Fades every zone through the colors in a loop, step seconds per color.
+    inline Layer sequenceLayer(const std::vector<RGB_HEX> &colors, double step)
+    {
+        if (colors.empty() || step <= 0.0)
+            throw std::invalid_argument("seq needs at least one color and step > 0");
+
+        std::string name = "seq:";
+        for (size_t i = 0; i < colors.size(); ++i)
+            name += (i ? "," : "") + utils::hex6(colors[i]);
+        Layer layer{name, BlendMode::Normal, 255, colors.size() > 1};
+        layer.period = step * static_cast<double>(colors.size());
+        auto shade = [colors, step](double t, auto lerp)
+        {
+            double x = std::fmod(t / step, static_cast<double>(colors.size()));
+            size_t k = static_cast<size_t>(x);
+            return lerp(OPAQUE | colors[k], colors[(k + 1) % colors.size()], x - static_cast<double>(k));
+        };
+        layer.render = [shade](double t, RGB_HEX *frame, size_t zones)
+        { std::fill(frame, frame + zones, shade(t, color::lerp)); };
+        layer.renderDeep = [shade](double t, color::Color16 *frame, size_t zones)
+        { std::fill(frame, frame + zones, shade(t, color::lerp16)); };
+        return layer;
+    }
+
+    inline std::vector<RGB_HEX> parseColorList(const std::string &list)
+    {
+        std::vector<RGB_HEX> colors;
+        size_t start = 0;
+        for (size_t comma; (comma = list.find(',', start)) != std::string::npos; start = comma + 1)
+            colors.push_back(utils::hexStringToRGB(utils::sanitizeHexString(list.substr(start, comma - start))));
+        colors.push_back(utils::hexStringToRGB(utils::sanitizeHexString(list.substr(start))));
+        return colors;
+    }
+
+    // Multiplies everything below by a level oscillating between floor and full.
+    inline Layer breatheLayer(double period, double floor)
+    {
+        if (period <= 0.0 || floor < 0.0 || floor > 1.0)
+            throw std::invalid_argument("breathe needs period > 0 and floor 0-1");
+
+        Layer layer{"breathe:" + formatNumber(period) + ":" + formatNumber(floor), BlendMode::Multiply, 255, true};
+        layer.period = period;
+        auto level = [period, floor](double t)
+        { return floor + (1.0 - floor) * (0.5 + 0.5 * std::cos(2.0 * M_PI * t / period)); };
+        layer.render = [level](double t, RGB_HEX *frame, size_t zones)
+        {
+            auto v = static_cast<RGB_HEX>(std::lround(255.0 * level(t)));
+            std::fill(frame, frame + zones, OPAQUE | v << 16 | v << 8 | v);
+        };
+        layer.renderDeep = [level](double t, color::Color16 *frame, size_t zones)
+        {
+            auto v = static_cast<uint16_t>(std::lround(65535.0 * level(t)));
+            std::fill(frame, frame + zones, color::Color16{v, v, v, 65535});
+        };
+        return layer;
+    }
+
+    // Blinks color over one zone, transparent elsewhere.
+    inline Layer flashLayer(size_t zone, RGB_HEX color, double period)
+    {
+        if (period <= 0.0)
+            throw std::invalid_argument("flash period must be greater than 0");
+
+        Layer layer{"flash:" + std::to_string(zone) + ":" + utils::hex6(color) + ":" + formatNumber(period), BlendMode::Normal, 255, true};
+        layer.period = period;
+        layer.render = [zone, color, period](double t, RGB_HEX *frame, size_t zones)
+        {
+            bool on = std::fmod(t, period) < period / 2.0;
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = (i == zone && on) ? OPAQUE | color : color;
+        };
+        return layer;
+    }
+
+    inline Layer dimLayer(size_t zone, uint8_t percent)
+    {
+        if (percent > 100)
+            throw std::invalid_argument("dim level must be between 0 and 100");
+
+        Layer layer{"dim:" + std::to_string(zone) + ":" + std::to_string(percent), BlendMode::Multiply};
+        auto level = static_cast<RGB_HEX>(percent * 255 / 100);
+        layer.render = [zone, level](double, RGB_HEX *frame, size_t zones)
+        {
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] = OPAQUE | (i == zone ? level << 16 | level << 8 | level : 0xFFFFFF);
+        };
+        return layer;
+    }
+
+    // Animated only if the expression reads t.
+    inline Layer exprLayer(const std::string &source)
+    {
+        expr::Program program = expr::compile(source);
+        Layer layer{"expr:" + source, BlendMode::Normal, 255, program.usesTime()};
+        layer.render = [program = std::move(program)](double t, RGB_HEX *frame, size_t zones)
+        {
+            program.render(t, frame, zones);
+            for (size_t i = 0; i < zones; ++i)
+                frame[i] |= OPAQUE;
+        };
+        return layer;
+    }
+
+    // Renders fully transparent once the plugin has been disabled.
+    inline Layer pluginLayer(const std::string &name, const std::string &args)
+    {
+        auto instance = plugins::host().create(name, args);
+        Layer layer{"plugin:" + name + (args.empty() ? "" : ":" + args), BlendMode::Normal, 255, true};
+        layer.render = [instance](double t, RGB_HEX *frame, size_t zones)
+        {
+            if (!instance->render(t, frame, zones))
+                std::fill(frame, frame + zones, 0);
+        };
+        return layer;
+    }
+
+    // Parses "kind:arg:arg[@mode][%opacity]", e.g. "preset:ocean" (or just "ocean"),
+    // "cycle:ocean:8", "fade:fire:ocean:2", "seq:FF0000,0000FF:1" (or "FF0000,0000FF"), "breathe:2:0.2",
+    // "flash:0:FF0000:1", "dim:3:40", "plugin:comet:FF4000", "preset:fire@screen%50".
+    // "expr:<expression>" takes the rest of the spec verbatim, so it has no suffixes.
+    inline Layer parseLayer(const std::string &spec)
+    {
+        if (utils::toLower(spec.substr(0, 5)) == "expr:")
+            return exprLayer(spec.substr(5));
+
+        std::string body = spec;
+        uint8_t opacity = 255;
+        std::string mode;
+
+        size_t pct = body.find('%');
+        if (pct != std::string::npos)
+        {
+            uint8_t percent = utils::stringToUint8(body.substr(pct + 1));
+            if (percent > 100)
+                throw std::invalid_argument("Layer opacity must be between 0 and 100");
+            opacity = static_cast<uint8_t>(percent * 255 / 100);
+            body.resize(pct);
+        }
+        size_t at = body.find('@');
+        if (at != std::string::npos)
+        {
+            mode = body.substr(at + 1);
+            body.resize(at);
+        }
+
+        std::vector<std::string> parts;
+        size_t start = 0;
+        for (size_t colon; (colon = body.find(':', start)) != std::string::npos; start = colon + 1)
+            parts.push_back(body.substr(start, colon - start));
+        parts.push_back(body.substr(start));
+
+        std::string kind = utils::toLower(parts[0]);
+        if (parts.size() == 1 && presets::exists(kind))
+            parts = {"preset", kind};
+        else if (parts[0].find(',') != std::string::npos)
+            parts.insert(parts.begin(), "seq");
+        kind = utils::toLower(parts[0]);
+
+        auto arg = [&](size_t i, const std::string &fallback = "") -> std::string
+        {
+            if (i < parts.size() && !parts[i].empty())
+                return parts[i];
+            if (fallback.empty())
+                throw std::invalid_argument("Missing argument " + std::to_string(i) + " in layer: " + spec);
+            return fallback;
+        };
+
+        Layer layer;
+        if (kind == "preset")
+            layer = presetLayer(arg(1));
+        else if (kind == "command")
+            layer = commandLayer(arg(1));
+        else if (kind == "cycle")
+            layer = cycleLayer(arg(1), parseNumber(arg(2, "8"), "period"));
+        else if (kind == "fade")
+            layer = fadeLayer(arg(1), arg(2), parseNumber(arg(3, "2"), "duration"));
+        else if (kind == "seq")
+            layer = sequenceLayer(parseColorList(arg(1)), parseNumber(arg(2, "1"), "step"));
+        else if (kind == "breathe")
+            layer = breatheLayer(parseNumber(arg(1, "3"), "period"), parseNumber(arg(2, "0.1"), "floor"));
+        else if (kind == "flash")
+            layer = flashLayer(utils::stringToUint8(arg(1, "0")),
+                               utils::hexStringToRGB(utils::sanitizeHexString(arg(2, "FFFFFF"))),
+                               parseNumber(arg(3, "1"), "period"));
+        else if (kind == "dim")
+            layer = dimLayer(utils::stringToUint8(arg(1)), utils::stringToUint8(arg(2, "50")));
+        else if (kind == "plugin")
+            layer = pluginLayer(arg(1), parts.size() > 2 ? parts[2] : "");
+        else
+            throw std::invalid_argument("Unknown layer: " + parts[0] + ". Valid layers: preset, command, cycle, fade, seq, breathe, flash, dim, expr, plugin");
+
+        if (!mode.empty())
+            layer.mode = parseBlendMode(mode);
+        if (opacity != 255)
+            layer.opacity = opacity;
+        return layer;
+    }
+}
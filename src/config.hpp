@@ -0,0 +1,364 @@
+#pragma once
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "presets.hpp"
+#include "schedule.hpp"
+#include "utils.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define CONFIG_PATH_ENV "OMEN_RGB_CONFIG"
+
+// Config file with hot reload: inotify wakes a background thread that reparses and
+// validates the file, then hands the result to the main loop, which builds its layers and
+// swaps it in whole. An invalid file is reported and the running state is left alone.
+namespace omen::rgb::config
+{
+    // $OMEN_RGB_CONFIG, else $XDG_CONFIG_HOME/omen-rgb-cli/config, else ~/.config/omen-rgb-cli/config.
+    inline std::string defaultPath()
+    {
+        if (const char *path = std::getenv(CONFIG_PATH_ENV); path && *path)
+            return path;
+        if (const char *xdg = std::getenv("XDG_CONFIG_HOME"); xdg && *xdg)
+            return std::string(xdg) + "/omen-rgb-cli/config";
+        const char *home = std::getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.config/omen-rgb-cli/config";
+    }
+
+    // A parsed and validated config. Its layers are only specs: building one may load a
+    // plugin, which belongs on the main thread (see buildLayers).
+    struct Config
+    {
+        std::string path;
+        std::string preset;
+        size_t presetLine = 0;
+        std::optional<int> brightness;
+        double fps = 30.0;
+        std::vector<std::string> layerSpecs;
+        std::vector<size_t> layerLines;
+        std::shared_ptr<const presets::PresetMap> userPresets;
+        std::string schedulePath;
+        std::vector<schedule::Entry> schedule;
+    };
+
+    // "key = value" lines; '#' starts a comment:
+    //   preset = <name>              base preset under the layers
+    //   brightness = <0-100>
+    //   fps = <n>                    frame rate while a layer animates
+    //   layer = <layer spec>         repeatable, bottom to top (see compose)
+    //   preset <name> = <hex>...     user preset, usable anywhere a preset name is
+    //   schedule = <file>            schedule run by the schedule command
+    inline std::shared_ptr<const Config> parse(const std::string &path, size_t zones = ZONE_COUNT)
+    {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error("Failed to open config " + path);
+
+        auto config = std::make_shared<Config>();
+        config->path = path;
+        auto user = std::make_shared<presets::PresetMap>();
+        size_t scheduleLine = 0;
+        std::string line;
+        for (size_t number = 1; std::getline(file, line); ++number)
+        {
+            line = line.substr(0, line.find('#'));
+            if (utils::split(line).empty())
+                continue;
+            try
+            {
+                size_t equals = line.find('=');
+                if (equals == std::string::npos)
+                    throw std::invalid_argument("expected <key> = <value>");
+                std::vector<std::string> key = utils::split(line.substr(0, equals));
+                std::string value = line.substr(equals + 1);
+                value.erase(0, value.find_first_not_of(" \t"));
+                value.erase(value.find_last_not_of(" \t\r") + 1);
+                if (key.empty() || value.empty())
+                    throw std::invalid_argument("expected <key> = <value>");
+                std::string name = utils::toLower(key[0]);
+
+                if (name == "preset" && key.size() == 2)
+                {
+                    std::string preset = utils::toLower(key[1]);
+                    if (presets::FLAG_DATABASE.count(preset))
+                        throw std::invalid_argument("user preset " + preset + " would shadow a built-in preset");
+                    std::vector<RGB_HEX> colors;
+                    for (const auto &hex : utils::split(value))
+                        colors.push_back(utils::hexStringToRGB(utils::sanitizeHexString(hex)));
+                    (*user)[preset] = {key[1], "", colors, "user"};
+                }
+                else if (key.size() != 1)
+                    throw std::invalid_argument("unknown key " + line.substr(0, equals));
+                else if (name == "preset")
+                {
+                    config->preset = utils::toLower(value);
+                    config->presetLine = number;
+                }
+                else if (name == "brightness")
+                {
+                    double level = compositor::parseNumber(value, "brightness");
+                    if (level < 0.0 || level > 100.0)
+                        throw std::invalid_argument("brightness must be 0-100");
+                    config->brightness = static_cast<int>(std::lround(level));
+                }
+                else if (name == "fps")
+                {
+                    config->fps = compositor::parseNumber(value, "fps");
+                    if (config->fps <= 0.0)
+                        throw std::invalid_argument("fps must be greater than 0");
+                }
+                else if (name == "layer")
+                {
+                    config->layerSpecs.push_back(value);
+                    config->layerLines.push_back(number);
+                }
+                else if (name == "schedule")
+                {
+                    config->schedulePath = value[0] == '~' && std::getenv("HOME") ? std::getenv("HOME") + value.substr(1) : value;
+                    scheduleLine = number;
+                }
+                else
+                    throw std::invalid_argument("unknown key " + name);
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(path + ":" + std::to_string(number) + ": " + e.what());
+            }
+        }
+
+        if (!config->schedulePath.empty())
+        {
+            try
+            {
+                std::ifstream in(config->schedulePath);
+                if (!in)
+                    throw std::runtime_error("Failed to open schedule " + config->schedulePath);
+                config->schedule = schedule::parse(in, config->schedulePath, zones);
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(path + ":" + std::to_string(scheduleLine) + ": " + e.what());
+            }
+        }
+        config->userPresets = std::move(user);
+        return config;
+    }
+
+    // Builds the config's preset and layers, bottom to top, against its own user presets
+    // rather than the published ones. Call on the main thread: plugin layers load plugins.
+    inline std::vector<compositor::Layer> buildLayers(const Config &config)
+    {
+        struct Scope
+        {
+            explicit Scope(const presets::PresetMap *map) { presets::threadPresets() = map; }
+            ~Scope() { presets::threadPresets() = nullptr; }
+        } scope(config.userPresets.get());
+
+        std::vector<compositor::Layer> layers;
+        auto at = [&](size_t number, const std::function<compositor::Layer()> &build)
+        {
+            try
+            {
+                layers.push_back(build());
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(config.path + ":" + std::to_string(number) + ": " + e.what());
+            }
+        };
+        if (!config.preset.empty())
+            at(config.presetLine, [&]()
+               { return compositor::presetLayer(config.preset); });
+        for (size_t i = 0; i < config.layerSpecs.size(); ++i)
+            at(config.layerLines[i], [&]()
+               { return compositor::parseLayer(config.layerSpecs[i]); });
+        return layers;
+    }
+
+    // Watches files through their directories, so editors that save by writing a new file
+    // and renaming it over the old one are seen too.
+    class Watcher
+    {
+    public:
+        Watcher()
+        {
+            fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd_ < 0)
+                throw std::runtime_error(std::string("Failed to create inotify instance: ") + std::strerror(errno));
+        }
+
+        ~Watcher() { close(fd_); }
+
+        Watcher(const Watcher &) = delete;
+        Watcher &operator=(const Watcher &) = delete;
+
+        int fd() const { return fd_; }
+
+        void add(const std::string &path)
+        {
+            size_t slash = path.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+            int wd = inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+            if (wd < 0)
+                throw std::runtime_error("Failed to watch " + dir + ": " + std::strerror(errno));
+            files_.push_back({wd, path.substr(slash + 1)});
+        }
+
+        // Drains pending events; true if any concerned a watched file.
+        bool changed()
+        {
+            alignas(inotify_event) char buffer[4096];
+            bool hit = false;
+            ssize_t n;
+            while ((n = read(fd_, buffer, sizeof(buffer))) > 0)
+                for (char *p = buffer; p < buffer + n;)
+                {
+                    const auto *event = reinterpret_cast<const inotify_event *>(p);
+                    for (const auto &[wd, name] : files_)
+                        if (event->wd == wd && event->len && name == event->name)
+                            hit = true;
+                    p += sizeof(inotify_event) + event->len;
+                }
+            return hit;
+        }
+
+    private:
+        int fd_ = -1;
+        std::vector<std::pair<int, std::string>> files_;
+    };
+
+    // Outcome of one background reload, picked up by the main loop.
+    struct Reload
+    {
+        std::shared_ptr<const Config> config;
+        std::string error;
+        double parseMs = 0.0;
+        std::chrono::steady_clock::time_point noticed;
+    };
+
+    // Reparses the config on a background thread whenever it (or its schedule) changes,
+    // and signals fd() when a result is ready.
+    class Reloader
+    {
+    public:
+        Reloader(std::shared_ptr<const Config> initial, size_t zones) : zones_(zones), path_(initial->path)
+        {
+            ready_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            stop_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (ready_ < 0 || stop_ < 0)
+                throw std::runtime_error(std::string("Failed to create eventfd: ") + std::strerror(errno));
+            watchFiles(*initial);
+            thread_ = std::thread([this]()
+                                  { loop(); });
+        }
+
+        ~Reloader()
+        {
+            uint64_t one = 1;
+            (void)::write(stop_, &one, sizeof(one));
+            thread_.join();
+            close(ready_);
+            close(stop_);
+        }
+
+        Reloader(const Reloader &) = delete;
+        Reloader &operator=(const Reloader &) = delete;
+
+        int fd() const { return ready_; }
+
+        // The latest result, if one arrived since the last call.
+        std::optional<Reload> take()
+        {
+            uint64_t count;
+            if (read(ready_, &count, sizeof(count)) < 0)
+                return std::nullopt;
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::optional<Reload> result = std::move(pending_);
+            pending_.reset();
+            return result;
+        }
+
+    private:
+        void watchFiles(const Config &config)
+        {
+            if (watcher_ && config.schedulePath == schedulePath_)
+                return;
+            watcher_ = std::make_unique<Watcher>();
+            watcher_->add(path_);
+            schedulePath_ = config.schedulePath;
+            if (!schedulePath_.empty())
+                watcher_->add(schedulePath_);
+        }
+
+        void loop()
+        {
+            for (;;)
+            {
+                pollfd fds[2] = {{stop_, POLLIN, 0}, {watcher_->fd(), POLLIN, 0}};
+                if (poll(fds, 2, -1) < 0 && errno != EINTR)
+                    return;
+                if (fds[0].revents)
+                    return;
+                if (!fds[1].revents || !watcher_->changed())
+                    continue;
+
+                // Editors often write in several steps; let the burst settle first.
+                Reload reload;
+                reload.noticed = std::chrono::steady_clock::now();
+                pollfd settle[2] = {{stop_, POLLIN, 0}, {watcher_->fd(), POLLIN, 0}};
+                while (poll(settle, 2, 20) > 0)
+                {
+                    if (settle[0].revents)
+                        return;
+                    watcher_->changed();
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                try
+                {
+                    reload.config = parse(path_, zones_);
+                    // The schedule file may have moved; follow it.
+                    watchFiles(*reload.config);
+                }
+                catch (const std::exception &e)
+                {
+                    reload.error = e.what();
+                }
+                reload.parseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    pending_ = std::move(reload);
+                }
+                uint64_t one = 1;
+                (void)::write(ready_, &one, sizeof(one));
+            }
+        }
+
+        size_t zones_;
+        std::string path_;
+        int ready_ = -1;
+        int stop_ = -1;
+        std::string schedulePath_;
+        std::unique_ptr<Watcher> watcher_;
+        std::mutex mutex_;
+        std::optional<Reload> pending_;
+        std::thread thread_;
+    };
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OMEN_X86 1
+#define OMEN_TARGET(isa) __attribute__((target(isa)))
+#endif
@@ -55,8 +55,34 @@
 #define CMD_HELP       "help"
 #define CMD_EXIT       "exit"
 #define CMD_VERSION    "version"
+#define CMD_STREAM     "stream"
+#define CMD_BENCH      "bench"
+#define CMD_COMPOSE    "compose"
+#define CMD_EFFECT     "effect"
+#define CMD_PLUGINS    "plugins"
+#define CMD_RENDER     "render"
+#define CMD_LOOP       "loop"
+#define CMD_ANIMATE    "animate"
+#define CMD_RUN        "run"
+#define CMD_CYCLE      "cycle"
+#define CMD_REACT      "react"
+#define CMD_AUDIO      "audio"
+#define CMD_AMBIENT    "ambient"
+#define CMD_TYPING     "typing"
+#define CMD_AUTO_BRIGHTNESS "auto-brightness"
+#define CMD_OPENRGB    "openrgb"
+#define CMD_SERVE      "serve"
+#define CMD_TIMELINE   "timeline"
+#define CMD_PLAY       "play"
+#define CMD_SCHEDULE   "schedule"
+#define CMD_REPLAY     "replay"
+#define CMD_METRICS    "metrics"
+#define CMD_DEVICES    "devices"
+#define CMD_CALIBRATION "calibration"
 
 #define ZONES_TEXT "0, 1, 2, 3"
+#define ZONE_COUNT 4
+#define MAX_FRAME_COLORS 4096
 
 #define ANIMATION_MODES_TEXT "static, breathing, rainbow, wave, pulse, chase, sparkle, candle, aurora, disco"
 
@@ -72,8 +98,31 @@ PROGRAM_NAME " " CMD_ANIMATION " breathing 3\n"
 CMD_ZONES " <zone_number> <hex_color>   - Set a single zone color (" ZONES_TEXT ", RRGGBB)\n" \
 CMD_ALL " <hex_color>                   - Set all zones to the same color\n" \
 CMD_BRIGHTNESS " <0-100>                - Set keyboard brightness\n" \
+CMD_AUTO_BRIGHTNESS " [--curve spec]    - Follow an IIO ambient light sensor with hysteresis and rate limiting\n" \
 CMD_ANIMATION " <mode> <speed>          - Set animation mode and speed (" ANIMATION_MODES_TEXT ")\n" \
 CMD_READ " <option>                     - Read current setting (brightness, animation, zone0-3, all)\n" \
+CMD_DEVICES "                           - List rgb_zones devices; --device <name,...|dir|all> on any command drives them together\n" \
+CMD_CALIBRATION " [check <file>]        - Show per-zone color calibration of the selected devices, or check a profile\n" \
+CMD_STREAM "                            - Read hex frames from stdin, one line per frame\n" \
+CMD_COMPOSE " [--fps N] <layer>...      - Blend layers (preset:<name>, breathe:<s>, flash:<zone>:<hex>, dim:<zone>:<0-100>, expr:<expr>, plugin:<name>[:<args>])\n" \
+CMD_RENDER " <source>... --out <file>   - Render frames offline on a virtual clock (bin, ppm, text)\n" \
+CMD_TIMELINE " compile <in> <out>       - Compile a keyframe timeline for playback\n" \
+CMD_PLAY " <show> [--seek t] [--loop]   - Play a timeline with exact keyframe timing\n" \
+CMD_SCHEDULE " <file> [--next [N]]      - Run time-of-day lighting entries in-process, or list the next ones\n" \
+CMD_RUN " [--fifo path] <layer>...      - Stay resident, tickless while static, updates via FIFO\n" \
+CMD_OPENRGB " [--port N]                - Serve the keyboard to OpenRGB clients (SDK protocol) on loopback\n" \
+CMD_SERVE " [--socket path]             - Share the keyboard between clients by priority, with leases\n" \
+CMD_CYCLE " <preset> [--period S]       - Cycle a preset at the highest sustainable fps, cheaper on battery\n" \
+CMD_REACT " <zone>=<metric>...          - Color zones by cpu, temp or battery through gradients\n" \
+CMD_AUDIO " <file.wav|-> [--offline]    - Music visualizer: FFT bass/mid/treble levels onto zones\n" \
+CMD_AMBIENT " [--smooth A] < in.ppm     - Ambient light: average a PPM (P6) stream into one band per zone\n" \
+CMD_TYPING " <device|capture>           - Keypress ripple / heatmap from evdev events or a recorded capture\n" \
+CMD_ANIMATE " <effect> [preset]         - Animate via firmware when equivalent, else in userspace\n" \
+CMD_LOOP " [--period S] <layer>...      - Replay one precomputed period of a looping animation\n" \
+CMD_METRICS " [--textfile path]         - Sysfs write/read counters and latency from all runs, in Prometheus format\n" \
+CMD_REPLAY " <trace> [--fast]           - Re-issue a recorded write trace ($OMEN_RGB_TRACE) at original pace or flat out\n" \
+CMD_PLUGINS "                           - List effect plugins and the plugin search path\n" \
+CMD_EFFECT " [--fps N] <expression>     - Run an expression effect, e.g. \"hsv(t*0.2 + zone/4, 1, 0.5+0.5*sin(t))\"\n" \
 "\nPresets:\n" \
 CMD_PRESETS "                           - Browse all available flags and themes\n" \
 CMD_PRIDE_PRESETS "                     - Browse pride flag options\n" \
@@ -83,6 +132,7 @@ CMD_THEME_PRESETS "                     - Browse color theme options\n" \
 CMD_EXAMPLES "                          - Show example commands\n" \
 CMD_HELP "                              - Show this help page\n" \
 CMD_VERSION "                           - Show the software version\n" \
+CMD_BENCH " <name> [args...]            - Run a throughput benchmark (hex, color, expr, loop, ambient, serve, timeline, io, devices, calibration, dither)\n" \
 "Usage: " PROGRAM_NAME " <command> [args...]\n"
 
 #define RGB_HEX uint32_t
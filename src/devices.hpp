@@ -0,0 +1,134 @@
+#pragma once
+#include "calibration.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <dirent.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEVICE_ENV "OMEN_RGB_DEVICE"
+#define PLATFORM_PATH "/sys/devices/platform"
+#define DEFAULT_DEVICE "omen-rgb-keyboard"
+
+// Devices exposing the rgb_zones interface. Every attribute path in definitions.hpp names the
+// default device; the fs layer maps those paths onto each selected device.
+namespace omen::fs::devices {
+  struct Device {
+      std::string name;
+      // Unresolved device directory; its attributes live under <path>/rgb_zones.
+      std::string path;
+      // Sorted entries of rgb_zones, listed when the device was selected.
+      std::vector<std::string> attributes;
+      size_t zones = 0;
+      // Applied to every zone color written to this device.
+      std::shared_ptr<const omen::rgb::calibration::Profile> calibration;
+
+      bool has(const std::string& attribute) const {
+          return std::binary_search(attributes.begin(), attributes.end(), attribute);
+      }
+  };
+
+  inline std::vector<std::string> listDirectory(const std::string& dir) {
+      std::vector<std::string> entries;
+      if (DIR* handle = opendir(dir.c_str())) {
+          while (dirent* entry = readdir(handle)) {
+              if (entry->d_name[0] != '.') {
+                  entries.push_back(entry->d_name);
+              }
+          }
+          closedir(handle);
+      }
+      std::sort(entries.begin(), entries.end());
+      return entries;
+  }
+
+  // Fills in a device from its resolved directory; false if it has no rgb_zones.
+  inline bool probe(Device& device, const std::string& resolved) {
+      device.attributes = listDirectory(resolved + "/rgb_zones");
+      device.zones = 0;
+      while (device.has(std::string(device.zones < 10 ? "zone0" : "zone") + std::to_string(device.zones))) {
+          ++device.zones;
+      }
+      return !device.attributes.empty();
+  }
+
+  // Runs a batch of tasks across a few threads, the caller included, and returns when all
+  // are done. One batch at a time; concurrent callers take turns.
+  class Pool {
+  public:
+      explicit Pool(size_t threads) {
+          for (size_t i = 0; i < threads; ++i) {
+              workers_.emplace_back([this]() { work(); });
+          }
+      }
+
+      ~Pool() {
+          {
+              std::lock_guard<std::mutex> lock(mutex_);
+              stop_ = true;
+          }
+          wake_.notify_all();
+          for (auto& worker : workers_) {
+              worker.join();
+          }
+      }
+
+      Pool(const Pool&) = delete;
+      Pool& operator=(const Pool&) = delete;
+
+      size_t threads() const { return workers_.size(); }
+
+      void run(size_t count, const std::function<void(size_t)>& task) {
+          std::unique_lock<std::mutex> lock(mutex_);
+          idle_.wait(lock, [this]() { return !task_; });
+          task_ = &task;
+          count_ = count;
+          next_ = 0;
+          done_ = 0;
+          if (count > 1) {
+              wake_.notify_all();
+          }
+          while (next_ < count_) {
+              size_t i = next_++;
+              lock.unlock();
+              task(i);
+              lock.lock();
+              ++done_;
+          }
+          finished_.wait(lock, [this]() { return done_ == count_; });
+          task_ = nullptr;
+          idle_.notify_one();
+      }
+
+  private:
+      void work() {
+          std::unique_lock<std::mutex> lock(mutex_);
+          for (;;) {
+              wake_.wait(lock, [this]() { return stop_ || (task_ && next_ < count_); });
+              if (stop_) {
+                  return;
+              }
+              size_t i = next_++;
+              const auto* task = task_;
+              lock.unlock();
+              (*task)(i);
+              lock.lock();
+              if (++done_ == count_) {
+                  finished_.notify_all();
+              }
+          }
+      }
+
+      std::vector<std::thread> workers_;
+      std::mutex mutex_;
+      std::condition_variable wake_, finished_, idle_;
+      const std::function<void(size_t)>* task_ = nullptr;
+      size_t count_ = 0, next_ = 0, done_ = 0;
+      bool stop_ = false;
+  };
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "color.hpp"
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "output.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Temporal dithering: animations are composed at 16 bits per channel and each zone alternates
+// between the two nearest 8-bit levels so that, averaged over a few frames, it shows the
+// value in between. Slow fades at low levels then glide instead of stepping.
+namespace omen::rgb::dither
+{
+    // Below this rate the alternation can show as flicker, so auto mode rounds instead.
+    constexpr double MIN_FPS = 60.0;
+
+    enum class Mode
+    {
+        Auto,
+        On,
+        Off
+    };
+
+    inline Mode parseMode(const std::string &name)
+    {
+        std::string mode = utils::toLower(name);
+        if (mode == "auto")
+            return Mode::Auto;
+        if (mode == "on")
+            return Mode::On;
+        if (mode == "off")
+            return Mode::Off;
+        throw std::invalid_argument("Invalid dither mode: " + name + ". Valid modes: auto, on, off");
+    }
+
+    inline bool enabled(Mode mode, double fps) { return mode == Mode::On || (mode == Mode::Auto && fps >= MIN_FPS); }
+
+    // First-order error diffusion across frames: each channel carries its rounding error into
+    // the next frame, so the shown levels average out to the 16-bit value.
+    class Temporal
+    {
+    public:
+        explicit Temporal(size_t zones) : error_(zones * 3, 0) {}
+
+        void reset() { std::fill(error_.begin(), error_.end(), 0); }
+
+        void quantize(const color::Color16 *in, RGB_HEX *out, size_t zones)
+        {
+            for (size_t i = 0; i < zones && i * 3 < error_.size(); ++i)
+            {
+                RGB_HEX pixel = compositor::OPAQUE;
+                const uint16_t channels[3] = {in[i].r, in[i].g, in[i].b};
+                for (int c = 0; c < 3; ++c)
+                {
+                    int32_t &error = error_[i * 3 + c];
+                    int32_t want = channels[c] + error;
+                    int32_t level = std::clamp((want + 128) / 257, 0, 255);
+                    error = std::clamp(want - level * 257, -257, 257);
+                    pixel |= static_cast<RGB_HEX>(level) << (16 - 8 * c);
+                }
+                out[i] = pixel;
+            }
+        }
+
+    private:
+        std::vector<int32_t> error_;
+    };
+
+    // The end of a render loop: composes, then writes the 8-bit frame or, while something
+    // animates and dithering is on, the 16-bit frame dithered down. Static stacks are never
+    // dithered, so they stay tickless.
+    class Stage
+    {
+    public:
+        explicit Stage(compositor::Compositor &comp) : comp_(comp), temporal_(comp.zones()), frame_(comp.zones()) {}
+
+        void setEnabled(bool enabled)
+        {
+            if (enabled != enabled_)
+                comp_.setDeep(enabled);
+            enabled_ = enabled;
+        }
+
+        bool enabled() const { return enabled_; }
+
+        void frame(double t, output::ZoneWriter &writer)
+        {
+            bool changed = comp_.compose(t);
+            if (enabled_ && comp_.animated())
+            {
+                temporal_.quantize(comp_.deepFrame(), frame_.data(), comp_.zones());
+                writer.write(frame_.data(), comp_.zones());
+                dithering_ = true;
+                return;
+            }
+            // Leaving dithering: the last frame written may be a level off.
+            if (changed || dithering_)
+                writer.write(comp_.frame(), comp_.zones());
+            temporal_.reset();
+            dithering_ = false;
+        }
+
+    private:
+        compositor::Compositor &comp_;
+        Temporal temporal_;
+        std::vector<RGB_HEX> frame_;
+        bool enabled_ = false;
+        bool dithering_ = false;
+    };
+}
@@ -1,3 +1,4 @@
+#pragma once
 namespace omen::enums
 {
     enum class Command {
@@ -52,6 +53,30 @@ namespace omen::enums
       ThemePresets,
       Examples,
       Version,
+      Stream,
+      Bench,
+      Compose,
+      Effect,
+      Plugins,
+      Render,
+      Loop,
+      Animate,
+      Run,
+      Cycle,
+      React,
+      Audio,
+      Ambient,
+      Typing,
+      AutoBrightness,
+      OpenRgb,
+      Serve,
+      Timeline,
+      Play,
+      Schedule,
+      Replay,
+      Metrics,
+      Devices,
+      Calibration,
       Unknown
   };
 }
@@ -0,0 +1,586 @@
+#pragma once
+#include "definitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Effect expressions such as "hsv(t*0.2 + zone/4, 1, 0.5+0.5*sin(t))".
+// Sources are parsed once into a tree, constant-folded and flattened into
+// stack bytecode; evaluation runs on a fixed-size stack with no allocation.
+// Variables: t (seconds), zone, zones, pos (zone / zones), pi.
+// The result is hsv(h,s,v) or rgb(r,g,b) with channels in 0-1, or a bare
+// scalar rendered as gray. Hue is in turns, so it wraps every 1.0.
+namespace omen::rgb::expr
+{
+    enum class Op : uint8_t
+    {
+        Const,
+        T,
+        Zone,
+        Zones,
+        Pos,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+        Pow,
+        Neg,
+        Sin,
+        Cos,
+        Abs,
+        Floor,
+        Fract,
+        Sqrt,
+        Min,
+        Max,
+        Clamp,
+        Mix,
+        Step,
+    };
+
+    struct Function
+    {
+        const char *name;
+        Op op;
+        uint8_t arity;
+    };
+
+    inline constexpr std::array<Function, 13> FUNCTIONS = {{
+        {"sin", Op::Sin, 1},
+        {"cos", Op::Cos, 1},
+        {"abs", Op::Abs, 1},
+        {"floor", Op::Floor, 1},
+        {"fract", Op::Fract, 1},
+        {"sqrt", Op::Sqrt, 1},
+        {"pow", Op::Pow, 2},
+        {"min", Op::Min, 2},
+        {"max", Op::Max, 2},
+        {"step", Op::Step, 2},
+        {"mod", Op::Mod, 2},
+        {"clamp", Op::Clamp, 3},
+        {"mix", Op::Mix, 3},
+    }};
+
+    inline double apply(Op op, const double *a)
+    {
+        switch (op)
+        {
+        case Op::Add:
+            return a[0] + a[1];
+        case Op::Sub:
+            return a[0] - a[1];
+        case Op::Mul:
+            return a[0] * a[1];
+        case Op::Div:
+            return a[1] != 0.0 ? a[0] / a[1] : 0.0;
+        case Op::Mod:
+            return a[1] != 0.0 ? a[0] - a[1] * std::floor(a[0] / a[1]) : 0.0;
+        case Op::Pow:
+            return std::pow(a[0], a[1]);
+        case Op::Neg:
+            return -a[0];
+        case Op::Sin:
+            return std::sin(a[0]);
+        case Op::Cos:
+            return std::cos(a[0]);
+        case Op::Abs:
+            return std::fabs(a[0]);
+        case Op::Floor:
+            return std::floor(a[0]);
+        case Op::Fract:
+            return a[0] - std::floor(a[0]);
+        case Op::Sqrt:
+            return a[0] > 0.0 ? std::sqrt(a[0]) : 0.0;
+        case Op::Min:
+            return std::min(a[0], a[1]);
+        case Op::Max:
+            return std::max(a[0], a[1]);
+        case Op::Clamp:
+            return std::min(std::max(a[0], a[1]), a[2]);
+        case Op::Mix:
+            return a[0] + (a[1] - a[0]) * a[2];
+        case Op::Step:
+            return a[1] >= a[0] ? 1.0 : 0.0;
+        default:
+            return 0.0;
+        }
+    }
+
+    inline size_t arity(Op op)
+    {
+        switch (op)
+        {
+        case Op::Const:
+        case Op::T:
+        case Op::Zone:
+        case Op::Zones:
+        case Op::Pos:
+            return 0;
+        case Op::Neg:
+            return 1;
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+        case Op::Div:
+        case Op::Mod:
+        case Op::Pow:
+            return 2;
+        default:
+            for (const auto &fn : FUNCTIONS)
+                if (fn.op == op)
+                    return fn.arity;
+            return 0;
+        }
+    }
+
+    // Clamps to 0-1, mapping NaN and infinities to 0.
+    inline double unit(double c) { return std::isfinite(c) ? std::clamp(c, 0.0, 1.0) : 0.0; }
+
+    inline RGB_HEX hsvToRgb(double h, double s, double v)
+    {
+        h = std::isfinite(h) ? (h - std::floor(h)) * 6.0 : 0.0;
+        s = unit(s);
+        v = unit(v);
+        int sector = static_cast<int>(h) % 6;
+        double f = h - std::floor(h);
+        double p = v * (1.0 - s), q = v * (1.0 - s * f), u = v * (1.0 - s * (1.0 - f));
+        double r, g, b;
+        switch (sector)
+        {
+        case 0: r = v, g = u, b = p; break;
+        case 1: r = q, g = v, b = p; break;
+        case 2: r = p, g = v, b = u; break;
+        case 3: r = p, g = q, b = v; break;
+        case 4: r = u, g = p, b = v; break;
+        default: r = v, g = p, b = q; break;
+        }
+        auto byte = [](double c)
+        { return static_cast<RGB_HEX>(c * 255.0 + 0.5); };
+        return byte(r) << 16 | byte(g) << 8 | byte(b);
+    }
+
+    inline RGB_HEX rgbToHex(double r, double g, double b)
+    {
+        auto byte = [](double c)
+        { return static_cast<RGB_HEX>(unit(c) * 255.0 + 0.5); };
+        return byte(r) << 16 | byte(g) << 8 | byte(b);
+    }
+
+    class Program
+    {
+    public:
+        static constexpr size_t MAX_STACK = 64;
+
+        enum class Output
+        {
+            Gray,
+            Rgb,
+            Hsv
+        };
+
+        struct Instr
+        {
+            Op op;
+            uint8_t arity;
+            uint16_t index;
+        };
+
+        Program() = default;
+        Program(Output output, std::vector<Instr> code, std::vector<double> constants, bool usesTime)
+            : output_(output), code_(std::move(code)), constants_(std::move(constants)), usesTime_(usesTime) {}
+
+        size_t size() const { return code_.size(); }
+        bool usesTime() const { return usesTime_; }
+
+        RGB_HEX eval(double t, size_t zone, size_t zones) const
+        {
+            double stack[MAX_STACK];
+            size_t sp = 0;
+            for (const Instr &in : code_)
+            {
+                switch (in.op)
+                {
+                case Op::Const:
+                    stack[sp++] = constants_[in.index];
+                    break;
+                case Op::T:
+                    stack[sp++] = t;
+                    break;
+                case Op::Zone:
+                    stack[sp++] = static_cast<double>(zone);
+                    break;
+                case Op::Zones:
+                    stack[sp++] = static_cast<double>(zones);
+                    break;
+                case Op::Pos:
+                    stack[sp++] = static_cast<double>(zone) / static_cast<double>(zones);
+                    break;
+                case Op::Add:
+                    --sp;
+                    stack[sp - 1] += stack[sp];
+                    break;
+                case Op::Sub:
+                    --sp;
+                    stack[sp - 1] -= stack[sp];
+                    break;
+                case Op::Mul:
+                    --sp;
+                    stack[sp - 1] *= stack[sp];
+                    break;
+                default:
+                    sp -= in.arity - 1;
+                    stack[sp - 1] = apply(in.op, &stack[sp - 1]);
+                    break;
+                }
+            }
+
+            switch (output_)
+            {
+            case Output::Hsv:
+                return hsvToRgb(stack[0], stack[1], stack[2]);
+            case Output::Rgb:
+                return rgbToHex(stack[0], stack[1], stack[2]);
+            default:
+                return rgbToHex(stack[0], stack[0], stack[0]);
+            }
+        }
+
+        void render(double t, RGB_HEX *frame, size_t zones) const
+        {
+            for (size_t zone = 0; zone < zones; ++zone)
+                frame[zone] = eval(t, zone, zones);
+        }
+
+    private:
+        Output output_ = Output::Gray;
+        std::vector<Instr> code_;
+        std::vector<double> constants_;
+        bool usesTime_ = false;
+    };
+
+    namespace detail
+    {
+        struct Node
+        {
+            Op op;
+            double value = 0.0;
+            size_t height = 1;
+            std::vector<std::unique_ptr<Node>> args;
+        };
+
+        using NodePtr = std::unique_ptr<Node>;
+
+        // Bounds parser recursion and tree height, so hostile input cannot exhaust the stack.
+        constexpr size_t MAX_NESTING = 256;
+
+        [[noreturn]] inline void tooDeep(const std::string &source)
+        {
+            throw std::invalid_argument("Expression is nested too deeply: " + source);
+        }
+
+        class Parser
+        {
+        public:
+            explicit Parser(const std::string &source) : src_(source) {}
+
+            // Parses the whole source; hsv()/rgb() are only allowed as the outermost call.
+            std::vector<NodePtr> parseRoot(Program::Output &output)
+            {
+                std::vector<NodePtr> channels;
+                skip();
+                size_t mark = pos_;
+                std::string name = identifier();
+                if ((name == "hsv" || name == "rgb") && peek('('))
+                {
+                    output = name == "hsv" ? Program::Output::Hsv : Program::Output::Rgb;
+                    channels = arguments(name, 3);
+                }
+                else
+                {
+                    pos_ = mark;
+                    output = Program::Output::Gray;
+                    channels.push_back(expression());
+                }
+                skip();
+                if (pos_ != src_.size())
+                    fail("Unexpected '" + std::string(1, src_[pos_]) + "'");
+                return channels;
+            }
+
+        private:
+            [[noreturn]] void fail(const std::string &message) const
+            {
+                throw std::invalid_argument(message + " at position " + std::to_string(pos_ + 1) + " in expression: " + src_);
+            }
+
+            void skip()
+            {
+                while (pos_ < src_.size() && std::isspace(static_cast<unsigned char>(src_[pos_])))
+                    ++pos_;
+            }
+
+            bool peek(char c)
+            {
+                skip();
+                return pos_ < src_.size() && src_[pos_] == c;
+            }
+
+            bool accept(char c)
+            {
+                if (!peek(c))
+                    return false;
+                ++pos_;
+                return true;
+            }
+
+            void expect(char c)
+            {
+                if (!accept(c))
+                    fail(std::string("Expected '") + c + "'");
+            }
+
+            std::string identifier()
+            {
+                skip();
+                size_t start = pos_;
+                while (pos_ < src_.size() && (std::isalnum(static_cast<unsigned char>(src_[pos_])) || src_[pos_] == '_'))
+                    ++pos_;
+                return src_.substr(start, pos_ - start);
+            }
+
+            static NodePtr constant(double value)
+            {
+                auto node = std::make_unique<Node>();
+                node->op = Op::Const;
+                node->value = value;
+                return node;
+            }
+
+            // Builds an operator node, folding it to a constant when every argument is constant.
+            NodePtr make(Op op, std::vector<NodePtr> args)
+            {
+                size_t height = 0;
+                for (const auto &arg : args)
+                    height = std::max(height, arg->height);
+                if (height >= MAX_NESTING)
+                    tooDeep(src_);
+                bool folded = std::all_of(args.begin(), args.end(), [](const NodePtr &n)
+                                          { return n->op == Op::Const; });
+                if (folded)
+                {
+                    double values[3] = {};
+                    for (size_t i = 0; i < args.size(); ++i)
+                        values[i] = args[i]->value;
+                    return constant(apply(op, values));
+                }
+                auto node = std::make_unique<Node>();
+                node->op = op;
+                node->height = height + 1;
+                node->args = std::move(args);
+                return node;
+            }
+
+            NodePtr make(Op op, NodePtr a, NodePtr b)
+            {
+                std::vector<NodePtr> args;
+                args.push_back(std::move(a));
+                args.push_back(std::move(b));
+                return make(op, std::move(args));
+            }
+
+            std::vector<NodePtr> arguments(const std::string &name, size_t count)
+            {
+                expect('(');
+                std::vector<NodePtr> args;
+                if (!peek(')'))
+                {
+                    do
+                        args.push_back(expression());
+                    while (accept(','));
+                }
+                expect(')');
+                if (args.size() != count)
+                    fail(name + "() takes " + std::to_string(count) + " arguments");
+                return args;
+            }
+
+            NodePtr expression()
+            {
+                NodePtr left = term();
+                for (;;)
+                {
+                    if (accept('+'))
+                        left = make(Op::Add, std::move(left), term());
+                    else if (accept('-'))
+                        left = make(Op::Sub, std::move(left), term());
+                    else
+                        return left;
+                }
+            }
+
+            NodePtr term()
+            {
+                NodePtr left = unary();
+                for (;;)
+                {
+                    if (accept('*'))
+                        left = make(Op::Mul, std::move(left), unary());
+                    else if (accept('/'))
+                        left = make(Op::Div, std::move(left), unary());
+                    else if (accept('%'))
+                        left = make(Op::Mod, std::move(left), unary());
+                    else
+                        return left;
+                }
+            }
+
+            // Every recursive path runs through here, so this is where nesting is counted.
+            NodePtr unary()
+            {
+                struct Level
+                {
+                    explicit Level(Parser &parser) : parser_(parser)
+                    {
+                        if (++parser_.nesting_ > MAX_NESTING)
+                            tooDeep(parser_.src_);
+                    }
+                    ~Level() { --parser_.nesting_; }
+                    Parser &parser_;
+                } level(*this);
+
+                if (accept('-'))
+                {
+                    std::vector<NodePtr> args;
+                    args.push_back(unary());
+                    return make(Op::Neg, std::move(args));
+                }
+                if (accept('+'))
+                    return unary();
+                NodePtr base = primary();
+                if (accept('^'))
+                    return make(Op::Pow, std::move(base), unary());
+                return base;
+            }
+
+            NodePtr primary()
+            {
+                skip();
+                if (pos_ >= src_.size())
+                    fail("Unexpected end");
+
+                char c = src_[pos_];
+                if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+                {
+                    size_t used = 0;
+                    double value = 0.0;
+                    try
+                    {
+                        value = std::stod(src_.substr(pos_), &used);
+                    }
+                    catch (const std::exception &)
+                    {
+                        fail("Invalid number");
+                    }
+                    pos_ += used;
+                    return constant(value);
+                }
+                if (accept('('))
+                {
+                    NodePtr inner = expression();
+                    expect(')');
+                    return inner;
+                }
+
+                std::string name = identifier();
+                if (name.empty())
+                    fail("Unexpected '" + std::string(1, c) + "'");
+
+                if (peek('('))
+                {
+                    for (const auto &fn : FUNCTIONS)
+                        if (name == fn.name)
+                            return make(fn.op, arguments(name, fn.arity));
+                    if (name == "hsv" || name == "rgb")
+                        fail(name + "() is only allowed as the outermost call");
+                    fail("Unknown function " + name + "()");
+                }
+
+                if (name == "pi")
+                    return constant(M_PI);
+                Op op;
+                if (name == "t")
+                    op = Op::T;
+                else if (name == "zone")
+                    op = Op::Zone;
+                else if (name == "zones")
+                    op = Op::Zones;
+                else if (name == "pos")
+                    op = Op::Pos;
+                else
+                    fail("Unknown variable " + name);
+                auto node = std::make_unique<Node>();
+                node->op = op;
+                return node;
+            }
+
+            const std::string &src_;
+            size_t pos_ = 0;
+            size_t nesting_ = 0;
+        };
+
+        struct Emitter
+        {
+            std::vector<Program::Instr> code;
+            std::vector<double> constants;
+            size_t depth = 0;
+            size_t maxDepth = 0;
+            bool usesTime = false;
+
+            void emit(const Node &node, const std::string &source, size_t level = 0)
+            {
+                if (level >= MAX_NESTING)
+                    tooDeep(source);
+                for (const auto &arg : node.args)
+                    emit(*arg, source, level + 1);
+
+                uint16_t index = 0;
+                if (node.op == Op::Const)
+                {
+                    auto it = std::find(constants.begin(), constants.end(), node.value);
+                    index = static_cast<uint16_t>(it - constants.begin());
+                    if (it == constants.end())
+                        constants.push_back(node.value);
+                }
+                size_t n = arity(node.op);
+                usesTime |= node.op == Op::T;
+                code.push_back({node.op, static_cast<uint8_t>(n), index});
+
+                depth = depth - n + 1;
+                maxDepth = std::max(maxDepth, depth);
+            }
+        };
+    }
+
+    inline Program compile(const std::string &source)
+    {
+        Program::Output output;
+        std::vector<detail::NodePtr> channels = detail::Parser(source).parseRoot(output);
+
+        detail::Emitter emitter;
+        for (const auto &channel : channels)
+            emitter.emit(*channel, source);
+        if (emitter.maxDepth > Program::MAX_STACK)
+            detail::tooDeep(source);
+        if (emitter.constants.size() > UINT16_MAX)
+            throw std::invalid_argument("Expression has too many constants: " + source);
+
+        return Program(output, std::move(emitter.code), std::move(emitter.constants), emitter.usesTime);
+    }
+}
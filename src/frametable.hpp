@@ -0,0 +1,306 @@
+#pragma once
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "render.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define CACHE_DIR_ENV "OMEN_RGB_CACHE_DIR"
+
+// One period of a looping animation rendered ahead of time and replayed by index,
+// optionally kept in a memory-mapped cache file so later runs skip rendering.
+namespace omen::rgb::frametable
+{
+    struct Key
+    {
+        std::vector<std::string> sources;
+        double period = 8.0;
+        double fps = 30.0;
+        size_t zones = ZONE_COUNT;
+
+        size_t frames() const { return static_cast<size_t>(std::max(1L, std::lround(period * fps))); }
+
+        std::string text() const
+        {
+            std::string key;
+            for (const auto &source : sources)
+                key += source + "\n";
+            std::ostringstream oss;
+            oss << "period=" << period << " fps=" << fps << " zones=" << zones;
+            return key + oss.str();
+        }
+    };
+
+    class Table
+    {
+    public:
+        // Renders the loop in memory.
+        static std::shared_ptr<const Table> build(const Key &key)
+        {
+            if (key.period <= 0.0 || key.fps <= 0.0)
+                throw std::invalid_argument("loop needs period > 0 and fps > 0");
+
+            auto table = std::shared_ptr<Table>(new Table(key));
+            table->owned_ = render::renderFrames(key.sources, {key.frames(), key.fps, key.zones});
+            table->colors_ = table->owned_.data();
+            return table;
+        }
+
+        // Maps a cache file written by save(); returns nullptr if it is missing or
+        // was written for a different key.
+        static std::shared_ptr<const Table> map(const std::string &path, const Key &key)
+        {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return nullptr;
+            struct stat st;
+            void *data = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+                data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED)
+                return nullptr;
+
+            auto table = std::shared_ptr<Table>(new Table(key));
+            table->mapping_ = data;
+            table->mappingSize_ = static_cast<size_t>(st.st_size);
+
+            std::string header = table->header();
+            size_t bytes = header.size() + key.frames() * key.zones * sizeof(RGB_HEX);
+            if (table->mappingSize_ != bytes || std::memcmp(data, header.data(), header.size()) != 0)
+                return nullptr;
+            table->colors_ = reinterpret_cast<const RGB_HEX *>(static_cast<const char *>(data) + header.size());
+            return table;
+        }
+
+        ~Table()
+        {
+            if (mapping_)
+                munmap(mapping_, mappingSize_);
+        }
+
+        Table(const Table &) = delete;
+        Table &operator=(const Table &) = delete;
+
+        const Key &key() const { return key_; }
+        size_t frames() const { return frames_; }
+        bool mapped() const { return mapping_ != nullptr; }
+        size_t bytes() const { return frames_ * key_.zones * sizeof(RGB_HEX); }
+
+        const RGB_HEX *frame(size_t index) const { return colors_ + index * key_.zones; }
+
+        const RGB_HEX *at(double t) const
+        {
+            auto index = static_cast<long long>(std::floor(t * key_.fps)) % static_cast<long long>(frames_);
+            return frame(static_cast<size_t>(index < 0 ? index + static_cast<long long>(frames_) : index));
+        }
+
+        // Writes to a temporary file and renames it into place, so a concurrent
+        // reader never maps a partial table.
+        void save(const std::string &path) const
+        {
+            std::string tmp = path + ".tmp" + std::to_string(getpid());
+            {
+                std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+                std::string header = this->header();
+                file.write(header.data(), static_cast<std::streamsize>(header.size()));
+                file.write(reinterpret_cast<const char *>(colors_), static_cast<std::streamsize>(bytes()));
+                if (!file)
+                {
+                    std::remove(tmp.c_str());
+                    throw std::runtime_error("Failed to write frame cache: " + tmp);
+                }
+            }
+            if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                std::remove(tmp.c_str());
+                throw std::runtime_error("Failed to install frame cache " + path + ": " + std::strerror(errno));
+            }
+        }
+
+    private:
+        explicit Table(Key key) : key_(std::move(key)), frames_(key_.frames()) {}
+
+        // "OMENFTB1", u32 zones, u32 frames, u32 key length, key text, padded to 4 bytes.
+        // Colors follow in native byte order; the cache is never shared between machines.
+        std::string header() const
+        {
+            std::string key = key_.text();
+            std::string header = "OMENFTB1";
+            for (uint32_t value : {static_cast<uint32_t>(key_.zones), static_cast<uint32_t>(frames_), static_cast<uint32_t>(key.size())})
+                header.append(reinterpret_cast<const char *>(&value), sizeof(value));
+            header += key;
+            header.resize((header.size() + 3) & ~size_t(3), '\0');
+            return header;
+        }
+
+        Key key_;
+        size_t frames_;
+        std::vector<RGB_HEX> owned_;
+        const RGB_HEX *colors_ = nullptr;
+        void *mapping_ = nullptr;
+        size_t mappingSize_ = 0;
+    };
+
+    // $OMEN_RGB_CACHE_DIR, else $XDG_CACHE_HOME/omen-rgb-cli, else ~/.cache/omen-rgb-cli.
+    inline std::string cacheDir()
+    {
+        if (const char *dir = std::getenv(CACHE_DIR_ENV); dir && *dir)
+            return dir;
+        if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+            return std::string(xdg) + "/omen-rgb-cli";
+        const char *home = std::getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.cache/omen-rgb-cli";
+    }
+
+    inline std::string cachePath(const Key &key)
+    {
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (char c : key.text())
+            h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        return cacheDir() + "/" + render::hashHex(h) + ".ftab";
+    }
+
+    // Lifetime lookup counters, kept next to the cache files.
+    struct CacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        double hitRate() const { return hits + misses ? 100.0 * hits / (hits + misses) : 0.0; }
+    };
+
+    inline CacheStats readStats()
+    {
+        CacheStats stats;
+        std::ifstream file(cacheDir() + "/stats");
+        file >> stats.hits >> stats.misses;
+        return stats;
+    }
+
+    struct Lookup
+    {
+        std::shared_ptr<const Table> table;
+        bool hit = false;
+        std::string path;
+        CacheStats stats;
+    };
+
+    // Frames compared against a live render before a cached table is trusted.
+    constexpr size_t CHECK_FRAMES = 8;
+
+    // True if frames spread evenly over the table still match a live render of its sources,
+    // which a changed preset or layer definition would break.
+    inline bool matchesLive(const Table &table)
+    {
+        const Key &key = table.key();
+        compositor::Compositor comp(key.zones);
+        for (const auto &source : key.sources)
+            comp.add(compositor::parseLayer(source));
+        size_t checks = std::min(CHECK_FRAMES, table.frames());
+        for (size_t k = 0; k < checks; ++k)
+        {
+            size_t index = k * table.frames() / checks;
+            comp.compose(static_cast<double>(index) / key.fps);
+            if (!std::equal(comp.frame(), comp.frame() + key.zones, table.frame(index), [](RGB_HEX live, RGB_HEX cached)
+                            { return (live & 0xFFFFFF) == cached; }))
+                return false;
+        }
+        return true;
+    }
+
+    // The shortest period after which every animated layer repeats, to the millisecond:
+    // the least common multiple of their periods, or 0 if nothing animates. Empty if a layer
+    // has no known period or the result would exceed maxSeconds.
+    inline std::optional<double> loopPeriod(const std::vector<std::string> &sources, double maxSeconds = 300.0)
+    {
+        const auto limit = static_cast<long long>(maxSeconds * 1000.0);
+        long long ms = 1;
+        bool animated = false;
+        for (const auto &source : sources)
+        {
+            compositor::Layer layer = compositor::parseLayer(source);
+            if (!layer.animated)
+                continue;
+            long long period = std::llround(layer.period * 1000.0);
+            if (period <= 0)
+                return std::nullopt;
+            animated = true;
+            ms = std::lcm(ms, period);
+            if (ms > limit)
+                return std::nullopt;
+        }
+        return animated ? static_cast<double>(ms) / 1000.0 : 0.0;
+    }
+
+    // Maps the cached loop for key, or renders and stores it. A cached table that no
+    // longer matches a live render (see matchesLive) counts as a miss.
+    inline Lookup load(const Key &key, bool useCache = true)
+    {
+        Lookup result;
+        if (!useCache)
+        {
+            result.table = Table::build(key);
+            return result;
+        }
+
+        result.path = cachePath(key);
+        result.table = Table::map(result.path, key);
+        if (result.table)
+            result.hit = matchesLive(*result.table);
+        if (!result.hit)
+        {
+            result.table = Table::build(key);
+            std::string dir = cacheDir();
+            size_t slash = dir.rfind('/');
+            if (slash != std::string::npos && slash > 0)
+                mkdir(dir.substr(0, slash).c_str(), 0755);
+            mkdir(dir.c_str(), 0755);
+            try
+            {
+                result.table->save(result.path);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << MSG_ERR(e.what()) << "\n";
+            }
+        }
+
+        result.stats = readStats();
+        ++(result.hit ? result.stats.hits : result.stats.misses);
+        std::ofstream(cacheDir() + "/stats") << result.stats.hits << " " << result.stats.misses << "\n";
+        return result;
+    }
+
+    // Plays the table back on the compositor clock.
+    inline compositor::Layer layer(std::shared_ptr<const Table> table)
+    {
+        compositor::Layer layer{"loop", compositor::BlendMode::Normal, 255, true};
+        layer.period = table->key().period;
+        layer.render = [table](double t, RGB_HEX *frame, size_t zones)
+        {
+            const RGB_HEX *colors = table->at(t);
+            size_t n = std::min(zones, table->key().zones);
+            for (size_t i = 0; i < n; ++i)
+                frame[i] = compositor::OPAQUE | colors[i];
+        };
+        return layer;
+    }
+}
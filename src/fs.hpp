@@ -1,38 +1,339 @@
 #pragma once
+#include "devices.hpp"
+#include "iostats.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cerrno>
 #include <string>
+#include <cstdlib>
 #include <fstream>
+#include <ftw.h>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define SYSFS_ROOT_ENV "OMEN_RGB_SYSFS_ROOT"
+#define PROCFS_ROOT_ENV "OMEN_RGB_PROC_ROOT"
 
 namespace omen::fs {
-  inline bool writeSysfs(const std::string& path, const std::string& value) {
-      std::ofstream file(path);
+  inline std::string rootFromEnv(const char* name) {
+      const char* value = std::getenv(name);
+      return std::string(value ? value : "");
+  }
+
+  // The prefix for /sys paths: $OMEN_RGB_SYSFS_ROOT, unless a Scratch tree stands in.
+  inline std::string& sysfsRoot() {
+      static std::string root = rootFromEnv(SYSFS_ROOT_ENV);
+      return root;
+  }
+
+  // Prefixes /sys paths with $OMEN_RGB_SYSFS_ROOT and /proc paths with $OMEN_RGB_PROC_ROOT
+  // so directories of fake files can stand in for the driver and the kernel.
+  inline std::string resolve(const std::string& path) {
+      static const std::string procRoot = rootFromEnv(PROCFS_ROOT_ENV);
+      const std::string& sysRoot = sysfsRoot();
+      if (!sysRoot.empty() && path.rfind("/sys/", 0) == 0) {
+          return sysRoot + path;
+      }
+      if (!procRoot.empty() && path.rfind("/proc/", 0) == 0) {
+          return procRoot + path;
+      }
+      return path;
+  }
+
+  // Start of a sysfs operation for the write trace and the I/O counters; 0 when both are off.
+  inline uint64_t ioBegin() {
+      return trace::Recorder::instance() || stats::Recorder::instance() ? trace::monotonicNs() : 0;
+  }
+
+  inline void ioEnd(stats::Op op, uint64_t start, const std::string& path, const std::string& value, int error) {
+      if (!start) {
+          return;
+      }
+      uint64_t end = trace::monotonicNs();
+      if (trace::Recorder* recorder = trace::Recorder::instance(); recorder && op == stats::Write) {
+          recorder->write(path, value, start, end, error);
+      }
+      if (stats::Recorder* recorder = stats::Recorder::instance()) {
+          recorder->record(op, path, value.size(), end - start, error);
+      }
+  }
+
+  // The devices that device attribute paths go to. By default only omen-rgb-keyboard,
+  // unprobed, with every path used as given.
+  struct Selection {
+      std::vector<devices::Device> devices{{DEFAULT_DEVICE, PLATFORM_PATH "/" DEFAULT_DEVICE, {}, 0,
+                                            omen::rgb::calibration::load(DEFAULT_DEVICE)}};
+      std::unique_ptr<devices::Pool> pool;
+  };
+
+  inline Selection& selection() {
+      static Selection selected;
+      return selected;
+  }
+
+  // The same attribute path on another device.
+  inline std::string onDevice(const devices::Device& device, const std::string& path) {
+      static const std::string prefix = PLATFORM_PATH "/" DEFAULT_DEVICE "/";
+      if (path.compare(0, prefix.size(), prefix) != 0 || device.path == PLATFORM_PATH "/" DEFAULT_DEVICE) {
+          return path;
+      }
+      return device.path + path.substr(prefix.size() - 1);
+  }
+
+  // True if the device lists the rgb_zones attribute the path names; other paths are served by all.
+  inline bool serves(const devices::Device& device, const std::string& path) {
+      static const std::string prefix = PLATFORM_PATH "/" DEFAULT_DEVICE "/rgb_zones/";
+      return path.compare(0, prefix.size(), prefix) != 0 || device.has(path.substr(prefix.size()));
+  }
+
+  // The device reads come from: the first selected one that has the attribute.
+  inline const devices::Device& readDevice(const std::string& path) {
+      const auto& selected = selection().devices;
+      for (const auto& device : selected) {
+          if (selected.size() == 1 || serves(device, path)) {
+              return device;
+          }
+      }
+      return selected.front();
+  }
+
+  // Every platform device with an rgb_zones directory, the default one first.
+  inline std::vector<devices::Device> listDevices() {
+      std::vector<devices::Device> found;
+      for (const auto& name : devices::listDirectory(resolve(PLATFORM_PATH))) {
+          devices::Device device{name, PLATFORM_PATH "/" + name, {}, 0};
+          if (devices::probe(device, resolve(device.path))) {
+              found.insert(name == DEFAULT_DEVICE ? found.begin() : found.end(), std::move(device));
+          }
+      }
+      return found;
+  }
+
+  // Selects devices from a comma list of platform device names or device directories, or
+  // "all". Writes to several devices run on a pool of up to `threads` extra threads.
+  inline void selectDevices(const std::string& spec, size_t threads = 3) {
+      std::vector<devices::Device> chosen;
+      if (spec == "all") {
+          chosen = listDevices();
+          for (auto& device : chosen) {
+              device.calibration = omen::rgb::calibration::load(device.name);
+          }
+          if (chosen.empty()) {
+              throw std::runtime_error("No devices with rgb_zones under " + resolve(PLATFORM_PATH));
+          }
+      } else {
+          size_t begin = 0;
+          while (begin <= spec.size()) {
+              size_t end = std::min(spec.find(',', begin), spec.size());
+              std::string item = spec.substr(begin, end - begin);
+              begin = end + 1;
+              if (item.empty()) {
+                  continue;
+              }
+              bool directory = item.find('/') != std::string::npos;
+              devices::Device device{item, directory ? item : PLATFORM_PATH "/" + item, {}, 0};
+              if (!devices::probe(device, resolve(device.path))) {
+                  std::string known;
+                  for (const auto& other : listDevices()) {
+                      known += (known.empty() ? "" : ", ") + other.name;
+                  }
+                  throw std::runtime_error("No rgb_zones device " + item + " (found: " + (known.empty() ? "none" : known) + ")");
+              }
+              device.calibration = omen::rgb::calibration::load(device.name);
+              chosen.push_back(std::move(device));
+          }
+          if (chosen.empty()) {
+              throw std::invalid_argument("Empty device selection");
+          }
+      }
+      Selection& selected = selection();
+      selected.pool.reset();
+      selected.devices = std::move(chosen);
+      if (selected.devices.size() > 1 && threads > 0) {
+          selected.pool = std::make_unique<devices::Pool>(std::min(threads, selected.devices.size() - 1));
+      }
+  }
+
+  // A zone color as the device should receive it: through the device's calibration profile,
+  // if it has one. Other attributes and values pass through.
+  inline std::string calibrated(const devices::Device& device, const std::string& path, const std::string& value) {
+      static const std::string prefix = PLATFORM_PATH "/" DEFAULT_DEVICE "/rgb_zones/zone";
+      if (!device.calibration || value.size() != 6 || path.compare(0, prefix.size(), prefix) != 0) {
+          return value;
+      }
+      char* end = nullptr;
+      unsigned long zone = std::strtoul(path.c_str() + prefix.size(), &end, 10);
+      if (*end || end == path.c_str() + prefix.size()) {
+          return value;
+      }
+      unsigned long color = std::strtoul(value.c_str(), &end, 16);
+      if (end != value.c_str() + 6) {
+          return value;
+      }
+      static const char digits[] = "0123456789ABCDEF";
+      uint32_t out = device.calibration->apply(zone, static_cast<uint32_t>(color));
+      std::string hex(6, '0');
+      for (int i = 5; i >= 0; --i, out >>= 4) {
+          hex[i] = digits[out & 0xF];
+      }
+      return hex;
+  }
+
+  // Flushed before the check so a value the driver rejects is reported here, not lost in
+  // the stream destructor. Traced and counted through ioEnd.
+  inline bool writeAttribute(const std::string& path, const std::string& value) {
+      uint64_t start = ioBegin();
+      errno = 0;
+      std::ofstream file(resolve(path));
       if (!file) {
+          ioEnd(stats::Write, start, path, value, errno ? errno : EIO);
           std::cerr << "Failed to open sysfs path for writing: " << path << "\n";
           return false;
       }
 
-      file << value;
+      file << value << std::flush;
       if (!file) {
+          ioEnd(stats::Write, start, path, value, errno ? errno : EIO);
           std::cerr << "Failed to write value to sysfs path: " << path << "\n";
           return false;
       }
 
+      ioEnd(stats::Write, start, path, value, 0);
       return true;
   }
 
-  inline std::string readSysfs(const std::string& path) {
-      std::ifstream file(path);
+  using Write = std::pair<std::string, std::string>;
+
+  // Issues a batch of writes on every selected device: each device writes its share in order
+  // on its own pool thread, so the batch takes as long as the slowest device. An attribute no
+  // device lists goes to the first so the failure is reported. Entry i is true if it
+  // succeeded everywhere it was written.
+  inline std::vector<char> writeBatch(const std::vector<Write>& writes) {
+      const Selection& selected = selection();
+      const auto& targets = selected.devices;
+      std::vector<char> ok(writes.size(), 1);
+      if (targets.size() == 1) {
+          for (size_t i = 0; i < writes.size(); ++i) {
+              ok[i] = writeAttribute(onDevice(targets[0], writes[i].first), calibrated(targets[0], writes[i].first, writes[i].second));
+          }
+          return ok;
+      }
+
+      std::vector<char> unserved(writes.size(), 1);
+      for (size_t i = 0; i < writes.size(); ++i) {
+          for (const auto& device : targets) {
+              unserved[i] = unserved[i] && !serves(device, writes[i].first);
+          }
+      }
+      // A row per device, so threads never write the same byte.
+      std::vector<std::vector<char>> results(targets.size(), std::vector<char>(writes.size(), 1));
+      auto task = [&](size_t d) {
+          for (size_t i = 0; i < writes.size(); ++i) {
+              if (serves(targets[d], writes[i].first) || (d == 0 && unserved[i])) {
+                  results[d][i] = writeAttribute(onDevice(targets[d], writes[i].first), calibrated(targets[d], writes[i].first, writes[i].second));
+              }
+          }
+      };
+      if (selected.pool) {
+          selected.pool->run(targets.size(), task);
+      } else {
+          for (size_t d = 0; d < targets.size(); ++d) {
+              task(d);
+          }
+      }
+      for (const auto& row : results) {
+          for (size_t i = 0; i < writes.size(); ++i) {
+              ok[i] = ok[i] && row[i];
+          }
+      }
+      return ok;
+  }
+
+  inline bool writeSysfs(const std::string& path, const std::string& value) {
+      if (selection().devices.size() == 1) {
+          const devices::Device& device = selection().devices[0];
+          return writeAttribute(onDevice(device, path), calibrated(device, path, value));
+      }
+      return writeBatch({{path, value}})[0];
+  }
+
+  // A traced write as it was recorded: its path already names the device and its value is
+  // already calibrated, so neither is mapped again.
+  inline bool writeRecorded(const std::string& path, const std::string& value) { return writeAttribute(path, value); }
+
+  inline std::string readSysfs(const std::string& logical) {
+      std::string path = onDevice(readDevice(logical), logical);
+      uint64_t start = ioBegin();
+      errno = 0;
+      std::ifstream file(resolve(path));
       if (!file) {
+          ioEnd(stats::Read, start, path, "", errno ? errno : EIO);
           throw std::runtime_error("Failed to open sysfs path for reading: " + path);
       }
 
       std::string value;
       std::getline(file, value);
+      ioEnd(stats::Read, start, path, value, 0);
       return value;
   }
 
   inline bool sysfsExists(const std::string& path) {
-      std::ifstream file(path);
+      std::ifstream file(resolve(onDevice(readDevice(path), path)));
       return file.good();
   }
+
+  // A throwaway keyboard with `zones` black zones in a new directory under /tmp, standing in
+  // for /sys and for the device selection until destroyed, so self-checks never drive real
+  // hardware. Create it before starting threads that do sysfs I/O.
+  class Scratch {
+  public:
+      explicit Scratch(size_t zones) {
+          char dir[] = "/tmp/omen-rgb-check-XXXXXX";
+          if (!mkdtemp(dir)) {
+              throw std::runtime_error("Failed to create a scratch sysfs tree under /tmp");
+          }
+          root_ = dir;
+          std::string path = root_;
+          for (const char* part : {"/sys", "/devices", "/platform", "/" DEFAULT_DEVICE, "/rgb_zones"}) {
+              path += part;
+              mkdir(path.c_str(), 0755);
+          }
+          std::vector<Write> files{{"brightness", "100"}, {"animation_mode", "static"}, {"animation_speed", "1"}};
+          for (size_t zone = 0; zone < zones; ++zone) {
+              files.push_back({(zone < 10 ? "zone0" : "zone") + std::to_string(zone), "000000"});
+          }
+          for (const auto& [name, value] : files) {
+              std::ofstream(path + "/" + name) << value << "\n";
+          }
+
+          saved_ = std::move(selection().devices);
+          savedPool_ = std::move(selection().pool);
+          selection().devices = {{DEFAULT_DEVICE, PLATFORM_PATH "/" DEFAULT_DEVICE, {}, 0, nullptr}};
+          savedRoot_ = sysfsRoot();
+          sysfsRoot() = root_;
+      }
+
+      ~Scratch() {
+          sysfsRoot() = savedRoot_;
+          selection().devices = std::move(saved_);
+          selection().pool = std::move(savedPool_);
+          nftw(root_.c_str(), [](const char* path, const struct stat*, int, struct FTW*) { return ::remove(path); }, 16,
+               FTW_DEPTH | FTW_PHYS);
+      }
+
+      Scratch(const Scratch&) = delete;
+      Scratch& operator=(const Scratch&) = delete;
+
+      const std::string& root() const { return root_; }
+
+  private:
+      std::string root_, savedRoot_;
+      std::vector<devices::Device> saved_;
+      std::unique_ptr<devices::Pool> savedPool_;
+  };
 }
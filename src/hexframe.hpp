@@ -0,0 +1,243 @@
+#pragma once
+#include "cpu.hpp"
+#include "definitions.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Bulk parser for text frames such as "FF0000 00FF00 0000FF FFFFFF".
+// Canonical runs (6 hex digits + single space) are decoded and validated
+// in SIMD blocks; anything else ('#' prefixes, tabs, repeated blanks)
+// goes through the scalar token path, which also produces the errors.
+namespace omen::rgb::hexframe
+{
+    enum class Backend
+    {
+        Scalar,
+        Ssse3,
+        Avx2
+    };
+
+    inline const char *backendName(Backend backend)
+    {
+        switch (backend)
+        {
+        case Backend::Ssse3:
+            return "ssse3";
+        case Backend::Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+        }
+    }
+
+    inline bool isSupported(Backend backend)
+    {
+#ifdef OMEN_X86
+        if (backend == Backend::Avx2)
+            return __builtin_cpu_supports("avx2");
+        if (backend == Backend::Ssse3)
+            return __builtin_cpu_supports("ssse3");
+#endif
+        return backend == Backend::Scalar;
+    }
+
+    inline Backend bestBackend()
+    {
+        static const Backend best = isSupported(Backend::Avx2)    ? Backend::Avx2
+                                    : isSupported(Backend::Ssse3) ? Backend::Ssse3
+                                                                  : Backend::Scalar;
+        return best;
+    }
+
+    namespace detail
+    {
+        constexpr std::array<int8_t, 256> makeNibbleTable()
+        {
+            std::array<int8_t, 256> table{};
+            for (int i = 0; i < 256; ++i)
+                table[i] = -1;
+            for (int i = 0; i < 10; ++i)
+                table['0' + i] = static_cast<int8_t>(i);
+            for (int i = 0; i < 6; ++i)
+            {
+                table['A' + i] = static_cast<int8_t>(10 + i);
+                table['a' + i] = static_cast<int8_t>(10 + i);
+            }
+            return table;
+        }
+
+        inline constexpr std::array<int8_t, 256> NIBBLE = makeNibbleTable();
+
+        inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+        inline const char *skipSpace(const char *p, const char *end)
+        {
+            while (p != end && isSpace(*p))
+                ++p;
+            return p;
+        }
+
+        // Parses one token at p (which is not whitespace) and returns the position after it.
+        inline const char *parseToken(const char *p, const char *end, RGB_HEX *out, size_t capacity, size_t &count)
+        {
+            if (count == capacity)
+                throw std::invalid_argument("Frame has more than " + std::to_string(capacity) + " colors");
+
+            if (*p == '#')
+                ++p;
+            if (end - p < 6)
+                throw std::invalid_argument("Hex string must have exactly 6 characters");
+
+            RGB_HEX color = 0;
+            int8_t bad = 0;
+            for (int i = 0; i < 6; ++i)
+            {
+                int8_t value = NIBBLE[static_cast<unsigned char>(p[i])];
+                bad |= value;
+                color = (color << 4) | static_cast<RGB_HEX>(value & 0xF);
+            }
+            p += 6;
+
+            if (bad < 0)
+                throw std::invalid_argument("Invalid character in hex string");
+            if (p != end && !isSpace(*p))
+                throw std::invalid_argument("Hex string must have exactly 6 characters");
+
+            out[count++] = color;
+            return p;
+        }
+
+#ifdef OMEN_X86
+        // Each 16-byte lane holds two colors at bytes 0-5 and 7-12 with spaces at 6 and 13.
+        OMEN_TARGET("ssse3")
+        inline bool decode2Ssse3(const char *p, RGB_HEX *out)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lower));
+            uint32_t hexMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(digit, alpha)));
+            uint32_t spaceMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(' '))));
+            if ((hexMask & 0x1FBF) != 0x1FBF || (spaceMask & 0x2040) != 0x2040)
+                return false;
+
+            __m128i nibbles = _mm_add_epi8(_mm_and_si128(c, _mm_set1_epi8(0x0F)),
+                                           _mm_and_si128(alpha, _mm_set1_epi8(9)));
+            nibbles = _mm_shuffle_epi8(nibbles, _mm_setr_epi8(0, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11, 12, -1, -1, -1, -1));
+            __m128i channels = _mm_maddubs_epi16(nibbles, _mm_setr_epi8(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 0, 0, 0, 0));
+            __m128i colors = _mm_shuffle_epi8(channels, _mm_setr_epi8(4, 2, 0, -1, 10, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out), colors);
+            return true;
+        }
+
+        // Same layout as decode2Ssse3, with the second lane loaded from p + 14.
+        OMEN_TARGET("avx2")
+        inline bool decode4Avx2(const char *p, RGB_HEX *out)
+        {
+            __m256i c = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 14)), 1);
+            __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+            __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+            __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+            uint32_t hexMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)));
+            uint32_t spaceMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '))));
+            if ((hexMask & 0x1FBF1FBF) != 0x1FBF1FBF || (spaceMask & 0x20402040) != 0x20402040)
+                return false;
+
+            __m256i nibbles = _mm256_add_epi8(_mm256_and_si256(c, _mm256_set1_epi8(0x0F)),
+                                              _mm256_and_si256(alpha, _mm256_set1_epi8(9)));
+            nibbles = _mm256_shuffle_epi8(nibbles, _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11, 12, -1, -1, -1, -1,
+                                                                    0, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11, 12, -1, -1, -1, -1));
+            __m256i channels = _mm256_maddubs_epi16(nibbles, _mm256_setr_epi8(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 0, 0, 0, 0,
+                                                                              16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 0, 0, 0, 0));
+            __m256i colors = _mm256_shuffle_epi8(channels, _mm256_setr_epi8(4, 2, 0, -1, 10, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                            4, 2, 0, -1, 10, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            colors = _mm256_permute4x64_epi64(colors, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(colors));
+            return true;
+        }
+
+        OMEN_TARGET("ssse3")
+        inline size_t parseSsse3(const char *p, const char *end, RGB_HEX *out, size_t capacity)
+        {
+            size_t count = 0;
+            for (;;)
+            {
+                while (end - p >= 16 && capacity - count >= 2 && decode2Ssse3(p, out + count))
+                {
+                    p += 14;
+                    count += 2;
+                }
+                p = skipSpace(p, end);
+                if (p == end)
+                    return count;
+                p = parseToken(p, end, out, capacity, count);
+            }
+        }
+
+        OMEN_TARGET("avx2")
+        inline size_t parseAvx2(const char *p, const char *end, RGB_HEX *out, size_t capacity)
+        {
+            size_t count = 0;
+            for (;;)
+            {
+                while (end - p >= 30 && capacity - count >= 4 && decode4Avx2(p, out + count))
+                {
+                    p += 28;
+                    count += 4;
+                }
+                if (end - p >= 16 && capacity - count >= 2 && decode2Ssse3(p, out + count))
+                {
+                    p += 14;
+                    count += 2;
+                    continue;
+                }
+                p = skipSpace(p, end);
+                if (p == end)
+                    return count;
+                p = parseToken(p, end, out, capacity, count);
+            }
+        }
+#endif
+
+        inline size_t parseScalar(const char *p, const char *end, RGB_HEX *out, size_t capacity)
+        {
+            size_t count = 0;
+            for (;;)
+            {
+                p = skipSpace(p, end);
+                if (p == end)
+                    return count;
+                p = parseToken(p, end, out, capacity, count);
+            }
+        }
+    }
+
+    // Decodes every color on the line into out[0..capacity) and returns how many were written.
+    // Throws std::invalid_argument on malformed colors or when the line holds more than capacity colors.
+    inline size_t parseFrame(std::string_view line, RGB_HEX *out, size_t capacity, Backend backend = bestBackend())
+    {
+        const char *p = line.data();
+        const char *end = p + line.size();
+        switch (backend)
+        {
+#ifdef OMEN_X86
+        case Backend::Avx2:
+            return detail::parseAvx2(p, end, out, capacity);
+        case Backend::Ssse3:
+            return detail::parseSsse3(p, end, out, capacity);
+#endif
+        default:
+            return detail::parseScalar(p, end, out, capacity);
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include "compositor.hpp"
+#include "fs.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <dirent.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define IIO_DEVICES_PATH "/sys/bus/iio/devices"
+#define IIO_DIR_ENV "OMEN_RGB_IIO_DIR"
+
+// Keyboard brightness from an IIO ambient light sensor: lux through a curve, then
+// hysteresis and a rate limit so sensor noise does not become driver writes.
+namespace omen::rgb::illuminance
+{
+    // $OMEN_RGB_IIO_DIR, else /sys/bus/iio/devices under the sysfs root.
+    inline std::string devicesDir()
+    {
+        if (const char *dir = std::getenv(IIO_DIR_ENV); dir && *dir)
+            return dir;
+        return omen::fs::resolve(IIO_DEVICES_PATH);
+    }
+
+    // The first IIO device with in_illuminance_input (lux), or in_illuminance_raw scaled by
+    // the optional in_illuminance_scale and in_illuminance_offset attributes.
+    class Sensor
+    {
+    public:
+        explicit Sensor(std::string device = "")
+        {
+            std::vector<std::string> candidates;
+            if (!device.empty())
+            {
+                candidates.push_back(device);
+            }
+            else if (DIR *d = opendir(devicesDir().c_str()))
+            {
+                while (dirent *entry = readdir(d))
+                    if (entry->d_name[0] != '.')
+                        candidates.push_back(devicesDir() + "/" + entry->d_name);
+                closedir(d);
+                std::sort(candidates.begin(), candidates.end());
+            }
+
+            for (const auto &dir : candidates)
+            {
+                if (readable(dir + "/in_illuminance_input"))
+                {
+                    input_ = std::make_unique<metrics::PreopenedFile>(dir + "/in_illuminance_input");
+                }
+                else if (readable(dir + "/in_illuminance_raw"))
+                {
+                    input_ = std::make_unique<metrics::PreopenedFile>(dir + "/in_illuminance_raw");
+                    scale_ = attribute(dir + "/in_illuminance_scale", 1.0);
+                    offset_ = attribute(dir + "/in_illuminance_offset", 0.0);
+                }
+                if (input_)
+                {
+                    path_ = dir;
+                    return;
+                }
+            }
+            throw std::runtime_error("No IIO illuminance sensor under " + (device.empty() ? devicesDir() : device));
+        }
+
+        const std::string &path() const { return path_; }
+
+        double lux() { return std::max(0.0, (std::strtod(input_->read(), nullptr) + offset_) * scale_); }
+
+    private:
+        static bool readable(const std::string &path) { return access(path.c_str(), R_OK) == 0; }
+
+        static double attribute(const std::string &path, double fallback)
+        {
+            if (!readable(path))
+                return fallback;
+            return std::strtod(metrics::PreopenedFile(path).read(), nullptr);
+        }
+
+        std::string path_;
+        std::unique_ptr<metrics::PreopenedFile> input_;
+        double scale_ = 1.0;
+        double offset_ = 0.0;
+    };
+
+    // Brightness in percent, interpolated between points on a log10(1 + lux) axis since
+    // perceived brightness follows the logarithm of illuminance.
+    class Curve
+    {
+    public:
+        static constexpr const char *DEFAULT = "0:10,10:25,100:50,1000:80,10000:100";
+
+        // "<lux>:<percent>,..." with increasing lux, e.g. 0:10,100:50,1000:100.
+        explicit Curve(const std::string &spec = DEFAULT)
+        {
+            size_t start = 0;
+            while (start <= spec.size())
+            {
+                size_t comma = std::min(spec.find(',', start), spec.size());
+                std::string point = spec.substr(start, comma - start);
+                size_t colon = point.find(':');
+                if (colon == std::string::npos)
+                    throw std::invalid_argument("Curve points must be <lux>:<percent>: " + point);
+                double lux = compositor::parseNumber(point.substr(0, colon), "lux");
+                double percent = compositor::parseNumber(point.substr(colon + 1), "brightness");
+                if (lux < 0.0 || percent < 0.0 || percent > 100.0 || (!points_.empty() && lux <= std::expm1(points_.back().first)))
+                    throw std::invalid_argument("Curve points need increasing lux >= 0 and brightness 0-100: " + point);
+                points_.emplace_back(std::log1p(lux), percent);
+                start = comma + 1;
+            }
+        }
+
+        double at(double lux) const
+        {
+            double x = std::log1p(std::max(0.0, lux));
+            if (x <= points_.front().first)
+                return points_.front().second;
+            for (size_t i = 1; i < points_.size(); ++i)
+                if (x <= points_[i].first)
+                {
+                    const auto &[x0, y0] = points_[i - 1];
+                    const auto &[x1, y1] = points_[i];
+                    return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+                }
+            return points_.back().second;
+        }
+
+    private:
+        std::vector<std::pair<double, double>> points_;
+    };
+
+    struct Settings
+    {
+        // Smoothing factor applied to each lux sample.
+        double smoothing = 0.3;
+        // Percentage points the curve must move from the current target before it is adopted.
+        double threshold = 5.0;
+        // Maximum brightness change in percentage points per second.
+        double rate = 20.0;
+    };
+
+    // Smooths lux, adopts a new target only past the threshold and ramps the output to it
+    // no faster than the rate limit. update() returns true when the written level should change.
+    class Controller
+    {
+    public:
+        Controller(Curve curve, Settings settings, int initial = -1)
+            : curve_(std::move(curve)), settings_(settings), level_(initial), output_(initial) {}
+
+        bool update(double lux, double elapsed)
+        {
+            smoothed_ = smoothed_ < 0.0 ? lux : smoothed_ + settings_.smoothing * (lux - smoothed_);
+            double wanted = curve_.at(smoothed_);
+            if (target_ < 0.0 || std::abs(wanted - target_) > settings_.threshold)
+                target_ = wanted;
+
+            // Without a known starting level the first target is applied at once.
+            output_ = output_ < 0.0 ? target_ : output_ + std::clamp(target_ - output_, -settings_.rate * elapsed, settings_.rate * elapsed);
+            int level = static_cast<int>(std::lround(output_));
+            if (level == level_)
+                return false;
+            level_ = level;
+            return true;
+        }
+
+        int level() const { return level_; }
+        double lux() const { return smoothed_; }
+        double target() const { return target_; }
+
+    private:
+        Curve curve_;
+        Settings settings_;
+        double smoothed_ = -1.0;
+        double target_ = -1.0;
+        int level_;
+        double output_;
+    };
+}
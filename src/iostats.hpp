@@ -0,0 +1,313 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <ostream>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#define STATS_PATH_ENV "OMEN_RGB_STATS"
+
+// Sysfs I/O counters shared by every invocation: a small memory-mapped segment under /dev/shm
+// holding an attribute table and per-process lanes of relaxed atomic counters. A process
+// claims a lane (reusing one whose owner has exited, counters and all) and is its only
+// writer, so recording never contends; readers sum all lanes.
+namespace omen::fs::stats {
+  enum Op { Write = 0, Read = 1 };
+
+  constexpr uint64_t MAGIC = 0x3153544E454D4FULL; // "OMENTS1"
+  constexpr size_t ATTRIBUTES = 48;
+  constexpr size_t NAME_SIZE = 112;
+  constexpr size_t LANES = 32;
+  constexpr size_t ERRNOS = 134;
+  // Yields while waiting for another process to finish naming an entry; one that died midway
+  // leaves it half-claimed, and after this many the entry is skipped.
+  constexpr int NAME_WAIT_YIELDS = 10000;
+  // Histogram upper bounds in microseconds; the last bucket is +Inf.
+  constexpr double BUCKETS_US[] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000};
+  constexpr size_t BUCKETS = sizeof(BUCKETS_US) / sizeof(BUCKETS_US[0]) + 1;
+
+  using Counter = std::atomic<uint64_t>;
+  static_assert(Counter::is_always_lock_free, "shared counters must be lock-free");
+
+  struct AttributeCounters {
+      Counter ops[2];
+      Counter failures[2];
+      Counter bytes[2];
+  };
+
+  struct Lane {
+      std::atomic<uint32_t> pid;
+      uint32_t reserved;
+      AttributeCounters attributes[ATTRIBUTES];
+      Counter errors[ERRNOS];
+      Counter buckets[2][BUCKETS];
+      Counter latencyNs[2];
+  };
+
+  struct Name {
+      // 0 free, 1 being claimed, 2 ready.
+      std::atomic<uint32_t> state;
+      char text[NAME_SIZE];
+  };
+
+  struct Segment {
+      std::atomic<uint64_t> magic;
+      Name names[ATTRIBUTES];
+      // Lane 0 is shared by processes that find no free lane.
+      Lane lanes[LANES];
+  };
+
+  // $OMEN_RGB_STATS ("off" disables), else /dev/shm/omen-rgb-cli-<uid>.stats.
+  inline std::string segmentPath() {
+      if (const char* path = std::getenv(STATS_PATH_ENV); path && *path) {
+          return path;
+      }
+      return "/dev/shm/omen-rgb-cli-" + std::to_string(getuid()) + ".stats";
+  }
+
+  // Maps the segment, creating it zero-filled (a valid empty state) if needed.
+  inline Segment* map(const std::string& path, bool create) {
+      if (path == "off") {
+          return nullptr;
+      }
+      int fd = open(path.c_str(), (create ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0600);
+      if (fd < 0) {
+          return nullptr;
+      }
+      struct stat info = {};
+      if (fstat(fd, &info) != 0 || (static_cast<size_t>(info.st_size) < sizeof(Segment) &&
+                                    (!create || ftruncate(fd, sizeof(Segment)) != 0))) {
+          close(fd);
+          return nullptr;
+      }
+      void* memory = mmap(nullptr, sizeof(Segment), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (memory == MAP_FAILED) {
+          return nullptr;
+      }
+      auto* segment = static_cast<Segment*>(memory);
+      uint64_t expected = 0;
+      if (create) {
+          segment->magic.compare_exchange_strong(expected, MAGIC);
+      }
+      if (segment->magic.load() != MAGIC) {
+          munmap(memory, sizeof(Segment));
+          return nullptr;
+      }
+      return segment;
+  }
+
+  class Recorder {
+  public:
+      // The process-wide recorder, or nullptr if the segment is disabled or unavailable.
+      static Recorder* instance() {
+          static Recorder* recorder = []() -> Recorder* {
+              Segment* segment = map(segmentPath(), true);
+              return segment ? new Recorder(segment) : nullptr;
+          }();
+          return recorder && recorder->enabled_ ? recorder : nullptr;
+      }
+
+      // For measuring the instrumentation itself.
+      void setEnabled(bool enabled) { enabled_ = enabled; }
+
+      void record(Op op, const std::string& path, size_t bytes, uint64_t latencyNs, int error) {
+          AttributeCounters& attribute = lane_->attributes[attributeIndex(path)];
+          attribute.ops[op].fetch_add(1, std::memory_order_relaxed);
+          attribute.bytes[op].fetch_add(bytes, std::memory_order_relaxed);
+          if (error) {
+              attribute.failures[op].fetch_add(1, std::memory_order_relaxed);
+              lane_->errors[error > 0 && static_cast<size_t>(error) < ERRNOS ? error : 0].fetch_add(1, std::memory_order_relaxed);
+          }
+          double us = static_cast<double>(latencyNs) * 1e-3;
+          size_t bucket = 0;
+          while (bucket + 1 < BUCKETS && us > BUCKETS_US[bucket]) {
+              ++bucket;
+          }
+          lane_->buckets[op][bucket].fetch_add(1, std::memory_order_relaxed);
+          lane_->latencyNs[op].fetch_add(latencyNs, std::memory_order_relaxed);
+      }
+
+  private:
+      explicit Recorder(Segment* segment) : segment_(segment), lane_(&segment->lanes[0]) {
+          uint32_t self = static_cast<uint32_t>(getpid());
+          for (size_t i = 1; i < LANES; ++i) {
+              std::atomic<uint32_t>& owner = segment->lanes[i].pid;
+              uint32_t pid = owner.load();
+              bool free = pid == 0 || (pid != self && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH);
+              if (free && owner.compare_exchange_strong(pid, self)) {
+                  lane_ = &segment->lanes[i];
+                  break;
+              }
+          }
+      }
+
+      // Index of path in the shared table, claiming a free entry the first time. The last
+      // entry collects attributes that no longer fit. Cached per thread, so recording takes
+      // no lock.
+      size_t attributeIndex(const std::string& path) {
+          thread_local std::unordered_map<std::string, size_t> cache;
+          if (auto it = cache.find(path); it != cache.end()) {
+              return it->second;
+          }
+          size_t index = ATTRIBUTES - 1;
+          for (size_t i = 0; i + 1 < ATTRIBUTES; ++i) {
+              Name& name = segment_->names[i];
+              uint32_t state = name.state.load(std::memory_order_acquire);
+              if (state == 0 && name.state.compare_exchange_strong(state, 1)) {
+                  std::strncpy(name.text, path.c_str(), NAME_SIZE - 1);
+                  name.state.store(2, std::memory_order_release);
+                  index = i;
+                  break;
+              }
+              // Another process is writing this name; it finishes within a few instructions.
+              for (int yields = 0; state == 1 && yields < NAME_WAIT_YIELDS; ++yields) {
+                  sched_yield();
+                  state = name.state.load(std::memory_order_acquire);
+              }
+              if (state == 2 && path.compare(0, NAME_SIZE - 1, name.text) == 0) {
+                  index = i;
+                  break;
+              }
+          }
+          cache[path] = index;
+          return index;
+      }
+
+      Segment* segment_;
+      Lane* lane_;
+      bool enabled_ = true;
+  };
+
+  inline const char* errnoName(int error) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 32)
+      if (const char* name = strerrorname_np(error)) {
+          return name;
+      }
+#endif
+      return nullptr;
+  }
+
+  // Sums all lanes of the segment at path into Prometheus text exposition format.
+  inline bool exposition(std::ostream& out, const std::string& path) {
+      Segment* segment = map(path, false);
+      if (!segment) {
+          return false;
+      }
+      auto sum = [&](auto get) {
+          uint64_t total = 0;
+          for (const Lane& lane : segment->lanes) {
+              total += get(lane).load(std::memory_order_relaxed);
+          }
+          return total;
+      };
+      static const char* ops[] = {"write", "read"};
+      auto label = [&](size_t i) {
+          if (i + 1 == ATTRIBUTES) {
+              return std::string("other");
+          }
+          std::string text(segment->names[i].text, strnlen(segment->names[i].text, NAME_SIZE));
+          std::string escaped;
+          for (char c : text) {
+              escaped += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+          }
+          return escaped;
+      };
+      auto used = [&](size_t i) {
+          return i + 1 == ATTRIBUTES || segment->names[i].state.load(std::memory_order_acquire) == 2;
+      };
+      // Entries sharing a name, which a process that gave up waiting on a slow claim can
+      // create, are reported as one.
+      std::vector<std::vector<size_t>> groups;
+      for (size_t i = 0; i < ATTRIBUTES; ++i) {
+          if (!used(i)) {
+              continue;
+          }
+          auto same = std::find_if(groups.begin(), groups.end(), [&](const std::vector<size_t>& group) {
+              return i + 1 < ATTRIBUTES && group[0] + 1 < ATTRIBUTES &&
+                     strncmp(segment->names[group[0]].text, segment->names[i].text, NAME_SIZE) == 0;
+          });
+          if (same != groups.end()) {
+              same->push_back(i);
+          } else {
+              groups.push_back({i});
+          }
+      }
+
+      struct Family {
+          const char* name;
+          const char* help;
+          int field;
+      };
+      static const Family families[] = {
+          {"omen_rgb_sysfs_operations_total", "Sysfs reads and writes by attribute.", 0},
+          {"omen_rgb_sysfs_failures_total", "Failed sysfs reads and writes by attribute.", 1},
+          {"omen_rgb_sysfs_bytes_total", "Bytes written to or read from sysfs by attribute.", 2},
+      };
+      for (const Family& family : families) {
+          out << "# HELP " << family.name << " " << family.help << "\n# TYPE " << family.name << " counter\n";
+          for (const auto& group : groups) {
+              for (int op = 0; op < 2; ++op) {
+                  uint64_t value = 0;
+                  for (size_t i : group) {
+                      value += sum([&](const Lane& lane) -> const Counter& {
+                          const AttributeCounters& a = lane.attributes[i];
+                          return family.field == 0 ? a.ops[op] : family.field == 1 ? a.failures[op] : a.bytes[op];
+                      });
+                  }
+                  if (value || family.field == 0) {
+                      out << family.name << "{attribute=\"" << label(group[0]) << "\",op=\"" << ops[op] << "\"} " << value << "\n";
+                  }
+              }
+          }
+      }
+
+      out << "# HELP omen_rgb_sysfs_errors_total Failed sysfs operations by errno.\n# TYPE omen_rgb_sysfs_errors_total counter\n";
+      for (size_t e = 0; e < ERRNOS; ++e) {
+          uint64_t value = sum([&](const Lane& lane) -> const Counter& { return lane.errors[e]; });
+          if (value) {
+              const char* name = e ? errnoName(static_cast<int>(e)) : nullptr;
+              out << "omen_rgb_sysfs_errors_total{errno=\"" << (name ? name : e ? std::to_string(e) : "other") << "\"} " << value << "\n";
+          }
+      }
+
+      out << "# HELP omen_rgb_sysfs_latency_seconds Sysfs operation latency.\n# TYPE omen_rgb_sysfs_latency_seconds histogram\n";
+      for (int op = 0; op < 2; ++op) {
+          uint64_t cumulative = 0;
+          for (size_t b = 0; b < BUCKETS; ++b) {
+              cumulative += sum([&](const Lane& lane) -> const Counter& { return lane.buckets[op][b]; });
+              out << "omen_rgb_sysfs_latency_seconds_bucket{op=\"" << ops[op] << "\",le=\"";
+              if (b + 1 < BUCKETS) {
+                  out << BUCKETS_US[b] * 1e-6;
+              } else {
+                  out << "+Inf";
+              }
+              out << "\"} " << cumulative << "\n";
+          }
+          out << "omen_rgb_sysfs_latency_seconds_sum{op=\"" << ops[op] << "\"} "
+              << static_cast<double>(sum([&](const Lane& lane) -> const Counter& { return lane.latencyNs[op]; })) * 1e-9 << "\n"
+              << "omen_rgb_sysfs_latency_seconds_count{op=\"" << ops[op] << "\"} " << cumulative << "\n";
+      }
+
+      size_t live = 0;
+      for (size_t i = 1; i < LANES; ++i) {
+          uint32_t pid = segment->lanes[i].pid.load();
+          live += pid && (kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH);
+      }
+      out << "# HELP omen_rgb_processes Running omen-rgb-cli processes holding a counter lane.\n# TYPE omen_rgb_processes gauge\n"
+          << "omen_rgb_processes " << live << "\n";
+      munmap(segment, sizeof(Segment));
+      return true;
+  }
+}
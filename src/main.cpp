@@ -6,5 +6,6 @@ int main(int argc, char *argv[]) {
     return 0;
   } catch (const std::exception &ex) {
     std::cout << "Error:\n  " << ex.what() << std::endl;
+    return 1;
   }
 }
@@ -0,0 +1,253 @@
+#pragma once
+#include "color.hpp"
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "fs.hpp"
+#include "power.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define PROC_STAT_PATH "/proc/stat"
+#define THERMAL_PATH "/sys/class/thermal"
+
+// System metrics read through file descriptors opened once and re-read with pread,
+// mapped onto zones through color gradients.
+namespace omen::rgb::metrics
+{
+    class PreopenedFile
+    {
+    public:
+        explicit PreopenedFile(const std::string &path) : path_(path), fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC))
+        {
+            if (fd_ < 0)
+                throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        }
+
+        ~PreopenedFile() { close(fd_); }
+
+        PreopenedFile(const PreopenedFile &) = delete;
+        PreopenedFile &operator=(const PreopenedFile &) = delete;
+
+        const std::string &path() const { return path_; }
+
+        // Re-reads from offset 0 into a reusable buffer; sysfs and procfs regenerate on each read.
+        const char *read()
+        {
+            ssize_t n = pread(fd_, buffer_, sizeof(buffer_) - 1, 0);
+            buffer_[n > 0 ? n : 0] = '\0';
+            return buffer_;
+        }
+
+    private:
+        std::string path_;
+        int fd_;
+        char buffer_[512];
+    };
+
+    // A metric normalised to a natural unit: percent for cpu and battery, degrees C for temp.
+    class Source
+    {
+    public:
+        virtual ~Source() = default;
+        virtual double sample() = 0;
+    };
+
+    // Busy share of all CPUs since the previous sample, from the aggregate "cpu" line.
+    class CpuLoad : public Source
+    {
+    public:
+        CpuLoad() : stat_(omen::fs::resolve(PROC_STAT_PATH)) { sample(); }
+
+        double sample() override
+        {
+            const char *p = stat_.read();
+            while (*p && (*p < '0' || *p > '9'))
+                ++p;
+            unsigned long long fields[8] = {};
+            char *end = nullptr;
+            for (auto &field : fields)
+            {
+                field = std::strtoull(p, &end, 10);
+                p = end;
+            }
+            unsigned long long idle = fields[3] + fields[4], total = 0;
+            for (auto field : fields)
+                total += field;
+
+            unsigned long long dTotal = total - lastTotal_, dIdle = idle - lastIdle_;
+            lastTotal_ = total;
+            lastIdle_ = idle;
+            return dTotal ? 100.0 * static_cast<double>(dTotal - dIdle) / static_cast<double>(dTotal) : 0.0;
+        }
+
+    private:
+        PreopenedFile stat_;
+        unsigned long long lastTotal_ = 0;
+        unsigned long long lastIdle_ = 0;
+    };
+
+    // Hottest thermal zone, in degrees C.
+    class Temperature : public Source
+    {
+    public:
+        Temperature()
+        {
+            std::string dir = omen::fs::resolve(THERMAL_PATH);
+            if (DIR *d = opendir(dir.c_str()))
+            {
+                while (dirent *entry = readdir(d))
+                {
+                    std::string name = entry->d_name;
+                    if (name.rfind("thermal_zone", 0) == 0 && access((dir + "/" + name + "/temp").c_str(), R_OK) == 0)
+                        zones_.push_back(std::make_unique<PreopenedFile>(dir + "/" + name + "/temp"));
+                }
+                closedir(d);
+            }
+            if (zones_.empty())
+                throw std::runtime_error("No thermal zones under " + dir);
+        }
+
+        double sample() override
+        {
+            double hottest = -273.0;
+            for (auto &zone : zones_)
+                hottest = std::max(hottest, std::strtod(zone->read(), nullptr) / 1000.0);
+            return hottest;
+        }
+
+    private:
+        std::vector<std::unique_ptr<PreopenedFile>> zones_;
+    };
+
+    // Capacity of the first battery, in percent.
+    class Battery : public Source
+    {
+    public:
+        Battery()
+        {
+            std::string dir = power::supplyDir();
+            if (DIR *d = opendir(dir.c_str()))
+            {
+                std::vector<std::string> names;
+                while (dirent *entry = readdir(d))
+                    names.push_back(entry->d_name);
+                closedir(d);
+                std::sort(names.begin(), names.end());
+                for (const auto &name : names)
+                {
+                    std::string base = dir + "/" + name + "/";
+                    if (name[0] != '.' && power::readAttribute(base + "type") == "battery" && access((base + "capacity").c_str(), R_OK) == 0)
+                    {
+                        capacity_ = std::make_unique<PreopenedFile>(base + "capacity");
+                        break;
+                    }
+                }
+            }
+            if (!capacity_)
+                throw std::runtime_error("No battery with a capacity attribute under " + dir);
+        }
+
+        double sample() override { return std::strtod(capacity_->read(), nullptr); }
+
+    private:
+        std::unique_ptr<PreopenedFile> capacity_;
+    };
+
+    // Piecewise-linear color ramp over [low, high], quantised to a number of steps
+    // so small metric jitter does not turn into zone writes.
+    struct Gradient
+    {
+        double low = 0.0;
+        double high = 100.0;
+        std::vector<RGB_HEX> stops;
+        int steps = 20;
+
+        RGB_HEX at(double value) const
+        {
+            double f = high > low ? std::clamp((value - low) / (high - low), 0.0, 1.0) : 0.0;
+            f = std::round(f * steps) / steps;
+            if (stops.size() == 1)
+                return stops[0];
+            double x = f * static_cast<double>(stops.size() - 1);
+            size_t k = std::min(static_cast<size_t>(x), stops.size() - 2);
+            return color::lerp(stops[k], stops[k + 1], x - static_cast<double>(k));
+        }
+    };
+
+    struct Binding
+    {
+        size_t zone;
+        std::string metric;
+        Gradient gradient;
+    };
+
+    inline std::unique_ptr<Source> makeSource(const std::string &metric)
+    {
+        if (metric == "cpu")
+            return std::make_unique<CpuLoad>();
+        if (metric == "temp")
+            return std::make_unique<Temperature>();
+        if (metric == "battery")
+            return std::make_unique<Battery>();
+        throw std::invalid_argument("Unknown metric: " + metric + ". Valid metrics: cpu, temp, battery");
+    }
+
+    // <zone>=<metric>[:<low>-<high>][:<hex>,<hex>,...], e.g. 0=cpu, 1=temp:40-90, 3=battery:0-100:FF0000,00FF00.
+    // Defaults: cpu 0-100 and temp 35-95 run green-yellow-red, battery 0-100 runs red-yellow-green.
+    inline Binding parseBinding(const std::string &spec, size_t zones = ZONE_COUNT)
+    {
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos || eq == 0)
+            throw std::invalid_argument("Binding must be <zone>=<metric>[:<low>-<high>][:<colors>]: " + spec);
+
+        Binding binding;
+        binding.zone = std::stoul(spec.substr(0, eq));
+        if (binding.zone >= zones)
+            throw std::invalid_argument("Zone " + std::to_string(binding.zone) + " out of range");
+
+        std::vector<std::string> parts;
+        std::string rest = spec.substr(eq + 1);
+        size_t start = 0;
+        for (size_t colon; (colon = rest.find(':', start)) != std::string::npos; start = colon + 1)
+            parts.push_back(rest.substr(start, colon - start));
+        parts.push_back(rest.substr(start));
+
+        binding.metric = utils::toLower(parts[0]);
+        Gradient &g = binding.gradient;
+        g.stops = {0x00FF00, 0xFFFF00, 0xFF0000};
+        if (binding.metric == "temp")
+        {
+            g.low = 35.0;
+            g.high = 95.0;
+        }
+        else if (binding.metric == "battery")
+        {
+            std::reverse(g.stops.begin(), g.stops.end());
+        }
+
+        for (size_t i = 1; i < parts.size(); ++i)
+        {
+            size_t dash = parts[i].find('-', 1);
+            if (dash != std::string::npos && parts[i].find(',') == std::string::npos)
+            {
+                g.low = compositor::parseNumber(parts[i].substr(0, dash), "low");
+                g.high = compositor::parseNumber(parts[i].substr(dash + 1), "high");
+            }
+            else
+            {
+                g.stops = compositor::parseColorList(parts[i]);
+            }
+        }
+        return binding;
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "presets.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Decides whether a high-level animation request can run as a firmware
+// animation_mode (free for the host) or has to be rendered in userspace.
+namespace omen::rgb::offload
+{
+    enum class Fidelity
+    {
+        None,
+        Approximate,
+        Exact
+    };
+
+    // Which fidelity is good enough to hand the animation to the firmware.
+    enum class Policy
+    {
+        Never,
+        Exact,
+        Approximate
+    };
+
+    inline const char *fidelityName(Fidelity fidelity)
+    {
+        switch (fidelity)
+        {
+        case Fidelity::Exact:
+            return "exact";
+        case Fidelity::Approximate:
+            return "approximate";
+        default:
+            return "none";
+        }
+    }
+
+    // Nominal firmware timing: one animation period lasts FIRMWARE_PERIOD_SPEED_1 / speed
+    // seconds. The 10 s base is an estimate, not measured on hardware, and may differ per
+    // model and mode, so "exact" matches are only as exact as it. Periods within
+    // EXACT_TOLERANCE of a speed step count as equivalent.
+    constexpr double FIRMWARE_PERIOD_SPEED_1 = 10.0;
+    constexpr double EXACT_TOLERANCE = 0.05;
+    constexpr double APPROXIMATE_TOLERANCE = 0.35;
+
+    struct Request
+    {
+        std::string effect;
+        std::string preset;
+        double period = 3.0;
+    };
+
+    struct Plan
+    {
+        Request request;
+        Fidelity fidelity = Fidelity::None;
+        std::string mode;
+        uint8_t speed = 0;
+        double firmwarePeriod = 0.0;
+        std::vector<RGB_HEX> colors;
+        std::vector<compositor::Layer> layers;
+        std::string note;
+
+        bool offloaded(Policy policy) const
+        {
+            return fidelity != Fidelity::None && policy != Policy::Never &&
+                   (fidelity == Fidelity::Exact || policy == Policy::Approximate);
+        }
+
+        // Zone colors plus animation_mode and animation_speed, written once.
+        size_t hardwareWrites() const { return colors.size() + 2; }
+    };
+
+    inline Fidelity speedFor(double period, uint8_t &speed, double &achieved)
+    {
+        long nearest = std::lround(FIRMWARE_PERIOD_SPEED_1 / period);
+        speed = static_cast<uint8_t>(std::clamp(nearest, 1L, 10L));
+        achieved = FIRMWARE_PERIOD_SPEED_1 / speed;
+        double error = std::abs(achieved - period) / period;
+        if (error <= EXACT_TOLERANCE)
+            return Fidelity::Exact;
+        return error <= APPROXIMATE_TOLERANCE ? Fidelity::Approximate : Fidelity::None;
+    }
+
+    // Effects: static, breathe, pulse, cycle (firmware wave) and rainbow (no preset).
+    inline Plan plan(const Request &request, size_t zones = ZONE_COUNT)
+    {
+        if (request.period <= 0.0)
+            throw std::invalid_argument("animate period must be greater than 0");
+
+        Plan result{request};
+        const std::string effect = utils::toLower(request.effect);
+        if (effect != "rainbow")
+        {
+            result.colors = presets::get(utils::toLower(request.preset)).colors;
+            result.colors.resize(zones, result.colors.back());
+            result.layers.push_back(compositor::presetLayer(request.preset));
+        }
+
+        Fidelity timing = speedFor(request.period, result.speed, result.firmwarePeriod);
+        std::ostringstream period;
+        period << request.period;
+
+        if (effect == "static")
+        {
+            result.mode = "static";
+            result.speed = 1;
+            result.fidelity = Fidelity::Exact;
+        }
+        else if (effect == "breathe")
+        {
+            result.mode = "breathing";
+            result.fidelity = timing;
+            result.layers.push_back(compositor::breatheLayer(request.period, 0.0));
+        }
+        else if (effect == "pulse")
+        {
+            result.mode = "pulse";
+            result.fidelity = timing;
+            auto layer = compositor::exprLayer("pow(0.5 + 0.5*cos(2*pi*t/" + period.str() + "), 4)");
+            layer.mode = compositor::BlendMode::Multiply;
+            result.layers.push_back(std::move(layer));
+        }
+        else if (effect == "cycle")
+        {
+            // The firmware wave travels across the zones but does not interpolate
+            // between them the way the cycle layer does.
+            result.mode = "wave";
+            result.fidelity = std::min(timing, Fidelity::Approximate);
+            result.layers = {compositor::cycleLayer(request.preset, request.period)};
+            result.note = "firmware wave steps between zones";
+        }
+        else if (effect == "rainbow")
+        {
+            result.mode = "rainbow";
+            result.fidelity = timing;
+            result.layers.push_back(compositor::exprLayer("hsv(t/" + period.str() + " + pos, 1, 1)"));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown animate effect: " + request.effect + ". Valid effects: static, breathe, pulse, cycle, rainbow");
+        }
+
+        if (result.fidelity == Fidelity::None)
+            result.note = "no firmware speed within " + std::to_string(static_cast<int>(APPROXIMATE_TOLERANCE * 100)) + "% of the period";
+        return result;
+    }
+
+    // Zone writes per second the userspace path needs at fps: one period is
+    // composed and every zone change (including the wrap back to frame 0) counts.
+    inline double hostWritesPerSecond(const Plan &plan, double fps, size_t zones = ZONE_COUNT)
+    {
+        compositor::Compositor comp(zones);
+        for (const auto &layer : plan.layers)
+            comp.add(layer);
+        if (!comp.animated())
+            return 0.0;
+
+        size_t frames = static_cast<size_t>(std::max(1L, std::lround(plan.request.period * fps)));
+        std::vector<RGB_HEX> previous;
+        size_t writes = 0;
+        for (size_t i = 0; i <= frames; ++i)
+        {
+            comp.compose(static_cast<double>(i) / fps);
+            std::vector<RGB_HEX> frame(comp.frame(), comp.frame() + zones);
+            for (size_t z = 0; i > 0 && z < zones; ++z)
+                writes += (frame[z] & 0xFFFFFF) != (previous[z] & 0xFFFFFF);
+            previous = std::move(frame);
+        }
+        return static_cast<double>(writes) / plan.request.period;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef OMEN_EFFECT_H
+#define OMEN_EFFECT_H
+
+/*
+ * C ABI for omen-rgb-cli effect plugins.
+ *
+ * A plugin is a shared object exporting OMEN_EFFECT_ENTRY_SYMBOL, which
+ * returns a pointer to a static omen_effect_v1 table. Frames are arrays of
+ * zone_count packed 0x00RRGGBB colors; bits 24-31 are alpha (0xFF opaque).
+ * init() is optional. If present, it runs before the first render() and its
+ * result is passed to render() and destroy(); NULL means init failed and
+ * disables the plugin without calling render(). Without init(), render()
+ * receives a NULL state.
+ * render() must return 0 on success; any other value disables the plugin.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OMEN_EFFECT_ABI_VERSION 1
+#define OMEN_EFFECT_ENTRY_SYMBOL "omen_effect_entry"
+
+typedef struct omen_effect_v1
+{
+    uint32_t abi_version;
+    const char *name;
+    void *(*init)(const char *args, uint32_t zone_count);
+    int (*render)(void *state, uint32_t *frame, uint32_t zone_count, double t);
+    void (*destroy)(void *state);
+} omen_effect_v1;
+
+typedef const omen_effect_v1 *(*omen_effect_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,895 @@
+#pragma once
+#include "definitions.hpp"
+#include "fs.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// A loopback server for the OpenRGB SDK protocol (versions 0-3) exposing the keyboard as
+// one controller: one single-LED zone per hardware zone, a Direct mode and the firmware modes.
+namespace omen::rgb::openrgb
+{
+    constexpr uint16_t DEFAULT_PORT = 6742;
+    constexpr uint32_t PROTOCOL_VERSION = 3;
+    constexpr uint32_t MAX_PACKET = 1 << 20;
+    constexpr int DEVICE_TYPE_KEYBOARD = 5;
+
+    enum Packet : uint32_t
+    {
+        REQUEST_CONTROLLER_COUNT = 0,
+        REQUEST_CONTROLLER_DATA = 1,
+        REQUEST_PROTOCOL_VERSION = 40,
+        SET_CLIENT_NAME = 50,
+        RESIZE_ZONE = 1000,
+        UPDATE_LEDS = 1050,
+        UPDATE_ZONE_LEDS = 1051,
+        UPDATE_SINGLE_LED = 1052,
+        SET_CUSTOM_MODE = 1100,
+        UPDATE_MODE = 1101,
+        SAVE_MODE = 1102
+    };
+
+    enum ModeFlag : uint32_t
+    {
+        HAS_SPEED = 1 << 0,
+        HAS_PER_LED_COLOR = 1 << 5
+    };
+
+    enum ColorMode : uint32_t
+    {
+        COLORS_NONE = 0,
+        COLORS_PER_LED = 1
+    };
+
+    // OpenRGB colors are 0x00BBGGRR.
+    inline RGB_HEX fromWire(uint32_t c) { return (c & 0xFF) << 16 | (c & 0xFF00) | (c >> 16 & 0xFF); }
+    inline uint32_t toWire(RGB_HEX c) { return (c >> 16 & 0xFF) | (c & 0xFF00) | (c & 0xFF) << 16; }
+
+    // Little-endian packet body builder.
+    class Writer
+    {
+    public:
+        void u16(uint16_t v) { raw(&v, 2); }
+        void u32(uint32_t v) { raw(&v, 4); }
+        void i32(int32_t v) { raw(&v, 4); }
+
+        // Length-prefixed, NUL-terminated.
+        void str(const std::string &s)
+        {
+            u16(static_cast<uint16_t>(s.size() + 1));
+            bytes.insert(bytes.end(), s.begin(), s.end());
+            bytes.push_back('\0');
+        }
+
+        void raw(const void *p, size_t n)
+        {
+            auto b = static_cast<const unsigned char *>(p);
+            bytes.insert(bytes.end(), b, b + n);
+        }
+
+        std::vector<unsigned char> bytes;
+    };
+
+    // Bounds-checked reader over a packet body; overruns throw and drop the client.
+    class Reader
+    {
+    public:
+        Reader(const unsigned char *data, size_t size) : data_(data), size_(size) {}
+
+        uint16_t u16() { return get<uint16_t>(); }
+        uint32_t u32() { return get<uint32_t>(); }
+        int32_t i32() { return get<int32_t>(); }
+
+        std::string str()
+        {
+            size_t n = u16();
+            need(n);
+            std::string s(reinterpret_cast<const char *>(data_ + pos_), n ? n - 1 : 0);
+            pos_ += n;
+            return s;
+        }
+
+        // The remaining bytes up to the first NUL, for unprefixed strings.
+        std::string rest()
+        {
+            const char *p = reinterpret_cast<const char *>(data_ + pos_);
+            std::string s(p, strnlen(p, size_ - pos_));
+            pos_ = size_;
+            return s;
+        }
+
+        size_t left() const { return size_ - pos_; }
+
+    private:
+        template <typename T>
+        T get()
+        {
+            need(sizeof(T));
+            T v;
+            std::memcpy(&v, data_ + pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return v;
+        }
+
+        void need(size_t n) const
+        {
+            if (size_ - pos_ < n)
+                throw std::runtime_error("Truncated OpenRGB packet");
+        }
+
+        const unsigned char *data_;
+        size_t size_;
+        size_t pos_ = 0;
+    };
+
+    struct Mode
+    {
+        std::string name;
+        // Value written to animation_mode; empty for Direct.
+        std::string firmware;
+        uint32_t flags = HAS_PER_LED_COLOR;
+        uint32_t speed = 5;
+    };
+
+    // The firmware speed range of cmdAnimation.
+    constexpr uint32_t SPEED_MIN = 1;
+    constexpr uint32_t SPEED_MAX = 10;
+
+    inline std::vector<Mode> modes()
+    {
+        std::vector<Mode> list = {{"Direct", "", HAS_PER_LED_COLOR, 0}};
+        std::string names = ANIMATION_MODES_TEXT;
+        for (size_t start = 0; start < names.size();)
+        {
+            size_t comma = std::min(names.find(',', start), names.size());
+            std::string name = names.substr(start, comma - start);
+            Mode mode{name, name, HAS_PER_LED_COLOR | HAS_SPEED, 5};
+            if (name == "static")
+                mode.flags = HAS_PER_LED_COLOR;
+            mode.name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(mode.name[0])));
+            list.push_back(mode);
+            start = comma + 2;
+        }
+        return list;
+    }
+
+    inline void describeMode(Writer &w, const Mode &mode, size_t index, uint32_t version)
+    {
+        bool speed = mode.flags & HAS_SPEED;
+        w.str(mode.name);
+        w.i32(static_cast<int32_t>(index));
+        w.u32(mode.flags);
+        w.u32(speed ? SPEED_MIN : 0);
+        w.u32(speed ? SPEED_MAX : 0);
+        if (version >= 3)
+        {
+            w.u32(0);
+            w.u32(0);
+        }
+        w.u32(0);
+        w.u32(0);
+        w.u32(speed ? mode.speed : 0);
+        if (version >= 3)
+            w.u32(0);
+        w.u32(0);
+        w.u32(COLORS_PER_LED);
+        w.u16(0);
+    }
+
+    // Mode body of UpdateMode/SaveMode; only the speed is taken from the client.
+    inline uint32_t readModeSpeed(Reader &r, uint32_t version)
+    {
+        r.str();
+        r.i32();
+        r.u32();
+        r.u32();
+        r.u32();
+        if (version >= 3)
+        {
+            r.u32();
+            r.u32();
+        }
+        r.u32();
+        r.u32();
+        uint32_t speed = r.u32();
+        return std::clamp(speed, SPEED_MIN, SPEED_MAX);
+    }
+
+    // A sysfs attribute of one device, opened once and rewritten with pwrite. Regular files
+    // (fake trees) are also truncated so shorter values do not leave stale bytes behind.
+    class Attribute
+    {
+    public:
+        Attribute(const omen::fs::devices::Device &device, const std::string &path)
+            : logical_(path), device_(&device), path_(omen::fs::onDevice(device, path)), fd_(open(omen::fs::resolve(path_).c_str(), O_WRONLY | O_CLOEXEC))
+        {
+            if (fd_ < 0)
+                throw std::runtime_error("Failed to open " + path_ + ": " + std::strerror(errno));
+            struct stat info = {};
+            regular_ = fstat(fd_, &info) == 0 && S_ISREG(info.st_mode);
+        }
+
+        ~Attribute()
+        {
+            if (fd_ >= 0)
+                close(fd_);
+        }
+
+        Attribute(Attribute &&other) noexcept
+            : logical_(std::move(other.logical_)), device_(other.device_), path_(std::move(other.path_)), fd_(other.fd_), regular_(other.regular_)
+        {
+            other.fd_ = -1;
+        }
+        Attribute(const Attribute &) = delete;
+        Attribute &operator=(const Attribute &) = delete;
+
+        bool write(const std::string &requested)
+        {
+            std::string value = omen::fs::calibrated(*device_, logical_, requested);
+            uint64_t start = omen::fs::ioBegin();
+            errno = 0;
+            if (pwrite(fd_, value.data(), value.size(), 0) != static_cast<ssize_t>(value.size()))
+            {
+                omen::fs::ioEnd(omen::fs::stats::Write, start, path_, value, errno ? errno : EIO);
+                std::cerr << "Failed to write value to sysfs path: " << path_ << "\n";
+                return false;
+            }
+            if (regular_)
+                (void)ftruncate(fd_, static_cast<off_t>(value.size()));
+            omen::fs::ioEnd(omen::fs::stats::Write, start, path_, value, 0);
+            return true;
+        }
+
+    private:
+        std::string logical_;
+        const omen::fs::devices::Device *device_;
+        std::string path_;
+        int fd_;
+        bool regular_ = false;
+    };
+
+    // An attribute on every selected device that has it; one no device lists opens on the
+    // first, so the failure is reported.
+    class Attributes
+    {
+    public:
+        explicit Attributes(const std::string &path)
+        {
+            const auto &selected = omen::fs::selection().devices;
+            for (size_t d = 0; d < selected.size(); ++d)
+                if (selected.size() == 1 || omen::fs::serves(selected[d], path))
+                    targets_.push_back({d, Attribute(selected[d], path)});
+            if (targets_.empty())
+                targets_.push_back({0, Attribute(selected.front(), path)});
+        }
+
+        bool write(const std::string &value)
+        {
+            bool ok = true;
+            for (auto &target : targets_)
+                ok = target.attribute.write(value) && ok;
+            return ok;
+        }
+
+        // Only the copy on the index-th selected device, if it has one.
+        bool write(const std::string &value, size_t device)
+        {
+            bool ok = true;
+            for (auto &target : targets_)
+                if (target.device == device)
+                    ok = target.attribute.write(value) && ok;
+            return ok;
+        }
+
+    private:
+        struct Target
+        {
+            size_t device;
+            Attribute attribute;
+        };
+        std::vector<Target> targets_;
+    };
+
+    struct Stats
+    {
+        uint64_t clients = 0;
+        uint64_t packets = 0;
+        uint64_t frames = 0;
+        uint64_t applied = 0;
+        uint64_t zoneWrites = 0;
+        uint64_t modeChanges = 0;
+    };
+
+    class Server
+    {
+    public:
+        Server(size_t zones, uint16_t port, double maxFps)
+            : zones_(zones), modes_(openrgb::modes()), colors_(zones, 0), pending_(zones, 0), written_(zones, ~RGB_HEX(0)),
+              mode_(ANIMATION_MODE_PATH), speed_(ANIMATION_SPEED_PATH)
+        {
+            if (maxFps <= 0.0)
+                throw std::invalid_argument("fps must be greater than 0");
+            interval_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / maxFps));
+            for (size_t zone = 0; zone < zones; ++zone)
+                zoneAttributes_.emplace_back(utils::zonePath(zone));
+            // Clients start from what the zones show, and zones no client sets are left alone.
+            for (size_t zone = 0; zone < zones; ++zone)
+            {
+                try
+                {
+                    colors_[zone] = utils::hexStringToRGB(omen::fs::readSysfs(utils::zonePath(zone)));
+                    written_[zone] = colors_[zone];
+                }
+                catch (const std::exception &)
+                {
+                }
+            }
+            pending_ = colors_;
+            for (const auto &device : omen::fs::selection().devices)
+                location_ += (location_.empty() ? "" : ", ") + omen::fs::resolve(device.path);
+
+            listener_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            int one = 1;
+            setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (listener_ < 0 || bind(listener_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener_, 16) != 0)
+                throw std::runtime_error("Failed to listen on 127.0.0.1:" + std::to_string(port) + ": " + std::strerror(errno));
+
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGINT);
+            sigaddset(&mask, SIGTERM);
+            sigprocmask(SIG_BLOCK, &mask, nullptr);
+            signals_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            stop_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            if (signals_ < 0 || timer_ < 0 || stop_ < 0 || epoll_ < 0)
+                throw std::runtime_error(std::string("Failed to set up event loop: ") + std::strerror(errno));
+            for (int fd : {listener_, signals_, timer_, stop_})
+                watch(fd, EPOLLIN);
+        }
+
+        ~Server()
+        {
+            for (auto &[fd, client] : clients_)
+                close(fd);
+            for (int fd : {listener_, signals_, timer_, stop_, epoll_})
+                if (fd >= 0)
+                    close(fd);
+        }
+
+        Server(const Server &) = delete;
+        Server &operator=(const Server &) = delete;
+
+        const Stats &stats() const { return stats_; }
+
+        // The bound port; the one the kernel picked if constructed with port 0.
+        uint16_t port() const
+        {
+            sockaddr_in addr{};
+            socklen_t size = sizeof(addr);
+            getsockname(listener_, reinterpret_cast<sockaddr *>(&addr), &size);
+            return ntohs(addr.sin_port);
+        }
+
+        // Thread-safe; makes run() return.
+        void stop()
+        {
+            uint64_t one = 1;
+            (void)::write(stop_, &one, sizeof(one));
+        }
+
+        // Serves until SIGINT, SIGTERM or stop().
+        void run()
+        {
+            for (;;)
+            {
+                epoll_event events[16];
+                int n = epoll_wait(epoll_, events, 16, -1);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                for (int i = 0; i < n; ++i)
+                {
+                    int fd = events[i].data.fd;
+                    if (fd == signals_ || fd == stop_)
+                        return;
+                    if (fd == listener_)
+                        accept();
+                    else if (fd == timer_)
+                    {
+                        uint64_t expirations;
+                        (void)read(timer_, &expirations, sizeof(expirations));
+                        timerArmed_ = false;
+                    }
+                    else if (clients_.count(fd) && !service(fd, events[i].events))
+                        drop(fd);
+                }
+                // All packets read in this wakeup have been parsed, so only the newest frame is applied.
+                flush();
+            }
+        }
+
+    private:
+        struct Client
+        {
+            std::vector<unsigned char> in;
+            std::vector<unsigned char> out;
+            uint32_t version = 0;
+            std::string name;
+        };
+
+        void watch(int fd, uint32_t events, int op = EPOLL_CTL_ADD)
+        {
+            epoll_event event{};
+            event.events = events;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_, op, fd, &event) != 0)
+                throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+        }
+
+        void accept()
+        {
+            int fd;
+            while ((fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                clients_[fd];
+                watch(fd, EPOLLIN);
+                ++stats_.clients;
+            }
+        }
+
+        void drop(int fd)
+        {
+            auto it = clients_.find(fd);
+            std::cout << "[OK] Client disconnected" << (it->second.name.empty() ? "" : ": " + it->second.name) << std::endl;
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            clients_.erase(it);
+        }
+
+        // Returns false once the client is gone or misbehaves.
+        bool service(int fd, uint32_t events)
+        {
+            Client &client = clients_[fd];
+            if (events & EPOLLOUT && !send(fd, client))
+                return false;
+            if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                return true;
+
+            unsigned char buffer[65536];
+            for (;;)
+            {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n > 0)
+                {
+                    client.in.insert(client.in.end(), buffer, buffer + n);
+                    continue;
+                }
+                if (n == 0)
+                    return false;
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return false;
+            }
+
+            size_t pos = 0;
+            try
+            {
+                while (client.in.size() - pos >= 16)
+                {
+                    const unsigned char *header = client.in.data() + pos;
+                    uint32_t device, id, size;
+                    std::memcpy(&device, header + 4, 4);
+                    std::memcpy(&id, header + 8, 4);
+                    std::memcpy(&size, header + 12, 4);
+                    if (std::memcmp(header, "ORGB", 4) != 0 || size > MAX_PACKET)
+                        return false;
+                    if (client.in.size() - pos - 16 < size)
+                        break;
+                    handle(client, device, id, Reader(header + 16, size));
+                    pos += 16 + size;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << MSG_ERR(e.what()) << "\n";
+                return false;
+            }
+            client.in.erase(client.in.begin(), client.in.begin() + static_cast<std::ptrdiff_t>(pos));
+            return send(fd, client);
+        }
+
+        bool send(int fd, Client &client)
+        {
+            while (!client.out.empty())
+            {
+                ssize_t n = write(fd, client.out.data(), client.out.size());
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (n <= 0)
+                    return false;
+                client.out.erase(client.out.begin(), client.out.begin() + n);
+            }
+            watch(fd, client.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+            return true;
+        }
+
+        void reply(Client &client, uint32_t device, uint32_t id, const Writer &body)
+        {
+            Writer header;
+            header.raw("ORGB", 4);
+            header.u32(device);
+            header.u32(id);
+            header.u32(static_cast<uint32_t>(body.bytes.size()));
+            client.out.insert(client.out.end(), header.bytes.begin(), header.bytes.end());
+            client.out.insert(client.out.end(), body.bytes.begin(), body.bytes.end());
+        }
+
+        void handle(Client &client, uint32_t device, uint32_t id, Reader r)
+        {
+            ++stats_.packets;
+            Writer body;
+            switch (id)
+            {
+            case REQUEST_CONTROLLER_COUNT:
+                body.u32(1);
+                reply(client, device, id, body);
+                return;
+            case REQUEST_PROTOCOL_VERSION:
+                client.version = std::min(r.left() >= 4 ? r.u32() : 0, PROTOCOL_VERSION);
+                body.u32(PROTOCOL_VERSION);
+                reply(client, device, id, body);
+                return;
+            case SET_CLIENT_NAME:
+                client.name = r.rest();
+                std::cout << "[OK] Client connected: " << client.name << std::endl;
+                return;
+            default:
+                break;
+            }
+
+            if (device != 0)
+                return;
+            switch (id)
+            {
+            case REQUEST_CONTROLLER_DATA:
+                describe(body, r.left() >= 4 ? std::min(r.u32(), PROTOCOL_VERSION) : 0);
+                reply(client, device, id, body);
+                break;
+            case UPDATE_LEDS:
+            {
+                r.u32();
+                size_t count = r.u16();
+                for (size_t led = 0; led < count; ++led)
+                {
+                    uint32_t c = r.u32();
+                    if (led < zones_)
+                        pending_[led] = fromWire(c);
+                }
+                frameReceived();
+                break;
+            }
+            case UPDATE_ZONE_LEDS:
+            {
+                r.u32();
+                uint32_t zone = r.u32();
+                if (r.u16() > 0 && zone < zones_)
+                    pending_[zone] = fromWire(r.u32());
+                frameReceived();
+                break;
+            }
+            case UPDATE_SINGLE_LED:
+            {
+                uint32_t led = static_cast<uint32_t>(r.i32());
+                uint32_t c = r.u32();
+                if (led < zones_)
+                    pending_[led] = fromWire(c);
+                frameReceived();
+                break;
+            }
+            case SET_CUSTOM_MODE:
+                setMode(0, modes_[0].speed);
+                break;
+            case UPDATE_MODE:
+            case SAVE_MODE:
+            {
+                r.u32();
+                auto index = static_cast<size_t>(r.i32());
+                uint32_t speed = readModeSpeed(r, client.version);
+                if (index < modes_.size())
+                    setMode(index, speed);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        void describe(Writer &w, uint32_t version)
+        {
+            Writer d;
+            d.i32(DEVICE_TYPE_KEYBOARD);
+            d.str("HP OMEN Keyboard");
+            if (version >= 1)
+                d.str("HP");
+            d.str("Four-zone keyboard backlight via " PROGRAM_NAME);
+            d.str(PROGRAM_VERSION);
+            d.str("");
+            d.str(location_);
+            d.u16(static_cast<uint16_t>(modes_.size()));
+            d.i32(static_cast<int32_t>(active_));
+            for (size_t i = 0; i < modes_.size(); ++i)
+                describeMode(d, modes_[i], i, version);
+
+            d.u16(static_cast<uint16_t>(zones_));
+            for (size_t zone = 0; zone < zones_; ++zone)
+            {
+                d.str("Zone " + std::to_string(zone));
+                d.i32(0);
+                d.u32(1);
+                d.u32(1);
+                d.u32(1);
+                d.u16(0);
+            }
+            d.u16(static_cast<uint16_t>(zones_));
+            for (size_t zone = 0; zone < zones_; ++zone)
+            {
+                d.str("Zone " + std::to_string(zone));
+                d.u32(static_cast<uint32_t>(zone));
+            }
+            d.u16(static_cast<uint16_t>(zones_));
+            for (RGB_HEX c : colors_)
+                d.u32(toWire(c));
+
+            w.u32(static_cast<uint32_t>(d.bytes.size() + 4));
+            w.raw(d.bytes.data(), d.bytes.size());
+        }
+
+        void setMode(size_t index, uint32_t speed)
+        {
+            const std::string &firmware = modes_[index].firmware;
+            mode_.write(firmware.empty() ? "static" : firmware);
+            if (modes_[index].flags & HAS_SPEED)
+                speed_.write(std::to_string(speed));
+            modes_[index].speed = speed;
+            active_ = index;
+            ++stats_.modeChanges;
+            std::cout << "[OK] Mode " << modes_[index].name << (modes_[index].flags & HAS_SPEED ? ", speed " + std::to_string(speed) : "") << std::endl;
+        }
+
+        void frameReceived()
+        {
+            ++stats_.frames;
+            dirty_ = true;
+        }
+
+        // Writes the newest frame, at most once per interval; a frame that arrives sooner
+        // is held and picked up by the one-shot timer.
+        void flush()
+        {
+            if (!dirty_)
+                return;
+            auto now = std::chrono::steady_clock::now();
+            auto due = lastApply_ + interval_;
+            if (now < due)
+            {
+                if (!timerArmed_)
+                {
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(due - now).count();
+                    itimerspec spec{};
+                    spec.it_value = {static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+                    timerfd_settime(timer_, 0, &spec, nullptr);
+                    timerArmed_ = true;
+                }
+                return;
+            }
+
+            colors_ = pending_;
+            std::vector<size_t> changed;
+            for (size_t zone = 0; zone < zones_; ++zone)
+                if (colors_[zone] != written_[zone])
+                    changed.push_back(zone);
+            // Each device writes its zones on its own pool thread, into its own row of results.
+            const auto &selected = omen::fs::selection();
+            std::vector<std::vector<char>> ok(selected.devices.size(), std::vector<char>(changed.size(), 1));
+            auto task = [&](size_t d)
+            {
+                for (size_t k = 0; k < changed.size(); ++k)
+                    ok[d][k] = zoneAttributes_[changed[k]].write(utils::hex6(colors_[changed[k]]), d);
+            };
+            if (selected.pool && !changed.empty())
+                selected.pool->run(selected.devices.size(), task);
+            else
+                for (size_t d = 0; d < selected.devices.size(); ++d)
+                    task(d);
+            for (size_t k = 0; k < changed.size(); ++k)
+                if (std::all_of(ok.begin(), ok.end(), [k](const std::vector<char> &row)
+                                { return row[k]; }))
+                {
+                    written_[changed[k]] = colors_[changed[k]];
+                    ++stats_.zoneWrites;
+                }
+            ++stats_.applied;
+            dirty_ = false;
+            lastApply_ = now;
+        }
+
+        size_t zones_;
+        std::vector<Mode> modes_;
+        size_t active_ = 0;
+        std::vector<RGB_HEX> colors_;
+        std::vector<RGB_HEX> pending_;
+        std::vector<RGB_HEX> written_;
+        std::vector<Attributes> zoneAttributes_;
+        Attributes mode_;
+        Attributes speed_;
+        std::string location_;
+        std::unordered_map<int, Client> clients_;
+        std::chrono::nanoseconds interval_{0};
+        std::chrono::steady_clock::time_point lastApply_{};
+        bool dirty_ = false;
+        bool timerArmed_ = false;
+        int listener_ = -1;
+        int signals_ = -1;
+        int timer_ = -1;
+        int stop_ = -1;
+        int epoll_ = -1;
+        Stats stats_;
+    };
+
+    // The controller as a client sees it in REQUEST_CONTROLLER_DATA.
+    struct Controller
+    {
+        std::string name;
+        std::string location;
+        size_t modes = 0;
+        size_t activeMode = 0;
+        std::vector<std::string> zones;
+        std::vector<RGB_HEX> colors;
+    };
+
+    inline Controller parseController(Reader &r, uint32_t version)
+    {
+        Controller c;
+        r.u32();
+        r.i32();
+        c.name = r.str();
+        if (version >= 1)
+            r.str();
+        r.str();
+        r.str();
+        r.str();
+        c.location = r.str();
+        c.modes = r.u16();
+        c.activeMode = static_cast<size_t>(r.i32());
+        for (size_t i = 0; i < c.modes; ++i)
+        {
+            r.str();
+            for (int field = 0; field < (version >= 3 ? 12 : 9); ++field)
+                r.u32();
+            for (size_t n = r.u16(); n > 0; --n)
+                r.u32();
+        }
+        for (size_t n = r.u16(); n > 0; --n)
+        {
+            c.zones.push_back(r.str());
+            r.i32();
+            r.u32();
+            r.u32();
+            r.u32();
+            size_t matrix = r.u16();
+            for (size_t i = 0; i < matrix; ++i)
+                r.u32();
+        }
+        for (size_t n = r.u16(); n > 0; --n)
+        {
+            r.str();
+            r.u32();
+        }
+        for (size_t n = r.u16(); n > 0; --n)
+            c.colors.push_back(fromWire(r.u32()));
+        return c;
+    }
+
+    // A blocking SDK client on loopback, for scripted sessions against the server.
+    class ScriptClient
+    {
+    public:
+        explicit ScriptClient(uint16_t port) : fd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0))
+        {
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            timeval timeout{2, 0};
+            if (fd_ < 0 || setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+                connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+                throw std::runtime_error("Failed to connect to 127.0.0.1:" + std::to_string(port) + ": " + std::strerror(errno));
+        }
+
+        ~ScriptClient()
+        {
+            if (fd_ >= 0)
+                close(fd_);
+        }
+
+        ScriptClient(const ScriptClient &) = delete;
+        ScriptClient &operator=(const ScriptClient &) = delete;
+
+        void send(uint32_t id, const Writer &body, uint32_t device = 0)
+        {
+            Writer packet;
+            packet.raw("ORGB", 4);
+            packet.u32(device);
+            packet.u32(id);
+            packet.u32(static_cast<uint32_t>(body.bytes.size()));
+            packet.raw(body.bytes.data(), body.bytes.size());
+            if (::send(fd_, packet.bytes.data(), packet.bytes.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(packet.bytes.size()))
+                throw std::runtime_error(std::string("OpenRGB client send failed: ") + std::strerror(errno));
+        }
+
+        // Sends a request and returns the body of its reply.
+        std::vector<unsigned char> request(uint32_t id, const Writer &body, uint32_t device = 0)
+        {
+            send(id, body, device);
+            unsigned char header[16];
+            receive(header, sizeof(header));
+            uint32_t replyId, size;
+            std::memcpy(&replyId, header + 8, 4);
+            std::memcpy(&size, header + 12, 4);
+            if (std::memcmp(header, "ORGB", 4) != 0 || replyId != id || size > MAX_PACKET)
+                throw std::runtime_error("Unexpected OpenRGB reply to packet " + std::to_string(id));
+            std::vector<unsigned char> reply(size);
+            receive(reply.data(), size);
+            return reply;
+        }
+
+    private:
+        void receive(unsigned char *out, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t n = recv(fd_, out, size, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw std::runtime_error(n == 0 ? "OpenRGB server closed the connection" : "No reply from the OpenRGB server");
+                out += n;
+                size -= static_cast<size_t>(n);
+            }
+        }
+
+        int fd_;
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "definitions.hpp"
+#include "fs.hpp"
+#include "utils.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace omen::rgb::output
+{
+    // Number of consecutive zoneNN attributes the driver exposes (the most of any selected
+    // device), or ZONE_COUNT if none can be seen.
+    inline size_t discoverZones(size_t limit = 100)
+    {
+        size_t zones = 0;
+        while (zones < limit && omen::fs::sysfsExists(utils::zonePath(zones)))
+            ++zones;
+        return zones ? zones : ZONE_COUNT;
+    }
+
+    // Writes frames to the zone attributes, skipping zones whose color is unchanged.
+    class ZoneWriter
+    {
+    public:
+        explicit ZoneWriter(size_t zones = ZONE_COUNT) : current_(zones, ~RGB_HEX(0))
+        {
+            for (size_t zone = 0; zone < zones; ++zone)
+                paths_.push_back(utils::zonePath(zone));
+        }
+
+        size_t zones() const { return paths_.size(); }
+        size_t writes() const { return writes_; }
+
+        // Returns false if any zone write failed; failed zones are retried on the next frame.
+        // The changed zones go out as one batch, so several devices are written in parallel.
+        bool write(const RGB_HEX *frame, size_t count)
+        {
+            std::vector<omen::fs::Write> batch;
+            std::vector<size_t> zones;
+            for (size_t zone = 0; zone < count && zone < paths_.size(); ++zone)
+            {
+                RGB_HEX color = frame[zone] & 0xFFFFFF;
+                if (color == current_[zone])
+                    continue;
+                batch.push_back({paths_[zone], utils::hex6(color)});
+                zones.push_back(zone);
+            }
+            if (batch.empty())
+                return true;
+            writes_ += batch.size();
+            std::vector<char> ok = omen::fs::writeBatch(batch);
+            bool all = true;
+            for (size_t i = 0; i < zones.size(); ++i)
+            {
+                if (ok[i])
+                    current_[zones[i]] = frame[zones[i]] & 0xFFFFFF;
+                all = all && ok[i];
+            }
+            return all;
+        }
+
+        bool writeZone(size_t zone, RGB_HEX color)
+        {
+            color &= 0xFFFFFF;
+            if (zone >= paths_.size() || color == current_[zone])
+                return zone < paths_.size();
+            ++writes_;
+            if (!omen::fs::writeSysfs(paths_[zone], utils::hex6(color)))
+                return false;
+            current_[zone] = color;
+            return true;
+        }
+
+    private:
+        std::vector<std::string> paths_;
+        std::vector<RGB_HEX> current_;
+        size_t writes_ = 0;
+    };
+}
@@ -0,0 +1,269 @@
+#pragma once
+#include "definitions.hpp"
+#include "omen_effect.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#ifndef OMEN_PLUGIN_DIR
+#define OMEN_PLUGIN_DIR "/usr/local/lib/omen-rgb-cli/plugins"
+#endif
+
+#define PLUGIN_PATH_ENV "OMEN_RGB_PLUGIN_PATH"
+
+namespace omen::rgb::plugins
+{
+    // A dlopen'ed effect plugin whose entry table passed the ABI check.
+    class Plugin
+    {
+    public:
+        static std::shared_ptr<Plugin> load(const std::string &path)
+        {
+            void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (!handle)
+                throw std::runtime_error(dlerror());
+
+            auto entry = reinterpret_cast<omen_effect_entry_fn>(dlsym(handle, OMEN_EFFECT_ENTRY_SYMBOL));
+            const omen_effect_v1 *table = entry ? entry() : nullptr;
+            std::string error;
+            if (!table)
+                error = "missing " OMEN_EFFECT_ENTRY_SYMBOL;
+            else if (table->abi_version != OMEN_EFFECT_ABI_VERSION)
+                error = "ABI version " + std::to_string(table->abi_version) + ", expected " + std::to_string(OMEN_EFFECT_ABI_VERSION);
+            else if (!table->name || !table->render)
+                error = "incomplete effect table";
+            if (!error.empty())
+            {
+                dlclose(handle);
+                throw std::runtime_error(path + ": " + error);
+            }
+            return std::shared_ptr<Plugin>(new Plugin(path, handle, table));
+        }
+
+        ~Plugin() { dlclose(handle_); }
+
+        const std::string &path() const { return path_; }
+        std::string name() const { return table_->name; }
+        const omen_effect_v1 &table() const { return *table_; }
+
+    private:
+        Plugin(std::string path, void *handle, const omen_effect_v1 *table)
+            : path_(std::move(path)), handle_(handle), table_(table) {}
+
+        std::string path_;
+        void *handle_;
+        const omen_effect_v1 *table_;
+    };
+
+    struct Stats
+    {
+        uint64_t calls = 0;
+        uint64_t overBudget = 0;
+        std::chrono::nanoseconds total{0};
+        std::chrono::nanoseconds max{0};
+    };
+
+    // One running effect. Render time is accounted per call; a plugin that runs over
+    // budget on STRIKES consecutive frames, or reports an error, is disabled for good.
+    class Instance
+    {
+    public:
+        static constexpr int STRIKES = 3;
+
+        Instance(std::shared_ptr<Plugin> plugin, std::string args, std::chrono::nanoseconds budget)
+            : plugin_(std::move(plugin)), args_(std::move(args)), budget_(budget) {}
+
+        ~Instance()
+        {
+            if (state_ && plugin_->table().destroy)
+                plugin_->table().destroy(state_);
+        }
+
+        Instance(const Instance &) = delete;
+        Instance &operator=(const Instance &) = delete;
+
+        const Plugin &plugin() const { return *plugin_; }
+        const Stats &stats() const { return stats_; }
+        bool disabled() const { return !reason_.empty(); }
+        const std::string &reason() const { return reason_; }
+
+        // Returns false (leaving frame untouched) once the plugin is disabled.
+        bool render(double t, RGB_HEX *frame, size_t zones)
+        {
+            if (disabled())
+                return false;
+
+            const omen_effect_v1 &table = plugin_->table();
+            auto zoneCount = static_cast<uint32_t>(zones);
+            if (!initialized_)
+            {
+                initialized_ = true;
+                if (table.init && !(state_ = table.init(args_.c_str(), zoneCount)))
+                {
+                    disable("init failed");
+                    return false;
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            int status = table.render(state_, frame, zoneCount, t);
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+            ++stats_.calls;
+            stats_.total += elapsed;
+            stats_.max = std::max(stats_.max, elapsed);
+            strikes_ = elapsed > budget_ ? strikes_ + 1 : 0;
+            stats_.overBudget += elapsed > budget_;
+
+            if (status != 0)
+                disable("render returned " + std::to_string(status));
+            else if (strikes_ >= STRIKES)
+                disable("exceeded " + std::to_string(budget_.count() / 1000) + " us budget on " + std::to_string(STRIKES) + " consecutive frames");
+            return !disabled();
+        }
+
+    private:
+        void disable(const std::string &reason)
+        {
+            reason_ = reason;
+            std::cerr << MSG_ERR("Plugin " + plugin_->name() + " disabled: " + reason) << "\n";
+        }
+
+        std::shared_ptr<Plugin> plugin_;
+        std::string args_;
+        std::chrono::nanoseconds budget_;
+        void *state_ = nullptr;
+        bool initialized_ = false;
+        int strikes_ = 0;
+        Stats stats_;
+        std::string reason_;
+    };
+
+    // Directories from $OMEN_RGB_PLUGIN_PATH (colon separated), then ./plugins next to
+    // the executable, then the install directory.
+    inline std::vector<std::string> searchPath()
+    {
+        std::vector<std::string> dirs;
+        if (const char *env = std::getenv(PLUGIN_PATH_ENV))
+        {
+            std::string path = env;
+            size_t start = 0;
+            for (size_t colon; (colon = path.find(':', start)) != std::string::npos; start = colon + 1)
+                dirs.push_back(path.substr(start, colon - start));
+            dirs.push_back(path.substr(start));
+        }
+
+        char exe[4096];
+        ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        if (n > 0)
+        {
+            std::string dir(exe, static_cast<size_t>(n));
+            dirs.push_back(dir.substr(0, dir.rfind('/')) + "/plugins");
+        }
+        dirs.push_back(OMEN_PLUGIN_DIR);
+
+        dirs.erase(std::remove(dirs.begin(), dirs.end(), ""), dirs.end());
+        return dirs;
+    }
+
+    inline std::vector<std::string> discover()
+    {
+        std::vector<std::string> files;
+        for (const auto &dir : searchPath())
+        {
+            DIR *d = opendir(dir.c_str());
+            if (!d)
+                continue;
+            std::vector<std::string> found;
+            while (dirent *entry = readdir(d))
+            {
+                std::string name = entry->d_name;
+                if (name.size() > 3 && name.compare(name.size() - 3, 3, ".so") == 0)
+                    found.push_back(dir + "/" + name);
+            }
+            closedir(d);
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        return files;
+    }
+
+    // Loads plugins on demand and watches the live instances so their accounting can be
+    // reported. The layers own the instances: removing one destroys its state.
+    class Host
+    {
+    public:
+        std::chrono::nanoseconds budget{std::chrono::milliseconds(2)};
+
+        std::shared_ptr<Instance> create(const std::string &name, const std::string &args)
+        {
+            for (const auto &plugin : loaded_)
+                if (plugin->name() == name)
+                    return track(plugin, args);
+
+            for (const auto &path : discover())
+            {
+                if (std::any_of(loaded_.begin(), loaded_.end(), [&](const auto &p)
+                                { return p->path() == path; }))
+                    continue;
+                try
+                {
+                    loaded_.push_back(Plugin::load(path));
+                }
+                catch (const std::exception &)
+                {
+                    continue;
+                }
+                if (loaded_.back()->name() == name)
+                    return track(loaded_.back(), args);
+            }
+            throw std::invalid_argument("No effect plugin named " + name + " (set " PLUGIN_PATH_ENV " to add directories)");
+        }
+
+        void report(std::ostream &out) const
+        {
+            for (const auto &weak : instances_)
+            {
+                std::shared_ptr<Instance> instance = weak.lock();
+                if (!instance)
+                    continue;
+                const Stats &s = instance->stats();
+                double avg = s.calls ? std::chrono::duration<double, std::micro>(s.total).count() / s.calls : 0.0;
+                out << "  plugin " << std::left << std::setw(12) << instance->plugin().name() << std::right
+                    << " calls " << s.calls << std::fixed << std::setprecision(1)
+                    << "  avg " << avg << " us  max " << std::chrono::duration<double, std::micro>(s.max).count()
+                    << " us  over budget " << s.overBudget
+                    << (instance->disabled() ? "  [disabled: " + instance->reason() + "]" : "") << "\n";
+            }
+        }
+
+    private:
+        std::shared_ptr<Instance> track(const std::shared_ptr<Plugin> &plugin, const std::string &args)
+        {
+            instances_.erase(std::remove_if(instances_.begin(), instances_.end(), [](const auto &weak)
+                                            { return weak.expired(); }),
+                             instances_.end());
+            auto instance = std::make_shared<Instance>(plugin, args, budget);
+            instances_.push_back(instance);
+            return instance;
+        }
+
+        std::vector<std::shared_ptr<Plugin>> loaded_;
+        std::vector<std::weak_ptr<Instance>> instances_;
+    };
+
+    inline Host &host()
+    {
+        static Host instance;
+        return instance;
+    }
+}
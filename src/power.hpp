@@ -0,0 +1,83 @@
+#pragma once
+#include "fs.hpp"
+#include "utils.hpp"
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+
+#define POWER_SUPPLY_PATH "/sys/class/power_supply"
+#define POWER_SUPPLY_ENV "OMEN_RGB_POWER_SUPPLY_DIR"
+
+namespace omen::rgb::power
+{
+    enum class Source
+    {
+        Unknown,
+        Ac,
+        Battery
+    };
+
+    inline const char *sourceName(Source source)
+    {
+        switch (source)
+        {
+        case Source::Ac:
+            return "AC";
+        case Source::Battery:
+            return "battery";
+        default:
+            return "unknown";
+        }
+    }
+
+    // $OMEN_RGB_POWER_SUPPLY_DIR, else /sys/class/power_supply under the sysfs root.
+    inline std::string supplyDir()
+    {
+        if (const char *dir = std::getenv(POWER_SUPPLY_ENV); dir && *dir)
+            return dir;
+        return omen::fs::resolve(POWER_SUPPLY_PATH);
+    }
+
+    inline std::string readAttribute(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string value;
+        std::getline(file, value);
+        return utils::toLower(value);
+    }
+
+    // Battery when some battery reports Discharging and no mains supply is online.
+    // Machines without a power_supply class (desktops, containers) read as Unknown.
+    inline Source read()
+    {
+        DIR *dir = opendir(supplyDir().c_str());
+        if (!dir)
+            return Source::Unknown;
+
+        bool discharging = false, mains = false, any = false;
+        while (dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name[0] == '.')
+                continue;
+            std::string base = supplyDir() + "/" + name + "/";
+            std::string type = readAttribute(base + "type");
+            if (type == "mains" || type == "usb")
+            {
+                any = true;
+                mains = mains || readAttribute(base + "online") == "1";
+            }
+            else if (type == "battery")
+            {
+                any = true;
+                discharging = discharging || readAttribute(base + "status") == "discharging";
+            }
+        }
+        closedir(dir);
+
+        if (!any)
+            return Source::Unknown;
+        return discharging && !mains ? Source::Battery : Source::Ac;
+    }
+}
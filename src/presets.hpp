@@ -0,0 +1,147 @@
+#pragma once
+#include "definitions.hpp"
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace omen::rgb::presets
+{
+    struct FlagData
+    {
+        std::string name;
+        std::string emoji;
+        std::vector<RGB_HEX> colors;
+        std::string category;
+    };
+
+    static const std::unordered_map<std::string, FlagData> FLAG_DATABASE = {
+        {"pride", {"Pride", "🌈", {0xFF0000, 0xFF8000, 0xFFFF00, 0x00FF00, 0x0000FF, 0x8000FF}, "pride"}},
+        {"trans", {"Transgender", "⚧", {0x5BCEFA, 0xF5A9B8, 0xFFFFFF, 0xF5A9B8, 0x5BCEFA}, "pride"}},
+        {"bi", {"Bisexual", "💖", {0xD60270, 0x9B4F96, 0x0038A8}, "pride"}},
+        {"pan", {"Pansexual", "💗", {0xFF1B8D, 0xFFD700, 0x1BB3FF}, "pride"}},
+        {"ace", {"Asexual", "🖤", {0x000000, 0xA3A3A3, 0xFFFFFF, 0x800080}, "pride"}},
+        {"lesbian", {"Lesbian", "🧡", {0xD52D00, 0xFF9A56, 0xFFFFFF, 0xD362A4, 0xA30262}, "pride"}},
+        {"gay", {"Gay", "💙", {0x078D70, 0x26CEAA, 0x98E8C1, 0xFFFFFF, 0x7BADE2, 0x5049CC, 0x3D1A78}, "pride"}},
+        {"nonbinary", {"Non-binary", "💛", {0xFFF430, 0xFFFFFF, 0x9C59D1, 0x000000}, "pride"}},
+        {"genderfluid", {"Genderfluid", "💜", {0xFF75A2, 0xFFFFFF, 0xBE18D6, 0x000000, 0x333EBD}, "pride"}},
+        {"agender", {"Agender", "🤍", {0x000000, 0xBCC4C6, 0xFFFFFF, 0xB8F483, 0xFFFFFF, 0xBCC4C6, 0x000000}, "pride"}},
+        {"demigirl", {"Demigirl", "💗", {0x7F7F7F, 0xC4C4C4, 0xFFB6C1, 0xFFFFFF, 0xFFB6C1, 0xC4C4C4, 0x7F7F7F}, "pride"}},
+        {"demiboy", {"Demiboy", "💙", {0x7F7F7F, 0xC4C4C4, 0x9ACEEB, 0xFFFFFF, 0x9ACEEB, 0xC4C4C4, 0x7F7F7F}, "pride"}},
+        {"aro", {"Aromantic", "🤍", {0x3DA542, 0xA7D379, 0xFFFFFF, 0xA9A9A9, 0x000000}, "pride"}},
+        {"demi", {"Demisexual", "💜", {0x000000, 0x7F7F7F, 0xFFFFFF, 0x800080}, "pride"}},
+        {"intersex", {"Intersex", "🟡", {0xFFD700, 0x7B68EE, 0xFFD700}, "pride"}},
+        {"twospirit", {"Two-Spirit", "🟣", {0x800080, 0xFFFFFF, 0x000000}, "pride"}},
+
+        {"usa", {"United States", "[US]", {0xB22234, 0xFFFFFF, 0x3C3B6E}, "country"}},
+        {"uk", {"United Kingdom", "[UK]", {0x012169, 0xFFFFFF, 0xC8102E}, "country"}},
+        {"france", {"France", "[FR]", {0x002395, 0xFFFFFF, 0xED2939}, "country"}},
+        {"germany", {"Germany", "[DE]", {0x000000, 0xDD0000, 0xFFCE00}, "country"}},
+        {"italy", {"Italy", "[IT]", {0x009246, 0xFFFFFF, 0xCE2B37}, "country"}},
+        {"canada", {"Canada", "[CA]", {0xFF0000, 0xFFFFFF, 0xFF0000}, "country"}},
+        {"japan", {"Japan", "[JP]", {0xFFFFFF, 0xBC002D, 0xFFFFFF}, "country"}},
+        {"brazil", {"Brazil", "[BR]", {0x009639, 0xFFDF00, 0x002776}, "country"}},
+        {"australia", {"Australia", "[AU]", {0x00008B, 0xFF0000, 0xFFFFFF}, "country"}},
+        {"spain", {"Spain", "[ES]", {0xAA151B, 0xF1BF00, 0xAA151B}, "country"}},
+
+        {"sunset", {"Sunset", "🌅", {0xFF6B6B, 0xFF8E53, 0xFF6B9D, 0xC44569, 0xF8B500}, "theme"}},
+        {"ocean", {"Ocean", "🌊", {0x006994, 0x0099CC, 0x00CCFF, 0x66E0FF}, "theme"}},
+        {"fire", {"Fire", "🔥", {0xFF4500, 0xFF6347, 0xFF7F50, 0xFFA500}, "theme"}},
+        {"rainbow", {"Rainbow", "🌈", {0xFF0000, 0xFF7F00, 0xFFFF00, 0x00FF00, 0x0000FF, 0x4B0082, 0x9400D3}, "theme"}},
+        {"aurora", {"Aurora", "🌌", {0x00FF9F, 0x00D4FF, 0x9D4EDD, 0x7209B7}, "theme"}},
+        {"matrix", {"Matrix", "🟢", {0x00FF00, 0x00CC00, 0x009900, 0x006600}, "theme"}},
+        {"cyberpunk", {"Cyberpunk", "🤖", {0xFF0080, 0x00FFFF, 0x8000FF, 0xFFFF00}, "theme"}},
+        {"neon", {"Neon", "💡", {0xFF00FF, 0x00FFFF, 0xFFFF00, 0xFF0080}, "theme"}},
+        {"galaxy", {"Galaxy", "🌌", {0x4B0082, 0x8A2BE2, 0x9370DB, 0xDA70D6}, "theme"}}};
+
+    // Palettes of the dedicated per-preset commands (cmdAce, cmdGay, ...), which
+    // differ in places from the FLAG_DATABASE entries of the same name.
+    static const std::unordered_map<std::string, std::vector<RGB_HEX>> COMMAND_PRESETS = {
+        {"ace", {0x000000, 0x808080, 0xFFFFFF, 0x800080}},
+        {"lesbian", {0xD52D00, 0xEF7627, 0xFF9A56, 0xFFFFFF, 0xD162A4, 0xB55690, 0xA30262}},
+        {"gay", {0x078D70, 0x26CEAA, 0x98E8C1, 0xFFFFFF, 0x7BADE2, 0x5049CC, 0x3D1A78}},
+        {"nonbinary", {0xFFF430, 0xFFFFFF, 0x9C59D1, 0x000000}},
+        {"genderfluid", {0xFF75A2, 0xFFFFFF, 0xBE18D6, 0x000000, 0x333EBD}},
+        {"agender", {0x000000, 0xBCC4C6, 0xFFFFFF, 0xB8F483, 0xFFFFFF, 0xBCC4C6, 0x000000}},
+        {"demigirl", {0x7F7F7F, 0xC4C4C4, 0xFFB7D5, 0xFFFFFF, 0xFFB7D5, 0xC4C4C4, 0x7F7F7F}},
+        {"demiboy", {0x7F7F7F, 0xC4C4C4, 0x9AD9EA, 0xFFFFFF, 0x9AD9EA, 0xC4C4C4, 0x7F7F7F}},
+        {"aro", {0x3AA63F, 0xA8D47A, 0xFFFFFF, 0xABABAB, 0x000000}},
+        {"demi", {0x7F7F7F, 0xFFFFFF, 0x7F7F7F}},
+        {"usa", {0xB22234, 0xFFFFFF, 0x3C3B6E}},
+        {"uk", {0x012169, 0xFFFFFF, 0xC8102E}},
+        {"france", {0x002395, 0xFFFFFF, 0xED2939}},
+        {"germany", {0x000000, 0xDD0000, 0xFFCE00}},
+        {"italy", {0x009246, 0xFFFFFF, 0xCE2B37}},
+        {"canada", {0xFF0000, 0xFFFFFF, 0xFF0000}},
+        {"japan", {0xFFFFFF, 0xBC002D, 0xFFFFFF}},
+        {"brazil", {0x009639, 0xFFDF00, 0x002776}},
+        {"australia", {0x00008B, 0xFF0000, 0xFFFFFF}},
+        {"spain", {0xAA151B, 0xF1BF00, 0xAA151B}},
+        {"intersex", {0xFFD700, 0x7B68EE, 0xFFD700}},
+        {"twospirit", {0x800080, 0xFFFFFF, 0x000000}},
+        {"sunset", {0xFF6B6B, 0xFF8E53, 0xFF6B9D, 0xC44569, 0xF8B500}},
+        {"ocean", {0x001F3F, 0x0074D9, 0x7FDBFF, 0x39CCCC, 0x3D9970}},
+        {"fire", {0xFF0000, 0xFF4500, 0xFF8C00, 0xFFD700, 0xFFFF00}},
+        {"rainbow", {0xFF0000, 0xFF7F00, 0xFFFF00, 0x00FF00, 0x0000FF, 0x4B0082, 0x9400D3}},
+        {"aurora", {0x00FF9F, 0x00D4FF, 0x9D4EDD, 0x7209B7}},
+        {"matrix", {0x00FF00, 0x00CC00, 0x009900, 0x006600}},
+        {"cyberpunk", {0xFF0080, 0x00FFFF, 0x8000FF, 0xFFFF00}},
+        {"neon", {0xFF00FF, 0x00FFFF, 0xFFFF00, 0xFF0080}},
+        {"galaxy", {0x4B0082, 0x8A2BE2, 0x9370DB, 0xDA70D6}}};
+
+    using PresetMap = std::unordered_map<std::string, FlagData>;
+
+    // User presets from the config file, published by the process that loaded it.
+    inline std::shared_ptr<const PresetMap> &userPresets()
+    {
+        static std::shared_ptr<const PresetMap> presets;
+        return presets;
+    }
+
+    // A config being validated off the main thread sees its own user presets instead.
+    inline const PresetMap *&threadPresets()
+    {
+        thread_local const PresetMap *presets = nullptr;
+        return presets;
+    }
+
+    inline const FlagData *findUser(const std::string &name)
+    {
+        const PresetMap *map = threadPresets() ? threadPresets() : userPresets().get();
+        if (!map)
+            return nullptr;
+        auto it = map->find(name);
+        return it == map->end() ? nullptr : &it->second;
+    }
+
+    inline bool exists(const std::string &name)
+    {
+        return findUser(name) || FLAG_DATABASE.count(name);
+    }
+
+    inline const FlagData &get(const std::string &name)
+    {
+        if (const FlagData *user = findUser(name))
+            return *user;
+        auto it = FLAG_DATABASE.find(name);
+        if (it == FLAG_DATABASE.end())
+            throw std::invalid_argument("Unknown flag/theme: " + name);
+        return it->second;
+    }
+
+    inline const std::vector<RGB_HEX> &commandPalette(const std::string &name)
+    {
+        auto it = COMMAND_PRESETS.find(name);
+        if (it == COMMAND_PRESETS.end())
+            throw std::invalid_argument("Unknown preset command: " + name);
+        return it->second;
+    }
+
+    // Zone i shows palette entry i; zones past the end repeat the last entry.
+    inline RGB_HEX zoneColor(const std::vector<RGB_HEX> &palette, size_t zone)
+    {
+        return zone < palette.size() ? palette[zone] : palette.back();
+    }
+}
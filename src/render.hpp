@@ -0,0 +1,199 @@
+#pragma once
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "presets.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Offline rendering on a virtual clock: frame i is composed at t = i / fps,
+// so the output depends only on the sources and options.
+namespace omen::rgb::render
+{
+    enum class Format
+    {
+        Binary,
+        Ppm,
+        Text
+    };
+
+    // Binary layout: "OMENFRM1", then little-endian u32 zones, u32 frames and
+    // u32 fps * 1000, followed by frames * zones RGB byte triplets.
+    constexpr char BINARY_MAGIC[8] = {'O', 'M', 'E', 'N', 'F', 'R', 'M', '1'};
+
+    inline Format parseFormat(const std::string &name)
+    {
+        std::string format = utils::toLower(name);
+        if (format == "bin")
+            return Format::Binary;
+        if (format == "ppm")
+            return Format::Ppm;
+        if (format == "text" || format == "txt")
+            return Format::Text;
+        throw std::invalid_argument("Invalid format: " + name + ". Valid formats: bin, ppm, text");
+    }
+
+    inline Format formatForPath(const std::string &path)
+    {
+        size_t dot = path.rfind('.');
+        if (dot != std::string::npos)
+        {
+            std::string ext = utils::toLower(path.substr(dot + 1));
+            if (ext == "ppm")
+                return Format::Ppm;
+            if (ext == "txt")
+                return Format::Text;
+        }
+        return Format::Binary;
+    }
+
+    struct Options
+    {
+        size_t frames = 600;
+        double fps = 60.0;
+        size_t zones = ZONE_COUNT;
+    };
+
+    // Returns frames * zones colors, one frame after another.
+    inline std::vector<RGB_HEX> renderFrames(const std::vector<std::string> &sources, const Options &options)
+    {
+        if (options.frames == 0 || options.fps <= 0.0 || options.zones == 0 || options.zones > MAX_FRAME_COLORS)
+            throw std::invalid_argument("render needs frames > 0, fps > 0 and 1-" + std::to_string(MAX_FRAME_COLORS) + " zones");
+
+        compositor::Compositor comp(options.zones);
+        for (const auto &source : sources)
+            comp.add(compositor::parseLayer(source));
+
+        std::vector<RGB_HEX> frames(options.frames * options.zones);
+        for (size_t i = 0; i < options.frames; ++i)
+        {
+            comp.compose(static_cast<double>(i) / options.fps);
+            std::transform(comp.frame(), comp.frame() + options.zones, frames.begin() + i * options.zones,
+                           [](RGB_HEX c)
+                           { return c & 0xFFFFFF; });
+        }
+        return frames;
+    }
+
+    inline void write(std::ostream &out, Format format, const std::vector<RGB_HEX> &frames, const Options &options)
+    {
+        std::string buffer;
+        if (format == Format::Text)
+        {
+            buffer.reserve(frames.size() * 7);
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                buffer += utils::hex6(frames[i]);
+                buffer += (i + 1) % options.zones ? ' ' : '\n';
+            }
+            out << buffer;
+            return;
+        }
+
+        if (format == Format::Ppm)
+        {
+            buffer = "P6\n" + std::to_string(options.zones) + " " + std::to_string(options.frames) + "\n255\n";
+        }
+        else
+        {
+            buffer.assign(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+            for (uint32_t value : {static_cast<uint32_t>(options.zones), static_cast<uint32_t>(options.frames),
+                                   static_cast<uint32_t>(options.fps * 1000.0 + 0.5)})
+                for (int shift = 0; shift < 32; shift += 8)
+                    buffer += static_cast<char>((value >> shift) & 0xFF);
+        }
+
+        buffer.reserve(buffer.size() + frames.size() * 3);
+        for (RGB_HEX c : frames)
+        {
+            buffer += static_cast<char>((c >> 16) & 0xFF);
+            buffer += static_cast<char>((c >> 8) & 0xFF);
+            buffer += static_cast<char>(c & 0xFF);
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+
+    // FNV-1a over the RGB bytes of every frame.
+    inline uint64_t hash(const std::vector<RGB_HEX> &frames)
+    {
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (RGB_HEX c : frames)
+            for (int shift = 16; shift >= 0; shift -= 8)
+                h = (h ^ ((c >> shift) & 0xFF)) * 0x100000001B3ull;
+        return h;
+    }
+
+    inline std::string hashHex(uint64_t h)
+    {
+        std::ostringstream oss;
+        oss << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << h;
+        return oss.str();
+    }
+
+    // Every preset, its palette cycle, and every dedicated preset command, sorted by name.
+    inline std::vector<std::string> goldenSources()
+    {
+        std::vector<std::string> sources;
+        for (const auto &pair : presets::FLAG_DATABASE)
+        {
+            sources.push_back("preset:" + pair.first);
+            sources.push_back("cycle:" + pair.first);
+        }
+        for (const auto &pair : presets::COMMAND_PRESETS)
+            sources.push_back("command:" + pair.first);
+        std::sort(sources.begin(), sources.end());
+        return sources;
+    }
+
+    inline void writeGolden(std::ostream &out, const Options &options)
+    {
+        out << "# frames=" << options.frames << " fps=" << options.fps << " zones=" << options.zones << "\n";
+        for (const auto &source : goldenSources())
+            out << source << " " << hashHex(hash(renderFrames({source}, options))) << "\n";
+    }
+
+    // Re-renders every entry of a golden file with its recorded options and
+    // returns a description of each mismatch.
+    inline std::vector<std::string> checkGolden(std::istream &in)
+    {
+        Options options;
+        std::vector<std::string> mismatches;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream iss(line);
+            if (line.rfind("# ", 0) == 0)
+            {
+                std::string word;
+                iss >> word;
+                while (iss >> word)
+                {
+                    size_t eq = word.find('=');
+                    std::string key = word.substr(0, eq), value = eq == std::string::npos ? "" : word.substr(eq + 1);
+                    if (key == "frames")
+                        options.frames = std::stoul(value);
+                    else if (key == "fps")
+                        options.fps = std::stod(value);
+                    else if (key == "zones")
+                        options.zones = std::stoul(value);
+                }
+                continue;
+            }
+
+            std::string source, expected;
+            if (!(iss >> source >> expected))
+                continue;
+            std::string actual = hashHex(hash(renderFrames({source}, options)));
+            if (actual != expected)
+                mismatches.push_back(source + ": expected " + expected + ", got " + actual);
+        }
+        return mismatches;
+    }
+}
@@ -0,0 +1,307 @@
+#pragma once
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "dither.hpp"
+#include "output.hpp"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define FIFO_PATH_ENV "OMEN_RGB_FIFO"
+
+// Resident mode: one epoll set over a FIFO for updates, a signalfd for shutdown and a
+// timerfd that is armed only while some layer animates. A static frame costs no wakeups.
+namespace omen::rgb::resident
+{
+    struct Stats
+    {
+        uint64_t wakeups = 0;
+        uint64_t timerWakeups = 0;
+        uint64_t fifoWakeups = 0;
+        uint64_t frames = 0;
+        double cpuSeconds = 0.0;
+    };
+
+    inline double cpuSeconds()
+    {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        auto seconds = [](const timeval &tv)
+        { return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) * 1e-6; };
+        return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+    }
+
+    inline void printStats(std::ostream &out, const Stats &stats)
+    {
+        out << "[OK] wakeups " << stats.wakeups << " (timer " << stats.timerWakeups << ", fifo " << stats.fifoWakeups
+            << "), frames " << stats.frames << ", CPU " << std::fixed << std::setprecision(3) << stats.cpuSeconds * 1e3
+            << " ms" << std::defaultfloat << std::endl;
+    }
+
+    // $OMEN_RGB_FIFO, else $XDG_RUNTIME_DIR/omen-rgb-cli.fifo, else /tmp/omen-rgb-cli.fifo.
+    inline std::string defaultFifoPath()
+    {
+        if (const char *path = std::getenv(FIFO_PATH_ENV); path && *path)
+            return path;
+        const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+        return std::string(runtime && *runtime ? runtime : "/tmp") + "/omen-rgb-cli.fifo";
+    }
+
+    class Runner
+    {
+    public:
+        // control handles one FIFO line and returns false to stop the loop.
+        using Control = std::function<bool(const std::string &line)>;
+
+        Runner(compositor::Compositor &comp, double fps, Control control)
+            : comp_(comp), writer_(comp.zones()), stage_(comp), control_(std::move(control))
+        {
+            if (fps <= 0.0)
+                throw std::invalid_argument("fps must be greater than 0");
+            interval_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / fps));
+            fps_ = fps;
+            stage_.setEnabled(dither::enabled(dither_, fps));
+
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (epoll_ < 0 || timer_ < 0)
+                throw std::runtime_error(std::string("Failed to set up event loop: ") + std::strerror(errno));
+            watch(timer_);
+        }
+
+        ~Runner()
+        {
+            for (int fd : {fifo_, signals_, timer_, epoll_})
+                if (fd >= 0)
+                    close(fd);
+        }
+
+        Runner(const Runner &) = delete;
+        Runner &operator=(const Runner &) = delete;
+
+        // Opened read-write so the FIFO never reports EOF when the last writer leaves.
+        void openFifo(const std::string &path)
+        {
+            if (mkfifo(path.c_str(), 0660) != 0 && errno != EEXIST)
+                throw std::runtime_error("Failed to create FIFO " + path + ": " + std::strerror(errno));
+            fifo_ = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (fifo_ < 0)
+                throw std::runtime_error("Failed to open FIFO " + path + ": " + std::strerror(errno));
+            watch(fifo_);
+        }
+
+        // SIGINT and SIGTERM end run() cleanly instead of killing the process.
+        void handleSignals()
+        {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGINT);
+            sigaddset(&mask, SIGTERM);
+            sigprocmask(SIG_BLOCK, &mask, nullptr);
+            signals_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (signals_ < 0)
+                throw std::runtime_error(std::string("Failed to create signalfd: ") + std::strerror(errno));
+            watch(signals_);
+        }
+
+        // Runs handler when fd becomes readable, then re-renders the stack.
+        void watch(int fd, std::function<void()> handler)
+        {
+            watch(fd);
+            handlers_.emplace_back(fd, std::move(handler));
+        }
+
+        // Takes effect on the next timer arm; a running animation is re-armed at once.
+        void setFps(double fps)
+        {
+            if (fps <= 0.0)
+                throw std::invalid_argument("fps must be greater than 0");
+            interval_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / fps));
+            fps_ = fps;
+            stage_.setEnabled(dither::enabled(dither_, fps));
+            if (armed_)
+                arm(true);
+        }
+
+        void setDither(dither::Mode mode)
+        {
+            dither_ = mode;
+            stage_.setEnabled(dither::enabled(mode, fps_));
+        }
+
+        bool dithering() const { return stage_.enabled(); }
+
+        const Stats &stats()
+        {
+            stats_.cpuSeconds = cpuSeconds() - cpuStart_;
+            return stats_;
+        }
+
+        size_t writes() const { return writer_.writes(); }
+
+        // Applies a control line immediately, as if it had arrived on the FIFO.
+        bool control(const std::string &line)
+        {
+            if (line == "stats")
+            {
+                printStats(std::cout, stats());
+                return true;
+            }
+            bool keepRunning = control_(line);
+            refresh();
+            return keepRunning;
+        }
+
+        // Runs until quit or a signal; a non-negative duration bounds the run for self-checks.
+        void run(std::chrono::milliseconds duration = std::chrono::milliseconds(-1))
+        {
+            using Clock = std::chrono::steady_clock;
+            const auto deadline = Clock::now() + duration;
+            refresh();
+
+            for (;;)
+            {
+                int timeout = -1;
+                if (duration.count() >= 0)
+                {
+                    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                    if (left <= 0)
+                        return;
+                    timeout = static_cast<int>(left);
+                }
+
+                epoll_event events[4];
+                int n = epoll_wait(epoll_, events, 4, timeout);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    continue;
+                ++stats_.wakeups;
+
+                for (int i = 0; i < n; ++i)
+                {
+                    int fd = events[i].data.fd;
+                    if (fd == timer_)
+                    {
+                        uint64_t expirations;
+                        if (read(timer_, &expirations, sizeof(expirations)) > 0)
+                        {
+                            ++stats_.timerWakeups;
+                            refresh();
+                        }
+                    }
+                    else if (fd == fifo_)
+                    {
+                        ++stats_.fifoWakeups;
+                        if (!drainFifo())
+                            return;
+                    }
+                    else if (fd == signals_)
+                    {
+                        signalfd_siginfo info;
+                        if (read(signals_, &info, sizeof(info)) > 0)
+                            return;
+                    }
+                    else
+                    {
+                        for (auto &[watched, handler] : handlers_)
+                            if (watched == fd)
+                                handler();
+                        refresh();
+                    }
+                }
+            }
+        }
+
+    private:
+        void watch(int fd)
+        {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0)
+                throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+        }
+
+        void frame()
+        {
+            ++stats_.frames;
+            stage_.frame(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count(), writer_);
+        }
+
+        // Renders the current stack once, then arms the frame timer only if something animates;
+        // a frame in which the last animation settled disarms it.
+        void refresh()
+        {
+            frame();
+            bool animate = comp_.animated();
+            if (animate != armed_)
+                arm(animate);
+        }
+
+        void arm(bool animate)
+        {
+            itimerspec spec{};
+            if (animate)
+            {
+                auto ns = interval_.count();
+                spec.it_interval = {static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+                spec.it_value = spec.it_interval;
+            }
+            timerfd_settime(timer_, 0, &spec, nullptr);
+            armed_ = animate;
+        }
+
+        bool drainFifo()
+        {
+            char buffer[4096];
+            ssize_t n;
+            while ((n = read(fifo_, buffer, sizeof(buffer))) > 0)
+                pending_.append(buffer, static_cast<size_t>(n));
+
+            for (size_t eol; (eol = pending_.find('\n')) != std::string::npos;)
+            {
+                std::string line = pending_.substr(0, eol);
+                pending_.erase(0, eol + 1);
+                if (!control(line))
+                    return false;
+            }
+            return true;
+        }
+
+        compositor::Compositor &comp_;
+        output::ZoneWriter writer_;
+        dither::Stage stage_;
+        Control control_;
+        std::chrono::nanoseconds interval_{0};
+        double fps_ = 0.0;
+        dither::Mode dither_ = dither::Mode::Auto;
+        int epoll_ = -1;
+        int timer_ = -1;
+        int fifo_ = -1;
+        int signals_ = -1;
+        bool armed_ = false;
+        std::string pending_;
+        std::vector<std::pair<int, std::function<void()>>> handlers_;
+        Stats stats_;
+        const double cpuStart_ = cpuSeconds();
+        const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    };
+}
@@ -0,0 +1,697 @@
+#pragma once
+#include "color.hpp"
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "fs.hpp"
+#include "output.hpp"
+#include "presets.hpp"
+#include "timeline.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Time-of-day schedules: entries at local wall-clock times, evaluated in-process. The
+// next entry is waited for on an absolute CLOCK_REALTIME timer that the kernel cancels
+// when the clock is set, so clock jumps are caught and the schedule is recomputed.
+namespace omen::rgb::schedule
+{
+    constexpr uint8_t EVERY_DAY = 0x7F;
+
+    // What an entry sets; parts left unset keep their current value.
+    struct Scene
+    {
+        std::vector<std::optional<RGB_HEX>> colors;
+        std::optional<int> brightness;
+        std::string mode;
+        int speed = 0;
+    };
+
+    struct Entry
+    {
+        // Seconds after local midnight.
+        int time = 0;
+        // Bit n is set for tm_wday n (0 = Sunday).
+        uint8_t days = EVERY_DAY;
+        Scene scene;
+        double fade = 0.0;
+        std::string text;
+    };
+
+    // "HH:MM" or "HH:MM:SS".
+    inline int parseClock(const std::string &text)
+    {
+        std::vector<std::string> parts;
+        std::string list = text;
+        std::replace(list.begin(), list.end(), ':', ' ');
+        parts = utils::split(list);
+        if (parts.size() < 2 || parts.size() > 3 || text.find_first_not_of("0123456789:") != std::string::npos)
+            throw std::invalid_argument("time must be HH:MM[:SS]: " + text);
+        int h = std::stoi(parts[0]), m = std::stoi(parts[1]), s = parts.size() == 3 ? std::stoi(parts[2]) : 0;
+        if (h > 23 || m > 59 || s > 59)
+            throw std::invalid_argument("time out of range: " + text);
+        return h * 3600 + m * 60 + s;
+    }
+
+    // "daily", "weekdays", "weekends", or days and ranges such as "mon-fri" or "sat,sun".
+    // Returns 0 when text is not a day set.
+    inline uint8_t parseDays(const std::string &text)
+    {
+        static const char *names[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+        std::string lower = utils::toLower(text);
+        if (lower == "daily")
+            return EVERY_DAY;
+        if (lower == "weekdays")
+            return 0x3E;
+        if (lower == "weekends")
+            return 0x41;
+        auto day = [&](const std::string &name) -> int
+        {
+            for (int d = 0; d < 7; ++d)
+                if (name == names[d])
+                    return d;
+            return -1;
+        };
+
+        uint8_t mask = 0;
+        std::replace(lower.begin(), lower.end(), ',', ' ');
+        for (const auto &part : utils::split(lower))
+        {
+            size_t dash = part.find('-');
+            int first = day(part.substr(0, dash)), last = dash == std::string::npos ? first : day(part.substr(dash + 1));
+            if (first < 0 || last < 0)
+                return 0;
+            for (int d = first;; d = (d + 1) % 7)
+            {
+                mask |= static_cast<uint8_t>(1u << d);
+                if (d == last)
+                    break;
+            }
+        }
+        return mask;
+    }
+
+    // "<n>[s|m|h]" in one word, or a number followed by a unit word ("10 min").
+    inline double parseDuration(const std::vector<std::string> &words, size_t &i)
+    {
+        if (i >= words.size())
+            throw std::invalid_argument("expected a duration after 'over'");
+        std::string text = utils::toLower(words[i]);
+        size_t end = text.find_first_not_of("0123456789.");
+        std::string unit = end == std::string::npos ? "" : text.substr(end);
+        if (unit.empty() && i + 1 < words.size())
+        {
+            std::string next = utils::toLower(words[i + 1]);
+            if (next.find_first_of("0123456789") == std::string::npos)
+            {
+                unit = next;
+                ++i;
+            }
+        }
+        double value = compositor::parseNumber(text.substr(0, end), "duration");
+        ++i;
+        if (unit.empty() || unit == "s" || unit == "sec" || unit == "secs" || unit == "second" || unit == "seconds")
+            return value;
+        if (unit == "m" || unit == "min" || unit == "mins" || unit == "minute" || unit == "minutes")
+            return value * 60.0;
+        if (unit == "h" || unit == "hour" || unit == "hours")
+            return value * 3600.0;
+        throw std::invalid_argument("unknown duration unit: " + unit);
+    }
+
+    // <HH:MM[:SS]> [days] [fade [to]] <action> [over <duration>], where action is a preset
+    // name, all <hex>, zones <zone> <hex>, brightness <0-100> or animation <mode> <speed>.
+    inline Entry parseEntry(const std::string &line, size_t zones)
+    {
+        std::vector<std::string> words = utils::split(line);
+        if (words.size() < 2)
+            throw std::invalid_argument("expected <time> <action>");
+        Entry entry;
+        entry.time = parseClock(words[0]);
+        entry.scene.colors.resize(zones);
+        size_t i = 1;
+        if (uint8_t days = parseDays(words[i]); days && i + 1 < words.size())
+        {
+            entry.days = days;
+            ++i;
+        }
+        bool fade = false;
+        if (utils::toLower(words[i]) == "fade")
+        {
+            fade = true;
+            if (++i < words.size() && utils::toLower(words[i]) == "to")
+                ++i;
+        }
+        if (i >= words.size())
+            throw std::invalid_argument("expected an action");
+
+        std::string action = utils::toLower(words[i++]);
+        auto take = [&](const char *what) -> const std::string &
+        {
+            if (i >= words.size())
+                throw std::invalid_argument(action + " expects " + what);
+            return words[i++];
+        };
+        auto hex = [&]()
+        { return utils::hexStringToRGB(utils::sanitizeHexString(take("a hex color"))); };
+
+        if (action == CMD_ALL)
+        {
+            RGB_HEX color = hex();
+            for (auto &c : entry.scene.colors)
+                c = color;
+        }
+        else if (action == CMD_ZONES || action == "zone")
+        {
+            double zone = compositor::parseNumber(take("<zone> <hex>"), "zone");
+            if (zone < 0.0 || zone >= static_cast<double>(zones))
+                throw std::invalid_argument("zone out of range: " + words[i - 1]);
+            entry.scene.colors[static_cast<size_t>(zone)] = hex();
+        }
+        else if (action == CMD_BRIGHTNESS)
+        {
+            double level = compositor::parseNumber(take("0-100"), "brightness");
+            if (level < 0.0 || level > 100.0)
+                throw std::invalid_argument("brightness must be 0-100");
+            entry.scene.brightness = static_cast<int>(std::lround(level));
+        }
+        else if (action == CMD_ANIMATION)
+        {
+            const auto &modes = timeline::firmwareModes();
+            entry.scene.mode = utils::toLower(take("<mode> <speed>"));
+            if (std::find(modes.begin(), modes.end(), entry.scene.mode) == modes.end())
+                throw std::invalid_argument("unknown mode " + entry.scene.mode + ". Valid modes: " ANIMATION_MODES_TEXT);
+            double speed = compositor::parseNumber(take("<mode> <speed>"), "speed");
+            if (speed < 1.0 || speed > 10.0)
+                throw std::invalid_argument("speed must be 1-10");
+            entry.scene.speed = static_cast<int>(speed);
+        }
+        else if (presets::exists(action))
+        {
+            const auto &palette = presets::get(action).colors;
+            for (size_t zone = 0; zone < zones; ++zone)
+                entry.scene.colors[zone] = presets::zoneColor(palette, zone);
+        }
+        else
+        {
+            throw std::invalid_argument("unknown action or preset: " + words[i - 1]);
+        }
+
+        if (i < words.size() && utils::toLower(words[i]) == "over")
+            entry.fade = parseDuration(words, ++i);
+        else if (fade)
+            throw std::invalid_argument("fade needs 'over <duration>'");
+        if (i < words.size())
+            throw std::invalid_argument("unexpected " + words[i]);
+        if (entry.fade > 0.0 && !entry.scene.mode.empty())
+            throw std::invalid_argument("animation changes cannot fade");
+
+        for (size_t w = 0; w < words.size(); ++w)
+            entry.text += (w ? " " : "") + words[w];
+        return entry;
+    }
+
+    // One entry per line; '#' starts a comment. Errors name the line.
+    inline std::vector<Entry> parse(std::istream &in, const std::string &name, size_t zones)
+    {
+        std::vector<Entry> entries;
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); ++number)
+        {
+            line = line.substr(0, line.find('#'));
+            if (utils::split(line).empty())
+                continue;
+            try
+            {
+                entries.push_back(parseEntry(line, zones));
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(name + ":" + std::to_string(number) + ": " + e.what());
+            }
+        }
+        if (entries.empty())
+            throw std::invalid_argument(name + ": no entries");
+        return entries;
+    }
+
+    // The entry's local time on the day `offset` days after the one containing now, through
+    // mktime so DST is applied for that date; 0 if the entry does not run that weekday.
+    // A time repeated when clocks go back resolves to its first instant, so it runs once,
+    // and a time skipped when they go forward runs at the normalised (later) time.
+    inline time_t occurrence(const Entry &entry, time_t now, int offset)
+    {
+        tm day{};
+        localtime_r(&now, &day);
+        day.tm_mday += offset;
+        day.tm_hour = entry.time / 3600;
+        day.tm_min = entry.time / 60 % 60;
+        day.tm_sec = entry.time % 60;
+
+        time_t at = 0;
+        for (int dst : {1, 0})
+        {
+            tm guess = day, check{};
+            guess.tm_isdst = dst;
+            time_t t = mktime(&guess);
+            if (localtime_r(&t, &check) && check.tm_isdst == dst && check.tm_hour == day.tm_hour && check.tm_min == day.tm_min && (!at || t < at))
+                at = t;
+        }
+        day.tm_isdst = -1;
+        time_t normalised = mktime(&day);
+        if (!at)
+            at = normalised;
+        return entry.days >> day.tm_wday & 1 ? at : 0;
+    }
+
+    // First occurrence strictly after now.
+    inline time_t nextOccurrence(const Entry &entry, time_t now)
+    {
+        for (int offset = 0; offset <= 8; ++offset)
+            if (time_t at = occurrence(entry, now, offset); at > now)
+                return at;
+        return 0;
+    }
+
+    // Last occurrence at or before now.
+    inline time_t lastOccurrence(const Entry &entry, time_t now)
+    {
+        for (int offset = 0; offset >= -8; --offset)
+            if (time_t at = occurrence(entry, now, offset); at && at <= now)
+                return at;
+        return 0;
+    }
+
+    struct Due
+    {
+        size_t entry;
+        time_t when;
+    };
+
+    // The next count occurrences after now, in order; entries due together keep file order.
+    inline std::vector<Due> upcoming(const std::vector<Entry> &entries, time_t now, size_t count)
+    {
+        std::vector<Due> due;
+        for (time_t from = now; due.size() < count;)
+        {
+            time_t when = 0;
+            for (const auto &entry : entries)
+                if (time_t at = nextOccurrence(entry, from); at && (!when || at < when))
+                    when = at;
+            if (!when)
+                break;
+            for (size_t e = 0; e < entries.size() && due.size() < count; ++e)
+                if (nextOccurrence(entries[e], from) == when)
+                    due.push_back({e, when});
+            from = when;
+        }
+        return due;
+    }
+
+    inline std::string formatLocal(time_t when)
+    {
+        tm local{};
+        localtime_r(&when, &local);
+        char buffer[64];
+        std::strftime(buffer, sizeof(buffer), "%a %Y-%m-%d %H:%M:%S %Z", &local);
+        return buffer;
+    }
+
+    // Keyboard state as last written, so fades start from what is actually shown.
+    struct State
+    {
+        std::vector<RGB_HEX> colors;
+        int brightness = 100;
+    };
+
+    // The scene of the latest entry is faded in from the state it found. Tracks its own
+    // copy of the state and writes only what changes.
+    class Applier
+    {
+    public:
+        explicit Applier(size_t zones) : writer_(zones)
+        {
+            state_.colors.assign(zones, 0);
+            for (size_t zone = 0; zone < zones; ++zone)
+                try
+                {
+                    state_.colors[zone] = utils::hexStringToRGB(utils::sanitizeHexString(omen::fs::readSysfs(utils::zonePath(zone))));
+                }
+                catch (const std::exception &)
+                {
+                }
+            try
+            {
+                state_.brightness = std::stoi(omen::fs::readSysfs(BRIGHTNESS_PATH));
+            }
+            catch (const std::exception &)
+            {
+            }
+            from_ = target_ = state_;
+        }
+
+        // Folds a scene into the target without a fade, as when catching up on past entries.
+        void settle(const Scene &scene)
+        {
+            finish();
+            merge(target_, scene);
+            from_ = target_;
+            if (!scene.mode.empty())
+                pendingMode_ = scene;
+        }
+
+        // Starts fading to scene; elapsed seconds of the fade have already passed.
+        void start(const Scene &scene, double fade, double elapsed = 0.0)
+        {
+            finish();
+            from_ = state_;
+            merge(target_, scene);
+            if (!scene.mode.empty())
+                pendingMode_ = scene;
+            fade_ = elapsed < fade ? fade : 0.0;
+            if (fade_ > 0.0)
+                ++fades_;
+            started_ = std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(elapsed));
+        }
+
+        // Writes the current point of the fade; returns true while it is still running.
+        bool step()
+        {
+            if (!pendingMode_.mode.empty())
+            {
+                omen::fs::writeSysfs(ANIMATION_MODE_PATH, pendingMode_.mode);
+                omen::fs::writeSysfs(ANIMATION_SPEED_PATH, std::to_string(pendingMode_.speed));
+                pendingMode_.mode.clear();
+            }
+            double f = fade_ > 0.0 ? std::min(1.0, std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count() / fade_) : 1.0;
+            for (size_t zone = 0; zone < state_.colors.size(); ++zone)
+            {
+                state_.colors[zone] = color::lerp(from_.colors[zone], target_.colors[zone], f);
+                writer_.writeZone(zone, state_.colors[zone]);
+            }
+            int level = static_cast<int>(std::lround(from_.brightness + (target_.brightness - from_.brightness) * f));
+            if (level != state_.brightness || !brightnessWritten_)
+            {
+                state_.brightness = level;
+                brightnessWritten_ = omen::fs::writeSysfs(BRIGHTNESS_PATH, std::to_string(level));
+            }
+            if (f >= 1.0)
+                fade_ = 0.0;
+            return fade_ > 0.0;
+        }
+
+        // Wake interval that moves the fade by about one output level.
+        std::chrono::nanoseconds stepInterval() const
+        {
+            int levels = std::abs(target_.brightness - from_.brightness);
+            for (size_t zone = 0; zone < from_.colors.size(); ++zone)
+                for (int shift : {0, 8, 16})
+                    levels = std::max(levels, std::abs(static_cast<int>(target_.colors[zone] >> shift & 0xFF) - static_cast<int>(from_.colors[zone] >> shift & 0xFF)));
+            double seconds = std::max(1.0 / 30.0, fade_ / std::max(levels, 1));
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds));
+        }
+
+        bool fading() const { return fade_ > 0.0; }
+        // Fades started so far; a change means the step interval must be recomputed.
+        uint64_t fades() const { return fades_; }
+        size_t writes() const { return writer_.writes(); }
+
+    private:
+        void finish()
+        {
+            if (fade_ > 0.0)
+                from_ = target_;
+            fade_ = 0.0;
+        }
+
+        static void merge(State &state, const Scene &scene)
+        {
+            for (size_t zone = 0; zone < state.colors.size() && zone < scene.colors.size(); ++zone)
+                if (scene.colors[zone])
+                    state.colors[zone] = *scene.colors[zone];
+            if (scene.brightness)
+                state.brightness = *scene.brightness;
+        }
+
+        output::ZoneWriter writer_;
+        State state_, from_, target_;
+        Scene pendingMode_;
+        double fade_ = 0.0;
+        uint64_t fades_ = 0;
+        bool brightnessWritten_ = false;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    struct Stats
+    {
+        uint64_t wakeups = 0;
+        uint64_t entries = 0;
+        uint64_t fadeSteps = 0;
+        uint64_t clockChanges = 0;
+    };
+
+    // The wall clock in seconds. time() reads the coarse clock, which can trail a timerfd
+    // expiry by a tick and would make an entry that just fired look not yet due.
+    inline time_t wallNow()
+    {
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        return now.tv_sec;
+    }
+
+    // Runs a schedule until SIGINT or SIGTERM. SIGUSR1 reports the next entry.
+    class Scheduler
+    {
+    public:
+        using Report = std::function<void(const std::string &line)>;
+
+        Scheduler(std::vector<Entry> entries, size_t zones, Report report)
+            : entries_(std::move(entries)), applier_(zones), report_(std::move(report))
+        {
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            wall_ = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+            fade_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGINT);
+            sigaddset(&mask, SIGTERM);
+            sigaddset(&mask, SIGUSR1);
+            sigprocmask(SIG_BLOCK, &mask, nullptr);
+            signals_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (epoll_ < 0 || wall_ < 0 || fade_ < 0 || signals_ < 0)
+                throw std::runtime_error(std::string("Failed to set up event loop: ") + std::strerror(errno));
+            for (int fd : {wall_, fade_, signals_})
+            {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+            }
+        }
+
+        ~Scheduler()
+        {
+            for (int fd : {wall_, fade_, signals_, epoll_})
+                if (fd >= 0)
+                    close(fd);
+        }
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        // Runs handler when fd becomes readable.
+        void watch(int fd, std::function<void()> handler)
+        {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0)
+                throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+            handlers_.emplace_back(fd, std::move(handler));
+        }
+
+        // Swaps in new entries. What is already shown, including a running fade, is kept;
+        // only the next wake-up is recomputed.
+        void replace(std::vector<Entry> entries)
+        {
+            entries_ = std::move(entries);
+            schedule(wallNow());
+        }
+
+        const Due &next() const { return next_; }
+        const Stats &stats() const { return stats_; }
+        size_t writes() const { return applier_.writes(); }
+
+        void run()
+        {
+            catchUp(wallNow());
+            for (;;)
+            {
+                epoll_event events[4];
+                int n = epoll_wait(epoll_, events, 4, -1);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ++stats_.wakeups;
+                for (int i = 0; i < n; ++i)
+                {
+                    int fd = events[i].data.fd; if (stats_.wakeups < 40) fprintf(stderr, "fd %d (wall %d fade %d) fading %d\n", fd, wall_, fade_, (int)applier_.fading());
+                    uint64_t expirations;
+                    if (fd == wall_)
+                    {
+                        if (read(wall_, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED)
+                        {
+                            ++stats_.clockChanges;
+                            report_("Clock changed, now " + formatLocal(wallNow()));
+                            catchUp(wallNow());
+                        }
+                        else if (wallNow() >= next_.when)
+                        {
+                            fire();
+                        }
+                        else
+                        {
+                            arm();
+                        }
+                    }
+                    else if (fd == fade_)
+                    {
+                        if (read(fade_, &expirations, sizeof(expirations)) > 0)
+                            step();
+                    }
+                    else if (fd == signals_)
+                    {
+                        signalfd_siginfo info;
+                        if (read(signals_, &info, sizeof(info)) <= 0)
+                            continue;
+                        if (info.ssi_signo != SIGUSR1)
+                            return;
+                        reportNext();
+                    }
+                    else
+                    {
+                        for (auto &[watched, handler] : handlers_)
+                            if (watched == fd)
+                                handler();
+                    }
+                }
+            }
+        }
+
+    private:
+        // Rebuilds the state as of now from each entry's last occurrence, resuming a fade
+        // that is still running, then schedules the next entry.
+        void catchUp(time_t now)
+        {
+            std::vector<Due> past;
+            for (size_t e = 0; e < entries_.size(); ++e)
+                if (time_t at = lastOccurrence(entries_[e], now))
+                    past.push_back({e, at});
+            std::stable_sort(past.begin(), past.end(), [](const Due &a, const Due &b)
+                             { return a.when < b.when; });
+            for (size_t p = 0; p < past.size(); ++p)
+            {
+                const Entry &entry = entries_[past[p].entry];
+                double elapsed = static_cast<double>(now - past[p].when);
+                if (p + 1 == past.size() && elapsed < entry.fade)
+                    applier_.start(entry.scene, entry.fade, elapsed);
+                else
+                    applier_.settle(entry.scene);
+            }
+            if (!past.empty())
+                report_("Resuming from " + entries_[past.back().entry].text + " (" + formatLocal(past.back().when) + ")");
+            step();
+            schedule(now);
+        }
+
+        void fire()
+        {
+            time_t when = next_.when;
+            for (const Due &due : upcoming(entries_, when - 1, entries_.size()))
+            {
+                if (due.when != when)
+                    break;
+                const Entry &entry = entries_[due.entry];
+                ++stats_.entries;
+                applier_.start(entry.scene, entry.fade, static_cast<double>(std::max<time_t>(0, wallNow() - when)));
+                report_(entry.text);
+            }
+            step();
+            schedule(when);
+        }
+
+        void step()
+        {
+            bool fading = applier_.step();
+            if (fading)
+                ++stats_.fadeSteps;
+            // A fade that replaced a running one keeps the timer armed but needs its own interval.
+            if (fading == fadeArmed_ && (!fading || applier_.fades() == armedFade_))
+                return;
+            itimerspec spec{};
+            if (fading)
+            {
+                auto ns = applier_.stepInterval().count();
+                spec.it_interval = {static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+                spec.it_value = spec.it_interval;
+            }
+            fprintf(stderr, "arm %ld %ld\n", (long)spec.it_value.tv_sec, spec.it_value.tv_nsec); timerfd_settime(fade_, 0, &spec, nullptr);
+            fadeArmed_ = fading;
+            armedFade_ = applier_.fades();
+        }
+
+        void schedule(time_t now)
+        {
+            std::vector<Due> due = upcoming(entries_, now, 1);
+            if (due.empty())
+                throw std::runtime_error("schedule has no upcoming entries");
+            next_ = due.front();
+            arm();
+            reportNext();
+        }
+
+        // Absolute wall-clock expiry, cancelled by the kernel if the clock is set.
+        void arm()
+        {
+            itimerspec spec{};
+            spec.it_value.tv_sec = next_.when;
+            if (timerfd_settime(wall_, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr) != 0)
+                throw std::runtime_error(std::string("Failed to arm schedule timer: ") + std::strerror(errno));
+        }
+
+        void reportNext()
+        {
+            long in = static_cast<long>(next_.when - wallNow());
+            report_("Next: " + entries_[next_.entry].text + " at " + formatLocal(next_.when) + " (in " + std::to_string(in / 3600) + "h" +
+                    std::to_string(in / 60 % 60) + "m" + std::to_string(in % 60) + "s)");
+        }
+
+        std::vector<Entry> entries_;
+        Applier applier_;
+        Report report_;
+        Due next_{0, 0};
+        Stats stats_;
+        std::vector<std::pair<int, std::function<void()>>> handlers_;
+        int epoll_ = -1;
+        int wall_ = -1;
+        int fade_ = -1;
+        int signals_ = -1;
+        bool fadeArmed_ = false;
+        uint64_t armedFade_ = 0;
+    };
+}
@@ -0,0 +1,485 @@
+#pragma once
+#include "color.hpp"
+#include "compositor.hpp"
+#include "definitions.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Authored light shows: a text timeline of per-zone color keyframes, brightness keyframes
+// and firmware mode changes, compiled into a flat file that is played straight from a
+// read-only mapping.
+//
+// Text format, one entry per line, '#' starts a comment; times are [[h:]m:]s[.frac]:
+//   zones <n>
+//   <time> zone <n|n,m,...|*> <hex> [easing]
+//   <time> brightness <0-100> [easing]
+//   <time> mode <firmware mode> <speed 1-10>
+//   <time> end
+// A keyframe's easing (linear, step, in, out, inout) shapes the transition that arrives at it.
+namespace omen::rgb::timeline
+{
+    enum class Easing : uint8_t
+    {
+        Linear,
+        Step,
+        In,
+        Out,
+        InOut
+    };
+
+    inline Easing parseEasing(const std::string &name)
+    {
+        static const char *names[] = {"linear", "step", "in", "out", "inout"};
+        for (uint8_t i = 0; i < 5; ++i)
+            if (utils::toLower(name) == names[i])
+                return static_cast<Easing>(i);
+        throw std::invalid_argument("Unknown easing: " + name + ". Valid easings: linear, step, in, out, inout");
+    }
+
+    inline double ease(Easing easing, double f)
+    {
+        switch (easing)
+        {
+        case Easing::Step:
+            return 0.0;
+        case Easing::In:
+            return f * f;
+        case Easing::Out:
+            return f * (2.0 - f);
+        case Easing::InOut:
+            return f * f * (3.0 - 2.0 * f);
+        default:
+            return f;
+        }
+    }
+
+    // Time in milliseconds; the value (color or brightness) in the low 24 bits, easing above.
+    struct Keyframe
+    {
+        uint32_t time;
+        uint32_t packed;
+
+        uint32_t value() const { return packed & 0xFFFFFF; }
+        Easing easing() const { return static_cast<Easing>(packed >> 24); }
+    };
+
+    struct Event
+    {
+        uint32_t time;
+        uint16_t mode;
+        uint16_t speed;
+    };
+
+    // File layout, all little-endian 32-bit words: Header, then per track u32 first keyframe
+    // and u32 keyframe count, all keyframes track by track, all events, and the time index:
+    // for every INDEX_STEP_MS bucket and every track (events last) the number of entries at
+    // or before the bucket start.
+    struct Header
+    {
+        char magic[8];
+        uint32_t zones;
+        uint32_t tracks;
+        uint32_t duration;
+        uint32_t indexStep;
+        uint32_t buckets;
+        uint32_t keyframes;
+        uint32_t events;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Header) == 40, "timeline header layout");
+
+    constexpr char MAGIC[8] = {'O', 'M', 'E', 'N', 'T', 'L', 'B', '1'};
+    constexpr uint32_t INDEX_STEP_MS = 1000;
+    constexpr uint32_t NONE = 0xFFFFFFFF;
+
+    inline const std::vector<std::string> &firmwareModes()
+    {
+        static const std::vector<std::string> modes = []()
+        {
+            std::vector<std::string> list;
+            std::string names = ANIMATION_MODES_TEXT;
+            for (size_t start = 0; start < names.size();)
+            {
+                size_t comma = std::min(names.find(',', start), names.size());
+                list.push_back(names.substr(start, comma - start));
+                start = comma + 2;
+            }
+            return list;
+        }();
+        return modes;
+    }
+
+    // [[h:]m:]s[.frac] to milliseconds.
+    inline uint32_t parseTime(const std::string &text)
+    {
+        double seconds = 0.0;
+        size_t start = 0;
+        for (size_t colon; (colon = text.find(':', start)) != std::string::npos; start = colon + 1)
+            seconds = (seconds + compositor::parseNumber(text.substr(start, colon - start), "time")) * 60.0;
+        seconds += compositor::parseNumber(text.substr(start), "time");
+        if (seconds < 0.0 || seconds * 1000.0 >= static_cast<double>(NONE))
+            throw std::invalid_argument("Time out of range: " + text);
+        return static_cast<uint32_t>(std::llround(seconds * 1000.0));
+    }
+
+    inline std::string formatTime(double ms)
+    {
+        auto total = static_cast<long long>(ms / 1000.0);
+        std::ostringstream oss;
+        oss << total / 3600 << ":" << std::setw(2) << std::setfill('0') << total / 60 % 60 << ":" << std::setw(2) << total % 60
+            << "." << std::setw(3) << static_cast<long long>(ms) % 1000;
+        return oss.str();
+    }
+
+    // A parsed timeline: tracks 0..zones-1 are zone colors, track zones is brightness.
+    struct Source
+    {
+        size_t zones = ZONE_COUNT;
+        std::vector<std::vector<Keyframe>> tracks;
+        std::vector<Event> events;
+        uint32_t duration = 0;
+    };
+
+    inline Source parse(std::istream &in, const std::string &name = "timeline")
+    {
+        Source source;
+        source.tracks.resize(source.zones + 1);
+        bool started = false;
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); ++number)
+        {
+            line = line.substr(0, line.find('#'));
+            std::vector<std::string> words = utils::split(line);
+            if (words.empty())
+                continue;
+            try
+            {
+                if (words[0] == "zones" && words.size() == 2)
+                {
+                    if (started)
+                        throw std::invalid_argument("zones must come before the first entry");
+                    source.zones = static_cast<size_t>(compositor::parseNumber(words[1], "zones"));
+                    if (source.zones == 0 || source.zones > 255)
+                        throw std::invalid_argument("zones must be 1-255");
+                    source.tracks.assign(source.zones + 1, {});
+                    continue;
+                }
+                if (words.size() < 2)
+                    throw std::invalid_argument("expected <time> <entry>");
+                started = true;
+                uint32_t time = parseTime(words[0]);
+                source.duration = std::max(source.duration, time);
+                std::string kind = utils::toLower(words[1]);
+
+                if (kind == "zone" && (words.size() == 4 || words.size() == 5))
+                {
+                    RGB_HEX color = utils::hexStringToRGB(utils::sanitizeHexString(words[3]));
+                    uint32_t packed = color | static_cast<uint32_t>(words.size() == 5 ? parseEasing(words[4]) : Easing::Linear) << 24;
+                    std::vector<size_t> zones;
+                    if (words[2] == "*")
+                        for (size_t z = 0; z < source.zones; ++z)
+                            zones.push_back(z);
+                    else
+                    {
+                        std::string list = words[2];
+                        std::replace(list.begin(), list.end(), ',', ' ');
+                        for (const auto &z : utils::split(list))
+                            zones.push_back(static_cast<size_t>(compositor::parseNumber(z, "zone")));
+                    }
+                    for (size_t z : zones)
+                    {
+                        if (z >= source.zones)
+                            throw std::invalid_argument("zone out of range: " + std::to_string(z));
+                        source.tracks[z].push_back({time, packed});
+                    }
+                }
+                else if (kind == "brightness" && (words.size() == 3 || words.size() == 4))
+                {
+                    double level = compositor::parseNumber(words[2], "brightness");
+                    if (level < 0.0 || level > 100.0)
+                        throw std::invalid_argument("brightness must be 0-100");
+                    uint32_t packed = static_cast<uint32_t>(std::lround(level)) | static_cast<uint32_t>(words.size() == 4 ? parseEasing(words[3]) : Easing::Linear) << 24;
+                    source.tracks[source.zones].push_back({time, packed});
+                }
+                else if (kind == "mode" && words.size() == 4)
+                {
+                    const auto &modes = firmwareModes();
+                    auto it = std::find(modes.begin(), modes.end(), utils::toLower(words[2]));
+                    if (it == modes.end())
+                        throw std::invalid_argument("unknown mode " + words[2] + ". Valid modes: " ANIMATION_MODES_TEXT);
+                    double speed = compositor::parseNumber(words[3], "speed");
+                    if (speed < 1.0 || speed > 10.0)
+                        throw std::invalid_argument("speed must be 1-10");
+                    source.events.push_back({time, static_cast<uint16_t>(it - modes.begin()), static_cast<uint16_t>(speed)});
+                }
+                else if (kind != "end" || words.size() != 2)
+                {
+                    throw std::invalid_argument("unrecognised entry");
+                }
+            }
+            catch (const std::exception &e)
+            {
+                throw std::invalid_argument(name + ":" + std::to_string(number) + ": " + e.what());
+            }
+        }
+
+        for (auto &track : source.tracks)
+            std::stable_sort(track.begin(), track.end(), [](const Keyframe &a, const Keyframe &b)
+                             { return a.time < b.time; });
+        std::stable_sort(source.events.begin(), source.events.end(), [](const Event &a, const Event &b)
+                         { return a.time < b.time; });
+        return source;
+    }
+
+    // Writes the compiled form through a temporary file renamed into place.
+    inline void compile(const Source &source, const std::string &path)
+    {
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.zones = static_cast<uint32_t>(source.zones);
+        header.tracks = static_cast<uint32_t>(source.tracks.size());
+        header.duration = source.duration;
+        header.indexStep = INDEX_STEP_MS;
+        header.buckets = source.duration / INDEX_STEP_MS + 1;
+        header.events = static_cast<uint32_t>(source.events.size());
+
+        std::vector<uint32_t> table;
+        for (const auto &track : source.tracks)
+        {
+            table.push_back(header.keyframes);
+            table.push_back(static_cast<uint32_t>(track.size()));
+            header.keyframes += static_cast<uint32_t>(track.size());
+        }
+
+        // One pass per track with a moving cursor keeps building the index linear.
+        std::vector<uint32_t> index(static_cast<size_t>(header.buckets) * (header.tracks + 1));
+        auto fill = [&](size_t column, size_t count, auto timeOf)
+        {
+            size_t cursor = 0;
+            for (uint32_t b = 0; b < header.buckets; ++b)
+            {
+                while (cursor < count && timeOf(cursor) <= b * INDEX_STEP_MS)
+                    ++cursor;
+                index[b * (header.tracks + 1) + column] = static_cast<uint32_t>(cursor);
+            }
+        };
+        for (size_t k = 0; k < source.tracks.size(); ++k)
+            fill(k, source.tracks[k].size(), [&](size_t i)
+                 { return source.tracks[k][i].time; });
+        fill(header.tracks, source.events.size(), [&](size_t i)
+             { return source.events[i].time; });
+
+        std::string tmp = path + ".tmp" + std::to_string(getpid());
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            auto put = [&](const void *data, size_t bytes)
+            { file.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes)); };
+            put(&header, sizeof(header));
+            put(table.data(), table.size() * sizeof(uint32_t));
+            for (const auto &track : source.tracks)
+                put(track.data(), track.size() * sizeof(Keyframe));
+            put(source.events.data(), source.events.size() * sizeof(Event));
+            put(index.data(), index.size() * sizeof(uint32_t));
+            if (!file)
+            {
+                std::remove(tmp.c_str());
+                throw std::runtime_error("Failed to write timeline: " + tmp);
+            }
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Failed to install timeline " + path + ": " + std::strerror(errno));
+        }
+    }
+
+    inline bool isCompiled(const std::string &path)
+    {
+        char magic[sizeof(MAGIC)] = {};
+        std::ifstream(path, std::ios::binary).read(magic, sizeof(magic));
+        return std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    // A compiled timeline mapped read-only; nothing is copied or parsed.
+    class Timeline
+    {
+    public:
+        static std::unique_ptr<const Timeline> map(const std::string &path)
+        {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+            struct stat st = {};
+            void *data = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+                data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("Failed to map timeline " + path);
+
+            std::unique_ptr<Timeline> timeline(new Timeline(data, static_cast<size_t>(st.st_size)));
+            const Header &h = *timeline->header_;
+            size_t words = 2 * static_cast<size_t>(h.tracks) + 2 * static_cast<size_t>(h.keyframes) + 2 * static_cast<size_t>(h.events) +
+                           static_cast<size_t>(h.buckets) * (h.tracks + 1);
+            if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.tracks != h.zones + 1 || h.indexStep == 0 || h.buckets == 0 ||
+                timeline->size_ != sizeof(Header) + words * sizeof(uint32_t))
+                throw std::runtime_error("Not a compiled timeline: " + path);
+
+            auto words32 = reinterpret_cast<const uint32_t *>(static_cast<const char *>(data) + sizeof(Header));
+            timeline->table_ = words32;
+            timeline->keyframes_ = reinterpret_cast<const Keyframe *>(words32 + 2 * h.tracks);
+            timeline->events_ = reinterpret_cast<const Event *>(timeline->keyframes_ + h.keyframes);
+            timeline->index_ = reinterpret_cast<const uint32_t *>(timeline->events_ + h.events);
+            for (uint32_t k = 0; k < h.tracks; ++k)
+                if (static_cast<uint64_t>(timeline->table_[2 * k]) + timeline->table_[2 * k + 1] > h.keyframes)
+                    throw std::runtime_error("Corrupt timeline track table: " + path);
+            const auto &modes = firmwareModes();
+            for (uint32_t e = 0; e < h.events; ++e)
+                if (timeline->events_[e].mode >= modes.size())
+                    throw std::runtime_error("Corrupt timeline event " + std::to_string(e) + ": " + path);
+            // Players index tracks and events with these, so each must stay within its column.
+            for (uint32_t b = 0; b < h.buckets; ++b)
+                for (uint32_t k = 0; k <= h.tracks; ++k)
+                    if (timeline->index_[static_cast<size_t>(b) * (h.tracks + 1) + k] > (k < h.tracks ? timeline->table_[2 * k + 1] : h.events))
+                        throw std::runtime_error("Corrupt timeline index: " + path);
+            return timeline;
+        }
+
+        ~Timeline() { munmap(mapping_, size_); }
+
+        Timeline(const Timeline &) = delete;
+        Timeline &operator=(const Timeline &) = delete;
+
+        size_t zones() const { return header_->zones; }
+        size_t tracks() const { return header_->tracks; }
+        uint32_t duration() const { return header_->duration; }
+        size_t bytes() const { return size_; }
+        size_t keyframeCount() const { return header_->keyframes; }
+
+        const Keyframe *track(size_t k) const { return keyframes_ + table_[2 * k]; }
+        size_t trackSize(size_t k) const { return table_[2 * k + 1]; }
+        const Event *events() const { return events_; }
+        size_t eventCount() const { return header_->events; }
+
+        // Entries of column (a track, or tracks() for events) at or before the bucket holding ms.
+        uint32_t indexed(size_t column, double ms) const
+        {
+            auto bucket = std::min<size_t>(static_cast<size_t>(std::max(0.0, ms) / header_->indexStep), header_->buckets - 1);
+            return index_[bucket * (header_->tracks + 1) + column];
+        }
+
+    private:
+        Timeline(void *mapping, size_t size) : mapping_(mapping), size_(size), header_(static_cast<const Header *>(mapping)) {}
+
+        void *mapping_;
+        size_t size_;
+        const Header *header_;
+        const uint32_t *table_ = nullptr;
+        const Keyframe *keyframes_ = nullptr;
+        const Event *events_ = nullptr;
+        const uint32_t *index_ = nullptr;
+    };
+
+    // Per-track cursors over a mapped timeline. seek() jumps through the index; advance()
+    // only moves forward, so steady playback touches each keyframe once.
+    class Player
+    {
+    public:
+        explicit Player(const Timeline &timeline) : timeline_(timeline), cursors_(timeline.tracks() + 1, 0) {}
+
+        // Positions at ms and returns the last mode event at or before it, if any.
+        const Event *seek(double ms)
+        {
+            for (size_t k = 0; k <= timeline_.tracks(); ++k)
+                cursors_[k] = timeline_.indexed(k, ms);
+            advanceTracks(ms);
+            size_t &e = cursors_.back();
+            while (e < timeline_.eventCount() && timeline_.events()[e].time <= ms)
+                ++e;
+            return e ? &timeline_.events()[e - 1] : nullptr;
+        }
+
+        // Moves to ms, calling fire for every mode event passed on the way.
+        template <typename Fn>
+        void advance(double ms, Fn &&fire)
+        {
+            advanceTracks(ms);
+            size_t &e = cursors_.back();
+            while (e < timeline_.eventCount() && timeline_.events()[e].time <= ms)
+                fire(timeline_.events()[e++]);
+        }
+
+        // Value of track k at ms (after advancing there), or NONE for an empty track.
+        uint32_t sample(size_t k, double ms) const
+        {
+            const Keyframe *kf = timeline_.track(k);
+            size_t n = timeline_.trackSize(k), c = cursors_[k];
+            if (n == 0)
+                return NONE;
+            if (c == 0)
+                return kf[0].value();
+            if (c == n)
+                return kf[n - 1].value();
+            const Keyframe &a = kf[c - 1], &b = kf[c];
+            double f = ease(b.easing(), (ms - a.time) / static_cast<double>(b.time - a.time));
+            if (k < timeline_.zones())
+                return color::lerp(a.value(), b.value(), f);
+            return static_cast<uint32_t>(std::lround(a.value() + (static_cast<double>(b.value()) - a.value()) * f));
+        }
+
+        // Time of the next keyframe or event after the current position (NONE if there is none);
+        // animating is set when some track is mid-transition and needs frames before then.
+        uint32_t nextChange(bool &animating) const
+        {
+            uint32_t next = NONE;
+            animating = false;
+            for (size_t k = 0; k < timeline_.tracks(); ++k)
+            {
+                const Keyframe *kf = timeline_.track(k);
+                size_t n = timeline_.trackSize(k), c = cursors_[k];
+                if (c == n)
+                    continue;
+                next = std::min(next, kf[c].time);
+                if (c > 0 && kf[c].easing() != Easing::Step && kf[c].value() != kf[c - 1].value())
+                    animating = true;
+            }
+            size_t e = cursors_.back();
+            if (e < timeline_.eventCount())
+                next = std::min(next, timeline_.events()[e].time);
+            return next;
+        }
+
+    private:
+        void advanceTracks(double ms)
+        {
+            for (size_t k = 0; k < timeline_.tracks(); ++k)
+            {
+                const Keyframe *kf = timeline_.track(k);
+                size_t n = timeline_.trackSize(k);
+                size_t &c = cursors_[k];
+                while (c < n && kf[c].time <= ms)
+                    ++c;
+            }
+        }
+
+        const Timeline &timeline_;
+        std::vector<size_t> cursors_;
+    };
+}
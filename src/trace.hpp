@@ -0,0 +1,226 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#define TRACE_PATH_ENV "OMEN_RGB_TRACE"
+
+// Write tracing: with $OMEN_RGB_TRACE set, every sysfs write is appended to a binary log
+// with its monotonic timestamp, latency and result. Records are varint-encoded and each is
+// appended with one write(), so several processes can share a log and a crash loses nothing.
+//
+// File: "OMENTRC1", then records tagged by their first byte:
+//   'S' pid, monotonic base ns, realtime ns       a process started tracing
+//   'A' pid, id, length, path                     attribute id, defined before first use
+//   'W' pid, id, ns since base, latency ns, errno, length, value
+namespace omen::fs::trace {
+  constexpr char MAGIC[8] = {'O', 'M', 'E', 'N', 'T', 'R', 'C', '1'};
+
+  inline uint64_t clockNs(clockid_t clock) {
+      timespec ts{};
+      clock_gettime(clock, &ts);
+      return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  inline uint64_t monotonicNs() { return clockNs(CLOCK_MONOTONIC); }
+
+  inline void putVarint(std::string& out, uint64_t value) {
+      while (value >= 0x80) {
+          out += static_cast<char>(value | 0x80);
+          value >>= 7;
+      }
+      out += static_cast<char>(value);
+  }
+
+  inline uint64_t getVarint(const uint8_t*& p, const uint8_t* end) {
+      uint64_t value = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+          if (p == end) {
+              throw std::runtime_error("truncated trace record");
+          }
+          uint8_t byte = *p++;
+          value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+          if (!(byte & 0x80)) {
+              return value;
+          }
+      }
+      throw std::runtime_error("bad varint in trace");
+  }
+
+  class Recorder {
+  public:
+      // The process-wide recorder, or nullptr when $OMEN_RGB_TRACE is unset.
+      static Recorder* instance() {
+          static Recorder* recorder = []() -> Recorder* {
+              const char* path = std::getenv(TRACE_PATH_ENV);
+              return path && *path ? new Recorder(path) : nullptr;
+          }();
+          return recorder && recorder->fd_ >= 0 ? recorder : nullptr;
+      }
+
+      void write(const std::string& path, const std::string& value, uint64_t start, uint64_t end, int error) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          std::string record;
+          auto it = ids_.find(path);
+          if (it == ids_.end()) {
+              it = ids_.emplace(path, ids_.size()).first;
+              record += 'A';
+              putVarint(record, pid_);
+              putVarint(record, it->second);
+              putVarint(record, path.size());
+              record += path;
+          }
+          record += 'W';
+          putVarint(record, pid_);
+          putVarint(record, it->second);
+          putVarint(record, start - base_);
+          putVarint(record, end - start);
+          putVarint(record, static_cast<uint64_t>(error));
+          putVarint(record, value.size());
+          record += value;
+          append(record);
+      }
+
+  private:
+      explicit Recorder(const std::string& path)
+          : pid_(static_cast<uint64_t>(getpid())), base_(monotonicNs()) {
+          fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+          if (fd_ < 0) {
+              std::cerr << "Failed to open write trace " << path << ": " << std::strerror(errno) << "\n";
+              return;
+          }
+          struct stat info = {};
+          std::string record;
+          if (fstat(fd_, &info) == 0 && info.st_size == 0) {
+              record.assign(MAGIC, sizeof(MAGIC));
+          }
+          record += 'S';
+          putVarint(record, pid_);
+          putVarint(record, base_);
+          putVarint(record, clockNs(CLOCK_REALTIME));
+          append(record);
+      }
+
+      void append(const std::string& record) {
+          if (::write(fd_, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+              std::cerr << "Failed to append to write trace: " << std::strerror(errno) << "\n";
+              close(fd_);
+              fd_ = -1;
+          }
+      }
+
+      int fd_ = -1;
+      uint64_t pid_;
+      uint64_t base_;
+      std::unordered_map<std::string, uint64_t> ids_;
+      std::mutex mutex_;
+  };
+
+  struct Record {
+      uint64_t pid;
+      // Absolute CLOCK_MONOTONIC time of the write.
+      uint64_t time;
+      uint64_t latency;
+      int error;
+      std::string path;
+      std::string value;
+  };
+
+  struct Log {
+      std::vector<Record> records;
+      // Earliest session start, for display.
+      uint64_t realtime = 0;
+      size_t sessions = 0;
+      size_t bytes = 0;
+  };
+
+  // Reads a whole trace, with the writes of all processes merged in time order.
+  inline Log load(const std::string& path) {
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+          throw std::runtime_error("Failed to open trace " + path + ": " + std::strerror(errno));
+      }
+      std::vector<uint8_t> data;
+      uint8_t buffer[65536];
+      for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;) {
+          data.insert(data.end(), buffer, buffer + n);
+      }
+      close(fd);
+      if (data.size() < sizeof(MAGIC) || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) {
+          throw std::runtime_error(path + " is not a write trace");
+      }
+
+      struct Session {
+          uint64_t base = 0;
+          std::vector<std::string> paths;
+      };
+      std::unordered_map<uint64_t, Session> sessions;
+      Log log;
+      log.bytes = data.size();
+      const uint8_t* p = data.data() + sizeof(MAGIC);
+      const uint8_t* end = data.data() + data.size();
+      auto bytes = [&](uint64_t n) {
+          if (static_cast<uint64_t>(end - p) < n) {
+              throw std::runtime_error("truncated trace record");
+          }
+          std::string out(reinterpret_cast<const char*>(p), n);
+          p += n;
+          return out;
+      };
+      while (p < end) {
+          uint8_t tag = *p++;
+          if (tag == MAGIC[0] && static_cast<size_t>(end - p) >= sizeof(MAGIC) - 1 &&
+              std::memcmp(p, MAGIC + 1, sizeof(MAGIC) - 1) == 0) {
+              // Two processes created the file at once; both wrote the header.
+              p += sizeof(MAGIC) - 1;
+              continue;
+          }
+          uint64_t pid = getVarint(p, end);
+          Session& session = sessions[pid];
+          if (tag == 'S') {
+              session = Session{getVarint(p, end), {}};
+              uint64_t realtime = getVarint(p, end);
+              log.realtime = log.realtime ? std::min(log.realtime, realtime) : realtime;
+              ++log.sessions;
+          } else if (tag == 'A') {
+              uint64_t id = getVarint(p, end);
+              std::string name = bytes(getVarint(p, end));
+              if (session.paths.size() <= id) {
+                  session.paths.resize(id + 1);
+              }
+              session.paths[id] = name;
+          } else if (tag == 'W') {
+              Record record;
+              record.pid = pid;
+              uint64_t id = getVarint(p, end);
+              record.time = session.base + getVarint(p, end);
+              record.latency = getVarint(p, end);
+              record.error = static_cast<int>(getVarint(p, end));
+              record.value = bytes(getVarint(p, end));
+              if (id >= session.paths.size()) {
+                  throw std::runtime_error("trace write names an undefined attribute");
+              }
+              record.path = session.paths[id];
+              log.records.push_back(std::move(record));
+          } else {
+              throw std::runtime_error("unknown trace record type " + std::to_string(tag) + " at offset " +
+                                       std::to_string(p - 1 - data.data()));
+          }
+      }
+      std::stable_sort(log.records.begin(), log.records.end(),
+                       [](const Record& a, const Record& b) { return a.time < b.time; });
+      return log;
+  }
+}
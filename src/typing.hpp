@@ -0,0 +1,217 @@
+#pragma once
+#include "color.hpp"
+#include "definitions.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <linux/input.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Typing-reactive effects fed by evdev key events. Captures use the kernel's own
+// struct input_event layout, so a device node, a recorded file and a FIFO all read the same.
+namespace omen::rgb::typing
+{
+    // Horizontal key position in 0-1 across a full-size layout, from the key's column in
+    // its row. Keys right of the main block (arrows, navigation, keypad) sit at the far right.
+    inline double keyPosition(uint16_t code)
+    {
+        static const std::vector<std::vector<uint16_t>> rows = {
+            {KEY_ESC, KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12},
+            {KEY_GRAVE, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0, KEY_MINUS, KEY_EQUAL, KEY_BACKSPACE},
+            {KEY_TAB, KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P, KEY_LEFTBRACE, KEY_RIGHTBRACE, KEY_BACKSLASH},
+            {KEY_CAPSLOCK, KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H, KEY_J, KEY_K, KEY_L, KEY_SEMICOLON, KEY_APOSTROPHE, KEY_ENTER},
+            {KEY_LEFTSHIFT, KEY_Z, KEY_X, KEY_C, KEY_V, KEY_B, KEY_N, KEY_M, KEY_COMMA, KEY_DOT, KEY_SLASH, KEY_RIGHTSHIFT},
+            {KEY_LEFTCTRL, KEY_LEFTMETA, KEY_LEFTALT, KEY_SPACE, KEY_RIGHTALT, KEY_COMPOSE, KEY_RIGHTCTRL}};
+        // The space bar spans the middle of the bottom row.
+        if (code == KEY_SPACE)
+            return 0.45;
+        for (const auto &row : rows)
+        {
+            auto it = std::find(row.begin(), row.end(), code);
+            if (it != row.end())
+                return (static_cast<double>(it - row.begin()) + 0.5) / static_cast<double>(row.size()) * 0.8;
+        }
+        return 0.95;
+    }
+
+    inline size_t keyZone(uint16_t code, size_t zones)
+    {
+        return std::min(zones - 1, static_cast<size_t>(keyPosition(code) * static_cast<double>(zones)));
+    }
+
+    // Key presses in, colors out. active() says whether frames still change, so the caller can
+    // stop ticking once the effect has settled.
+    class Effect
+    {
+    public:
+        virtual ~Effect() = default;
+        virtual void press(size_t zone, double t) = 0;
+        virtual void render(double t, RGB_HEX *frame, size_t zones) = 0;
+        virtual bool active(double t) const = 0;
+    };
+
+    // Each press lights its zone at once and reaches neighbours spread seconds per zone later,
+    // dimmed by falloff per zone; every contribution decays exponentially with time constant decay.
+    class Ripple : public Effect
+    {
+    public:
+        Ripple(std::vector<RGB_HEX> palette, RGB_HEX background, double decay = 0.35, double spread = 0.08, double falloff = 0.5)
+            : palette_(std::move(palette)), background_(background), decay_(decay), spread_(spread), falloff_(falloff) {}
+
+        void press(size_t zone, double t) override { presses_.push_back({zone, t}); }
+
+        void render(double t, RGB_HEX *frame, size_t zones) override
+        {
+            presses_.erase(std::remove_if(presses_.begin(), presses_.end(), [&](const Press &p)
+                                          { return t - p.t > horizon(zones); }),
+                           presses_.end());
+            for (size_t z = 0; z < zones; ++z)
+            {
+                double level = 0.0;
+                for (const auto &p : presses_)
+                {
+                    double distance = std::abs(static_cast<double>(z) - static_cast<double>(p.zone));
+                    double age = t - p.t - spread_ * distance;
+                    if (age >= 0.0)
+                        level += std::pow(falloff_, distance) * std::exp(-age / decay_);
+                }
+                frame[z] = color::lerp(background_, palette_[z % palette_.size()], std::min(level, 1.0));
+            }
+        }
+
+        bool active(double) const override { return !presses_.empty(); }
+
+    private:
+        struct Press
+        {
+            size_t zone;
+            double t;
+        };
+
+        // Past this age a press is below 1/255 everywhere.
+        double horizon(size_t zones) const { return spread_ * static_cast<double>(zones) + decay_ * std::log(255.0); }
+
+        std::vector<RGB_HEX> palette_;
+        RGB_HEX background_;
+        double decay_;
+        double spread_;
+        double falloff_;
+        std::vector<Press> presses_;
+    };
+
+    // Heat per zone rises by one per press and halves every halfLife seconds; saturation
+    // presses of heat map to the hot end of the gradient.
+    class Heatmap : public Effect
+    {
+    public:
+        explicit Heatmap(double halfLife = 2.0, double saturation = 12.0) : halfLife_(halfLife)
+        {
+            gradient_.low = 0.0;
+            gradient_.high = saturation;
+            gradient_.stops = {0x000020, 0x0040FF, 0xFFFF00, 0xFF0000};
+            gradient_.steps = 64;
+        }
+
+        void press(size_t zone, double t) override
+        {
+            decayTo(t);
+            if (heat_.size() <= zone)
+                heat_.resize(zone + 1, 0.0);
+            heat_[zone] += 1.0;
+        }
+
+        void render(double t, RGB_HEX *frame, size_t zones) override
+        {
+            decayTo(t);
+            heat_.resize(std::max(heat_.size(), zones), 0.0);
+            for (size_t z = 0; z < zones; ++z)
+                frame[z] = gradient_.at(heat_[z]);
+        }
+
+        bool active(double) const override
+        {
+            return std::any_of(heat_.begin(), heat_.end(), [&](double h)
+                               { return h > 0.0; });
+        }
+
+    private:
+        void decayTo(double t)
+        {
+            double factor = std::exp2(-(t - last_) / halfLife_);
+            last_ = t;
+            // Snap to zero below the first gradient step so the effect can settle.
+            double floor = (gradient_.high - gradient_.low) / (2.0 * gradient_.steps);
+            for (auto &h : heat_)
+                h = h * factor < floor ? 0.0 : h * factor;
+        }
+
+        double halfLife_;
+        double last_ = 0.0;
+        metrics::Gradient gradient_;
+        std::vector<double> heat_;
+    };
+
+    inline std::unique_ptr<Effect> makeEffect(const std::string &name, const std::vector<RGB_HEX> &palette)
+    {
+        if (name == "ripple")
+            return std::make_unique<Ripple>(palette, 0x000000);
+        if (name == "heatmap")
+            return std::make_unique<Heatmap>();
+        throw std::invalid_argument("Unknown typing effect: " + name + ". Valid effects: ripple, heatmap");
+    }
+
+    inline double eventSeconds(const input_event &event)
+    {
+        return static_cast<double>(event.input_event_sec) + static_cast<double>(event.input_event_usec) * 1e-6;
+    }
+
+    // Presses and autorepeats light keys; releases do not.
+    inline bool isKeyPress(const input_event &event)
+    {
+        return event.type == EV_KEY && (event.value == 1 || event.value == 2);
+    }
+
+    // Whole struct input_event records from a file descriptor. Pipes can split a record
+    // across reads, so partial tails are kept for the next call.
+    class EventReader
+    {
+    public:
+        explicit EventReader(int fd) : fd_(fd) {}
+
+        // Appends the complete events from one read(); returns false at end of stream.
+        bool read(std::vector<input_event> &events)
+        {
+            ssize_t n;
+            do
+                n = ::read(fd_, buffer_ + held_, sizeof(buffer_) - held_);
+            while (n < 0 && errno == EINTR);
+            if (n < 0)
+                throw std::runtime_error(std::string("Failed to read input events: ") + std::strerror(errno));
+            if (n == 0)
+                return false;
+            held_ += static_cast<size_t>(n);
+            size_t whole = held_ / sizeof(input_event);
+            for (size_t i = 0; i < whole; ++i)
+            {
+                input_event event;
+                std::memcpy(&event, buffer_ + i * sizeof(input_event), sizeof(input_event));
+                events.push_back(event);
+            }
+            held_ -= whole * sizeof(input_event);
+            std::memmove(buffer_, buffer_ + whole * sizeof(input_event), held_);
+            return true;
+        }
+
+    private:
+        int fd_;
+        unsigned char buffer_[64 * sizeof(input_event)];
+        size_t held_ = 0;
+    };
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include "definitions.hpp"
 #include <algorithm>
 #include <cstdint>
@@ -99,6 +100,18 @@ namespace omen::rgb::utils {
     return s;
   }
 
+  inline std::string zonePath(size_t zone) {
+    return std::string(ZONE_BASE_PATH) + (zone < 10 ? "0" : "") + std::to_string(zone);
+  }
+
+  inline std::string hex6(RGB_HEX value) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out(6, '0');
+    for (int i = 5; i >= 0; --i, value >>= 4)
+      out[i] = digits[value & 0xF];
+    return out;
+  }
+
   inline std::string rgbHexToUpper(uint32_t value, bool withHash = true) {
     std::ostringstream oss;
     if (withHash) oss << "#";